@@ -19,122 +19,478 @@
 #include "esg-bsp-test.h"
 #include "alsa-audio-runner.h"
 #include "alsa-device.h"
+#include "rackAuvitran.h"
+#include "wi_time.h"
+#include "esg-stats.h"
+#include "audio-glitch.h"
+#include "audio-telemetry.h"
+#include "esg-load.h"
+#include "tdma-phase.h"
+#include "tdma-bridge.h"
 
 DLT_IMPORT_CONTEXT(dlt_ctxt_audio);
 
-static uint8_t buf[AUDIO_TEST_BUFFER_SZ_BYTES];
-static void *ch_bufs[AUDIO_TEST_CHANNELS] = {0};
+/* planar buffers: every channel starts on its own cache line, so threads working on different
+ * channels never share a line; the spare line keeps channel starts off the same cache set.
+ * sized for the highest rate, so a rate switch never needs to reallocate.
+ */
+#define CH_STRIDE_BYTES (((AUDIO_TEST_SAMPLE_SZ_BYTES * AUDIO_TEST_PERIOD_SZ_FRAMES_MAX + AUDIO_CACHE_LINE_BYTES - 1U) & ~(AUDIO_CACHE_LINE_BYTES - 1U)) + AUDIO_CACHE_LINE_BYTES)
+
+static uint8_t *buf = NULL;
+static size_t buf_sz = 0U;
+static void *ch_bufs[AUDIO_TEST_CHANNELS_MAX] = {0};
 
 static unsigned int nfds = 0;
 static struct pollfd *pfds = NULL;
 static AlsaDevice_t *audio_dev = NULL;
 
-static void *audio_runner(void *p_data)
+/* rates cycled by the --rate-switch stress, all of them supported by rack_set_sampling_rate() */
+static const uint32_t switch_rates[] = {44100U, 48000U, 88200U, 96000U};
+#define SWITCH_RATES_NB (sizeof(switch_rates) / sizeof(switch_rates[0]))
+
+typedef struct
+{
+	uint32_t nb_switches;
+	uint32_t rate_index;
+	uint8_t pending;		  /* waiting for the first capture after a switch, to measure the gap */
+	uint64_t last_read_ns;	  /* end of the last successful capture */
+	int64_t last_switch_us;	  /* duration of the last switch */
+	esg_stats_t switch_us;	  /* close + rack clock + reopen + restart */
+	esg_stats_t lost_us;	  /* capture gap around the switch, minus the one period we expect anyway */
+} rate_switch_t;
+
+static rate_switch_t rate_switch = {0};
+
+/* time to first audio: first non-silent sample reaching the DAC */
+typedef struct
+{
+	uint8_t armed;				/* waiting for it since the last start */
+	uint8_t profiled;			/* the startup profile is logged once */
+	uint64_t main_ns;			/* CLOCK_BOOTTIME at main() */
+	uint64_t open_ns;			/* CLOCK_BOOTTIME once the device got opened */
+	esg_stats_t from_start_us;	/* from stream start, for every start */
+} first_audio_t;
+
+static first_audio_t first_audio = {0};
+
+/* pause/resume (or warm restart) cycle duration */
+static esg_stats_t restart_us;
+
+static uint8_t injecting = 0U;
+static esg_load_t injector;
+
+static uint8_t telemetry_enabled = 0U;
+static audio_telemetry_t telemetry;
+
+static uint8_t glitch_enabled = 0U;
+static uint8_t phase_enabled = 0U;
+static uint8_t bridge_enabled = 0U;
+static audio_glitch_t glitch;
+
+/* runner CPU load, for the channel sweep */
+typedef struct
+{
+	uint32_t periods;		  /* periods captured */
+	uint64_t cpu_ns;		  /* thread CPU time over the whole run */
+	esg_stats_t loop_cpu_us;  /* thread CPU time per loop */
+} audio_load_t;
+
+static int audio_runner_alloc_bufs(uint32_t channels)
 {
 	int ret = EXIT_SUCCESS;
 
-	ebt_settings_t *settings = (ebt_settings_t *)p_data;
+	buf_sz = channels * CH_STRIDE_BYTES;
+	ret = -posix_memalign((void **)&buf, AUDIO_CACHE_LINE_BYTES, buf_sz);
 
-	if (NULL == settings)
+	if (EXIT_SUCCESS == ret)
 	{
-		DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("START failed, ebt_settings_t null"));
-		ret = -EINVAL;
+		memset(buf, 0, buf_sz);
+
+		/* non-interleaved channel buffer offets */
+		for (uint32_t c = 0U; c < channels; c++)
+		{
+			ch_bufs[c] = (void *)(buf + (c * CH_STRIDE_BYTES));
+		}
+	}
+
+	return ret;
+}
+
+static int audio_runner_setup_fds(void)
+{
+	int ret = EXIT_SUCCESS;
+
+	/* Setup all file descriptors for poll()ing */
+	nfds = alsa_device_nfds(audio_dev);
+
+	free(pfds);
+	pfds = malloc(sizeof(*pfds) * (nfds));
+
+	if (NULL == pfds)
+	{
+		ret = -ENOMEM;
+	}
+	else
+	{
+		alsa_device_getfds(audio_dev, pfds, nfds);
+	}
+
+	return ret;
+}
+
+/* Full rate change: stop the PCM pair, move the rack clock, reopen at the new rate and restart.
+ * the rack is re-clocked while no stream is running, the PCMs never see a moving clock.
+ */
+static int audio_runner_switch_rate(ebt_settings_t *settings)
+{
+	int ret = EXIT_SUCCESS;
+	uint64_t t_start = time_getClock_ns();
+	uint32_t new_rate;
+
+	rate_switch.rate_index = (rate_switch.rate_index + 1U) % SWITCH_RATES_NB;
+	new_rate = switch_rates[rate_switch.rate_index];
+
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("rate switch (from/to)"), DLT_UINT32(settings->audio_rate), DLT_UINT32(new_rate));
+
+	alsa_device_close(audio_dev);
+	audio_dev = NULL;
+
+	if (0U != settings->rack_enabled)
+	{
+		ret = rack_set_sampling_rate_hz(new_rate);
 	}
 
 	if (EXIT_SUCCESS == ret)
 	{
-		uint32_t nb_loops = settings->nb_loops;
+		settings->audio_rate = new_rate;
+
+		audio_dev = alsa_device_open(settings);
+		ret = (NULL != audio_dev) ? audio_runner_setup_fds() : -EINVAL;
+	}
 
+	if (EXIT_SUCCESS == ret)
+	{
+		/* pre-roll with silence, not with a period captured at the previous rate */
+		memset(buf, 0, buf_sz);
 		alsa_device_startn(audio_dev, ch_bufs);
+		audio_glitch_restart(&glitch);
+		first_audio.armed = 1U;
+
+		rate_switch.last_switch_us = (int64_t)(time_getClock_ns() - t_start) / 1000;
+		esg_stats_add(&rate_switch.switch_us, rate_switch.last_switch_us);
+		rate_switch.nb_switches++;
+		rate_switch.pending = 1U;
+	}
+	else
+	{
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("rate switch failed (rate/err)"), DLT_UINT32(new_rate), DLT_INT32(ret));
+	}
+
+	return ret;
+}
+
+/* channel 0 to the TDMA uplink, stamped with the time its first frame was sampled */
+static void audio_runner_bridge_capture(uint64_t now)
+{
+	snd_pcm_sframes_t delay = alsa_device_delay(audio_dev, 1 /*rec*/);
+
+	/* the last frame read was sampled 'delay' frames ago */
+	delay = ((0 < delay) ? delay : 0) + audio_dev->period;
+
+	tdma_bridge_capture((const int32_t *)ch_bufs[0], audio_dev->period, audio_dev->rate,
+						now - (uint64_t)delay * 1000000000ULL / audio_dev->rate);
+}
+
+/* the TDMA downlink on every channel, stamped with the time its first frame will be played */
+static void audio_runner_bridge_playback(void)
+{
+	snd_pcm_sframes_t delay = alsa_device_delay(audio_dev, 0 /*play*/);
+	uint64_t now = time_getClock_ns();
+
+	delay = (0 < delay) ? delay : 0;
+
+	tdma_bridge_playback((int32_t *)ch_bufs[0], audio_dev->period, audio_dev->rate,
+						 now + (uint64_t)delay * 1000000000ULL / audio_dev->rate);
+
+	for (uint32_t c = 1U; c < audio_dev->channels; c++)
+	{
+		memcpy(ch_bufs[c], ch_bufs[0], (size_t)audio_dev->period * AUDIO_TEST_SAMPLE_SZ_BYTES);
+	}
+}
+
+/* called after each successful capture: glitch detection, and closes the measurement of a pending switch */
+static void audio_runner_capture_done(void)
+{
+	uint64_t now = time_getClock_ns();
+
+	if (0U != phase_enabled)
+	{
+		tdma_phase_audio(time_getClockRaw_ns());
+	}
+
+	if (0U != bridge_enabled)
+	{
+		audio_runner_bridge_capture(now);
+	}
+
+	if (0U != glitch_enabled)
+	{
+		(void)audio_glitch_process(&glitch, ch_bufs, audio_dev->period, audio_dev->rate, now);
+	}
+
+	if ((0U != rate_switch.pending) && (0U != rate_switch.last_read_ns))
+	{
+		int64_t gap_us = (int64_t)(now - rate_switch.last_read_ns) / 1000;
+
+		esg_stats_add(&rate_switch.lost_us, gap_us - AUDIO_TEST_PERIOD_TIME_US);
+		rate_switch.pending = 0U;
+
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("rate switch done (rate/switch us/lost us)"),
+				DLT_UINT32(audio_dev->rate),
+				DLT_INT64(rate_switch.last_switch_us),
+				DLT_INT64(gap_us - AUDIO_TEST_PERIOD_TIME_US));
+	}
+
+	rate_switch.last_read_ns = now;
+}
+
+/* first frame above the silence level, over all channels, -1 if none */
+static int audio_runner_first_audible(void)
+{
+	int first = audio_dev->period;
+
+	for (uint32_t c = 0U; c < audio_dev->channels; c++)
+	{
+		const int32_t *x = (const int32_t *)ch_bufs[c];
+
+		for (int i = 0; i < first; i++)
+		{
+			if ((AUDIO_TEST_SILENCE_LEVEL < x[i]) || (-AUDIO_TEST_SILENCE_LEVEL > x[i]))
+			{
+				first = i;
+				break;
+			}
+		}
+	}
+
+	return (first < audio_dev->period) ? first : -1;
+}
+
+static void audio_runner_first_audio(void)
+{
+	snd_pcm_sframes_t delay = alsa_device_delay(audio_dev, 0 /*play*/);
+	uint64_t now = time_getBoottime_ns();
+	int frame = audio_runner_first_audible();
+
+	if ((0 <= frame) && (0 <= delay))
+	{
+		/* it will be played once what is already queued is, plus its offset in the period */
+		uint64_t play_ns = now + (uint64_t)(delay + frame) * 1000000000ULL / audio_dev->rate;
+
+		first_audio.armed = 0U;
+		esg_stats_add(&first_audio.from_start_us, (int64_t)(play_ns - audio_dev->start_ns) / 1000);
+
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("first audio (us since stream start/queued frames/frame)"),
+				DLT_UINT64((play_ns - audio_dev->start_ns) / 1000U), DLT_INT32(delay), DLT_INT32(frame));
+
+		if (0U == first_audio.profiled)
+		{
+			uint64_t process_ns = time_getProcessStart_ns();
+
+			first_audio.profiled = 1U;
+
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("startup profile, ms since boot (process/main/audio open/stream start/first audio)"),
+					DLT_UINT32(process_ns / 1000000U), DLT_UINT32(first_audio.main_ns / 1000000U),
+					DLT_UINT32(first_audio.open_ns / 1000000U), DLT_UINT32(audio_dev->start_ns / 1000000U),
+					DLT_UINT32(play_ns / 1000000U),
+					DLT_STRING("first audio ms since process start"), DLT_UINT32((play_ns - process_ns) / 1000000U));
+		}
+	}
+}
+
+static snd_pcm_sframes_t audio_runner_playback(void)
+{
+	if (0U != bridge_enabled)
+	{
+		audio_runner_bridge_playback();
+	}
+
+	if (0U != first_audio.armed)
+	{
+		audio_runner_first_audio();
+	}
+
+	/* Playback the audio and reset the echo canceller if we got an underrun */
+	return alsa_device_writen(audio_dev, ch_bufs, audio_dev->period);
+}
+
+static void audio_runner_rate_switch_report(void)
+{
+	if (0U < rate_switch.nb_switches)
+	{
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("rate switches"), DLT_UINT32(rate_switch.nb_switches),
+				DLT_STRING("switch us (min/avg/max)"),
+				DLT_INT64(rate_switch.switch_us.min), DLT_INT64(esg_stats_avg(&rate_switch.switch_us)), DLT_INT64(rate_switch.switch_us.max),
+				DLT_STRING("lost us (min/avg/max)"),
+				DLT_INT64(rate_switch.lost_us.min), DLT_INT64(esg_stats_avg(&rate_switch.lost_us)), DLT_INT64(rate_switch.lost_us.max));
+	}
+}
+
+static int audio_runner_loop(ebt_settings_t *settings, uint32_t nb_loops, audio_load_t *load)
+{
+	int ret = EXIT_SUCCESS;
+	uint32_t periods = 0U;
+	uint64_t cpu_start = time_getThreadCpu_ns();
+
+	memset(load, 0, sizeof(*load));
+	esg_stats_reset(&load->loop_cpu_us);
 
 #define SELECT_nPOLL
 #ifdef SELECT_nPOLL
-		fd_set read_fds, write_fds;
+	fd_set read_fds, write_fds;
 
-		DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("START"), DLT_UINT32(nb_loops), DLT_STRING("(select)"));
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("START"), DLT_UINT32(nb_loops), DLT_STRING("(select)"));
 #else
-		DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("START"), DLT_UINT32(nb_loops), DLT_STRING("(poll)"));
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("START"), DLT_UINT32(nb_loops), DLT_STRING("(poll)"));
 #endif
 
-		while ((0 < nb_loops--) && (0 <= ret))
-		{
-			int avail;
+	while ((0 < nb_loops--) && (0 <= ret))
+	{
+		int avail;
+		uint64_t loop_start;
+		uint8_t captured = 0U;
+		uint8_t missed = 0U;
 
 #ifdef SELECT_nPOLL
 
-			/* RTFM : masks are modified in place by (shitty) select, hence this must reinit for each loop */
-			FD_ZERO(&read_fds);
-			FD_ZERO(&write_fds);
-			FD_SET(pfds[CAPTURE_FD_INDEX].fd, &read_fds);
-			FD_SET(pfds[PLAYBACK_FD_INDEX].fd, &write_fds);
+		/* RTFM : masks are modified in place by (shitty) select, hence this must reinit for each loop */
+		FD_ZERO(&read_fds);
+		FD_ZERO(&write_fds);
+		FD_SET(pfds[CAPTURE_FD_INDEX].fd, &read_fds);
+		FD_SET(pfds[PLAYBACK_FD_INDEX].fd, &write_fds);
 
-			ret = select(pfds[PLAYBACK_FD_INDEX].fd + 1 /*highest fd, plus one because 'select' is P.O.S*/,
-						 &read_fds,
-						 &write_fds,
-						 NULL,
-						 NULL);
+		ret = select(pfds[PLAYBACK_FD_INDEX].fd + 1 /*highest fd, plus one because 'select' is P.O.S*/,
+					 &read_fds,
+					 &write_fds,
+					 NULL,
+					 NULL);
 
-			/*	DLT_HEX32(read_fds.__fds_bits[0]),
-				DLT_HEX32(write_fds.__fds_bits[0]),*/
+		loop_start = time_getThreadCpu_ns();
 
-			DLT_LOG(dlt_ctxt_audio, DLT_LOG_VERBOSE, DLT_STRING("select (#fds/play-is-set/capture-is-set)"),
-					DLT_UINT32(ret),
-					DLT_UINT32(FD_ISSET(pfds[PLAYBACK_FD_INDEX].fd, &write_fds)),
-					DLT_UINT32(FD_ISSET(pfds[CAPTURE_FD_INDEX].fd, &read_fds)));
+		/*	DLT_HEX32(read_fds.__fds_bits[0]),
+			DLT_HEX32(write_fds.__fds_bits[0]),*/
 
-			if (0 > ret)
-			{
-				DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("select failed with"), DLT_UINT32(errno));
-			}
-			else
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_VERBOSE, DLT_STRING("select (#fds/play-is-set/capture-is-set)"),
+				DLT_UINT32(ret),
+				DLT_UINT32(FD_ISSET(pfds[PLAYBACK_FD_INDEX].fd, &write_fds)),
+				DLT_UINT32(FD_ISSET(pfds[CAPTURE_FD_INDEX].fd, &read_fds)));
+
+		if (0 > ret)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("select failed with"), DLT_UINT32(errno));
+		}
+		else
+		{
+			/* Audio available from the soundcard (capture) */
+			if (FD_ISSET(pfds[CAPTURE_FD_INDEX].fd, &read_fds))
 			{
-				/* Audio available from the soundcard (capture) */
-				if (FD_ISSET(pfds[CAPTURE_FD_INDEX].fd, &read_fds))
+				/* Get audio from the soundcard */
+				ret = alsa_device_readn(audio_dev, ch_bufs, audio_dev->period);
+				if (audio_dev->period == ret)
 				{
-					/* Get audio from the soundcard */
-					ret = alsa_device_readn(audio_dev, ch_bufs, AUDIO_TEST_PERIOD_SZ_FRAMES);
+					load->periods++;
+					captured = 1U;
+					audio_runner_capture_done();
 				}
-
-				/* Ready to play a frame (playback) */
-				if (FD_ISSET(pfds[PLAYBACK_FD_INDEX].fd, &write_fds))
+				else
 				{
-					/* Playback the audio and reset the echo canceller if we got an underrun */
-					ret = alsa_device_writen(audio_dev, ch_bufs, AUDIO_TEST_PERIOD_SZ_FRAMES);
+					missed = 1U;
 				}
 			}
-#else
-			ret = poll(pfds, nfds, -1);
 
-			if (0 > ret)
+			/* Ready to play a frame (playback) */
+			if (FD_ISSET(pfds[PLAYBACK_FD_INDEX].fd, &write_fds))
 			{
-				DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("poll failed with"), DLT_UINT32(errno));
+				ret = audio_runner_playback();
+				missed |= (audio_dev->period != ret);
 			}
-			else
-			{
-				DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("poll (err/ret)"), DLT_UINT32(errno), DLT_UINT32(ret));
+		}
+#else
+		ret = poll(pfds, nfds, -1);
 
-				/* Audio available from the soundcard (capture) */
-				ret = alsa_device_capture_ready(audio_dev, pfds, nfds);
-				if (0 < ret)
+		loop_start = time_getThreadCpu_ns();
+
+		if (0 > ret)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("poll failed with"), DLT_UINT32(errno));
+		}
+		else
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("poll (err/ret)"), DLT_UINT32(errno), DLT_UINT32(ret));
+
+			/* Audio available from the soundcard (capture) */
+			ret = alsa_device_capture_ready(audio_dev, pfds, nfds);
+			if (0 < ret)
+			{
+				/* Get audio from the soundcard */
+				ret = alsa_device_readn(audio_dev, ch_bufs, audio_dev->period);
+				if (audio_dev->period == ret)
 				{
-					/* Get audio from the soundcard */
-					ret = alsa_device_readn(audio_dev, ch_bufs, AUDIO_TEST_PERIOD_SZ_FRAMES);
+					load->periods++;
+					captured = 1U;
+					audio_runner_capture_done();
 				}
-
-				/* Ready to play a frame (playback) */
-				ret = alsa_device_playback_ready(audio_dev, pfds, nfds);
-				if (0 < ret)
+				else
 				{
-					/* Playback the audio and reset the echo canceller if we got an underrun */
-					ret = alsa_device_writen(audio_dev, ch_bufs, AUDIO_TEST_PERIOD_SZ_FRAMES);
+					missed = 1U;
 				}
 			}
+
+			/* Ready to play a frame (playback) */
+			ret = alsa_device_playback_ready(audio_dev, pfds, nfds);
+			if (0 < ret)
+			{
+				ret = audio_runner_playback();
+				missed |= (audio_dev->period != ret);
+			}
+		}
 #endif
 
-			/* Stress (full) pause/resume cycle */
-			if ((0U < settings->pauses) && (4U == (nb_loops & 0xFF)))
+		if (0U != telemetry_enabled)
+		{
+			audio_telemetry_sample(&telemetry, audio_dev);
+		}
+
+		/* synthetic load, once per period. a full period already waiting in the capture buffer is a missed deadline */
+		if ((0U != injecting) && ((0U != captured) || (0U != missed)))
+		{
+			missed |= (alsa_device_avail(audio_dev, 1 /*rec*/) >= audio_dev->period);
+
+			if (0U != esg_load_cycle_end(&injector, missed))
+			{
+				nb_loops = 0U;
+			}
+
+			esg_load_burn(&injector, AUDIO_TEST_PERIOD_TIME_US);
+		}
+
+		esg_stats_add(&load->loop_cpu_us, (int64_t)(time_getThreadCpu_ns() - loop_start) / 1000);
+
+		/* Stress (full) pause/resume cycle */
+		if ((0U < settings->pauses) && (4U == (nb_loops & 0xFF)))
+		{
+			uint64_t t_pause = time_getClock_ns();
+
+			if (0U != settings->warm_restart)
 			{
-				 int paused = alsa_device_pause(audio_dev, 1 /*pause*/, ch_bufs);
+				/* keep handles and hw/sw params, restart with silence */
+				memset(buf, 0, buf_sz);
+				ret = alsa_device_restart(audio_dev, ch_bufs);
+				DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("warm restart"));
+			}
+			else
+			{
+				int paused = alsa_device_pause(audio_dev, 1 /*pause*/, ch_bufs);
 				DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("pausing"));
 
 				(void)alsa_device_state(audio_dev, 0 /*play*/ );
@@ -142,17 +498,150 @@ static void *audio_runner(void *p_data)
 
 				alsa_device_pause(audio_dev, 0, ch_bufs);
 				DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("resuming"));
+			}
 
-				(void)alsa_device_state(audio_dev, 0);
-				(void)alsa_device_state(audio_dev, 1 /*rec*/ );
+			esg_stats_add(&restart_us, (int64_t)(time_getClock_ns() - t_pause) / 1000);
+			audio_glitch_restart(&glitch);
+			first_audio.armed = 1U;
 
-				settings->pauses--;
-			}
+			(void)alsa_device_state(audio_dev, 0);
+			(void)alsa_device_state(audio_dev, 1 /*rec*/ );
+
+			settings->pauses--;
+		}
+
+		/* Stress rate changes, the rack clock follows if the rack is in use */
+		periods++;
+		if ((0 <= ret) && (0U < settings->rate_switch) && (0U == (periods % settings->rate_switch)))
+		{
+			ret = audio_runner_switch_rate(settings);
+		}
+	}
+
+	load->cpu_ns = time_getThreadCpu_ns() - cpu_start;
+
+	return ret;
+}
+
+/* CPU per period as the channel count scales: 2, 4, 8 ... up to --channels-sweep, reopening the PCM pair
+ * for each step. stops early when the card refuses the channel count, which is the card limit.
+ */
+static int audio_runner_channel_sweep(ebt_settings_t *settings)
+{
+	int ret = EXIT_SUCCESS;
+	uint32_t channels_max = settings->channels_sweep;
+	uint32_t channels = 2U;
+	audio_load_t load;
+
+	while ((EXIT_SUCCESS == ret) && (channels <= channels_max))
+	{
+		alsa_device_close(audio_dev);
+
+		settings->audio_channels = channels;
+		audio_dev = alsa_device_open(settings);
+
+		if (NULL == audio_dev)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("channel sweep: card refused (channels)"), DLT_UINT32(channels));
+			break;
+		}
+
+		ret = audio_runner_setup_fds();
+
+		if (EXIT_SUCCESS == ret)
+		{
+			memset(buf, 0, buf_sz);
+			alsa_device_startn(audio_dev, ch_bufs);
+			audio_glitch_init(&glitch, channels);
+			first_audio.armed = 1U;
+
+			ret = audio_runner_loop(settings, settings->nb_loops, &load);
+			ret = (0 > ret) ? ret : EXIT_SUCCESS;
+		}
+
+		if ((EXIT_SUCCESS == ret) && (0U < load.periods))
+		{
+			uint64_t period_cpu_us = load.cpu_ns / 1000U / load.periods;
+
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("channel sweep (channels/rate)"), DLT_UINT32(channels), DLT_UINT32(audio_dev->rate),
+					DLT_STRING("cpu us per period"), DLT_UINT64(period_cpu_us),
+					DLT_STRING("(% of period)"), DLT_UINT64(period_cpu_us * 100U / AUDIO_TEST_PERIOD_TIME_US),
+					DLT_STRING("cpu us per loop (avg/max)"), DLT_INT64(esg_stats_avg(&load.loop_cpu_us)), DLT_INT64(load.loop_cpu_us.max));
+		}
+
+		/* last step is --channels-sweep itself, even if not a power of two */
+		channels = ((channels < channels_max) && ((channels * 2U) > channels_max)) ? channels_max : (channels * 2U);
+	}
+
+	return ret;
+}
+
+static void *audio_runner(void *p_data)
+{
+	int ret = EXIT_SUCCESS;
+	audio_load_t load;
+
+	ebt_settings_t *settings = (ebt_settings_t *)p_data;
+
+	if (NULL == settings)
+	{
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("START failed, ebt_settings_t null"));
+		ret = -EINVAL;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (0U != settings->channels_sweep))
+	{
+		ret = audio_runner_channel_sweep(settings);
+	}
+	else if (EXIT_SUCCESS == ret)
+	{
+		alsa_device_startn(audio_dev, ch_bufs);
+		first_audio.armed = 1U;
+
+		ret = audio_runner_loop(settings, settings->nb_loops, &load);
+
+		audio_runner_rate_switch_report();
+
+		if (1U < first_audio.from_start_us.count)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("first audio after start"),
+					DLT_UINT32(first_audio.from_start_us.count), DLT_STRING("us (min/avg/max)"),
+					DLT_INT64(first_audio.from_start_us.min), DLT_INT64(esg_stats_avg(&first_audio.from_start_us)), DLT_INT64(first_audio.from_start_us.max));
+		}
+
+		if (0U < restart_us.count)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING((0U != settings->warm_restart) ? "warm restarts" : "pause/resume cycles"),
+					DLT_UINT32(restart_us.count), DLT_STRING("us (min/avg/max)"),
+					DLT_INT64(restart_us.min), DLT_INT64(esg_stats_avg(&restart_us)), DLT_INT64(restart_us.max));
 		}
 
 		// alsa_device_close(audio_dev);
 	}
 
+	if (0U != glitch_enabled)
+	{
+		audio_glitch_report(&glitch);
+	}
+
+	if (0U != injecting)
+	{
+		esg_load_report(&injector);
+		esg_load_free(&injector);
+		injecting = 0U;
+	}
+
+	if ((0U != telemetry_enabled) && (NULL != settings->fill_trace) && (NULL != audio_dev))
+	{
+		(void)audio_telemetry_export(&telemetry, audio_dev, settings->fill_trace);
+	}
+
+	if (0U != telemetry_enabled)
+	{
+		audio_telemetry_free(&telemetry);
+		telemetry_enabled = 0U;
+	}
+
 	DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("EXIT"), DLT_UINT32(ret));
 
 	return (void *)ret;
@@ -164,6 +653,12 @@ int audio_runner_init_poll(pthread_t *runner, ebt_settings_t *settings)
 
 	DLT_REGISTER_CONTEXT_LL_TS(dlt_ctxt_audio, "AUDI", "ESG BSP Audio Context", DLT_LOG_INFO, DLT_TRACE_STATUS_DEFAULT);
 
+	/* the rack clock must match the rate the PCMs are opened with */
+	if ((EXIT_SUCCESS == ret) && (0U != settings->rack_enabled))
+	{
+		ret = rack_set_sampling_rate_hz(settings->audio_rate);
+	}
+
 	if (EXIT_SUCCESS == ret)
 	{
 		audio_dev = alsa_device_open(settings);
@@ -175,26 +670,55 @@ int audio_runner_init_poll(pthread_t *runner, ebt_settings_t *settings)
 
 	if (EXIT_SUCCESS == ret)
 	{
-		/* Setup all file descriptors for poll()ing */
-		nfds = alsa_device_nfds(audio_dev);
-		pfds = malloc(sizeof(*pfds) * (nfds));
+		ret = audio_runner_setup_fds();
+	}
 
-		alsa_device_getfds(audio_dev, pfds, nfds);
+	if (EXIT_SUCCESS == ret)
+	{
+		/* start the rate cycle from the current rate */
+		for (uint32_t i = 0U; i < SWITCH_RATES_NB; i++)
+		{
+			if (switch_rates[i] == settings->audio_rate)
+			{
+				rate_switch.rate_index = i;
+			}
+		}
+
+		esg_stats_reset(&rate_switch.switch_us);
+		esg_stats_reset(&rate_switch.lost_us);
+		esg_stats_reset(&restart_us);
+		esg_stats_reset(&first_audio.from_start_us);
+		first_audio.main_ns = settings->main_ns;
+		first_audio.open_ns = time_getBoottime_ns();
+
+		glitch_enabled = settings->glitch_detect;
+		phase_enabled = settings->phase_monitor;
+		bridge_enabled = settings->bridge;
+		audio_glitch_init(&glitch, settings->audio_channels);
+	}
+
+	if ((EXIT_SUCCESS == ret) && ((0U < settings->load_percent) || (0U != settings->load_ramp)))
+	{
+		ret = esg_load_init(&injector, "audio", settings->load_kernel, settings->load_percent, settings->load_ramp);
+		injecting = (EXIT_SUCCESS == ret) ? 1U : 0U;
+	}
+
+	if ((EXIT_SUCCESS == ret) && ((0U != settings->telemetry) || (NULL != settings->fill_trace)))
+	{
+		ret = audio_telemetry_init(&telemetry);
+		telemetry_enabled = (EXIT_SUCCESS == ret) ? 1U : 0U;
 	}
 
 	if (EXIT_SUCCESS == ret)
 	{
 		/* actual sample buffer */
-		memset(buf, 0, sizeof(buf));
+		ret = audio_runner_alloc_bufs((settings->channels_sweep > settings->audio_channels) ? settings->channels_sweep : settings->audio_channels);
+	}
 
+	if (EXIT_SUCCESS == ret)
+	{
 		DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("audio_runner_init_poll: creating runner"));
 
-		/* non-interleaved channel buffer offets */
-		for (int c = 0; c < AUDIO_TEST_CHANNELS; c++)
-		{
-			ch_bufs[c] = (void *)((unsigned char *)buf + (c * AUDIO_TEST_SAMPLE_SZ_BYTES * AUDIO_TEST_PERIOD_SZ_FRAMES));
-		}
-
 		ret = pthread_create(runner, NULL, audio_runner, (void *)settings);
 	}
 
@@ -0,0 +1,406 @@
+/*
+ ============================================================================
+ Name        : alsa-bw-runner.c
+ Version     :
+ Copyright   : Closed
+ Description : capture-only / playback-only multi-stream DMA bandwidth stress.
+               No loopback, no link: N independent streams at the card maximum
+               channels and rate, to find the SAI/DMA limits on their own.
+ ============================================================================
+ */
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "alsa-device.h"
+#include "wi_time.h"
+
+DLT_IMPORT_CONTEXT(dlt_ctxt_audio);
+
+typedef struct
+{
+	char name[64];
+	snd_pcm_t *pcm;
+	unsigned int channels;
+	unsigned int rate;
+	snd_pcm_uframes_t period;
+	int nfds;
+	struct pollfd *pfds;	/* into the shared poll array */
+	uint8_t *buf;
+	void *ch_bufs[AUDIO_TEST_CHANNELS_MAX];
+	uint64_t frames;
+	uint32_t xruns;
+} bw_stream_t;
+
+/* system wide figures from /proc/stat */
+typedef struct
+{
+	uint64_t busy;
+	uint64_t irq;		/* irq + softirq */
+	uint64_t total;
+	uint64_t intr;		/* interrupts serviced */
+} bw_cpu_t;
+
+static bw_stream_t streams[BW_STREAMS_MAX];
+static uint32_t nb_streams = 0U;
+static struct pollfd *pfds = NULL;
+static int nfds = 0;
+
+static void alsa_bw_read_cpu(bw_cpu_t *cpu)
+{
+	unsigned long long user = 0, nice = 0, system = 0, idle = 0, iowait = 0, irq = 0, softirq = 0, steal = 0;
+	char line[256];
+	FILE *f = fopen("/proc/stat", "r");
+
+	memset(cpu, 0, sizeof(*cpu));
+
+	if (NULL != f)
+	{
+		while (NULL != fgets(line, sizeof(line), f))
+		{
+			if (0 == strncmp(line, "cpu ", 4))
+			{
+				(void)sscanf(line + 4, "%llu %llu %llu %llu %llu %llu %llu %llu", &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal);
+				cpu->irq = irq + softirq;
+				cpu->busy = user + nice + system + irq + softirq + steal;
+				cpu->total = cpu->busy + idle + iowait;
+			}
+			else if (0 == strncmp(line, "intr ", 5))
+			{
+				/* first number is the total, the line itself can be longer than our buffer */
+				(void)sscanf(line + 5, "%llu", &user);
+				cpu->intr = user;
+				break;
+			}
+		}
+
+		fclose(f);
+	}
+}
+
+/* the pcm name may hold a single %d, replaced by the stream index (e.g. "hw:0,0,%d" for subdevices) */
+static void alsa_bw_name(char *name, size_t len, const char *pattern, uint32_t index)
+{
+	const char *fmt = strstr(pattern, "%d");
+
+	if ((NULL != fmt) && (fmt == strchr(pattern, '%')) && (NULL == strchr(fmt + 1, '%')))
+	{
+		snprintf(name, len, pattern, (int)index);
+	}
+	else
+	{
+		snprintf(name, len, "%s", pattern);
+	}
+}
+
+static int alsa_bw_open(bw_stream_t *stream, snd_pcm_stream_t direction)
+{
+	int err;
+	snd_pcm_hw_params_t *hw_params;
+	snd_pcm_sw_params_t *sw_params;
+
+	snd_pcm_hw_params_alloca(&hw_params);
+	snd_pcm_sw_params_alloca(&sw_params);
+
+	err = snd_pcm_open(&stream->pcm, stream->name, direction, SND_PCM_NONBLOCK);
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_any(stream->pcm, hw_params);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_set_access(stream->pcm, hw_params, AUDIO_TEST_SAMPLE_ACCESS);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_set_format(stream->pcm, hw_params, AUDIO_TEST_SAMPLE_FORMAT);
+	}
+
+	/* as much as the card takes, within what our buffers are sized for */
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_get_channels_max(hw_params, &stream->channels);
+		stream->channels = (AUDIO_TEST_CHANNELS_MAX < stream->channels) ? AUDIO_TEST_CHANNELS_MAX : stream->channels;
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_set_channels(stream->pcm, hw_params, stream->channels);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_get_rate_max(hw_params, &stream->rate, NULL);
+		stream->rate = (AUDIO_TEST_RATE_MAX < stream->rate) ? AUDIO_TEST_RATE_MAX : stream->rate;
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params_set_rate_near(stream->pcm, hw_params, &stream->rate, NULL);
+	}
+
+	if (0 <= err)
+	{
+		stream->period = AUDIO_PERIOD_SZ_FRAMES(stream->rate);
+		err = snd_pcm_hw_params_set_period_size_near(stream->pcm, hw_params, &stream->period, NULL);
+	}
+
+	if (0 <= err)
+	{
+		snd_pcm_uframes_t buffer_size = AUDIO_TEST_PERIODS * stream->period;
+
+		err = snd_pcm_hw_params_set_buffer_size_near(stream->pcm, hw_params, &buffer_size);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_hw_params(stream->pcm, hw_params);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_sw_params_current(stream->pcm, sw_params);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_sw_params_set_avail_min(stream->pcm, sw_params, stream->period);
+	}
+
+	if (0 <= err)
+	{
+		err = snd_pcm_sw_params(stream->pcm, sw_params);
+	}
+
+	if ((0 <= err) && (AUDIO_TEST_PERIOD_SZ_FRAMES_MAX < stream->period))
+	{
+		/* the card rounded the period up beyond our buffers */
+		err = -ERANGE;
+	}
+
+	if (0 <= err)
+	{
+		size_t stride = AUDIO_TEST_SAMPLE_SZ_BYTES * AUDIO_TEST_PERIOD_SZ_FRAMES_MAX;
+
+		err = -posix_memalign((void **)&stream->buf, AUDIO_CACHE_LINE_BYTES, stream->channels * stride);
+		for (uint32_t c = 0U; (0 <= err) && (c < stream->channels); c++)
+		{
+			stream->ch_bufs[c] = stream->buf + (c * stride);
+		}
+	}
+
+	if (0 <= err)
+	{
+		memset(stream->buf, 0, stream->channels * AUDIO_TEST_SAMPLE_SZ_BYTES * AUDIO_TEST_PERIOD_SZ_FRAMES_MAX);
+		stream->nfds = snd_pcm_poll_descriptors_count(stream->pcm);
+	}
+
+	DLT_LOG(dlt_ctxt_audio, (0 <= err) ? DLT_LOG_INFO : DLT_LOG_ERROR, DLT_STRING("bw open (pcm/channels/rate/period)"),
+			DLT_STRING(stream->name), DLT_UINT32(stream->channels), DLT_UINT32(stream->rate), DLT_UINT32(stream->period),
+			DLT_STRING(snd_strerror(err)));
+
+	return err;
+}
+
+static int alsa_bw_start(bw_stream_t *stream, uint8_t capture)
+{
+	int err = snd_pcm_prepare(stream->pcm);
+
+	/* playback: fill the whole buffer with silence first */
+	for (int p = 0; (0 <= err) && (0U == capture) && (p < AUDIO_TEST_PERIODS); p++)
+	{
+		err = snd_pcm_writen(stream->pcm, stream->ch_bufs, stream->period);
+	}
+
+	if ((0 <= err) && (SND_PCM_STATE_PREPARED == snd_pcm_state(stream->pcm)))
+	{
+		err = snd_pcm_start(stream->pcm);
+	}
+
+	return err;
+}
+
+static void alsa_bw_transfer(bw_stream_t *stream, uint8_t capture)
+{
+	unsigned short revents = 0;
+	snd_pcm_sframes_t ret = snd_pcm_poll_descriptors_revents(stream->pcm, stream->pfds, stream->nfds, &revents);
+
+	if ((0 <= ret) && (0 != (revents & (POLLIN | POLLOUT | POLLERR))))
+	{
+		ret = (0U != capture) ? snd_pcm_readn(stream->pcm, stream->ch_bufs, stream->period)
+							  : snd_pcm_writen(stream->pcm, stream->ch_bufs, stream->period);
+
+		if (0 < ret)
+		{
+			stream->frames += ret;
+		}
+		else if ((-EPIPE == ret) || (-ESTRPIPE == ret))
+		{
+			stream->xruns++;
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("bw xrun"), DLT_STRING(stream->name), DLT_UINT32(stream->xruns));
+
+			if (0 <= snd_pcm_recover(stream->pcm, ret, 1))
+			{
+				(void)alsa_bw_start(stream, capture);
+			}
+		}
+		else if (-EAGAIN != ret)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("bw transfer failed"), DLT_STRING(stream->name), DLT_STRING(snd_strerror(ret)));
+		}
+	}
+}
+
+static void *alsa_bw_runner(void *p_data)
+{
+	int ret = EXIT_SUCCESS;
+	ebt_settings_t *settings = (ebt_settings_t *)p_data;
+	uint8_t capture = (AUDIO_BW_CAPTURE == settings->bw_mode);
+	uint64_t target = (uint64_t)settings->nb_loops * streams[0].period;
+	bw_cpu_t cpu_start, cpu_end;
+	uint64_t t_start, thread_cpu_start, elapsed_ns;
+	uint64_t bytes = 0U;
+	uint32_t xruns = 0U;
+
+	alsa_bw_read_cpu(&cpu_start);
+	t_start = time_getClock_ns();
+	thread_cpu_start = time_getThreadCpu_ns();
+
+	for (uint32_t s = 0U; (EXIT_SUCCESS == ret) && (s < nb_streams); s++)
+	{
+		ret = alsa_bw_start(&streams[s], capture);
+		ret = (0 > ret) ? ret : EXIT_SUCCESS;
+	}
+
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("bw START (streams/capture/loops)"),
+			DLT_UINT32(nb_streams), DLT_UINT8(capture), DLT_UINT32(settings->nb_loops), DLT_INT32(ret));
+
+	/* the first stream paces the run, nb_loops of its periods */
+	while ((EXIT_SUCCESS == ret) && (streams[0].frames < target))
+	{
+		int ready = poll(pfds, nfds, 1000);
+
+		if (0 > ready)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("bw poll failed with"), DLT_UINT32(errno));
+			ret = -errno;
+		}
+		else if (0 == ready)
+		{
+			DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("bw poll timeout"));
+			ret = -ETIMEDOUT;
+		}
+		else
+		{
+			for (uint32_t s = 0U; s < nb_streams; s++)
+			{
+				alsa_bw_transfer(&streams[s], capture);
+			}
+		}
+	}
+
+	elapsed_ns = time_getClock_ns() - t_start;
+	alsa_bw_read_cpu(&cpu_end);
+
+	for (uint32_t s = 0U; s < nb_streams; s++)
+	{
+		uint64_t stream_bytes = streams[s].frames * streams[s].channels * AUDIO_TEST_SAMPLE_SZ_BYTES;
+
+		bytes += stream_bytes;
+		xruns += streams[s].xruns;
+
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("bw stream (pcm/channels/rate)"),
+				DLT_STRING(streams[s].name), DLT_UINT32(streams[s].channels), DLT_UINT32(streams[s].rate),
+				DLT_STRING("frames"), DLT_UINT64(streams[s].frames), DLT_STRING("xruns"), DLT_UINT32(streams[s].xruns),
+				DLT_STRING("kB/s"), DLT_UINT64((0U < elapsed_ns) ? (stream_bytes * 1000000U / (elapsed_ns / 1000U)) / 1000U : 0U));
+
+		snd_pcm_close(streams[s].pcm);
+		free(streams[s].buf);
+	}
+
+	{
+		uint64_t total = cpu_end.total - cpu_start.total;
+
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("bw total (streams/ms)"), DLT_UINT32(nb_streams), DLT_UINT64(elapsed_ns / 1000000U),
+				DLT_STRING("kB/s"), DLT_UINT64((0U < elapsed_ns) ? (bytes * 1000000U / (elapsed_ns / 1000U)) / 1000U : 0U),
+				DLT_STRING("xruns"), DLT_UINT32(xruns),
+				DLT_STRING("runner cpu %"), DLT_UINT64((0U < elapsed_ns) ? (time_getThreadCpu_ns() - thread_cpu_start) * 100U / elapsed_ns : 0U),
+				DLT_STRING("system cpu % (busy/irq)"),
+				DLT_UINT64((0U < total) ? (cpu_end.busy - cpu_start.busy) * 100U / total : 0U),
+				DLT_UINT64((0U < total) ? (cpu_end.irq - cpu_start.irq) * 100U / total : 0U),
+				DLT_STRING("irq/s"), DLT_UINT64((0U < elapsed_ns) ? (cpu_end.intr - cpu_start.intr) * 1000U / (elapsed_ns / 1000000U + 1U) : 0U));
+	}
+
+	free(pfds);
+	pfds = NULL;
+
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("bw EXIT"), DLT_INT32(ret));
+
+	return (void *)ret;
+}
+
+int alsa_bw_runner_init(pthread_t *runner, ebt_settings_t *settings)
+{
+	int ret = (NULL != settings) ? EXIT_SUCCESS : -EINVAL;
+	snd_pcm_stream_t direction;
+
+	DLT_REGISTER_CONTEXT_LL_TS(dlt_ctxt_audio, "AUDI", "ESG BSP Audio Context", DLT_LOG_INFO, DLT_TRACE_STATUS_DEFAULT);
+
+	if (EXIT_SUCCESS == ret)
+	{
+		direction = (AUDIO_BW_CAPTURE == settings->bw_mode) ? SND_PCM_STREAM_CAPTURE : SND_PCM_STREAM_PLAYBACK;
+		nb_streams = (BW_STREAMS_MAX < settings->bw_streams) ? BW_STREAMS_MAX : settings->bw_streams;
+		nb_streams = (0U == nb_streams) ? 1U : nb_streams;
+		nfds = 0;
+	}
+
+	for (uint32_t s = 0U; (EXIT_SUCCESS == ret) && (s < nb_streams); s++)
+	{
+		alsa_bw_name(streams[s].name, sizeof(streams[s].name), settings->pcm_name, s);
+		ret = alsa_bw_open(&streams[s], direction);
+		ret = (0 > ret) ? ret : EXIT_SUCCESS;
+		nfds += streams[s].nfds;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		pfds = malloc(nfds * sizeof(*pfds));
+		ret = (NULL != pfds) ? EXIT_SUCCESS : -ENOMEM;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		struct pollfd *p = pfds;
+
+		for (uint32_t s = 0U; s < nb_streams; s++)
+		{
+			streams[s].pfds = p;
+			(void)snd_pcm_poll_descriptors(streams[s].pcm, p, streams[s].nfds);
+			p += streams[s].nfds;
+		}
+
+		ret = pthread_create(runner, NULL, alsa_bw_runner, (void *)settings);
+	}
+
+	/* pthread_create() returns a positive errno */
+	if (EXIT_SUCCESS != ret)
+	{
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_bw_runner_init: failed"), DLT_INT32(ret));
+
+		for (uint32_t s = 0U; s < nb_streams; s++)
+		{
+			if (NULL != streams[s].pcm)
+			{
+				snd_pcm_close(streams[s].pcm);
+			}
+			free(streams[s].buf);
+		}
+		free(pfds);
+		memset(streams, 0, sizeof(streams));
+		pfds = NULL;
+	}
+
+	return ret;
+}
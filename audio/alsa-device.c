@@ -31,10 +31,23 @@
 */
 
 #include "alsa-device.h"
+#include "wi_time.h"
 #include <stdlib.h>
 
 DLT_IMPORT_CONTEXT(dlt_ctxt_audio);
 
+static const char *open_phase_names[ALSA_OPEN_PHASES] = {"C-open", "C-hw", "C-sw", "P-open", "P-hw", "P-sw", "link", "fds"};
+
+/* store the time spent since t_prev in us, and return the new reference */
+static uint64_t alsa_device_lap(uint32_t *slot_us, uint64_t t_prev)
+{
+   uint64_t now = time_getClock_ns();
+
+   *slot_us = (uint32_t)((now - t_prev) / 1000U);
+
+   return now;
+}
+
 #define USE_SILENCE /* use silence setytings, to handle x-run*/
 
 static int alsa_device_hw_params(snd_pcm_t *pcm_handle, ebt_settings_t *settings)
@@ -73,26 +86,32 @@ static int alsa_device_hw_params(snd_pcm_t *pcm_handle, ebt_settings_t *settings
 
    if (0 <= err)
    {
-      uint32_t rate = AUDIO_TEST_RATE;
+      uint32_t rate = settings->audio_rate;
       err = snd_pcm_hw_params_set_rate_near(pcm_handle, hw_params, &rate, 0);
       if (0 > err)
       {
          DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_hw_params_set_rate_near capture"), DLT_UINT32(rate), DLT_STRING(snd_strerror(err)));
       }
+      else if (rate != settings->audio_rate)
+      {
+         /* the period size is derived from the requested rate, so we can't go on with a different one */
+         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_hw_params_set_rate_near (wanted/got)"), DLT_UINT32(settings->audio_rate), DLT_UINT32(rate));
+         err = -EINVAL;
+      }
    }
 
    if (0 <= err)
    {
-      err = snd_pcm_hw_params_set_channels(pcm_handle, hw_params, AUDIO_TEST_CHANNELS);
+      err = snd_pcm_hw_params_set_channels(pcm_handle, hw_params, settings->audio_channels);
       if (0 > err)
       {
-         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_hw_params_set_channels capture"), DLT_STRING(snd_strerror(err)));
+         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_hw_params_set_channels capture"), DLT_UINT32(settings->audio_channels), DLT_STRING(snd_strerror(err)));
       }
    }
 
    if (0 <= err)
    {
-      err = snd_pcm_hw_params_set_period_size(pcm_handle, hw_params, AUDIO_TEST_PERIOD_SZ_FRAMES, 0);
+      err = snd_pcm_hw_params_set_period_size(pcm_handle, hw_params, AUDIO_PERIOD_SZ_FRAMES(settings->audio_rate), 0);
       if (0 > err)
       {
          DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_hw_params_set_period_size constraint failed"), DLT_STRING(snd_strerror(err)));
@@ -110,7 +129,7 @@ static int alsa_device_hw_params(snd_pcm_t *pcm_handle, ebt_settings_t *settings
 
    if (0 <= err)
    {
-      snd_pcm_uframes_t buffer_size = AUDIO_TEST_PERIODS * AUDIO_TEST_PERIOD_SZ_FRAMES;
+      snd_pcm_uframes_t buffer_size = AUDIO_TEST_PERIODS * AUDIO_PERIOD_SZ_FRAMES(settings->audio_rate);
 
       err = snd_pcm_hw_params_set_buffer_size_near(pcm_handle, hw_params, &buffer_size);
       if (0 > err)
@@ -136,7 +155,7 @@ static int alsa_device_hw_params(snd_pcm_t *pcm_handle, ebt_settings_t *settings
    return err;
 }
 
-static int alsa_device_sw_params(snd_pcm_t *pcm_handle, snd_pcm_uframes_t avail_min, ebt_settings_t *settings)
+static int alsa_device_sw_params(snd_pcm_t *pcm_handle, snd_pcm_uframes_t avail_min, snd_pcm_uframes_t start_threshold, ebt_settings_t *settings)
 {
    int err = ((NULL != pcm_handle) && (NULL != settings)) ? 0 : -EINVAL;
 
@@ -161,6 +180,16 @@ static int alsa_device_sw_params(snd_pcm_t *pcm_handle, snd_pcm_uframes_t avail_
       }
    }
 
+   /* 0 keeps the alsa default (start on first write, in practice we start explicitely) */
+   if ((0 <= err) && (0 != start_threshold))
+   {
+      err = snd_pcm_sw_params_set_start_threshold(pcm_handle, sw_params, start_threshold);
+      if (0 > err)
+      {
+         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_sw_params_set_start_threshold"), DLT_UINT32(start_threshold), DLT_STRING(snd_strerror(err)));
+      }
+   }
+
 #ifdef USE_SILENCE
    /* Handle X-run with silence */
    if (0 <= err)
@@ -209,8 +238,10 @@ AlsaDevice_t *alsa_device_open(ebt_settings_t *settings)
 {
    int err = (NULL != settings) ? EXIT_SUCCESS : -EINVAL;
    static snd_output_t *jcd_out;
+   uint64_t t = time_getClock_ns();
+   uint64_t t_open = t;
 
-   AlsaDevice_t *dev = malloc(sizeof(*dev));
+   AlsaDevice_t *dev = calloc(1, sizeof(*dev));
    if (!dev)
       return NULL;
 
@@ -221,36 +252,56 @@ AlsaDevice_t *alsa_device_open(ebt_settings_t *settings)
       DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_open capture"), DLT_STRING(snd_strerror(err)));
       assert(0);
    }
+   t = alsa_device_lap(&dev->open_us[ALSA_PHASE_CAPTURE_OPEN], t);
 
    if (0 <= err)
    {
       err = alsa_device_hw_params(dev->capture_handle, settings);
+      t = alsa_device_lap(&dev->open_us[ALSA_PHASE_CAPTURE_HW], t);
       if (0 <= err)
       {
          /* got period OK */
-         dev->period = AUDIO_TEST_PERIOD_SZ_FRAMES;
+         dev->rate = settings->audio_rate;
+         dev->channels = settings->audio_channels;
+         dev->period = AUDIO_PERIOD_SZ_FRAMES(settings->audio_rate);
+
+         /* a blocking write beyond the buffer would never return before start */
+         dev->prefill = (0 > settings->prefill) ? (AUDIO_TEST_PERIODS * dev->period) : (snd_pcm_uframes_t)settings->prefill;
+         dev->prefill = (dev->prefill > (AUDIO_TEST_PERIODS * dev->period)) ? (AUDIO_TEST_PERIODS * dev->period) : dev->prefill;
       }
    }
 
    if (0 <= err)
    {
-      err = alsa_device_sw_params(dev->capture_handle, 0, settings);
+      err = alsa_device_sw_params(dev->capture_handle, 0, 0, settings);
+      t = alsa_device_lap(&dev->open_us[ALSA_PHASE_CAPTURE_SW], t);
    }
 
-   if ((err = snd_pcm_open(&dev->playback_handle, AUDIO_TEST_DEVICE_NAME, SND_PCM_STREAM_PLAYBACK, 0)) < 0)
+   if ((0 <= err) && ((err = snd_pcm_open(&dev->playback_handle, AUDIO_TEST_DEVICE_NAME, SND_PCM_STREAM_PLAYBACK, 0)) < 0))
    {
       DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_open play"), DLT_STRING(snd_strerror(err)));
       assert(0);
    }
+   t = alsa_device_lap(&dev->open_us[ALSA_PHASE_PLAYBACK_OPEN], t);
 
    if (0 <= err)
    {
       err = alsa_device_hw_params(dev->playback_handle, settings);
+      t = alsa_device_lap(&dev->open_us[ALSA_PHASE_PLAYBACK_HW], t);
    }
 
    if (0 <= err)
    {
-      err = alsa_device_sw_params(dev->playback_handle, /* avail min*/ AUDIO_TEST_PERIOD_SZ_FRAMES, settings);
+      err = alsa_device_sw_params(dev->playback_handle, /* avail min*/ dev->period, settings->start_threshold, settings);
+      t = alsa_device_lap(&dev->open_us[ALSA_PHASE_PLAYBACK_SW], t);
+   }
+
+   if (0 > err)
+   {
+      /* e.g. the card refused the rate, let the caller decide what to do */
+      DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_open: hw/sw params failed (rate/channels)"), DLT_UINT32(settings->audio_rate), DLT_UINT32(settings->audio_channels));
+      alsa_device_close(dev);
+      return NULL;
    }
 
 #define USE_SND_PCM_LINK
@@ -265,6 +316,7 @@ AlsaDevice_t *alsa_device_open(ebt_settings_t *settings)
       DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_link OK"));
    }
 #endif
+   t = alsa_device_lap(&dev->open_us[ALSA_PHASE_LINK], t);
 
    dev->readN = snd_pcm_poll_descriptors_count(dev->capture_handle);
    dev->writeN = snd_pcm_poll_descriptors_count(dev->playback_handle);
@@ -287,6 +339,18 @@ AlsaDevice_t *alsa_device_open(ebt_settings_t *settings)
       DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_poll_descriptors P failed"));
       assert(0);
    }
+   t = alsa_device_lap(&dev->open_us[ALSA_PHASE_FDS], t);
+
+   DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("alsa_device_open (total us)"), DLT_UINT32((uint32_t)((t - t_open) / 1000U)),
+           DLT_STRING(open_phase_names[ALSA_PHASE_CAPTURE_OPEN]), DLT_UINT32(dev->open_us[ALSA_PHASE_CAPTURE_OPEN]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_CAPTURE_HW]), DLT_UINT32(dev->open_us[ALSA_PHASE_CAPTURE_HW]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_CAPTURE_SW]), DLT_UINT32(dev->open_us[ALSA_PHASE_CAPTURE_SW]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_PLAYBACK_OPEN]), DLT_UINT32(dev->open_us[ALSA_PHASE_PLAYBACK_OPEN]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_PLAYBACK_HW]), DLT_UINT32(dev->open_us[ALSA_PHASE_PLAYBACK_HW]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_PLAYBACK_SW]), DLT_UINT32(dev->open_us[ALSA_PHASE_PLAYBACK_SW]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_LINK]), DLT_UINT32(dev->open_us[ALSA_PHASE_LINK]),
+           DLT_STRING(open_phase_names[ALSA_PHASE_FDS]), DLT_UINT32(dev->open_us[ALSA_PHASE_FDS]));
+
    return dev;
 }
 
@@ -294,8 +358,18 @@ void alsa_device_close(AlsaDevice_t *dev)
 {
    DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("alsa_device_close"));
 
-   snd_pcm_close(dev->capture_handle);
-   snd_pcm_close(dev->playback_handle);
+   if (NULL != dev->capture_handle)
+   {
+      snd_pcm_close(dev->capture_handle);
+   }
+
+   if (NULL != dev->playback_handle)
+   {
+      snd_pcm_close(dev->playback_handle);
+   }
+
+   free(dev->read_fd);
+   free(dev->write_fd);
    free(dev);
 }
 
@@ -330,15 +404,15 @@ snd_pcm_sframes_t alsa_device_readn(AlsaDevice_t *dev, void **ch_buf, int len)
    }
    else
    {
-      if (abs(((int32_t *)ch_buf[0])[0]) < 0x00002000U)
+      if (abs(((int32_t *)ch_buf[0])[0]) < AUDIO_TEST_SILENCE_LEVEL)
       {
          DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO,
                  DLT_STRING("IN1 level too low ? snd_pcm_readn"),
                  DLT_STRING(snd_strerror(err)),
                  DLT_HEX32(((uint32_t *)ch_buf[0])[0]),
-                 DLT_HEX32(((uint32_t *)ch_buf[1])[0]),
-                 DLT_HEX32(((uint32_t *)ch_buf[2])[0]),
-                 DLT_HEX32(((uint32_t *)ch_buf[3])[0]));
+                 DLT_HEX32(((uint32_t *)ch_buf[dev->channels / 4U])[0]),
+                 DLT_HEX32(((uint32_t *)ch_buf[dev->channels / 2U])[0]),
+                 DLT_HEX32(((uint32_t *)ch_buf[dev->channels - 1U])[0]));
       }
    }
    return err;
@@ -484,6 +558,23 @@ int alsa_device_playback_ready(AlsaDevice_t *dev, struct pollfd *pfds, unsigned
    return ret;
 }
 
+/* silence (ch_buf) written before start, split in periods */
+static int alsa_device_prefill(AlsaDevice_t *dev, void **ch_buf)
+{
+   int ret = 0;
+   snd_pcm_uframes_t left = dev->prefill;
+
+   while ((0 <= ret) && (0U < left))
+   {
+      int len = (left < (snd_pcm_uframes_t)dev->period) ? (int)left : dev->period;
+
+      ret = alsa_device_writen(dev, ch_buf, len);
+      left -= len;
+   }
+
+   return ret;
+}
+
 void alsa_device_startn(AlsaDevice_t *dev, void **ch_buf)
 {
    int ret = 0;
@@ -508,28 +599,107 @@ void alsa_device_startn(AlsaDevice_t *dev, void **ch_buf)
          DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("snd_pcm_prepare play"), DLT_STRING(snd_strerror(ret)));
       }
 
-//#ifdef USE_SILENCE
-      ret = alsa_device_writen(dev, ch_buf, dev->period);
+      ret = alsa_device_prefill(dev, ch_buf);
       if (0 > ret)
       {
-         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_writen pre-roll failed, PERIOD0"));
+         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_writen pre-roll failed"), DLT_UINT32(dev->prefill));
+      }
+
+#ifndef USE_SND_PCM_LINK
+      /* it seem pcm are already running at this point and start is not needed in link mode.
+       * I assume writen get things rolling. */
+      snd_pcm_start(dev->capture_handle);
+
+#endif
+      /* a start threshold within the prefill already started the pair */
+      if (SND_PCM_STATE_PREPARED == snd_pcm_state(dev->playback_handle))
+      {
+         snd_pcm_start(dev->playback_handle);
       }
+      dev->start_ns = time_getBoottime_ns();
+   }
+}
 
-      ret = alsa_device_writen(dev, ch_buf, dev->period);
+/* Warm restart of the (linked) pair: handles and negotiated hw/sw params are kept,
+ * only drop/prepare/prefill/start is done. ch_buf shall hold silence.
+ */
+int alsa_device_restart(AlsaDevice_t *dev, void **ch_buf)
+{
+   int ret = (NULL != dev) ? 0 : -EINVAL;
+   uint64_t t = time_getClock_ns();
+
+   if (0 <= ret)
+   {
+      /* linked: drop, prepare and start on playback act on capture as well */
+      ret = snd_pcm_drop(dev->playback_handle);
+#ifndef USE_SND_PCM_LINK
+      (void)snd_pcm_drop(dev->capture_handle);
+#endif
+      t = alsa_device_lap(&dev->restart_us[ALSA_RESTART_DROP], t);
       if (0 > ret)
       {
-         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_writen pre-roll failed, PERIOD1"));
+         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_restart snd_pcm_drop"), DLT_STRING(snd_strerror(ret)));
       }
-//#endif
+   }
 
+   if (0 <= ret)
+   {
+      ret = snd_pcm_prepare(dev->playback_handle);
 #ifndef USE_SND_PCM_LINK
-      /* it seem pcm are already running at this point and start is not needed in link mode.
-       * I assume writen get things rolling. */
-      snd_pcm_start(dev->capture_handle);
+      (void)snd_pcm_prepare(dev->capture_handle);
+#endif
+      t = alsa_device_lap(&dev->restart_us[ALSA_RESTART_PREPARE], t);
+      if (0 > ret)
+      {
+         DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_restart snd_pcm_prepare"), DLT_STRING(snd_strerror(ret)));
+      }
+   }
 
+   if (0 <= ret)
+   {
+      ret = alsa_device_prefill(dev, ch_buf);
+      t = alsa_device_lap(&dev->restart_us[ALSA_RESTART_PREFILL], t);
+   }
+
+   if ((0 <= ret) && (SND_PCM_STATE_PREPARED == snd_pcm_state(dev->playback_handle)))
+   {
+      ret = snd_pcm_start(dev->playback_handle);
+#ifndef USE_SND_PCM_LINK
+      (void)snd_pcm_start(dev->capture_handle);
 #endif
-      snd_pcm_start(dev->playback_handle);
    }
+   t = alsa_device_lap(&dev->restart_us[ALSA_RESTART_START], t);
+   dev->start_ns = time_getBoottime_ns();
+
+   if (0 > ret)
+   {
+      DLT_LOG(dlt_ctxt_audio, DLT_LOG_ERROR, DLT_STRING("alsa_device_restart failed"), DLT_STRING(snd_strerror(ret)));
+   }
+   else
+   {
+      DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("alsa_device_restart us (drop/prepare/prefill/start)"),
+              DLT_UINT32(dev->restart_us[ALSA_RESTART_DROP]),
+              DLT_UINT32(dev->restart_us[ALSA_RESTART_PREPARE]),
+              DLT_UINT32(dev->restart_us[ALSA_RESTART_PREFILL]),
+              DLT_UINT32(dev->restart_us[ALSA_RESTART_START]));
+   }
+
+   return ret;
+}
+
+/* frames between the application pointer and the DAC (play) or ADC (rec), negative on error */
+snd_pcm_sframes_t alsa_device_delay(AlsaDevice_t *dev, uint8_t rec_nPlay)
+{
+   snd_pcm_sframes_t delay = 0;
+   int err = snd_pcm_delay((0 != rec_nPlay) ? dev->capture_handle : dev->playback_handle, &delay);
+
+   return (0 > err) ? err : delay;
+}
+
+/* frames ready to be read (rec) or written (play), no syscall on mmap'ed status */
+snd_pcm_sframes_t alsa_device_avail(AlsaDevice_t *dev, uint8_t rec_nPlay)
+{
+   return snd_pcm_avail_update((0 != rec_nPlay) ? dev->capture_handle : dev->playback_handle);
 }
 
 snd_pcm_state_t alsa_device_state(AlsaDevice_t *dev, uint8_t rec_nPlay)
@@ -588,7 +758,7 @@ void alsa_device_recover(AlsaDevice_t *dev, void **ch_buf, int err)
 #if 0
    snd_pcm_prepare(dev->playback_handle);
 
-   snd_pcm_writen(dev->playback_handle, ch_buf, AUDIO_TEST_PERIOD_SZ_FRAMES);
+   snd_pcm_writen(dev->playback_handle, ch_buf, dev->period);
 
    snd_pcm_start(dev->playback_handle);
 #else
@@ -46,10 +46,41 @@ extern "C"
 {
 #endif
 
+   /* cold open phases, timed in alsa_device_open() */
+   typedef enum
+   {
+      ALSA_PHASE_CAPTURE_OPEN = 0,
+      ALSA_PHASE_CAPTURE_HW,
+      ALSA_PHASE_CAPTURE_SW,
+      ALSA_PHASE_PLAYBACK_OPEN,
+      ALSA_PHASE_PLAYBACK_HW,
+      ALSA_PHASE_PLAYBACK_SW,
+      ALSA_PHASE_LINK,
+      ALSA_PHASE_FDS,
+      //
+      ALSA_OPEN_PHASES
+   } alsa_open_phase_t;
+
+   /* warm restart phases, timed in alsa_device_restart() */
+   typedef enum
+   {
+      ALSA_RESTART_DROP = 0,
+      ALSA_RESTART_PREPARE,
+      ALSA_RESTART_PREFILL,
+      ALSA_RESTART_START,
+      //
+      ALSA_RESTART_PHASES
+   } alsa_restart_phase_t;
+
    typedef struct AlsaDevice_
    {
-      //  int channels;
+      uint32_t open_us[ALSA_OPEN_PHASES];
+      uint32_t restart_us[ALSA_RESTART_PHASES];
+      unsigned int channels;
+      unsigned int rate;
       int period;
+      snd_pcm_uframes_t prefill;   /* silence written before start */
+      uint64_t start_ns;           /* CLOCK_BOOTTIME at last start */
       snd_pcm_t *capture_handle;
       snd_pcm_t *playback_handle;
       int readN, writeN;
@@ -80,6 +111,12 @@ extern "C"
 
    void alsa_device_startn(AlsaDevice_t *dev, void **ch_buf);
 
+   int alsa_device_restart(AlsaDevice_t *dev, void **ch_buf);
+
+   snd_pcm_sframes_t alsa_device_delay(AlsaDevice_t *dev, uint8_t rec_nPlay);
+
+   snd_pcm_sframes_t alsa_device_avail(AlsaDevice_t *dev, uint8_t rec_nPlay);
+
    int alsa_device_nfds(AlsaDevice_t *dev);
 
    void alsa_device_getfds(AlsaDevice_t *dev, struct pollfd *pfds, unsigned int nfds);
@@ -0,0 +1,233 @@
+/*
+ ============================================================================
+ Name        : audio-glitch.c
+ Version     :
+ Copyright   : Closed
+ Description : click / dropout detector run on every captured period
+ ============================================================================
+ */
+#include <string.h>
+
+#include "audio-glitch.h"
+
+DLT_IMPORT_CONTEXT(dlt_ctxt_audio);
+
+static const char *glitch_names[GLITCH_TYPES] = {"zero run", "discontinuity", "repeated block"};
+
+/* the kernels below are plain branchless loops, built with -O3 (see CMakeLists.txt) so they vectorize.
+ * the scalar paths only run once a kernel found something.
+ */
+
+/* number of exact zeros */
+static uint32_t glitch_count_zeros(const int32_t *restrict x, uint32_t n)
+{
+	uint32_t zeros = 0U;
+
+	for (uint32_t i = 0U; i < n; i++)
+	{
+		zeros += (0 == x[i]);
+	}
+
+	return zeros;
+}
+
+/* 2nd order prediction error |x[i] - (2.x[i-1] - x[i-2])|, on 24 bits so it can't overflow */
+static int32_t glitch_prediction_error(const int32_t *restrict x, uint32_t n, int64_t *sum)
+{
+	int64_t s = 0;
+	int32_t m = 0;
+
+	for (uint32_t i = 2U; i < n; i++)
+	{
+		int32_t e = (x[i] >> 8) - 2 * (x[i - 1] >> 8) + (x[i - 2] >> 8);
+
+		e = (e < 0) ? -e : e;
+		s += e;
+		m = (e > m) ? e : m;
+	}
+
+	*sum = s;
+	return m;
+}
+
+/* order sensitive checksum, a plain sum would not see a shuffled block */
+static uint32_t glitch_checksum(const int32_t *restrict x, uint32_t n)
+{
+	uint32_t sum = 0U;
+
+	for (uint32_t i = 0U; i < n; i++)
+	{
+		sum += (uint32_t)x[i] * (2U * i + 1U);
+	}
+
+	return sum;
+}
+
+static void glitch_event(audio_glitch_t *glitch, audio_glitch_type_t type, uint32_t channel, int64_t frame,
+						 uint32_t frames, uint32_t rate, uint64_t capture_ns, int32_t value)
+{
+	/* the period was complete at capture_ns, date the sample from the end of it */
+	uint64_t ts_ns = capture_ns - (uint64_t)(((int64_t)frames - frame) * 1000000000LL / rate);
+
+	glitch->events[type]++;
+
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("glitch:"), DLT_STRING(glitch_names[type]),
+			DLT_STRING("(channel/period/frame/value)"),
+			DLT_UINT32(channel), DLT_UINT64(glitch->periods), DLT_INT64(frame), DLT_INT32(value),
+			DLT_STRING("at us"), DLT_UINT64(ts_ns / 1000U));
+}
+
+static uint32_t glitch_zero_runs(audio_glitch_t *glitch, audio_glitch_ch_t *ch, uint32_t channel, const int32_t *x,
+								 uint32_t zeros, uint32_t frames, uint32_t rate, uint64_t capture_ns, uint8_t report)
+{
+	uint32_t events = 0U;
+	uint32_t run_min = GLITCH_ZERO_RUN_MIN(rate);
+
+	if (0U == zeros)
+	{
+		ch->zero_run = 0U;
+		ch->in_zero_run = 0U;
+	}
+	else
+	{
+		uint32_t first = (zeros == frames) ? (frames - 1U) : 0U;
+
+		/* a full period of zeros only extends the run, no need to walk it */
+		if (zeros == frames)
+		{
+			ch->zero_run += frames - 1U;
+		}
+
+		for (uint32_t i = first; i < frames; i++)
+		{
+			if (0 != x[i])
+			{
+				ch->zero_run = 0U;
+				ch->in_zero_run = 0U;
+			}
+			else if ((run_min <= ++ch->zero_run) && (0U == ch->in_zero_run))
+			{
+				/* report once per run, at its start (which may be in a previous period) */
+				ch->in_zero_run = 1U;
+
+				if (0U != report)
+				{
+					glitch_event(glitch, GLITCH_ZERO_RUN, channel, (int64_t)i + 1 - ch->zero_run, frames, rate, capture_ns, 0);
+					events++;
+				}
+			}
+		}
+	}
+
+	return events;
+}
+
+void audio_glitch_init(audio_glitch_t *glitch, uint32_t channels)
+{
+	memset(glitch, 0, sizeof(*glitch));
+
+	glitch->channels = (AUDIO_TEST_CHANNELS_MAX < channels) ? AUDIO_TEST_CHANNELS_MAX : channels;
+	glitch->holdoff = GLITCH_HOLDOFF_PERIODS;
+}
+
+void audio_glitch_restart(audio_glitch_t *glitch)
+{
+	/* drop the history, it belongs to the previous stream */
+	memset(glitch->ch, 0, sizeof(glitch->ch));
+	glitch->holdoff = GLITCH_HOLDOFF_PERIODS;
+}
+
+uint32_t audio_glitch_process(audio_glitch_t *glitch, void **ch_bufs, uint32_t frames, uint32_t rate, uint64_t capture_ns)
+{
+	uint32_t events = 0U;
+	uint8_t report = (0U == glitch->holdoff);
+
+	if ((2U > frames) || (0U == rate))
+	{
+		return 0U;
+	}
+
+	for (uint32_t c = 0U; c < glitch->channels; c++)
+	{
+		const int32_t *x = (const int32_t *)ch_bufs[c];
+		audio_glitch_ch_t *ch = &glitch->ch[c];
+		uint32_t zeros = glitch_count_zeros(x, frames);
+		uint32_t sum = glitch_checksum(x, frames);
+		int64_t err_sum;
+		int32_t err_max = glitch_prediction_error(x, frames, &err_sum);
+		int32_t e0, e1;
+
+		/* the first two samples are predicted from the end of the previous period */
+		e0 = (x[0] >> 8) - 2 * ch->prev[1] + ch->prev[0];
+		e1 = (x[1] >> 8) - 2 * (x[0] >> 8) + ch->prev[1];
+		e0 = (e0 < 0) ? -e0 : e0;
+		e1 = (e1 < 0) ? -e1 : e1;
+		err_sum += e0 + e1;
+		err_max = (e0 > err_max) ? e0 : err_max;
+		err_max = (e1 > err_max) ? e1 : err_max;
+
+		events += glitch_zero_runs(glitch, ch, c, x, zeros, frames, rate, capture_ns, report);
+
+		if ((0U != report) && (GLITCH_DISCONT_FLOOR < err_max) && ((int64_t)err_max * frames > GLITCH_DISCONT_RATIO * err_sum))
+		{
+			int64_t frame = (e0 == err_max) ? 0 : 1;
+
+			/* locate the click, only now */
+			for (uint32_t i = 2U; (err_max != e0) && (err_max != e1) && (i < frames); i++)
+			{
+				int32_t e = (x[i] >> 8) - 2 * (x[i - 1] >> 8) + (x[i - 2] >> 8);
+
+				if (((e < 0) ? -e : e) == err_max)
+				{
+					frame = i;
+					break;
+				}
+			}
+
+			glitch_event(glitch, GLITCH_DISCONTINUITY, c, frame, frames, rate, capture_ns, err_max);
+			events++;
+		}
+
+		/* silence repeats by nature, the zero run detector covers it */
+		if (zeros != frames)
+		{
+			uint32_t p = 0U;
+
+			while ((p < AUDIO_TEST_PERIODS) && (sum != ch->sums[p]))
+			{
+				p++;
+			}
+
+			if ((0U != report) && (p < AUDIO_TEST_PERIODS) && (0U == ch->repeating))
+			{
+				glitch_event(glitch, GLITCH_REPEATED_BLOCK, c, 0, frames, rate, capture_ns, (int32_t)(p + 1U));
+				events++;
+			}
+
+			ch->repeating = (p < AUDIO_TEST_PERIODS);
+		}
+
+		memmove(&ch->sums[1], &ch->sums[0], sizeof(ch->sums) - sizeof(ch->sums[0]));
+		ch->sums[0] = sum;
+		ch->prev[0] = x[frames - 2U] >> 8;
+		ch->prev[1] = x[frames - 1U] >> 8;
+	}
+
+	glitch->periods++;
+
+	if (0U < glitch->holdoff)
+	{
+		glitch->holdoff--;
+	}
+
+	return events;
+}
+
+void audio_glitch_report(const audio_glitch_t *glitch)
+{
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("glitch detector (periods/channels)"),
+			DLT_UINT64(glitch->periods), DLT_UINT32(glitch->channels),
+			DLT_STRING("zero runs"), DLT_UINT64(glitch->events[GLITCH_ZERO_RUN]),
+			DLT_STRING("discontinuities"), DLT_UINT64(glitch->events[GLITCH_DISCONTINUITY]),
+			DLT_STRING("repeated blocks"), DLT_UINT64(glitch->events[GLITCH_REPEATED_BLOCK]));
+}
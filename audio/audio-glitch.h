@@ -0,0 +1,59 @@
+/*
+ ============================================================================
+ Name        : audio-glitch.h
+ Version     :
+ Copyright   : Closed
+ Description : click / dropout detector run on every captured period
+ ============================================================================
+ */
+#ifndef AUDIO_GLITCH
+#define AUDIO_GLITCH
+#pragma once
+
+#include <stdint.h>
+
+#include "esg-bsp-test.h"
+
+/* a run of exact zeros this long is a dropout: 1ms of samples at the actual rate */
+#define GLITCH_ZERO_RUN_US 1000U
+#define GLITCH_ZERO_RUN_MIN(rate) ((rate) * GLITCH_ZERO_RUN_US / 1000000U)
+/* a click is a 2nd order prediction error this many times above the period average ... */
+#define GLITCH_DISCONT_RATIO 32
+/* ... and above this floor (24 bits scale), so that a quiet input does not trigger on noise */
+#define GLITCH_DISCONT_FLOOR 0x40000
+/* periods skipped after a (re)start, the capture then holds the playback prefill */
+#define GLITCH_HOLDOFF_PERIODS (AUDIO_TEST_PERIODS + 1U)
+
+typedef enum
+{
+	GLITCH_ZERO_RUN = 0,
+	GLITCH_DISCONTINUITY = 1,
+	GLITCH_REPEATED_BLOCK = 2,
+	//
+	GLITCH_TYPES = 3
+} audio_glitch_type_t;
+
+typedef struct
+{
+	int32_t prev[2];						/* last two samples of the previous period (24 bits), for the predictor */
+	uint32_t zero_run;						/* zeros at the end of the previous period */
+	uint8_t in_zero_run;					/* current zero run already reported */
+	uint8_t repeating;						/* last period matched already, a steady periodic source is reported once */
+	uint32_t sums[AUDIO_TEST_PERIODS];		/* checksums of the last periods, a DMA slip replays one of them */
+} audio_glitch_ch_t;
+
+typedef struct
+{
+	uint32_t channels;
+	uint32_t holdoff;
+	uint64_t periods;
+	uint64_t events[GLITCH_TYPES];
+	audio_glitch_ch_t ch[AUDIO_TEST_CHANNELS_MAX];
+} audio_glitch_t;
+
+void audio_glitch_init(audio_glitch_t *glitch, uint32_t channels);
+void audio_glitch_restart(audio_glitch_t *glitch);
+uint32_t audio_glitch_process(audio_glitch_t *glitch, void **ch_bufs, uint32_t frames, uint32_t rate, uint64_t capture_ns);
+void audio_glitch_report(const audio_glitch_t *glitch);
+
+#endif // AUDIO_GLITCH
@@ -0,0 +1,129 @@
+/*
+ ============================================================================
+ Name        : audio-telemetry.c
+ Version     :
+ Copyright   : Closed
+ Description : capture/playback ring buffer occupancy, sampled every loop
+ ============================================================================
+ */
+#include <string.h>
+
+#include "audio-telemetry.h"
+#include "wi_time.h"
+
+DLT_IMPORT_CONTEXT(dlt_ctxt_audio);
+
+static int16_t telemetry_clamp(snd_pcm_sframes_t frames)
+{
+	return (INT16_MAX < frames) ? INT16_MAX : ((INT16_MIN > frames) ? INT16_MIN : (int16_t)frames);
+}
+
+static void telemetry_window_reset(audio_telemetry_t *tel)
+{
+	tel->capture.min = INT16_MAX;
+	tel->capture.max = INT16_MIN;
+	tel->playback.min = INT16_MAX;
+	tel->playback.max = INT16_MIN;
+}
+
+int audio_telemetry_init(audio_telemetry_t *tel)
+{
+	int ret = EXIT_SUCCESS;
+
+	memset(tel, 0, sizeof(*tel));
+
+	tel->records = calloc(AUDIO_TELEMETRY_RECORDS, sizeof(*tel->records));
+	if (NULL == tel->records)
+	{
+		ret = -ENOMEM;
+	}
+
+	tel->start_ns = time_getClock_ns();
+	tel->window_ns = tel->start_ns;
+	telemetry_window_reset(tel);
+
+	return ret;
+}
+
+void audio_telemetry_sample(audio_telemetry_t *tel, AlsaDevice_t *dev)
+{
+	uint64_t now = time_getClock_ns();
+	audio_fill_record_t *rec = &tel->records[tel->head];
+
+	rec->t_us = (uint32_t)((now - tel->start_ns) / 1000U);
+	rec->c_avail = telemetry_clamp(alsa_device_avail(dev, 1 /*rec*/));
+	rec->c_delay = telemetry_clamp(alsa_device_delay(dev, 1 /*rec*/));
+	rec->p_avail = telemetry_clamp(alsa_device_avail(dev, 0 /*play*/));
+	rec->p_delay = telemetry_clamp(alsa_device_delay(dev, 0 /*play*/));
+
+	tel->head = (tel->head + 1U) % AUDIO_TELEMETRY_RECORDS;
+	if (AUDIO_TELEMETRY_RECORDS > tel->count)
+	{
+		tel->count++;
+	}
+	else
+	{
+		tel->dropped++;
+	}
+
+	tel->capture.min = (rec->c_avail < tel->capture.min) ? rec->c_avail : tel->capture.min;
+	tel->capture.max = (rec->c_avail > tel->capture.max) ? rec->c_avail : tel->capture.max;
+	tel->playback.min = (rec->p_delay < tel->playback.min) ? rec->p_delay : tel->playback.min;
+	tel->playback.max = (rec->p_delay > tel->playback.max) ? rec->p_delay : tel->playback.max;
+
+	if ((now - tel->window_ns) >= (AUDIO_TELEMETRY_WINDOW_US * 1000ULL))
+	{
+		DLT_LOG(dlt_ctxt_audio, DLT_LOG_INFO, DLT_STRING("fill (capture avail min/max, playback delay min/max)"),
+				DLT_INT16(tel->capture.min), DLT_INT16(tel->capture.max),
+				DLT_INT16(tel->playback.min), DLT_INT16(tel->playback.max));
+
+		tel->window_ns = now;
+		telemetry_window_reset(tel);
+	}
+}
+
+int audio_telemetry_export(const audio_telemetry_t *tel, const AlsaDevice_t *dev, const char *path)
+{
+	int ret = EXIT_SUCCESS;
+	FILE *f = fopen(path, "wb");
+	audio_fill_header_t hdr = {
+		.magic = AUDIO_TELEMETRY_MAGIC,
+		.version = AUDIO_TELEMETRY_VERSION,
+		.record_size = sizeof(audio_fill_record_t),
+		.rate = dev->rate,
+		.period = dev->period,
+		.buffer = AUDIO_TEST_PERIODS * dev->period,
+		.count = tel->count,
+		.dropped = tel->dropped};
+
+	if (NULL == f)
+	{
+		ret = -errno;
+	}
+	else
+	{
+		/* oldest first: the ring tail when it wrapped, the first record otherwise */
+		uint32_t tail = (AUDIO_TELEMETRY_RECORDS == tel->count) ? tel->head : 0U;
+		uint32_t first_part = (AUDIO_TELEMETRY_RECORDS == tel->count) ? (AUDIO_TELEMETRY_RECORDS - tail) : tel->count;
+
+		if ((1U != fwrite(&hdr, sizeof(hdr), 1, f)) ||
+			(first_part != fwrite(&tel->records[tail], sizeof(audio_fill_record_t), first_part, f)) ||
+			((tel->count - first_part) != fwrite(&tel->records[0], sizeof(audio_fill_record_t), tel->count - first_part, f)))
+		{
+			ret = -EIO;
+		}
+
+		fclose(f);
+	}
+
+	DLT_LOG(dlt_ctxt_audio, DLT_LOG_WARN, DLT_STRING("fill trace (file/records/dropped/ret)"),
+			DLT_STRING(path), DLT_UINT32(tel->count), DLT_UINT32(tel->dropped), DLT_INT32(ret));
+
+	return ret;
+}
+
+void audio_telemetry_free(audio_telemetry_t *tel)
+{
+	free(tel->records);
+	tel->records = NULL;
+}
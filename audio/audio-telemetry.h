@@ -0,0 +1,71 @@
+/*
+ ============================================================================
+ Name        : audio-telemetry.h
+ Version     :
+ Copyright   : Closed
+ Description : capture/playback ring buffer occupancy, sampled every loop
+ ============================================================================
+ */
+#ifndef AUDIO_TELEMETRY
+#define AUDIO_TELEMETRY
+#pragma once
+
+#include <stdint.h>
+
+#include "alsa-device.h"
+
+/* bounded history, oldest samples are overwritten (~10 minutes at 50 loops/s) */
+#define AUDIO_TELEMETRY_RECORDS 32768U
+/* min/max reporting window */
+#define AUDIO_TELEMETRY_WINDOW_US 1000000U
+
+#define AUDIO_TELEMETRY_MAGIC 0x46475345U /* "ESGF" */
+#define AUDIO_TELEMETRY_VERSION 1U
+
+/* one sample, in frames; negative values are alsa errors (e.g. -EPIPE on x-run) */
+typedef struct __attribute__((packed))
+{
+	uint32_t t_us;			/* since telemetry start, CLOCK_MONOTONIC */
+	int16_t c_avail;		/* capture: frames ready to be read, growing toward the buffer size means overrun */
+	int16_t c_delay;
+	int16_t p_avail;
+	int16_t p_delay;		/* playback: frames queued for the DAC, falling toward 0 means underrun */
+} audio_fill_record_t;
+
+/* trace file header, followed by 'count' records, oldest first */
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t rate;
+	uint32_t period;
+	uint32_t buffer;
+	uint32_t count;
+	uint32_t dropped;		/* overwritten by the ring */
+} audio_fill_header_t;
+
+typedef struct
+{
+	int16_t min;
+	int16_t max;
+} audio_fill_range_t;
+
+typedef struct
+{
+	uint64_t start_ns;
+	uint64_t window_ns;
+	uint32_t head;
+	uint32_t count;
+	uint32_t dropped;
+	audio_fill_range_t capture;		/* avail over the window */
+	audio_fill_range_t playback;	/* delay over the window */
+	audio_fill_record_t *records;
+} audio_telemetry_t;
+
+int audio_telemetry_init(audio_telemetry_t *tel);
+void audio_telemetry_sample(audio_telemetry_t *tel, AlsaDevice_t *dev);
+int audio_telemetry_export(const audio_telemetry_t *tel, const AlsaDevice_t *dev, const char *path);
+void audio_telemetry_free(audio_telemetry_t *tel);
+
+#endif // AUDIO_TELEMETRY
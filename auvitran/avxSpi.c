@@ -30,6 +30,187 @@ static int avx_read_mailbox_byte(avx_device *dev, int slot, int page, int offset
 static int avx_wait_mailbox_completion(avx_device *dev);
 static int avx_wait_flash_completion(avx_device *dev, int slot, int page_fppr);
 
+/* One logical operation (page select, command, NOP read ...) built as a list of segments,
+ * sent in a single SPI_IOC_MESSAGE(N) when batching, one ioctl per segment otherwise.
+ * Sized for the largest chain: page select + 32 bytes burst + ECS + CMD.
+ * The bytes live in the locked buffer of the device, each segment has both a TX and a
+ * RX buffer at the same offset of its half: the driver never needs a dummy one.
+ */
+#define AVX_BATCH_BYTES 64U
+#define AVX_DMA_BYTES (2U * AVX_BATCH_BYTES)
+
+/* Between a command and its NOP read. One ioctl per segment left the rack a syscall turnaround
+ * (some 10us at least) to prepare its answer, a batch chains them back to back: this restores
+ * that gap on the bus. An answer still not ready is caught by avx_check_answer(), which reads again.
+ */
+#define AVX_READ_DELAY_US 10U
+
+typedef struct
+{
+   spi_seg_t segs[SPI_SEGS_MAX];
+   uint32_t nb;
+   size_t used;
+   uint8_t *tx;
+   uint8_t *rx;
+} avx_batch_t;
+
+static void avx_batch_init(avx_batch_t *batch, avx_device *dev)
+{
+   batch->nb = 0U;
+   batch->used = 0U;
+   batch->tx = dev->dma;
+   batch->rx = dev->dma + AVX_BATCH_BYTES;
+}
+
+//==============================================================================
+//! \brief Append a segment to a batch
+//!
+//! \param  batch: batch being built
+//! \param  len: segment length
+//! \param  read: true for a NOP word read (zeros out, data in), false for a write (data out, ignored in)
+//! \return zeroed buffer to fill (write) or to read once flushed, NULL if the batch is full
+//==============================================================================
+static uint8_t *avx_batch_seg(avx_batch_t *batch, size_t len, bool read)
+{
+   uint8_t *buff = NULL;
+
+   if ((SPI_SEGS_MAX > batch->nb) && (AVX_BATCH_BYTES >= (batch->used + len)))
+   {
+      spi_seg_t *seg = &batch->segs[batch->nb++];
+
+      bzero(&batch->tx[batch->used], len);
+      bzero(&batch->rx[batch->used], len);
+      buff = read ? &batch->rx[batch->used] : &batch->tx[batch->used];
+
+      seg->tx = &batch->tx[batch->used];
+      seg->rx = &batch->rx[batch->used];
+      seg->len = len;
+      seg->delay_us = 0U;
+      batch->used += len;
+
+      if (read && (1U < batch->nb))
+      {
+         batch->segs[batch->nb - 2U].delay_us = AVX_READ_DELAY_US;
+      }
+   }
+
+   return buff;
+}
+
+//==============================================================================
+//! \brief Append a (burst) write, preceded by the page select when page != 0
+//!
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+static int avx_batch_write(avx_batch_t *batch, int page, int offset, const uint8_t *data, size_t length)
+{
+   uint8_t *tx;
+
+   if (page != 0)
+   {
+      // 1st, write target page to the proper register
+      tx = avx_batch_seg(batch, 2, false);
+      if (NULL == tx)
+      {
+         return -ENOMEM;
+      }
+
+      tx[0] = (UNITARY_WRITE | (REG_PAGE & OFFSET_MASK)) & ~PAGE0_BIT;
+      tx[1] = page;
+   }
+
+   // +1 for 'command'
+   tx = avx_batch_seg(batch, length + 1, false);
+   if (NULL == tx)
+   {
+      return -ENOMEM;
+   }
+
+   tx[0] = UNITARY_WRITE | (offset & OFFSET_MASK);
+   tx[0] = (page == 0) ? (tx[0] & ~PAGE0_BIT) : (tx[0] | PAGE0_BIT);
+   memcpy(tx + 1, data, length);
+
+   return 0;
+}
+
+//==============================================================================
+//! \brief Send a batch
+//!
+//! \return ioctl result (> 0) in case of success, or negative errno error code
+//==============================================================================
+static int avx_batch_flush(avx_device *dev, const avx_batch_t *batch)
+{
+   int ret = -EINVAL;
+
+   errno = 0;
+
+   if (dev->batching)
+   {
+      ret = spi_transfer_segs(&dev->spi_dev, batch->segs, batch->nb);
+   }
+   else
+   {
+      for (uint32_t i = 0U; i < batch->nb; i++)
+      {
+         ret = spi_transfer(&dev->spi_dev, batch->segs[i].tx, batch->segs[i].rx, batch->segs[i].len);
+         if (0 > ret)
+         {
+            break;
+         }
+      }
+   }
+
+   /* a failed ioctl gives -1 and errno, spi_transfer_segs() its own negative errno (-EINVAL, -EMSGSIZE) */
+   if (-1 == ret)
+   {
+      ret = (0 != errno) ? -errno : -EIO;
+   }
+
+   if (0 > ret)
+   {
+      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err/segments)"), DLT_INT32(ret), DLT_UINT32(batch->nb));
+   }
+
+   return ret;
+}
+
+//==============================================================================
+//! \brief Check the 2 bytes answer of a NOP read, read once more if not yet valid
+//!
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+static int avx_check_answer(avx_device *dev, uint8_t *buff)
+{
+   int ret;
+
+   // Getting all 1s shows the rack is not connected
+   if ((buff[0] == 0xFF) && (buff[1] == 0xFF))
+   {
+      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer, rack is not connected"));
+      return -ENODEV;
+   }
+
+   if (buff[0] == 0)
+   {
+      // Data not valid: read once again through a 16b NOP word, the zeros of its TX twin
+      ret = spi_transfer(&dev->spi_dev, buff - AVX_BATCH_BYTES, buff, 2);
+      if (ret == -1)
+      {
+         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
+         return -errno;
+      }
+
+      if (buff[0] == 0)
+      {
+         // Still invalid: give up
+         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Invalid read from SPI"));
+         return -EINVAL;
+      }
+   }
+
+   return 0;
+}
+
 //==============================================================================
 //! \brief Function to initialize the SPI bus
 //!
@@ -42,10 +223,21 @@ int avx_init(avx_device *dev, char *dev_path)
    uint8_t sr1 = 0;
    int ret = EXIT_SUCCESS;
 
-   ret = spi_init(&dev->spi_dev, dev_path, AVX_SPI_HIGH_SPEED, SPI_MODE_3);
-   if (0 > ret)
+   dev->batching = true;
+
+   dev->dma = spi_buf_alloc(AVX_DMA_BYTES);
+   if (NULL == dev->dma)
+   {
+      ret = -ENOMEM;
+   }
+
+   if (EXIT_SUCCESS == ret)
    {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed to initialize SPI device"));
+      ret = spi_init(&dev->spi_dev, dev_path, AVX_SPI_HIGH_SPEED, SPI_MODE_3);
+      if (0 > ret)
+      {
+         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed to initialize SPI device"));
+      }
    }
 
    /* Read SR1 register */
@@ -78,6 +270,8 @@ int avx_init(avx_device *dev, char *dev_path)
 void avx_terminate(avx_device *dev)
 {
    spi_close(&dev->spi_dev);
+   spi_buf_free(dev->dma, AVX_DMA_BYTES);
+   dev->dma = NULL;
 }
 
 //==============================================================================
@@ -91,35 +285,22 @@ void avx_terminate(avx_device *dev)
 //==============================================================================
 int avx_write_byte(avx_device *dev, int page, int offset, uint8_t data)
 {
-   uint8_t tx_buff[2];
+   avx_batch_t batch;
    int ret;
 
-   tx_buff[0] = UNITARY_WRITE | (offset & OFFSET_MASK);
+   avx_batch_init(&batch, dev);
 
-   if (page == 0)
+   // page select and data write in one go
+   ret = avx_batch_write(&batch, page, offset, &data, 1);
+   if (0 == ret)
    {
-      tx_buff[0] &= ~PAGE0_BIT;
+      ret = avx_batch_flush(dev, &batch);
    }
-   else
-   {
-      // 1st, write target page to the proper register
-      ret = avx_write_byte(dev, PAGE_0, REG_PAGE, page);
-      if (ret < 0)
-      {
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed changing (page/err"), DLT_HEX32(page), DLT_UINT32(errno));
-         return ret;
-      }
-
-      tx_buff[0] |= PAGE0_BIT;
-   }
-
-   tx_buff[1] = data;
 
-   ret = spi_transfer(&dev->spi_dev, tx_buff, NULL, sizeof(tx_buff));
-   if (ret == -1)
+   if (0 > ret)
    {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-      return errno;
+      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed writing byte (page/offset/err)"), DLT_HEX32(page), DLT_HEX32(offset), DLT_INT32(ret));
+      return ret;
    }
 
    return 0;
@@ -136,48 +317,30 @@ int avx_write_byte(avx_device *dev, int page, int offset, uint8_t data)
 //==============================================================================
 int avx_read_byte(avx_device *dev, int page, int offset, uint8_t *data)
 {
-   uint8_t buff[2];
+   avx_batch_t batch;
+   uint8_t *tx;
+   uint8_t *buff;
+   int check;
    int ret;
 
-   buff[0] = UNITARY_READ | (offset & OFFSET_MASK);
-   buff[1] = page & 0xFF;
-   ret = spi_transfer(&dev->spi_dev, buff, NULL, sizeof(buff));
-   if (ret == -1)
-   {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-      return errno;
-   }
+   avx_batch_init(&batch, dev);
 
-   ret = spi_transfer(&dev->spi_dev, NULL, buff, sizeof(buff));
-   if (ret == -1)
-   {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-      return errno;
-   }
+   // command, then the answer through a 16b NOP word
+   tx = avx_batch_seg(&batch, 2, false);
+   tx[0] = UNITARY_READ | (offset & OFFSET_MASK);
+   tx[1] = page & 0xFF;
+   buff = avx_batch_seg(&batch, 2, true);
 
-   // Getting all 1s shows the rack is not connected
-   if ((buff[0] == 0xFF) && (buff[1] == 0xFF))
+   ret = avx_batch_flush(dev, &batch);
+   if (0 > ret)
    {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer, rack is not connected"));
-      return -ENODEV;
+      return ret;
    }
 
-   if (buff[0] == 0)
+   check = avx_check_answer(dev, buff);
+   if (0 > check)
    {
-      // Data not valid: read once again through a 16b NOP word
-      ret = spi_transfer(&dev->spi_dev, NULL, buff, sizeof(buff));
-      if (ret == -1)
-      {
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-         return errno;
-      }
-
-      if (buff[0] == 0)
-      {
-         // Still invalid: give up
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Invalid read from SPI"));
-         return -EINVAL;
-      }
+      return check;
    }
 
    *data = buff[1];
@@ -228,66 +391,38 @@ int avx_test_and_reset(avx_device *dev, int page, int offset, uint8_t mask, uint
 //==============================================================================
 int avx_test_and_toggle(avx_device *dev, uint8_t command, int page, int offset, uint8_t mask, uint8_t *data)
 {
-   uint8_t buff[2];
+   avx_batch_t batch;
+   uint8_t *tx;
+   uint8_t *buff;
    int ret;
 
-   buff[0] = TEST_AND_SET | (offset & OFFSET_MASK);
-   buff[1] = mask;
+   avx_batch_init(&batch, dev);
 
-   if (page == 0)
-   {
-      buff[0] &= ~PAGE0_BIT;
-   }
-   else
+   if (page != 0)
    {
       // 1st, write target page to the proper register
-      ret = avx_write_byte(dev, PAGE_0, REG_PAGE, page);
-      if (ret < 0)
-      {
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed changing (page/err)"), DLT_HEX32(page), DLT_UINT32(ret));
-         return ret;
-      }
-
-      buff[0] |= PAGE0_BIT;
+      tx = avx_batch_seg(&batch, 2, false);
+      tx[0] = (UNITARY_WRITE | (REG_PAGE & OFFSET_MASK)) & ~PAGE0_BIT;
+      tx[1] = page;
    }
 
-   ret = spi_transfer(&dev->spi_dev, buff, NULL, sizeof(buff));
-   if (ret == -1)
-   {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-      return errno;
-   }
+   tx = avx_batch_seg(&batch, 2, false);
+   tx[0] = command | (offset & OFFSET_MASK);
+   tx[0] = (page == 0) ? (tx[0] & ~PAGE0_BIT) : (tx[0] | PAGE0_BIT);
+   tx[1] = mask;
 
-   ret = spi_transfer(&dev->spi_dev, NULL, buff, sizeof(buff));
-   if (ret == -1)
-   {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-      return errno;
-   }
+   buff = avx_batch_seg(&batch, 2, true);
 
-   // Getting all 1s shows the rack is not connected
-   if ((buff[0] == 0xFF) && (buff[1] == 0xFF))
+   ret = avx_batch_flush(dev, &batch);
+   if (0 > ret)
    {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer, rack is not connected"));
-      return -ENODEV;
+      return ret;
    }
 
-   if (buff[0] == 0)
+   ret = avx_check_answer(dev, buff);
+   if (0 > ret)
    {
-      // Data not valid: read once again through a 16b NOP word
-      ret = spi_transfer(&dev->spi_dev, NULL, buff, sizeof(buff));
-      if (ret == -1)
-      {
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-         return errno;
-      }
-
-      if (buff[0] == 0)
-      {
-         // Still invalid: give up
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Invalid read from SPI"));
-         return -EINVAL;
-      }
+      return ret;
    }
 
    *data = buff[1];
@@ -307,8 +442,7 @@ int avx_test_and_toggle(avx_device *dev, uint8_t command, int page, int offset,
 //==============================================================================
 int avx_write_burst(avx_device *dev, int page, int offset, const uint8_t *data, size_t length)
 {
-   // +1 for 'command'
-   uint8_t tx_buff[length + 1];
+   avx_batch_t batch;
    int ret;
 
    if (!dev->burst_support)
@@ -317,35 +451,68 @@ int avx_write_burst(avx_device *dev, int page, int offset, const uint8_t *data,
       return -ENOSYS;
    }
 
-   tx_buff[0] = UNITARY_WRITE | (offset & OFFSET_MASK);
+   if (length > AXC_PAGE_SIZE)
+   {
+      return -EINVAL;
+   }
 
-   if (page == 0)
+   avx_batch_init(&batch, dev);
+
+   ret = avx_batch_write(&batch, page, offset, data, length);
+   if (0 == ret)
    {
-      tx_buff[0] &= ~PAGE0_BIT;
+      ret = avx_batch_flush(dev, &batch);
    }
-   else
+
+   return (0 > ret) ? ret : 0;
+}
+
+//==============================================================================
+//! \brief Write the mailbox ECS (and MOV) then CMD registers, in a single transaction
+//!
+//! \param  dev: pointer to the avx_device structure to be used
+//! \param  ecs: ECS[0..] and MOV[0] bytes
+//! \param  ecs_len: 1 to 3
+//! \param  cmd: CMD[0] and CMD[1]
+//! \param  data: optional page 2 contents, written first (NULL if none)
+//! \param  length: size of data
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+static int avx_mailbox_command(avx_device *dev, const uint8_t *ecs, size_t ecs_len, const uint8_t *cmd, const uint8_t *data, size_t length)
+{
+   avx_batch_t batch;
+   int ret = EXIT_SUCCESS;
+
+   if (!dev->burst_support)
    {
-      // 1st, write target page to the proper register
-      ret = avx_write_byte(dev, PAGE_0, REG_PAGE, page);
-      if (ret < 0)
-      {
-         DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed changing (page/err)"), DLT_HEX32(page), DLT_UINT32(ret));
-         return ret;
-      }
+      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Burst write not supported"));
+      return -ENOSYS;
+   }
 
-      tx_buff[0] |= PAGE0_BIT;
+   avx_batch_init(&batch, dev);
+
+   if (NULL != data)
+   {
+      // Write data to page 2
+      ret = avx_batch_write(&batch, PAGE_2, 0, data, length);
    }
 
-   memcpy(tx_buff + 1, data, length);
+   if (0 == ret)
+   {
+      ret = avx_batch_write(&batch, PAGE_0, REG_MBX_ECS_0, ecs, ecs_len);
+   }
 
-   ret = spi_transfer(&dev->spi_dev, tx_buff, NULL, sizeof(tx_buff));
-   if (ret == -1)
+   if (0 == ret)
    {
-      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed SPI transfer (err)"), DLT_UINT32(errno));
-      return errno;
+      ret = avx_batch_write(&batch, PAGE_0, REG_MBX_CMD_0, cmd, 2);
    }
 
-   return 0;
+   if (0 == ret)
+   {
+      ret = avx_batch_flush(dev, &batch);
+   }
+
+   return (0 > ret) ? ret : 0;
 }
 
 //==============================================================================
@@ -361,8 +528,8 @@ int avx_write_burst(avx_device *dev, int page, int offset, const uint8_t *data,
 int avx_read_burst(avx_device *dev, int page, int offset, uint8_t *data, size_t length)
 {
    // +2 for 'command' and +1 for STATUS byte
-   uint8_t tx_buff[length + 3];
-   uint8_t rx_buff[length + 3];
+   uint8_t *tx_buff = dev->dma;
+   uint8_t *rx_buff = dev->dma + AVX_BATCH_BYTES;
    int ret;
 
    if (!dev->burst_support)
@@ -371,11 +538,16 @@ int avx_read_burst(avx_device *dev, int page, int offset, uint8_t *data, size_t
       return -ENOSYS;
    }
 
+   if (length > AXC_PAGE_SIZE)
+   {
+      return -EINVAL;
+   }
+
    // 1st, send command and get status
    tx_buff[0] = UNITARY_READ | (offset & OFFSET_MASK);
    tx_buff[1] = page & 0xFF;
    bzero(tx_buff + 2, length + 1);
-   bzero(rx_buff, sizeof(rx_buff));
+   bzero(rx_buff, length + 3);
    ret = spi_transfer(&dev->spi_dev, tx_buff, rx_buff, length + 2 + 1);
    if (0 > ret)
    {
@@ -423,16 +595,11 @@ int32_t avx_write_mailbox_byte(avx_device *dev, int slot, int page, int offset,
    ecs[0] &= ~MBX_MOV;
    ecs[0] |= MBX_WP0;
    ecs[1] = page;
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_ECS_0, ecs, sizeof(ecs));
-   if (ret != 0)
-   {
-      return ret;
-   }
 
    // CMD
    cmd[0] = data;
    cmd[1] = (MBX_WRITE_PAGED << OFFSET_LENGTH) | (offset & OFFSET_MASK);
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_CMD_0, cmd, sizeof(cmd));
+   ret = avx_mailbox_command(dev, ecs, sizeof(ecs), cmd, NULL, 0);
    if (ret != 0)
    {
       return ret;
@@ -495,12 +662,6 @@ int32_t avx_write_mailbox(avx_device *dev, int slot, int page, int offset, const
       return avx_write_mailbox_byte(dev, slot, page, offset, data[0]);
    }
 
-   if (0 <= ret)
-   {
-      // Write data to page 2
-      ret = avx_write_burst(dev, PAGE_2, 0, data, length);
-   }
-
    if (0 <= ret)
    {
       // ECS[0], ECS[1] and MOV[0] : page , slot and flags (WP0=1, MOV=1)
@@ -509,15 +670,13 @@ int32_t avx_write_mailbox(avx_device *dev, int slot, int page, int offset, const
       config[0] |= MBX_WP0;
       config[1] = page;
       config[2] = length - 1;
-      ret = avx_write_burst(dev, PAGE_0, REG_MBX_ECS_0, config, sizeof(config));
-   }
 
-   if (0 <= ret)
-   {
       // CMD
       cmd[0] = 0;
       cmd[1] = (MBX_WRITE_PAGED << OFFSET_LENGTH) | (offset & OFFSET_MASK);
-      ret = avx_write_burst(dev, PAGE_0, REG_MBX_CMD_0, cmd, sizeof(cmd));
+
+      // data to page 2, ECS and CMD in one transaction
+      ret = avx_mailbox_command(dev, config, sizeof(config), cmd, data, length);
    }
 
    if (0 <= ret)
@@ -561,16 +720,11 @@ int avx_read_mailbox_byte(avx_device *dev, int slot, int page, int offset, uint8
    // ECS[0] : slot and flags (WP0=0, MOV=0)
    ecs = slot & SLOT_MASK;
    ecs &= ~(MBX_WP0 & MBX_MOV);
-   ret = avx_write_byte(dev, PAGE_0, REG_MBX_ECS_0, ecs);
-   if (0 > ret)
-   {
-      return ret;
-   }
 
    // CMD[0] and CMD[1]
    cmd[0] = page;
    cmd[1] = (MBX_READ_PAGED << OFFSET_LENGTH) | (offset & OFFSET_MASK);
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_CMD_0, cmd, sizeof(cmd));
+   ret = avx_mailbox_command(dev, &ecs, sizeof(ecs), cmd, NULL, 0);
    if (0 >ret)
    {
       return ret;
@@ -635,16 +789,11 @@ int avx_read_mailbox(avx_device *dev, int slot, int page, int offset, uint8_t *d
    config[0] |= MBX_WP0;
    config[1] = page;
    config[2] = length - 1;
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_ECS_0, config, sizeof(config));
-   if (0 > ret)
-   {
-      return ret;
-   }
 
    // CMD[0] and CMD[1]
    cmd[0] = 0;
    cmd[1] = (MBX_READ_PAGED << OFFSET_LENGTH) | (offset & OFFSET_MASK);
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_CMD_0, cmd, sizeof(cmd));
+   ret = avx_mailbox_command(dev, config, sizeof(config), cmd, NULL, 0);
    if (0 > ret)
    {
       return ret;
@@ -710,16 +859,11 @@ int avx_test_and_toggle_mailbox(avx_device *dev, uint8_t command, int slot, int
    ecs[0] &= ~MBX_MOV;
    ecs[0] |= MBX_WP0;
    ecs[1] = page;
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_ECS_0, ecs, sizeof(ecs));
-   if (0 > ret)
-   {
-      return ret;
-   }
 
    // CMD
    cmd[0] = mask;
    cmd[1] = (command << OFFSET_LENGTH) | (offset & OFFSET_MASK);
-   ret = avx_write_burst(dev, PAGE_0, REG_MBX_CMD_0, cmd, sizeof(cmd));
+   ret = avx_mailbox_command(dev, ecs, sizeof(ecs), cmd, NULL, 0);
    if (0 > ret)
    {
       return ret;
@@ -25,6 +25,12 @@ typedef struct {
    bool fast_support;
    bool mbox_support;
 
+   /* chain the segments of one operation in a single ioctl (default), or one ioctl each */
+   bool batching;
+
+   /* TX then RX halves of every transfer, spi_buf_alloc()'ed by avx_init() */
+   uint8_t *dma;
+
 } avx_device;
 
 // Note: we don't define all existing page types here
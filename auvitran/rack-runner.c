@@ -4,8 +4,54 @@
 /*
  * See README
  */
+#include <unistd.h>
+#include <sys/prctl.h>
+
 #include "esg-bsp-test.h"
 #include "rackAuvitran.h"
+#include "esg-stats.h"
+#include "tdma-sched.h"
+
+/* SPI cost of one peak-meter read, [0] one ioctl per segment, [1] batched */
+typedef struct
+{
+	esg_stats_t ioctls;
+	esg_stats_t bus_us;
+} rack_op_cost_t;
+
+static rack_op_cost_t vumeter_cost[2];
+static tdma_sched_t rack_sched;
+
+static int rack_runner_read_vumeter(bool batching)
+{
+	int vu_pre, vu_post;
+	uint32_t ioctls_0, ioctls_1;
+	uint64_t bus_ns_0, bus_ns_1;
+	int ret;
+
+	rack_set_batching(batching);
+
+	rack_get_spi_counters(&ioctls_0, &bus_ns_0);
+	ret = rack_get_vumeter(IN, 1, &vu_pre, &vu_post);
+	rack_get_spi_counters(&ioctls_1, &bus_ns_1);
+
+	esg_stats_add(&vumeter_cost[batching].ioctls, ioctls_1 - ioctls_0);
+	esg_stats_add(&vumeter_cost[batching].bus_us, (int64_t)(bus_ns_1 - bus_ns_0) / 1000);
+
+	DLT_LOG(dlt_ctxt_rack, DLT_LOG_DEBUG, DLT_STRING("vumeter in 1 (pre/post)"), DLT_INT(vu_pre), DLT_INT(vu_post));
+
+	return ret;
+}
+
+static void rack_runner_cost_report(const char *name, const rack_op_cost_t *cost)
+{
+	if (0U < cost->ioctls.count)
+	{
+		DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("vumeter read cost"), DLT_STRING(name), DLT_UINT32(cost->ioctls.count),
+				DLT_STRING("ioctls (min/avg/max)"), DLT_INT64(cost->ioctls.min), DLT_INT64(esg_stats_avg(&cost->ioctls)), DLT_INT64(cost->ioctls.max),
+				DLT_STRING("us (min/avg/max)"), DLT_INT64(cost->bus_us.min), DLT_INT64(esg_stats_avg(&cost->bus_us)), DLT_INT64(cost->bus_us.max));
+	}
+}
 
 static void *rack_runner(void *p_data)
 {
@@ -23,11 +69,45 @@ static void *rack_runner(void *p_data)
 		uint32_t nb_loops = settings->nb_loops;
 
 		DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("START"), DLT_UINT32(nb_loops));
+		/* names its slot of the spi profile */
+		(void)prctl(PR_SET_NAME, "rack", 0, 0, 0);
+
+		for (uint32_t i = 0U; i < 2U; i++)
+		{
+			esg_stats_reset(&vumeter_cost[i].ioctls);
+			esg_stats_reset(&vumeter_cost[i].bus_us);
+		}
+
+		/* on the same grid as the stm32 cycles, see --tdma-phase */
+		if (0U < settings->rack_freq)
+		{
+			tdma_sched_init(&rack_sched, 1000000000ULL / settings->rack_freq, 0U);
+		}
 
 		while ((0 < nb_loops--) && (EXIT_SUCCESS == ret))
 		{
 			DLT_LOG(dlt_ctxt_rack, DLT_LOG_DEBUG, DLT_STRING("rack_runner"), DLT_UINT32(nb_loops));
 
+			/* peak-meters at the --rack frequency, alternately unbatched and batched with --rack-compare */
+			if (0U < settings->rack_freq)
+			{
+				ret = tdma_sched_wait(&rack_sched);
+
+				if (EXIT_SUCCESS == ret)
+				{
+					ret = rack_runner_read_vumeter((0U == settings->rack_compare) || (0U != (nb_loops & 1U)));
+				}
+
+				tdma_sched_done(&rack_sched);
+			}
+		}
+
+		rack_runner_cost_report("one ioctl per segment", &vumeter_cost[0]);
+		rack_runner_cost_report("batched", &vumeter_cost[1]);
+
+		if (0U < settings->rack_freq)
+		{
+			tdma_sched_report("rack", &rack_sched);
 		}
 	}
 
@@ -52,7 +132,7 @@ int rack_runner_init(pthread_t *runner, ebt_settings_t *settings)
 	{
 		DLT_REGISTER_CONTEXT_LL_TS(dlt_ctxt_rack, "RACK", "AUVITRAN Rack Context", settings->verbosity, DLT_TRACE_STATUS_DEFAULT);
 
-		ret = rack_initialize();
+		ret = rack_initialize(settings->sched_rt);
 	}
 
 	if (EXIT_SUCCESS == ret)
@@ -19,11 +19,13 @@
 #include <string.h>
 #include <unistd.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "rackAuvitran.h"
 
 #include "avxSpi.h"
 #include "avxDefs.h"
+#include "esg-spidev-exec.h"
 
 DLT_DECLARE_CONTEXT(dlt_ctxt_rack);
 
@@ -38,11 +40,80 @@ typedef struct
    avx_device avx_device;
    slot_info_t slots[MAX_SLOT_NUMBERS];
 
+   /* owns the rack spidev once initialized, the rack API runs on it */
+   spi_exec_t exec;
+
 } rackinfo_t;
 
 // Task state and variables
 static rackinfo_t RackAuvitran;
 
+/* read held by each rack API call, written by rack_release(): the device is not freed under a call */
+static pthread_rwlock_t RackReleaseLock = PTHREAD_RWLOCK_INITIALIZER;
+
+/* parameters of one rack API call, run as a transaction on the bus owning thread */
+typedef struct
+{
+   direction_t direction;
+   int channel;
+   float gain;
+   float *p_gain;
+   uint8_t pad_level;
+   uint8_t *p_pad_level;
+   int *vu_pre;
+   int *vu_post;
+   sampling_rate_t sampling_rate;
+   int product_id_in;
+   int channel_in;
+   int product_id_out;
+   int channel_out;
+   bool enable_nMute;
+   /* raw mailbox access */
+   int slot;
+   int page;
+   int offset;
+   uint8_t *data;
+   uint8_t *data_ext;
+   size_t length;
+} rack_call_t;
+
+static const uint32_t rack_deadlines_us[SPI_EXEC_CLASSES] = {
+   SPI_EXEC_DEADLINE_URGENT_US,
+   SPI_EXEC_DEADLINE_CONTROL_US,
+   SPI_EXEC_DEADLINE_BULK_US,
+};
+
+static int32_t rack_exec(spi_exec_class_t cls, spi_exec_fn_t fn, rack_call_t *call)
+{
+   int32_t ret = -ENODEV;
+
+   pthread_rwlock_rdlock(&RackReleaseLock);
+
+   /* not initialized (no --rack), or released */
+   if (NULL != RackAuvitran.avx_device.dma)
+   {
+      ret = spi_exec_run(&RackAuvitran.exec, cls, rack_deadlines_us[cls], fn, call);
+   }
+
+   pthread_rwlock_unlock(&RackReleaseLock);
+
+   return ret;
+}
+
+static int rack_read_mailbox_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return avx_read_mailbox(&RackAuvitran.avx_device, call->slot, call->page, call->offset, call->data, call->length);
+}
+
+static int rack_write_mailbox_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return avx_write_mailbox(&RackAuvitran.avx_device, call->slot, call->page, call->offset, call->data, call->length);
+}
+
 //==============================================================================
 //! \brief Find page address for a given slot and page type
 //!
@@ -257,7 +328,7 @@ int discover_slot(int slot)
      sampling_rate = FREQ_96k;*/
 
 //==============================================================================
-int32_t rack_set_sampling_rate(sampling_rate_t sampling_rate)
+static int32_t rack_do_set_sampling_rate(sampling_rate_t sampling_rate)
 {
    int32_t ret;
    int page;
@@ -302,6 +373,42 @@ int32_t rack_set_sampling_rate(sampling_rate_t sampling_rate)
    return ret;
 }
 
+//==============================================================================
+//! \brief Set sampling rate for the rack, given in Hz
+//! \param rate_hz: 44100, 48000, 88200 or 96000
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int32_t rack_set_sampling_rate_hz(uint32_t rate_hz)
+{
+   int32_t ret;
+
+   switch (rate_hz)
+   {
+   case 44100U:
+      ret = rack_set_sampling_rate(FREQ_44_1k);
+      break;
+
+   case 48000U:
+      ret = rack_set_sampling_rate(FREQ_48k);
+      break;
+
+   case 88200U:
+      ret = rack_set_sampling_rate(FREQ_88_2k);
+      break;
+
+   case 96000U:
+      ret = rack_set_sampling_rate(FREQ_96k);
+      break;
+
+   default:
+      DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Unsupported rack sampling rate (Hz)"), DLT_UINT32(rate_hz));
+      ret = -EINVAL;
+      break;
+   }
+
+   return ret;
+}
+
 //==============================================================================
 //! \brief Apply default parameters (such as gain, etc...) to the slots we
 //!        discovered in the rack.
@@ -344,7 +451,7 @@ static int32_t initialize_default_parameters(void)
 //! \param channel_out: Channel for the output, within range of output card
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_matrix_set(int product_id_in, int channel_in, int product_id_out, int channel_out, bool enable_nMute)
+static int32_t rack_do_matrix_set(int product_id_in, int channel_in, int product_id_out, int channel_out, bool enable_nMute)
 {
    int32_t ret = EXIT_SUCCESS;
    int page_mxpr, page_out;
@@ -425,14 +532,18 @@ int32_t rack_matrix_set(int product_id_in, int channel_in, int product_id_out, i
 //==============================================================================
 //! \brief task start function
 //!
-//! \param  startData: unused
+//! Discovers the rack from the calling thread, then hands the bus over to its
+//! executor thread.
+//!
+//! \param  exec_priority: SCHED_FIFO priority of the bus owning thread, 0 to inherit
 //! \return none
 //==============================================================================
-uint32_t rack_initialize(void)
+uint32_t rack_initialize(int exec_priority)
 {
    uint8_t PIR = 0;
    int slot;
    uint32_t ret = avx_init(&RackAuvitran.avx_device, RACK_SPIDEV);
+   spi_dev_t *spi = &RackAuvitran.avx_device.spi_dev;
 
    if (0 > ret)
    {
@@ -492,6 +603,14 @@ uint32_t rack_initialize(void)
       DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("rack_initialize failed (errno)"), DLT_INT(ret));
    }
 
+   DLT_LOG(dlt_ctxt_rack, DLT_LOG_INFO, DLT_STRING("rack_initialize cost (ioctls/bytes/us)"),
+           DLT_UINT32(spi->ioctls), DLT_UINT64(spi->bytes), DLT_UINT64(spi->bus_ns / 1000U));
+
+   if (0 == ret)
+   {
+      ret = spi_exec_start(&RackAuvitran.exec, RACK_SPIDEV, exec_priority);
+   }
+
    return ret;
 }
 
@@ -503,7 +622,7 @@ uint32_t rack_initialize(void)
 //! \param  gain: gain in dB (typically negative)
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_set_gain(direction_t direction, int channel, float gain)
+static int32_t rack_do_set_gain(direction_t direction, int channel, float gain)
 {
    int slot;
    int page;
@@ -636,7 +755,7 @@ int32_t rack_set_gain(direction_t direction, int channel, float gain)
 //! \param  gain: Updated with current gain in dB (typically negative)
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_get_gain(direction_t direction, int channel, float *gain)
+static int32_t rack_do_get_gain(direction_t direction, int channel, float *gain)
 {
    int slot;
    int page;
@@ -743,7 +862,7 @@ int32_t rack_get_gain(direction_t direction, int channel, float *gain)
 //! \param  pad_level: Either PAD_10_DBU or PAD_24_DBU
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_set_pad_level(direction_t direction, int channel, uint8_t pad_level)
+static int32_t rack_do_set_pad_level(direction_t direction, int channel, uint8_t pad_level)
 {
    int slot;
    int page;
@@ -842,7 +961,7 @@ int32_t rack_set_pad_level(direction_t direction, int channel, uint8_t pad_level
 //! \param  pad_level: Updated with current pad level (either PAD_10_DBU or PAD_24_DBU)
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_get_pad_level(direction_t direction, int channel, uint8_t *pad_level)
+static int32_t rack_do_get_pad_level(direction_t direction, int channel, uint8_t *pad_level)
 {
    int slot;
    int page;
@@ -932,7 +1051,7 @@ int32_t rack_get_pad_level(direction_t direction, int channel, uint8_t *pad_leve
 //! \param  vu_post: Updated with current VU-meter for post-fader
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_get_vumeter(direction_t direction, int channel, int *vu_pre, int *vu_post)
+static int32_t rack_do_get_vumeter(direction_t direction, int channel, int *vu_pre, int *vu_post)
 {
    int slot;
    int page;
@@ -1023,6 +1142,8 @@ int32_t rack_get_vumeter(direction_t direction, int channel, int *vu_pre, int *v
 //==============================================================================
 //! \brief Clear the whole audio matrix
 //!
+//! One bulk transaction per page, so that a mute never waits for the whole clear.
+//!
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
 int rack_matrix_clear(void)
@@ -1030,7 +1151,8 @@ int rack_matrix_clear(void)
    int slot;
    int page_mxpr;
    int page;
-   static const uint8_t clean_page[32] = {0};
+   static uint8_t clean_page[32] = {0};
+   rack_call_t call = {.slot = MATRIX_SLOT};
    int overall_ret;
    uint8_t allowed;
    int ret;
@@ -1043,7 +1165,11 @@ int rack_matrix_clear(void)
    }
 
    /* Are we allowed to modify matrix ? */
-   ret = avx_read_mailbox(&RackAuvitran.avx_device, MATRIX_SLOT, page_mxpr, REG_MXPR_ALLOW, &allowed, 1);
+   call.page = page_mxpr;
+   call.offset = REG_MXPR_ALLOW;
+   call.data = &allowed;
+   call.length = 1;
+   ret = rack_exec(SPI_EXEC_BULK, rack_read_mailbox_txn, &call);
    if (ret != 0)
    {
       DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed reading matrix modification rights"));
@@ -1074,7 +1200,11 @@ int rack_matrix_clear(void)
       for (index = 0; index < 4; index++)
       {
          int ret;
-         ret = avx_write_mailbox(&RackAuvitran.avx_device, MATRIX_SLOT, page, 0, clean_page, sizeof(clean_page));
+         call.page = page;
+         call.offset = 0;
+         call.data = clean_page;
+         call.length = sizeof(clean_page);
+         ret = rack_exec(SPI_EXEC_BULK, rack_write_mailbox_txn, &call);
          if (ret != 0)
          {
             DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("Failed clearing audio matrix, slot "), DLT_INT(slot), DLT_STRING(", page "), DLT_INT(page));
@@ -1094,7 +1224,7 @@ int rack_matrix_clear(void)
 //! \param pEXT: Pointer to a byte representing firmware extension
 //! \return 0 in case of success, or negative errno error code
 //==============================================================================
-int32_t rack_get_card_version(int slot, uint8_t *pFIR, uint8_t *pEXT)
+static int32_t rack_do_get_card_version(int slot, uint8_t *pFIR, uint8_t *pEXT)
 {
    int32_t ret;
 
@@ -1120,6 +1250,149 @@ int32_t rack_get_card_version(int slot, uint8_t *pFIR, uint8_t *pEXT)
    return 0;
 }
 
+static int rack_set_gain_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_set_gain(call->direction, call->channel, call->gain);
+}
+
+static int rack_get_gain_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_get_gain(call->direction, call->channel, call->p_gain);
+}
+
+static int rack_set_pad_level_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_set_pad_level(call->direction, call->channel, call->pad_level);
+}
+
+static int rack_get_pad_level_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_get_pad_level(call->direction, call->channel, call->p_pad_level);
+}
+
+static int rack_get_vumeter_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_get_vumeter(call->direction, call->channel, call->vu_pre, call->vu_post);
+}
+
+static int rack_set_sampling_rate_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_set_sampling_rate(call->sampling_rate);
+}
+
+static int rack_matrix_set_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_matrix_set(call->product_id_in, call->channel_in, call->product_id_out, call->channel_out, call->enable_nMute);
+}
+
+static int rack_get_card_version_txn(void *arg)
+{
+   const rack_call_t *call = (const rack_call_t *)arg;
+
+   return rack_do_get_card_version(call->slot, call->data, call->data_ext);
+}
+
+/*
+ * The rack API: each call is one transaction of the bus executor, in the class
+ * of its urgency, see the rack_do_ functions for the parameters.
+ */
+
+int32_t rack_set_gain(direction_t direction, int channel, float gain)
+{
+   rack_call_t call = {.direction = direction, .channel = channel, .gain = gain};
+
+   return rack_exec(SPI_EXEC_CONTROL, rack_set_gain_txn, &call);
+}
+
+int32_t rack_get_gain(direction_t direction, int channel, float *gain)
+{
+   rack_call_t call = {.direction = direction, .channel = channel, .p_gain = gain};
+
+   return rack_exec(SPI_EXEC_CONTROL, rack_get_gain_txn, &call);
+}
+
+int32_t rack_set_pad_level(direction_t direction, int channel, uint8_t pad_level)
+{
+   rack_call_t call = {.direction = direction, .channel = channel, .pad_level = pad_level};
+
+   return rack_exec(SPI_EXEC_CONTROL, rack_set_pad_level_txn, &call);
+}
+
+int32_t rack_get_pad_level(direction_t direction, int channel, uint8_t *pad_level)
+{
+   rack_call_t call = {.direction = direction, .channel = channel, .p_pad_level = pad_level};
+
+   return rack_exec(SPI_EXEC_CONTROL, rack_get_pad_level_txn, &call);
+}
+
+int32_t rack_get_vumeter(direction_t direction, int channel, int *vu_pre, int *vu_post)
+{
+   rack_call_t call = {.direction = direction, .channel = channel, .vu_pre = vu_pre, .vu_post = vu_post};
+
+   return rack_exec(SPI_EXEC_BULK, rack_get_vumeter_txn, &call);
+}
+
+int32_t rack_set_sampling_rate(sampling_rate_t sampling_rate)
+{
+   rack_call_t call = {.sampling_rate = sampling_rate};
+
+   return rack_exec(SPI_EXEC_CONTROL, rack_set_sampling_rate_txn, &call);
+}
+
+/* a mute (enable_nMute false) goes before everything else queued */
+int32_t rack_matrix_set(int product_id_in, int channel_in, int product_id_out, int channel_out, bool enable_nMute)
+{
+   rack_call_t call = {.product_id_in = product_id_in, .channel_in = channel_in, .product_id_out = product_id_out,
+                       .channel_out = channel_out, .enable_nMute = enable_nMute};
+
+   return rack_exec(enable_nMute ? SPI_EXEC_CONTROL : SPI_EXEC_URGENT, rack_matrix_set_txn, &call);
+}
+
+int32_t rack_get_card_version(int slot, uint8_t *pFIR, uint8_t *pEXT)
+{
+   rack_call_t call = {.slot = slot, .data = pFIR, .data_ext = pEXT};
+
+   return rack_exec(SPI_EXEC_BULK, rack_get_card_version_txn, &call);
+}
+
+//==============================================================================
+//! \brief Select how the SPI segments of one rack access are sent
+//!
+//! \param  batching: true for one ioctl per access, false for one ioctl per segment
+//! \return none
+//==============================================================================
+void rack_set_batching(bool batching)
+{
+   RackAuvitran.avx_device.batching = batching;
+}
+
+//==============================================================================
+//! \brief Get the rack SPI cost counters, since rack_initialize()
+//!
+//! \param  ioctls: updated with the number of SPI_IOC_MESSAGE syscalls
+//! \param  bus_ns: updated with the time spent in those syscalls
+//! \return none
+//==============================================================================
+void rack_get_spi_counters(uint32_t *ioctls, uint64_t *bus_ns)
+{
+   *ioctls = RackAuvitran.avx_device.spi_dev.ioctls;
+   *bus_ns = RackAuvitran.avx_device.spi_dev.bus_ns;
+}
+
 //==============================================================================
 //! \brief Module termination, releases everything
 //!
@@ -1130,5 +1403,13 @@ void rack_release(void)
 {
    DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("rack:terminate"));
 
+   /* the calls in progress complete first, those after this one get -ENODEV */
+   pthread_rwlock_wrlock(&RackReleaseLock);
+
+   spi_exec_stop(&RackAuvitran.exec);
+   spi_exec_report(&RackAuvitran.exec);
+
    avx_terminate(&RackAuvitran.avx_device);
+
+   pthread_rwlock_unlock(&RackReleaseLock);
 }
@@ -3,6 +3,9 @@
 #define RACK_RUNNER
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "dlt-client.h"
 
 #define RACK_SPIDEV  "/dev/spidev1.0"
@@ -27,7 +30,7 @@ typedef enum
    FREQ_96k,
 } sampling_rate_t;
 
-uint32_t rack_initialize(void);
+uint32_t rack_initialize(int exec_priority);
 void rack_release(void);
 
 int32_t rack_set_gain(direction_t direction, int channel, float gain);
@@ -36,7 +39,14 @@ int32_t rack_set_pad_level(direction_t direction, int channel, uint8_t pad_level
 int32_t rack_get_pad_level(direction_t direction, int channel, uint8_t *pad_level);
 int32_t rack_get_vumeter(direction_t direction, int channel, int *vu_pre, int *vu_post);
 int32_t rack_set_sampling_rate(sampling_rate_t sampling_rate);
+int32_t rack_set_sampling_rate_hz(uint32_t rate_hz);
 
 int32_t rack_get_card_version(int slot, uint8_t *pFIR, uint8_t *pEXT);
 
+int32_t rack_matrix_set(int product_id_in, int channel_in, int product_id_out, int channel_out, bool enable_nMute);
+int rack_matrix_clear(void);
+
+void rack_set_batching(bool batching);
+void rack_get_spi_counters(uint32_t *ioctls, uint64_t *bus_ns);
+
 #endif //RACK_RUNNER
\ No newline at end of file
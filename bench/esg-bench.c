@@ -0,0 +1,67 @@
+/*
+ ============================================================================
+ Name        : esg-bench.c
+ Version     :
+ Copyright   : Closed
+ Description : micro-benchmarks, run instead of the runners with --bench=NAME
+ ============================================================================
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "esg-bench.h"
+#include "tdma-codec.h"
+#include "tdma-crc.h"
+#include "esg-spidev-bench.h"
+
+typedef struct
+{
+	const char *name;
+	int (*run)(ebt_settings_t *settings);
+} esg_bench_t;
+
+/* -l gives the number of iterations */
+static int esg_bench_codec(ebt_settings_t *settings)
+{
+	return tdma_codec_bench(settings->nb_loops);
+}
+
+static int esg_bench_crc(ebt_settings_t *settings)
+{
+	return tdma_crc_bench(settings->nb_loops);
+}
+
+/* -l gives the number of messages per point */
+static int esg_bench_spi(ebt_settings_t *settings)
+{
+	return spi_bench(settings->spi_dev, settings->spi_mode, settings->nb_loops);
+}
+
+static const esg_bench_t benches[] = {
+	{"codec", esg_bench_codec},
+	{"crc", esg_bench_crc},
+	{"spi", esg_bench_spi},
+};
+
+int esg_bench_run(const char *name, ebt_settings_t *settings)
+{
+	int ret = -EINVAL;
+	uint32_t i;
+
+	for (i = 0U; i < (sizeof(benches) / sizeof(benches[0])); i++)
+	{
+		if (0 == strcmp(name, benches[i].name))
+		{
+			DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("bench"), DLT_STRING(name), DLT_UINT32(settings->nb_loops));
+			ret = benches[i].run(settings);
+			break;
+		}
+	}
+
+	if (i == (sizeof(benches) / sizeof(benches[0])))
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("unknown bench"), DLT_STRING(name));
+	}
+
+	return ret;
+}
@@ -0,0 +1,17 @@
+/*
+ ============================================================================
+ Name        : esg-bench.h
+ Version     :
+ Copyright   : Closed
+ Description : micro-benchmarks, run instead of the runners with --bench=NAME
+ ============================================================================
+ */
+#ifndef ESG_BENCH
+#define ESG_BENCH
+#pragma once
+
+#include "esg-bsp-test.h"
+
+int esg_bench_run(const char *name, ebt_settings_t *settings);
+
+#endif // ESG_BENCH
@@ -6,6 +6,7 @@
  */
 #include "esg-bsp-test.h"
 #include "elite-slave-ready-gpio.h"
+#include "tdma-phase.h"
 
 DLT_DECLARE_CONTEXT(dlt_ctxt_tdma);
 
@@ -33,7 +34,11 @@ static void *elite_gpiod_runner(void *p_data)
 			DLT_LOG(dlt_ctxt_tdma, DLT_LOG_DEBUG, DLT_STRING("elite_gpiod_runner"), DLT_UINT32(nb_loops));
 
 			/*wait for slave-ready GPIO to be asserted */
-			elite_slave_ready_wait(&slave_ready_gpio);
+			if (0 <= elite_slave_ready_wait(&slave_ready_gpio))
+			{
+				/* the phase monitor takes its edges from this runner only, the stm32 one waits on the same GPIO */
+				tdma_phase_sready(slave_ready_gpio.edge_ns);
+			}
 		}
 	}
 
@@ -4,6 +4,7 @@
 #include <string.h>   //4 strlen & memcpy
 #include <sys/time.h> //4 time
 #include "elite-slave-ready-gpio.h"
+#include "wi_time.h"
 
 DLT_DECLARE_CONTEXT(dlt_ctxt_gpioe);
 
@@ -112,6 +113,16 @@ int elite_gpio_close(elite_gpio_t *sready_gpio)
     return 0;
 }
 
+/* closes the value fd only, the GPIO stays exported for the other runners using it */
+void elite_gpio_release(elite_gpio_t *sready_gpio)
+{
+    if (0 < sready_gpio->fd)
+    {
+        close(sready_gpio->fd);
+        sready_gpio->fd = 0;
+    }
+}
+
 int8_t elite_gpio_get(elite_gpio_t *sready_gpio)
 {
     char value;
@@ -144,7 +155,7 @@ static int elite_gpio_configure_event(elite_gpio_t *sready_gpio)
 
     //    strcpy(edge, "rising");
 
-    if (write(fd, edge, strlen(buf)) < strlen(buf))
+    if (write(fd, edge, strlen(edge)) < strlen(edge))
     {
         DLT_LOG(dlt_ctxt_gpioe, DLT_LOG_ERROR, DLT_STRING("Could write in: /sys/class/gpio/gpio/edge"));
         close(fd);
@@ -173,6 +184,12 @@ int elite_slave_ready_gpio_init(elite_gpio_t *sready_gpio, ebt_settings_t *setti
         if (0 < ret)
         {
             ret = elite_gpio_configure_event(sready_gpio);
+
+            /* the value file is born with an event pending, read it so that the first wait is a real edge */
+            if (0 == ret)
+            {
+                (void)elite_gpio_get(sready_gpio);
+            }
         }
         else
         {
@@ -185,28 +202,54 @@ int elite_slave_ready_gpio_init(elite_gpio_t *sready_gpio, ebt_settings_t *setti
     {
         DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("GPIO 'spi slave ready' init failed"));
     }
+
+    return ret;
 }
 
-int elite_slave_ready_wait(elite_gpio_t *sready_gpio)
+/* returns the GPIO level after the edge, 0 or 1, -ETIMEDOUT when no edge came within timeout_us (0 waits forever), < 0 on error */
+int elite_slave_ready_wait_timeout(elite_gpio_t *sready_gpio, uint32_t timeout_us)
 {
     fd_set read_fds;
     int ret_select;
+    struct timeval timeout = {.tv_sec = timeout_us / 1000000U, .tv_usec = timeout_us % 1000000U};
+    int val;
 
     FD_ZERO(&read_fds);
     FD_SET(sready_gpio->fd, &read_fds);
 
     // Attente passive
-    ret_select = select(sready_gpio->fd+1, NULL, NULL, &read_fds, NULL);
+    ret_select = select(sready_gpio->fd+1, NULL, NULL, &read_fds, (0U != timeout_us) ? &timeout : NULL);
+
+    /* stamp first, before anything else can delay it */
+    if (ret_select > 0)
+    {
+        sready_gpio->edge_ns = time_getClockRaw_ns();
+    }
 
   //  DLT_LOG(dlt_ctxt_gpioe, DLT_LOG_INFO, DLT_STRING("GPIO select ret_select="), DLT_UINT32(ret_select));
 
     if (ret_select < 0)
     {
+        val = -errno;
         DLT_LOG(dlt_ctxt_gpioe, DLT_LOG_ERROR, DLT_STRING("GPIO select failed"));
         // pthread_exit(0);
     }
+    else if (ret_select == 0)
+    {
+        val = -ETIMEDOUT;
+    }
+    else
+    {
+        /* the read also acknowledges the edge */
+        val = elite_gpio_get(sready_gpio);
+
+        DLT_LOG(dlt_ctxt_gpioe, DLT_LOG_VERBOSE, DLT_STRING("GPIO val ="), DLT_INT32(val));
+    }
 
-    int val = elite_gpio_get(sready_gpio);
+    return val;
+}
 
-    DLT_LOG(dlt_ctxt_gpioe, DLT_LOG_VERBOSE, DLT_STRING("GPIO val ="), DLT_UINT32(val));
+int elite_slave_ready_wait(elite_gpio_t *sready_gpio)
+{
+    return elite_slave_ready_wait_timeout(sready_gpio, 0U);
 }
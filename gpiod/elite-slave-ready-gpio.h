@@ -26,13 +26,16 @@
 typedef struct{
     uint16_t id;
     int fd;
+    uint64_t edge_ns;   /* CLOCK_MONOTONIC_RAW of the last wake up on an edge */
 } elite_gpio_t;
 
 
 int elite_slave_ready_gpio_init(elite_gpio_t *sready_gpio, ebt_settings_t *settings);
 
 int elite_gpio_close(elite_gpio_t *sready_gpio);
+void elite_gpio_release(elite_gpio_t *sready_gpio);
 int8_t elite_gpio_get(elite_gpio_t *sready_gpio);
 int elite_slave_ready_wait(elite_gpio_t *sready_gpio);
+int elite_slave_ready_wait_timeout(elite_gpio_t *sready_gpio, uint32_t timeout_us);
 
 #endif //ELITE_SLAVE_READY_GPIO
\ No newline at end of file
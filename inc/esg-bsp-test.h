@@ -20,6 +20,11 @@
 #define AUDIO_TEST_SAMPLE_SZ_BYTES 4U
 #define AUDIO_TEST_CHANNELS 4U
 #define AUDIO_TEST_SAMPLE_FORMAT SND_PCM_FORMAT_S32_LE
+#define AUDIO_TEST_RATE_MAX 96000U
+#define AUDIO_TEST_CHANNELS_MAX 64U
+#define AUDIO_CACHE_LINE_BYTES 64U
+/* below this level (32 bits scale) a sample is considered silent */
+#define AUDIO_TEST_SILENCE_LEVEL 0x00002000
 
 #define AUDIO_TEST_FRAME_SZ_BYTES (AUDIO_TEST_CHANNELS * AUDIO_TEST_SAMPLE_SZ_BYTES)
 #define AUDIO_TEST_BUFFER_TIME_US (AUDIO_TEST_PERIODS * AUDIO_TEST_PERIOD_TIME_US)
@@ -27,6 +32,16 @@
 #define AUDIO_TEST_BUFFER_SZ_FRAMES (AUDIO_TEST_RATE * AUDIO_TEST_BUFFER_TIME_US / 1000000)
 #define AUDIO_TEST_BUFFER_SZ_BYTES (AUDIO_TEST_BUFFER_SZ_FRAMES * AUDIO_TEST_FRAME_SZ_BYTES)
 
+/* the rate can change at runtime (see --rate-switch), so period size is derived from the actual rate */
+#define AUDIO_PERIOD_SZ_FRAMES(rate) ((rate) * AUDIO_TEST_PERIOD_TIME_US / 1000000)
+#define AUDIO_TEST_PERIOD_SZ_FRAMES_MAX AUDIO_PERIOD_SZ_FRAMES(AUDIO_TEST_RATE_MAX)
+
+/* DMA bandwidth stress (--bw) */
+#define AUDIO_BW_OFF 0U
+#define AUDIO_BW_CAPTURE 1U
+#define AUDIO_BW_PLAYBACK 2U
+#define BW_STREAMS_MAX 8U
+
 #if 0
 #define AUDIO_TEST_DEVICE_NAME "hw:0,0"
 #define AUDIO_TEST_SAMPLE_ACCESS SND_PCM_ACCESS_RW_INTERLEAVED
@@ -43,10 +58,45 @@ typedef struct esg_bsp_test_settings
     uint32_t pauses;
     uint32_t rack_freq;
     uint8_t sched_rt;
+    uint8_t rack_enabled;
+    uint32_t audio_rate;
+    uint32_t rate_switch;
+    uint32_t audio_channels;
+    uint32_t channels_sweep;
+    uint8_t glitch_detect;
+    uint8_t warm_restart;
+    int32_t prefill;
+    uint32_t start_threshold;
+    uint64_t main_ns;
+    uint8_t telemetry;
+    const char *fill_trace;
+    uint8_t bw_mode;
+    uint32_t bw_streams;
+    const char *pcm_name;
+    uint32_t load_percent;
+    uint8_t load_kernel;
+    uint8_t load_ramp;
+    uint8_t phase_monitor;
+    uint8_t rack_compare;
+    uint32_t tdma_pipeline;
+    uint8_t tdma_timer;
+    uint32_t tdma_phase_us;
+    const char *tdma_capture;
+    const char *tdma_replay;
+    uint32_t replay_speed;
+    const char *spi_dev;
+    uint32_t spi_mode;
+    uint8_t bridge;
+    const char *bridge_codec;
+    uint32_t bridge_jitter;
+    uint32_t tdma_ext;
+    uint32_t tdma_voices;
+    uint8_t tdma_pattern;
 } ebt_settings_t ;
 
 
 int audio_runner_init_poll(pthread_t *runner, ebt_settings_t *settings);
+int alsa_bw_runner_init(pthread_t *runner, ebt_settings_t *settings);
 int elite_gpiod_init(pthread_t *runner, ebt_settings_t *settings);
 int elite_uart_dsp_runner_init(pthread_t *runner, ebt_settings_t *settings);
 int rack_runner_init(pthread_t *runner, ebt_settings_t *settings);
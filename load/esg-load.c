@@ -0,0 +1,153 @@
+/*
+ ============================================================================
+ Name        : esg-load.c
+ Version     :
+ Copyright   : Closed
+ Description : synthetic per-cycle CPU load, burnt inside the real-time runners
+               to measure how much of a period is really usable
+ ============================================================================
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "esg-bsp-test.h"
+#include "esg-load.h"
+#include "wi_time.h"
+
+/* work between two clock reads, small enough to stop within a few us of the budget */
+#define LOAD_BUSY_CHUNK 256U
+#define LOAD_MEM_CHUNK_LINES 64U
+#define LOAD_CACHE_LINE 64U
+
+static void esg_load_busy(esg_load_t *load, uint64_t end_ns)
+{
+	uint32_t acc = load->sink;
+
+	while (time_getClock_ns() < end_ns)
+	{
+		for (uint32_t i = 0U; i < LOAD_BUSY_CHUNK; i++)
+		{
+			acc = acc * 1664525U + 1013904223U;
+		}
+	}
+
+	load->sink = acc;
+}
+
+static void esg_load_memory(esg_load_t *load, uint64_t end_ns)
+{
+	while (time_getClock_ns() < end_ns)
+	{
+		for (uint32_t i = 0U; i < LOAD_MEM_CHUNK_LINES; i++)
+		{
+			load->mem[load->mem_pos]++;
+			load->mem_pos = (load->mem_pos + LOAD_CACHE_LINE) % ESG_LOAD_MEM_SZ;
+		}
+	}
+}
+
+int esg_load_init(esg_load_t *load, const char *name, esg_load_kernel_t kernel, uint32_t percent, uint8_t ramp)
+{
+	int ret = EXIT_SUCCESS;
+
+	memset(load, 0, sizeof(*load));
+
+	load->name = name;
+	load->kernel = kernel;
+	load->ramp = ramp;
+	load->percent = (0U != ramp) ? percent : ((100U < percent) ? 100U : percent);
+	load->max_ok = -1;
+
+	if (ESG_LOAD_MEMORY == kernel)
+	{
+		/* a large block is mapped on demand: written and locked here, its page faults are not part of the load */
+		load->mem = malloc(ESG_LOAD_MEM_SZ);
+		ret = (NULL != load->mem) ? EXIT_SUCCESS : -ENOMEM;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (NULL != load->mem))
+	{
+		memset(load->mem, 0, ESG_LOAD_MEM_SZ);
+
+		if (0 != mlock(load->mem, ESG_LOAD_MEM_SZ))
+		{
+			DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("load buffer not locked (bytes/err)"), DLT_UINT32(ESG_LOAD_MEM_SZ), DLT_INT32(-errno));
+		}
+	}
+
+	return ret;
+}
+
+void esg_load_burn(esg_load_t *load, uint32_t cycle_us)
+{
+	if ((0U < load->percent) && (0U == load->done))
+	{
+		uint64_t end_ns = time_getClock_ns() + (uint64_t)cycle_us * load->percent * 10U;
+
+		if (ESG_LOAD_MEMORY == load->kernel)
+		{
+			esg_load_memory(load, end_ns);
+		}
+		else
+		{
+			esg_load_busy(load, end_ns);
+		}
+	}
+}
+
+/* account for one cycle, returns 1 once the ramp is over */
+uint8_t esg_load_cycle_end(esg_load_t *load, uint8_t missed)
+{
+	load->cycles++;
+
+	if (0U != missed)
+	{
+		load->misses++;
+		load->total_misses++;
+	}
+
+	if ((0U != load->ramp) && (0U == load->done) && (ESG_LOAD_RAMP_CYCLES <= load->cycles))
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING(load->name), DLT_STRING("load step (percent/misses)"),
+				DLT_UINT32(load->percent), DLT_UINT32(load->misses));
+
+		if (0U == load->misses)
+		{
+			load->max_ok = (int32_t)load->percent;
+			load->percent += ESG_LOAD_RAMP_STEP;
+		}
+
+		load->done = ((0U != load->misses) || (100U < load->percent));
+		load->cycles = 0U;
+		load->misses = 0U;
+	}
+
+	return (0U != load->ramp) ? load->done : 0U;
+}
+
+void esg_load_report(const esg_load_t *load)
+{
+	if (0U != load->ramp)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(load->name), DLT_STRING("maximum usable percentage of the period"),
+				DLT_INT32(load->max_ok), DLT_STRING((ESG_LOAD_MEMORY == load->kernel) ? "(memory)" : "(busy)"),
+				DLT_STRING((0U != load->done) ? "" : "ramp not finished, more loops needed"));
+	}
+	else if (0U < load->percent)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(load->name), DLT_STRING("load (percent/deadline misses)"),
+				DLT_UINT32(load->percent), DLT_UINT64(load->total_misses), DLT_STRING((ESG_LOAD_MEMORY == load->kernel) ? "(memory)" : "(busy)"));
+	}
+}
+
+void esg_load_free(esg_load_t *load)
+{
+	if (NULL != load->mem)
+	{
+		(void)munlock(load->mem, ESG_LOAD_MEM_SZ);
+	}
+	free(load->mem);
+	load->mem = NULL;
+}
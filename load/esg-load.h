@@ -0,0 +1,51 @@
+/*
+ ============================================================================
+ Name        : esg-load.h
+ Version     :
+ Copyright   : Closed
+ Description : synthetic per-cycle CPU load, burnt inside the real-time runners
+               to measure how much of a period is really usable
+ ============================================================================
+ */
+#ifndef ESG_LOAD
+#define ESG_LOAD
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* ramp: +5% of the period every 100 cycles, until a deadline is missed */
+#define ESG_LOAD_RAMP_STEP 5U
+#define ESG_LOAD_RAMP_CYCLES 100U
+/* the memory kernel walks a buffer well beyond the L2 */
+#define ESG_LOAD_MEM_SZ (8U * 1024U * 1024U)
+
+typedef enum
+{
+	ESG_LOAD_BUSY = 0,	  /* ALU only, stays in L1 */
+	ESG_LOAD_MEMORY = 1,  /* cache line read-modify-write, bound by the DDR */
+} esg_load_kernel_t;
+
+typedef struct
+{
+	const char *name;
+	esg_load_kernel_t kernel;
+	uint32_t percent;	  /* of the cycle, burnt each cycle */
+	uint8_t ramp;
+	uint8_t done;		  /* ramp over: a step missed deadlines, or 100% reached */
+	uint32_t cycles;	  /* in the current step */
+	uint32_t misses;	  /* in the current step */
+	int32_t max_ok;		  /* highest percent without a miss, -1 if none */
+	uint64_t total_misses;
+	uint8_t *mem;
+	size_t mem_pos;
+	volatile uint32_t sink;
+} esg_load_t;
+
+int esg_load_init(esg_load_t *load, const char *name, esg_load_kernel_t kernel, uint32_t percent, uint8_t ramp);
+void esg_load_burn(esg_load_t *load, uint32_t cycle_us);
+uint8_t esg_load_cycle_end(esg_load_t *load, uint8_t missed);
+void esg_load_report(const esg_load_t *load);
+void esg_load_free(esg_load_t *load);
+
+#endif // ESG_LOAD
@@ -2,10 +2,22 @@
  * Copyright (c) 2023 VOGO S.A., All rights reserved
  */
 
+#include <string.h>
+
 #define DLT_CLIENT_MAIN_MODULE
 #include "esg-bsp-test.h"
 #include "elite-slave-ready-gpio.h"
 #include "rackAuvitran.h"
+#include "wi_time.h"
+#include "esg-load.h"
+#include "tdma-phase.h"
+#include "esg-bench.h"
+#include "tdma-pipe.h"
+#include "esg-spidev.h"
+#include "esg-spidev-prof.h"
+#include "tdma-bridge.h"
+#include "tdma-load.h"
+#include "tdma-extdata.h"
 
 DLT_DECLARE_CONTEXT(dlt_ctxt_btst)
 
@@ -18,8 +30,9 @@ enum
 	RUNNER_ELITE_UDSP = 2, 
 	RUNNER_RACK = 3,	   // auvitran rack
 	RUNNER_STM32 = 4,
+	RUNNER_AUDIO_BW = 5,   // alsa, capture or playback only
 	//
-	RUNNER_INVALID = 5
+	RUNNER_INVALID = 6
 };
 
 pthread_t test_runner[RUNNER_INVALID] = {0};
@@ -30,13 +43,50 @@ ebt_settings_t g_settings =
 		.verbosity = DLT_LOG_INFO,
 		.pauses = 0U,
 		.rack_freq = 0U,
-		.sched_rt = 0U
+		.sched_rt = 0U,
+		.rack_enabled = 0U,
+		.audio_rate = AUDIO_TEST_RATE,
+		.rate_switch = 0U,
+		.audio_channels = AUDIO_TEST_CHANNELS,
+		.channels_sweep = 0U,
+		.glitch_detect = 0U,
+		.warm_restart = 0U,
+		.prefill = -1,
+		.start_threshold = 0U,
+		.telemetry = 0U,
+		.fill_trace = NULL,
+		.bw_mode = AUDIO_BW_OFF,
+		.bw_streams = 1U,
+		.pcm_name = AUDIO_TEST_DEVICE_NAME,
+		.load_percent = 0U,
+		.load_kernel = ESG_LOAD_BUSY,
+		.load_ramp = 0U,
+		.phase_monitor = 0U,
+		.rack_compare = 0U,
+		.tdma_pipeline = 0U,
+		.tdma_timer = 0U,
+		.tdma_phase_us = 0U,
+		.tdma_capture = NULL,
+		.tdma_replay = NULL,
+		.replay_speed = 1U,
+		.spi_dev = SPI_STM_DEVICE,
+		.spi_mode = SPI_MODE_0,
+		.bridge = 0U,
+		.bridge_codec = "stub",
+		.bridge_jitter = 2U,
+		.tdma_ext = 0U,
+		.tdma_voices = 0U,
+		.tdma_pattern = TDMA_LOAD_BURST
 	};
 
 int main(int argc, char **argv)
 {
 	int ret = EXIT_SUCCESS;
 	struct gengetopt_args_info args_info;
+	int buffer_frames;
+
+	/* startup profile reference */
+	g_settings.main_ns = time_getBoottime_ns();
 
 	/* let's call our cmdline parser */
 	if ((cmdline_parser(argc, argv, &args_info) != 0) || (1 == argc))
@@ -60,6 +110,173 @@ int main(int argc, char **argv)
 	g_settings.pauses = args_info.pauses_arg;
 	g_settings.rack_freq = args_info.rack_arg;
 	g_settings.sched_rt = args_info.sched_rt_arg;
+	g_settings.rack_enabled = (0 != args_info.rack_given) ? 1U : 0U;
+	g_settings.audio_rate = args_info.rate_arg;
+	g_settings.rate_switch = args_info.rate_switch_arg;
+	g_settings.audio_channels = args_info.channels_arg;
+	g_settings.channels_sweep = args_info.channels_sweep_arg;
+	g_settings.glitch_detect = (0 != args_info.glitch_flag) ? 1U : 0U;
+	g_settings.warm_restart = (0 != args_info.warm_restart_flag) ? 1U : 0U;
+	g_settings.prefill = args_info.prefill_arg;
+	g_settings.start_threshold = args_info.start_threshold_arg;
+	g_settings.telemetry = (0 != args_info.telemetry_flag) ? 1U : 0U;
+	g_settings.fill_trace = (0 != args_info.fill_trace_given) ? args_info.fill_trace_arg : NULL;
+	g_settings.bw_streams = args_info.bw_streams_arg;
+	g_settings.pcm_name = (0 != args_info.pcm_given) ? args_info.pcm_arg : AUDIO_TEST_DEVICE_NAME;
+
+	g_settings.load_percent = args_info.load_arg;
+	g_settings.load_ramp = (0 != args_info.load_ramp_flag) ? 1U : 0U;
+	g_settings.phase_monitor = (0 != args_info.phase_flag) ? 1U : 0U;
+	g_settings.rack_compare = (0 != args_info.rack_compare_flag) ? 1U : 0U;
+	g_settings.tdma_pipeline = args_info.tdma_pipeline_arg;
+	g_settings.tdma_timer = (0 != args_info.tdma_timer_flag) ? 1U : 0U;
+	g_settings.tdma_phase_us = args_info.tdma_phase_arg;
+	g_settings.tdma_capture = (0 != args_info.tdma_capture_given) ? args_info.tdma_capture_arg : NULL;
+	g_settings.tdma_replay = (0 != args_info.tdma_replay_given) ? args_info.tdma_replay_arg : NULL;
+	g_settings.replay_speed = args_info.tdma_replay_speed_arg;
+	g_settings.spi_dev = (0 != args_info.spi_dev_given) ? args_info.spi_dev_arg : SPI_STM_DEVICE;
+	g_settings.spi_mode = (uint32_t)args_info.spi_mode_arg | ((0 != args_info.spi_loop_flag) ? SPI_LOOP : 0U);
+	g_settings.bridge = (0 != args_info.bridge_flag) ? 1U : 0U;
+	g_settings.bridge_codec = (0 != args_info.bridge_codec_given) ? args_info.bridge_codec_arg : "stub";
+	g_settings.bridge_jitter = (uint32_t)args_info.bridge_jitter_arg;
+	g_settings.tdma_ext = (uint32_t)args_info.tdma_ext_arg;
+	g_settings.tdma_voices = (uint32_t)args_info.tdma_voices_arg;
+
+	if (0 != args_info.tdma_pattern_given)
+	{
+		int pattern = tdma_load_pattern(args_info.tdma_pattern_arg);
+
+		if (0 > pattern)
+		{
+			fprintf(stderr, "--tdma-pattern must be 'burst', 'all' or 'silence'\n");
+			exit(1);
+		}
+		g_settings.tdma_pattern = (uint8_t)pattern;
+	}
+
+	if (0 != args_info.load_kernel_given)
+	{
+		if (0 == strcmp(args_info.load_kernel_arg, "memory"))
+		{
+			g_settings.load_kernel = ESG_LOAD_MEMORY;
+		}
+		else if (0 != strcmp(args_info.load_kernel_arg, "busy"))
+		{
+			fprintf(stderr, "--load-kernel must be 'busy' or 'memory'\n");
+			exit(1);
+		}
+	}
+
+	if (0 != args_info.bw_given)
+	{
+		if (0 == strcmp(args_info.bw_arg, "capture"))
+		{
+			g_settings.bw_mode = AUDIO_BW_CAPTURE;
+		}
+		else if (0 == strcmp(args_info.bw_arg, "playback"))
+		{
+			g_settings.bw_mode = AUDIO_BW_PLAYBACK;
+		}
+		else
+		{
+			fprintf(stderr, "--bw must be 'capture' or 'playback'\n");
+			exit(1);
+		}
+	}
+
+	if ((1U == g_settings.tdma_pipeline) || (TDMA_PIPE_SLOTS < g_settings.tdma_pipeline))
+	{
+		fprintf(stderr, "--tdma-pipeline must be 0 (in line) or 2..%u\n", TDMA_PIPE_SLOTS);
+		exit(1);
+	}
+
+	if ((0 > args_info.tdma_phase_arg) || (10000 <= args_info.tdma_phase_arg))
+	{
+		fprintf(stderr, "--tdma-phase must be within 0..9999 us\n");
+		exit(1);
+	}
+
+	if (0 > args_info.tdma_replay_speed_arg)
+	{
+		fprintf(stderr, "--tdma-replay-speed must be >= 0\n");
+		exit(1);
+	}
+
+	if ((0 > args_info.spi_mode_arg) || (SPI_MODE_3 < args_info.spi_mode_arg))
+	{
+		fprintf(stderr, "--spi-mode must be within 0..3\n");
+		exit(1);
+	}
+
+	if ((0 > args_info.tdma_ext_arg) || (TDMA_EXT_DECIMATION_MAX < args_info.tdma_ext_arg))
+	{
+		fprintf(stderr, "--tdma-ext must be within 0..%u frames\n", TDMA_EXT_DECIMATION_MAX);
+		exit(1);
+	}
+
+	if ((0 > args_info.tdma_voices_arg) || (COMMPAR_AUDIO_VOIX_MAX < args_info.tdma_voices_arg))
+	{
+		fprintf(stderr, "--tdma-voices must be within 0..%d\n", COMMPAR_AUDIO_VOIX_MAX);
+		exit(1);
+	}
+
+	if ((1 > args_info.bridge_jitter_arg) || (TDMA_BRIDGE_JITTER_MAX < args_info.bridge_jitter_arg))
+	{
+		fprintf(stderr, "--bridge-jitter must be within 1..%u blocks\n", TDMA_BRIDGE_JITTER_MAX);
+		exit(1);
+	}
+
+	if ((1U > g_settings.audio_channels) || (AUDIO_TEST_CHANNELS_MAX < g_settings.audio_channels))
+	{
+		fprintf(stderr, "channels must be within 1..%u\n", AUDIO_TEST_CHANNELS_MAX);
+		exit(1);
+	}
+
+	/* a sweep starts at 2 channels, 1 would run nothing */
+	if ((0 != args_info.channels_sweep_arg) && ((2 > args_info.channels_sweep_arg) || ((int)AUDIO_TEST_CHANNELS_MAX < args_info.channels_sweep_arg)))
+	{
+		fprintf(stderr, "--channels-sweep must be 0 (off) or within 2..%u\n", AUDIO_TEST_CHANNELS_MAX);
+		exit(1);
+	}
+
+	if ((1 > args_info.bw_streams_arg) || ((int)BW_STREAMS_MAX < args_info.bw_streams_arg))
+	{
+		fprintf(stderr, "--bw-streams must be within 1..%u\n", BW_STREAMS_MAX);
+		exit(1);
+	}
+
+	if ((44100 != args_info.rate_arg) && (48000 != args_info.rate_arg) && (88200 != args_info.rate_arg) && (96000 != args_info.rate_arg))
+	{
+		fprintf(stderr, "--rate must be 44100, 48000, 88200 or 96000\n");
+		exit(1);
+	}
+
+	if (0 > args_info.rate_switch_arg)
+	{
+		fprintf(stderr, "--rate-switch must be >= 0 periods\n");
+		exit(1);
+	}
+
+	/* the buffer holds two periods, of the lowest rate when it switches */
+	buffer_frames = AUDIO_TEST_PERIODS * (int)AUDIO_PERIOD_SZ_FRAMES((0 < args_info.rate_switch_arg) ? 44100 : args_info.rate_arg);
+
+	if ((-1 > args_info.prefill_arg) || (buffer_frames < args_info.prefill_arg))
+	{
+		fprintf(stderr, "--prefill must be -1 or within 0..%d frames\n", buffer_frames);
+		exit(1);
+	}
+
+	if ((0 > args_info.start_threshold_arg) || (buffer_frames < args_info.start_threshold_arg))
+	{
+		fprintf(stderr, "--start-threshold must be within 0..%d frames\n", buffer_frames);
+		exit(1);
+	}
+
+	if ((0 > args_info.load_arg) || (100 < args_info.load_arg))
+	{
+		fprintf(stderr, "--load must be within 0..100 percent\n");
+		exit(1);
+	}
 
 	DLT_REGISTER_CONTEXT_LL_TS(dlt_ctxt_btst, "BTST", "BSP Test suite", g_settings.verbosity, DLT_TRACE_STATUS_DEFAULT);
 
@@ -69,17 +286,70 @@ int main(int argc, char **argv)
 	{
 		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : loops:"), DLT_UINT32(g_settings.nb_loops));
 		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : pauses:"), DLT_INT32(args_info.pauses_arg));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : rate:"), DLT_UINT32(g_settings.audio_rate));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : rate switch every:"), DLT_UINT32(g_settings.rate_switch));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : channels:"), DLT_UINT32(g_settings.audio_channels));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : channel sweep up to:"), DLT_UINT32(g_settings.channels_sweep));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : glitch detector:"), DLT_UINT32(g_settings.glitch_detect));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : warm restart:"), DLT_UINT32(g_settings.warm_restart));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : prefill/start threshold:"), DLT_INT32(g_settings.prefill), DLT_UINT32(g_settings.start_threshold));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio : fill telemetry:"), DLT_UINT32(g_settings.telemetry), DLT_STRING((NULL != g_settings.fill_trace) ? g_settings.fill_trace : "-"));
 	}
 
 	if (0 != args_info.rack_given)
 	{
 		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("rack read freq: "), DLT_INT32(g_settings.rack_freq));
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("rack batching compare: "), DLT_UINT32(g_settings.rack_compare));
 	}
 
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("load injection (percent/kernel/ramp):"), DLT_UINT32(g_settings.load_percent), DLT_UINT32(g_settings.load_kernel), DLT_UINT32(g_settings.load_ramp));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio/tdma phase monitor:"), DLT_UINT32(g_settings.phase_monitor));
 	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("stm32 enabled:"), DLT_INT32(args_info.stm32_flag));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("stm32 frame pipeline depth:"), DLT_UINT32(g_settings.tdma_pipeline));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("stm32 cycle timer (enabled/phase us):"), DLT_UINT32(g_settings.tdma_timer), DLT_UINT32(g_settings.tdma_phase_us));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("stm32 capture/replay (speed):"), DLT_STRING((NULL != g_settings.tdma_capture) ? g_settings.tdma_capture : "-"),
+			DLT_STRING((NULL != g_settings.tdma_replay) ? g_settings.tdma_replay : "-"), DLT_UINT32(g_settings.replay_speed));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("stm32 ext data frames per sample:"), DLT_UINT32(g_settings.tdma_ext));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("stm32 synthetic voices (voices/pattern):"), DLT_UINT32(g_settings.tdma_voices),
+			DLT_UINT32(g_settings.tdma_pattern));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio/stm32 voice bridge (enabled/codec/jitter blocks):"), DLT_UINT32(g_settings.bridge),
+			DLT_STRING(g_settings.bridge_codec), DLT_UINT32(g_settings.bridge_jitter));
 	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("uart  enabled:"), DLT_INT32(args_info.uart_flag));
 	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("gpio poll test only:"), DLT_INT32(args_info.gpio_test_only_flag));
 
+	/* a micro-benchmark runs alone, then exits */
+	if ((EXIT_SUCCESS == ret) && (0 != args_info.bench_given))
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("bench spi device/mode:"), DLT_STRING(g_settings.spi_dev), DLT_HEX32(g_settings.spi_mode));
+
+		ret = esg_bench_run(args_info.bench_arg, &g_settings);
+		spi_prof_report();
+
+		dlt_client_exit();
+
+		return ret;
+	}
+
+	/* reads the ext data stream of another instance, then exits */
+	if ((EXIT_SUCCESS == ret) && (0 != args_info.tdma_ext_query_flag))
+	{
+		ret = tdma_ext_query(g_settings.nb_loops);
+
+		dlt_client_exit();
+
+		return ret;
+	}
+
+	/* reads the spi profile of another instance, then exits */
+	if ((EXIT_SUCCESS == ret) && (0 != args_info.spi_prof_query_flag))
+	{
+		ret = spi_prof_query();
+
+		dlt_client_exit();
+
+		return ret;
+	}
+
 	/* quick ctr+c test for the slave-ready GPIO */
 	if ((EXIT_SUCCESS == ret) && (1 == args_info.gpio_test_only_flag))
 	{
@@ -93,13 +363,47 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* the phase monitor compares the audio periods with the slave-ready edges, it needs both runners */
+	if ((EXIT_SUCCESS == ret) && (0U != g_settings.phase_monitor))
+	{
+		if ((0 != args_info.audio_flag) && (0 != args_info.gpiod_flag))
+		{
+			tdma_phase_init();
+		}
+		else
+		{
+			DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("phase monitor needs --audio and --gpiod, ignored"));
+			g_settings.phase_monitor = 0U;
+		}
+	}
+
+	/* the voice bridge joins the audio periods and the TDMA cycles, it needs both runners */
+	if ((EXIT_SUCCESS == ret) && (0U != g_settings.bridge))
+	{
+		if ((0 != args_info.audio_flag) && (0 != args_info.stm32_flag) && (AUDIO_BW_OFF == g_settings.bw_mode))
+		{
+			ret = tdma_bridge_init(g_settings.bridge_codec, g_settings.bridge_jitter);
+		}
+		else
+		{
+			DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("voice bridge needs --audio and --stm32, ignored"));
+			g_settings.bridge = 0U;
+		}
+	}
+
 	/* check if auvitran interface test is wanted, set the default gains and audio matrix */
 	if ((EXIT_SUCCESS == ret) && (0 != args_info.rack_given))
 	{
 		ret = rack_runner_init(&test_runner[RUNNER_RACK], (void *)&g_settings);
 	}
 
-	if ((EXIT_SUCCESS == ret) && (0 != args_info.audio_flag))
+	/* the bandwidth stress takes the card for itself */
+	if ((EXIT_SUCCESS == ret) && (AUDIO_BW_OFF != g_settings.bw_mode))
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("audio bw : mode/streams/pcm:"), DLT_UINT32(g_settings.bw_mode), DLT_UINT32(g_settings.bw_streams), DLT_STRING(g_settings.pcm_name));
+		ret = alsa_bw_runner_init(&test_runner[RUNNER_AUDIO_BW], (void *)&g_settings);
+	}
+	else if ((EXIT_SUCCESS == ret) && (0 != args_info.audio_flag))
 	{
 		ret = audio_runner_init_poll(&test_runner[RUNNER_AUDIO], (void *)&g_settings);
 	}
@@ -126,6 +430,11 @@ int main(int argc, char **argv)
 		pthread_join(test_runner[RUNNER_AUDIO], NULL);
 	}
 
+	if (0 != test_runner[RUNNER_AUDIO_BW])
+	{
+		pthread_join(test_runner[RUNNER_AUDIO_BW], NULL);
+	}
+
 	if (0 != test_runner[RUNNER_ELITE_GPIOD])
 	{
 		pthread_join(test_runner[RUNNER_ELITE_GPIOD], NULL);
@@ -142,6 +451,19 @@ int main(int argc, char **argv)
 	}
 
 
+	if (0U != g_settings.phase_monitor)
+	{
+		tdma_phase_report();
+	}
+
+	if (0U != g_settings.bridge)
+	{
+		tdma_bridge_report();
+		tdma_bridge_close();
+	}
+
+	spi_prof_report();
+
 	/* we don't join the uard runner, we just kill it when comm
 	 * is no longuer needed
 
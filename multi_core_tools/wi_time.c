@@ -2,6 +2,9 @@
 #include <stdlib.h>
 #include <stdint.h> //4 uint...
 #include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include "wi_time.h"
 
@@ -50,4 +53,70 @@ long time_getElapse_us(long start_time)
     {
     }
     return ((res.tv_sec*1000000 + res.tv_nsec/1000) - start_time);
-}
\ No newline at end of file
+}
+
+// 64 bits nanoseconds, does not wrap on 32 bits targets
+uint64_t time_getClock_ns(void)
+{
+    struct timespec res;
+    if(clock_gettime(TIME_CLOCK, &res)<0)
+    {
+    }
+    return ((uint64_t)res.tv_sec*1000000000ULL + (uint64_t)res.tv_nsec);
+}
+
+// CPU time consumed by the calling thread only, blocking in select()/poll() does not count
+uint64_t time_getThreadCpu_ns(void)
+{
+    struct timespec res;
+    if(clock_gettime(CLOCK_THREAD_CPUTIME_ID, &res)<0)
+    {
+    }
+    return ((uint64_t)res.tv_sec*1000000000ULL + (uint64_t)res.tv_nsec);
+}
+
+// counts suspend time too, hence usable for a time since power-on
+uint64_t time_getBoottime_ns(void)
+{
+    struct timespec res;
+    if(clock_gettime(CLOCK_BOOTTIME, &res)<0)
+    {
+    }
+    return ((uint64_t)res.tv_sec*1000000000ULL + (uint64_t)res.tv_nsec);
+}
+
+// process start on the CLOCK_BOOTTIME scale (field 22 of /proc/self/stat, in clock ticks), 0 if unknown
+uint64_t time_getProcessStart_ns(void)
+{
+    char stat[512] = {0};
+    unsigned long long start_ticks = 0;
+    long ticks = sysconf(_SC_CLK_TCK);
+    FILE *f = fopen("/proc/self/stat", "r");
+
+    if(NULL != f)
+    {
+        char *p;
+
+        stat[fread(stat, 1, sizeof(stat) - 1, f)] = 0;
+        /* comm may hold spaces, fields are counted from the closing parenthesis (field 2) */
+        p = strrchr(stat, ')');
+
+        if((NULL == p) || (1 != sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d %*d %*d %llu", &start_ticks)))
+        {
+            start_ticks = 0;
+        }
+        fclose(f);
+    }
+
+    return (0 < ticks) ? (start_ticks * 1000000000ULL / (unsigned long long)ticks) : 0;
+}
+
+// raw hardware counter, not slewed by NTP/PTP: two clock domains compared on it show their true drift
+uint64_t time_getClockRaw_ns(void)
+{
+    struct timespec res;
+    if(clock_gettime(CLOCK_MONOTONIC_RAW, &res)<0)
+    {
+    }
+    return ((uint64_t)res.tv_sec*1000000000ULL + (uint64_t)res.tv_nsec);
+}
@@ -18,5 +18,10 @@ int time_isTimeout( struct timeval *a);
 long time_getClkockResolution_ns(void);
 long time_getClock_us(void);
 long time_getElapse_us(long start_time);
+uint64_t time_getClock_ns(void);
+uint64_t time_getThreadCpu_ns(void);
+uint64_t time_getBoottime_ns(void);
+uint64_t time_getProcessStart_ns(void);
+uint64_t time_getClockRaw_ns(void);
 
 #endif //__TIME_H__
\ No newline at end of file
@@ -34,24 +34,61 @@ const char *gengetopt_args_info_versiontext = "";
 const char *gengetopt_args_info_description = "";
 
 const char *gengetopt_args_info_help[] = {
-  "  -h, --help            Print help and exit",
-  "  -V, --version         Print version and exit",
-  "  -l, --loops=INT       Number or cycles for each running. this is roughly the\n                          number of 20ms audio periods to process, or 10ms SPI\n                          messages\n                            (default=`1000')",
-  "  -p, --pauses=INT      Number or pauses (stop, restart) to simulate.\n                            (default=`0')",
-  "  -r, --rack=INT        frequency for reading peak-meters  (default=`0')",
-  "      --audio           enable audio runner  (default=off)",
-  "      --gpiod           enable gpiod x-fer  (default=off)",
-  "      --uart            enable uart x-fer  (default=off)",
-  "      --gpio-test-only  just check select() on gpio47  (default=off)",
-  "      --stm32           enable stm32 x-fer on spidev 3.0 (tdma spidev sim)\n                          (default=off)",
-  "  -s, --sched-rt=INT    make runner about realtime with a SCHED_FIFO prio (1 to\n                          99)  (default=`50')",
-  "  -v, --verbose         force VERBOSE mode",
+  "  -h, --help                   Print help and exit",
+  "  -V, --version                Print version and exit",
+  "  -l, --loops=INT              Number or cycles for each running. this is\n                                 roughly the number of 20ms audio periods to\n                                 process, or 10ms SPI messages\n                                   (default=`1000')",
+  "  -p, --pauses=INT             Number or pauses (stop, restart) to simulate.\n                                   (default=`0')",
+  "  -r, --rack=INT               frequency for reading peak-meters  (default=`0')",
+  "      --audio                  enable audio runner  (default=off)",
+  "      --gpiod                  enable gpiod x-fer  (default=off)",
+  "      --uart                   enable uart x-fer  (default=off)",
+  "      --gpio-test-only         just check select() on gpio47  (default=off)",
+  "      --stm32                  enable stm32 x-fer on spidev 3.0 (tdma spidev\n                                 sim)  (default=off)",
+  "      --rate=INT               audio sample rate in Hz (44100, 48000, 88200 or\n                                 96000)  (default=`48000')",
+  "      --rate-switch=INT        switch audio rate every N periods, cycling\n                                 44.1/48/88.2/96kHz (rack clock follows with\n                                 --rack)  (default=`0')",
+  "      --channels=INT           audio channels per stream (1 to 64)\n                                 (default=`4')",
+  "      --channels-sweep=INT     benchmark CPU per period for 2, 4, 8 ... up to N\n                                 channels (stops at the card limit)\n                                 (default=`0')",
+  "      --glitch                 run the click/dropout detector on every captured\n                                 period  (default=off)",
+  "      --warm-restart           pause cycles (-p) use a warm restart\n                                 (drop/prepare/prefill/start) instead of drain\n                                 and restart  (default=off)",
+  "      --prefill=INT            frames of silence written before starting\n                                 playback (-1: two periods, at most the buffer)\n                                 (default=`-1')",
+  "      --start-threshold=INT    playback start threshold in frames (0: alsa\n                                 default, start is explicit)  (default=`0')",
+  "      --telemetry              sample capture/playback buffer fill every loop,\n                                 log min/max every second  (default=off)",
+  "      --fill-trace=filename    write the buffer fill timeline to this binary\n                                 file at exit (implies --telemetry)",
+  "      --bw=mode                DMA bandwidth stress, 'capture' or 'playback'\n                                 only, at the card max channels and rate\n                                 (instead of --audio)",
+  "      --bw-streams=INT         number of streams opened at once by --bw (1 to 8)\n                                 (default=`1')",
+  "      --pcm=name               pcm name for --bw, a %d is replaced by the stream\n                                 index (e.g. hw:0,0,%d for subdevices)",
+  "      --load=INT               burn this percentage of each audio period and\n                                 stm32 cycle inside the runner threads\n                                 (default=`0')",
+  "      --load-kernel=kernel     synthetic load kernel, 'busy' (ALU) or 'memory'\n                                 (cache line walk over 8MB)",
+  "      --load-ramp              raise the load by 5% every 100 cycles until a\n                                 deadline is missed, then report the maximum\n                                 usable percentage  (default=off)",
+  "      --phase                  monitor the phase, drift and jitter between the\n                                 audio periods and the TDMA slave-ready edges\n                                 (needs --audio and --gpiod)  (default=off)",
+  "      --rack-compare           alternate peak-meter reads with one ioctl per SPI\n                                 segment and batched, report the cost of both\n                                 (default=off)",
+  "      --tdma-pipeline=INT      stm32: N buffer pairs (2 to 8), TX frames built\n                                 and RX frames parsed by helper threads, 0 keeps\n                                 it in line in the RT thread  (default=`0')",
+  "      --tdma-timer             stm32: release the transfers on absolute 10ms\n                                 deadlines (clock_nanosleep) instead of the\n                                 slave-ready GPIO  (default=off)",
+  "      --tdma-phase=INT         stm32: offset in us of its cycles on the 10ms\n                                 grid shared with the rack runner (--rack), with\n                                 --tdma-timer  (default=`0')",
+  "      --tdma-capture=filename  stm32: record every TX/RX frame pair with its\n                                 timestamps to this file",
+  "      --tdma-replay=filename   stm32: feed the RX frames of a capture to the\n                                 runner, instead of the spidev and slave-ready\n                                 GPIO",
+  "      --tdma-replay-speed=INT  1 replays at the recorded timing, N N times\n                                 faster, 0 as fast as possible  (default=`1')",
+  "      --tdma-ext=INT           stm32: decode the extended data of every RX frame\n                                 (VU, quality per terminal, recording, PIO),\n                                 publish one aggregate every N frames (1 to\n                                 1000) to /dev/shm/esg-tdma-ext, summary every\n                                 5s  (default=`0')",
+  "      --tdma-ext-query         print the last -l aggregates published by\n                                 --tdma-ext (running, or the last run), then\n                                 exit  (default=off)",
+  "      --tdma-voices=INT        stm32: synthetic TX traffic, N voices (1 to 5)\n                                 with opus 16/24kHz payloads, changing audio\n                                 control and slot info, CPU cost per frame at\n                                 exit (0: one counter voice)  (default=`0')",
+  "      --tdma-pattern=pattern   voice activity of --tdma-voices: 'burst' (talk\n                                 spurts and silences), 'all' (every voice talks,\n                                 the peak) or 'silence'",
+  "      --bridge                 voice bridge: capture channel 0 to TX voice 0, RX\n                                 voice 0 to playback, with mouth-to-ear latency\n                                 (needs --audio and --stm32)  (default=off)",
+  "      --bridge-codec=codec     voice bridge codec, 'stub' (3.2kHz 8 bits, no\n                                 dependency) or 'opus' (16kHz 16kb/s, when built\n                                 with libopus)",
+  "      --bridge-jitter=INT      voice bridge jitter buffer target, in 10ms blocks\n                                 (1 to 8)  (default=`2')",
+  "      --bench=name             run a micro-benchmark instead of the runners, -l\n                                 iterations: 'codec', 'crc', 'spi'",
+  "      --spi-dev=device         spidev swept by --bench=spi (/dev/spidev1.0 rack,\n                                 /dev/spidev3.0 STM32), 'mock' for an in-process\n                                 loopback",
+  "      --spi-mode=INT           SPI mode (0 to 3) for --bench=spi, the rack uses\n                                 3  (default=`0')",
+  "      --spi-loop               --bench=spi sets SPI_LOOP and checks that what\n                                 comes back is what was sent  (default=off)",
+  "      --spi-prof-query         print the SPI ioctl profile (per thread and\n                                 device: count, bytes, errors, time) of a\n                                 running instance, or of the last run, then exit\n                                 (default=off)",
+  "  -s, --sched-rt=INT           make runner about realtime with a SCHED_FIFO prio\n                                 (1 to 99)  (default=`50')",
+  "  -v, --verbose                force VERBOSE mode",
   "\nExample1 :run audio-loopback and uart-parsing : #>esg-bsp-test --audio --uart\n-l 10000000 --verbose\n\nExample2 :run audio-loopback and stress pause/resume : #>esg-bsp-test --audio\n-p -l 10000000\nGood luck.",
     0
 };
 
 typedef enum {ARG_NO
   , ARG_FLAG
+  , ARG_STRING
   , ARG_INT
 } cmdline_parser_arg_type;
 
@@ -81,6 +118,42 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->uart_given = 0 ;
   args_info->gpio_test_only_given = 0 ;
   args_info->stm32_given = 0 ;
+  args_info->rate_given = 0 ;
+  args_info->rate_switch_given = 0 ;
+  args_info->channels_given = 0 ;
+  args_info->channels_sweep_given = 0 ;
+  args_info->glitch_given = 0 ;
+  args_info->warm_restart_given = 0 ;
+  args_info->prefill_given = 0 ;
+  args_info->start_threshold_given = 0 ;
+  args_info->telemetry_given = 0 ;
+  args_info->fill_trace_given = 0 ;
+  args_info->bw_given = 0 ;
+  args_info->bw_streams_given = 0 ;
+  args_info->pcm_given = 0 ;
+  args_info->load_given = 0 ;
+  args_info->load_kernel_given = 0 ;
+  args_info->load_ramp_given = 0 ;
+  args_info->phase_given = 0 ;
+  args_info->rack_compare_given = 0 ;
+  args_info->tdma_pipeline_given = 0 ;
+  args_info->tdma_timer_given = 0 ;
+  args_info->tdma_phase_given = 0 ;
+  args_info->tdma_capture_given = 0 ;
+  args_info->tdma_replay_given = 0 ;
+  args_info->tdma_replay_speed_given = 0 ;
+  args_info->tdma_ext_given = 0 ;
+  args_info->tdma_ext_query_given = 0 ;
+  args_info->tdma_voices_given = 0 ;
+  args_info->tdma_pattern_given = 0 ;
+  args_info->bridge_given = 0 ;
+  args_info->bridge_codec_given = 0 ;
+  args_info->bridge_jitter_given = 0 ;
+  args_info->bench_given = 0 ;
+  args_info->spi_dev_given = 0 ;
+  args_info->spi_mode_given = 0 ;
+  args_info->spi_loop_given = 0 ;
+  args_info->spi_prof_query_given = 0 ;
   args_info->sched_rt_given = 0 ;
   args_info->verbose_given = 0 ;
 }
@@ -100,6 +173,67 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->uart_flag = 0;
   args_info->gpio_test_only_flag = 0;
   args_info->stm32_flag = 0;
+  args_info->rate_arg = 48000;
+  args_info->rate_orig = NULL;
+  args_info->rate_switch_arg = 0;
+  args_info->rate_switch_orig = NULL;
+  args_info->channels_arg = 4;
+  args_info->channels_orig = NULL;
+  args_info->channels_sweep_arg = 0;
+  args_info->channels_sweep_orig = NULL;
+  args_info->glitch_flag = 0;
+  args_info->warm_restart_flag = 0;
+  args_info->prefill_arg = -1;
+  args_info->prefill_orig = NULL;
+  args_info->start_threshold_arg = 0;
+  args_info->start_threshold_orig = NULL;
+  args_info->telemetry_flag = 0;
+  args_info->fill_trace_arg = NULL;
+  args_info->fill_trace_orig = NULL;
+  args_info->bw_arg = NULL;
+  args_info->bw_orig = NULL;
+  args_info->bw_streams_arg = 1;
+  args_info->bw_streams_orig = NULL;
+  args_info->pcm_arg = NULL;
+  args_info->pcm_orig = NULL;
+  args_info->load_arg = 0;
+  args_info->load_orig = NULL;
+  args_info->load_kernel_arg = NULL;
+  args_info->load_kernel_orig = NULL;
+  args_info->load_ramp_flag = 0;
+  args_info->phase_flag = 0;
+  args_info->rack_compare_flag = 0;
+  args_info->tdma_pipeline_arg = 0;
+  args_info->tdma_pipeline_orig = NULL;
+  args_info->tdma_timer_flag = 0;
+  args_info->tdma_phase_arg = 0;
+  args_info->tdma_phase_orig = NULL;
+  args_info->tdma_capture_arg = NULL;
+  args_info->tdma_capture_orig = NULL;
+  args_info->tdma_replay_arg = NULL;
+  args_info->tdma_replay_orig = NULL;
+  args_info->tdma_replay_speed_arg = 1;
+  args_info->tdma_replay_speed_orig = NULL;
+  args_info->tdma_ext_arg = 0;
+  args_info->tdma_ext_orig = NULL;
+  args_info->tdma_ext_query_flag = 0;
+  args_info->tdma_voices_arg = 0;
+  args_info->tdma_voices_orig = NULL;
+  args_info->tdma_pattern_arg = NULL;
+  args_info->tdma_pattern_orig = NULL;
+  args_info->bridge_flag = 0;
+  args_info->bridge_codec_arg = NULL;
+  args_info->bridge_codec_orig = NULL;
+  args_info->bridge_jitter_arg = 2;
+  args_info->bridge_jitter_orig = NULL;
+  args_info->bench_arg = NULL;
+  args_info->bench_orig = NULL;
+  args_info->spi_dev_arg = NULL;
+  args_info->spi_dev_orig = NULL;
+  args_info->spi_mode_arg = 0;
+  args_info->spi_mode_orig = NULL;
+  args_info->spi_loop_flag = 0;
+  args_info->spi_prof_query_flag = 0;
   args_info->sched_rt_arg = 50;
   args_info->sched_rt_orig = NULL;
   
@@ -120,8 +254,44 @@ void init_args_info(struct gengetopt_args_info *args_info)
   args_info->uart_help = gengetopt_args_info_help[7] ;
   args_info->gpio_test_only_help = gengetopt_args_info_help[8] ;
   args_info->stm32_help = gengetopt_args_info_help[9] ;
-  args_info->sched_rt_help = gengetopt_args_info_help[10] ;
-  args_info->verbose_help = gengetopt_args_info_help[11] ;
+  args_info->rate_help = gengetopt_args_info_help[10] ;
+  args_info->rate_switch_help = gengetopt_args_info_help[11] ;
+  args_info->channels_help = gengetopt_args_info_help[12] ;
+  args_info->channels_sweep_help = gengetopt_args_info_help[13] ;
+  args_info->glitch_help = gengetopt_args_info_help[14] ;
+  args_info->warm_restart_help = gengetopt_args_info_help[15] ;
+  args_info->prefill_help = gengetopt_args_info_help[16] ;
+  args_info->start_threshold_help = gengetopt_args_info_help[17] ;
+  args_info->telemetry_help = gengetopt_args_info_help[18] ;
+  args_info->fill_trace_help = gengetopt_args_info_help[19] ;
+  args_info->bw_help = gengetopt_args_info_help[20] ;
+  args_info->bw_streams_help = gengetopt_args_info_help[21] ;
+  args_info->pcm_help = gengetopt_args_info_help[22] ;
+  args_info->load_help = gengetopt_args_info_help[23] ;
+  args_info->load_kernel_help = gengetopt_args_info_help[24] ;
+  args_info->load_ramp_help = gengetopt_args_info_help[25] ;
+  args_info->phase_help = gengetopt_args_info_help[26] ;
+  args_info->rack_compare_help = gengetopt_args_info_help[27] ;
+  args_info->tdma_pipeline_help = gengetopt_args_info_help[28] ;
+  args_info->tdma_timer_help = gengetopt_args_info_help[29] ;
+  args_info->tdma_phase_help = gengetopt_args_info_help[30] ;
+  args_info->tdma_capture_help = gengetopt_args_info_help[31] ;
+  args_info->tdma_replay_help = gengetopt_args_info_help[32] ;
+  args_info->tdma_replay_speed_help = gengetopt_args_info_help[33] ;
+  args_info->tdma_ext_help = gengetopt_args_info_help[34] ;
+  args_info->tdma_ext_query_help = gengetopt_args_info_help[35] ;
+  args_info->tdma_voices_help = gengetopt_args_info_help[36] ;
+  args_info->tdma_pattern_help = gengetopt_args_info_help[37] ;
+  args_info->bridge_help = gengetopt_args_info_help[38] ;
+  args_info->bridge_codec_help = gengetopt_args_info_help[39] ;
+  args_info->bridge_jitter_help = gengetopt_args_info_help[40] ;
+  args_info->bench_help = gengetopt_args_info_help[41] ;
+  args_info->spi_dev_help = gengetopt_args_info_help[42] ;
+  args_info->spi_mode_help = gengetopt_args_info_help[43] ;
+  args_info->spi_loop_help = gengetopt_args_info_help[44] ;
+  args_info->spi_prof_query_help = gengetopt_args_info_help[45] ;
+  args_info->sched_rt_help = gengetopt_args_info_help[46] ;
+  args_info->verbose_help = gengetopt_args_info_help[47] ;
   
 }
 
@@ -214,6 +384,41 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->loops_orig));
   free_string_field (&(args_info->pauses_orig));
   free_string_field (&(args_info->rack_orig));
+  free_string_field (&(args_info->rate_orig));
+  free_string_field (&(args_info->rate_switch_orig));
+  free_string_field (&(args_info->channels_orig));
+  free_string_field (&(args_info->channels_sweep_orig));
+  free_string_field (&(args_info->prefill_orig));
+  free_string_field (&(args_info->start_threshold_orig));
+  free_string_field (&(args_info->fill_trace_arg));
+  free_string_field (&(args_info->fill_trace_orig));
+  free_string_field (&(args_info->bw_arg));
+  free_string_field (&(args_info->bw_orig));
+  free_string_field (&(args_info->bw_streams_orig));
+  free_string_field (&(args_info->pcm_arg));
+  free_string_field (&(args_info->pcm_orig));
+  free_string_field (&(args_info->load_orig));
+  free_string_field (&(args_info->load_kernel_arg));
+  free_string_field (&(args_info->load_kernel_orig));
+  free_string_field (&(args_info->tdma_pipeline_orig));
+  free_string_field (&(args_info->tdma_phase_orig));
+  free_string_field (&(args_info->tdma_capture_arg));
+  free_string_field (&(args_info->tdma_capture_orig));
+  free_string_field (&(args_info->tdma_replay_arg));
+  free_string_field (&(args_info->tdma_replay_orig));
+  free_string_field (&(args_info->tdma_replay_speed_orig));
+  free_string_field (&(args_info->tdma_ext_orig));
+  free_string_field (&(args_info->tdma_voices_orig));
+  free_string_field (&(args_info->tdma_pattern_arg));
+  free_string_field (&(args_info->tdma_pattern_orig));
+  free_string_field (&(args_info->bridge_codec_arg));
+  free_string_field (&(args_info->bridge_codec_orig));
+  free_string_field (&(args_info->bridge_jitter_orig));
+  free_string_field (&(args_info->bench_arg));
+  free_string_field (&(args_info->bench_orig));
+  free_string_field (&(args_info->spi_dev_arg));
+  free_string_field (&(args_info->spi_dev_orig));
+  free_string_field (&(args_info->spi_mode_orig));
   free_string_field (&(args_info->sched_rt_orig));
   
   
@@ -265,6 +470,78 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "gpio-test-only", 0, 0 );
   if (args_info->stm32_given)
     write_into_file(outfile, "stm32", 0, 0 );
+  if (args_info->rate_given)
+    write_into_file(outfile, "rate", args_info->rate_orig, 0);
+  if (args_info->rate_switch_given)
+    write_into_file(outfile, "rate-switch", args_info->rate_switch_orig, 0);
+  if (args_info->channels_given)
+    write_into_file(outfile, "channels", args_info->channels_orig, 0);
+  if (args_info->channels_sweep_given)
+    write_into_file(outfile, "channels-sweep", args_info->channels_sweep_orig, 0);
+  if (args_info->glitch_given)
+    write_into_file(outfile, "glitch", 0, 0 );
+  if (args_info->warm_restart_given)
+    write_into_file(outfile, "warm-restart", 0, 0 );
+  if (args_info->prefill_given)
+    write_into_file(outfile, "prefill", args_info->prefill_orig, 0);
+  if (args_info->start_threshold_given)
+    write_into_file(outfile, "start-threshold", args_info->start_threshold_orig, 0);
+  if (args_info->telemetry_given)
+    write_into_file(outfile, "telemetry", 0, 0 );
+  if (args_info->fill_trace_given)
+    write_into_file(outfile, "fill-trace", args_info->fill_trace_orig, 0);
+  if (args_info->bw_given)
+    write_into_file(outfile, "bw", args_info->bw_orig, 0);
+  if (args_info->bw_streams_given)
+    write_into_file(outfile, "bw-streams", args_info->bw_streams_orig, 0);
+  if (args_info->pcm_given)
+    write_into_file(outfile, "pcm", args_info->pcm_orig, 0);
+  if (args_info->load_given)
+    write_into_file(outfile, "load", args_info->load_orig, 0);
+  if (args_info->load_kernel_given)
+    write_into_file(outfile, "load-kernel", args_info->load_kernel_orig, 0);
+  if (args_info->load_ramp_given)
+    write_into_file(outfile, "load-ramp", 0, 0 );
+  if (args_info->phase_given)
+    write_into_file(outfile, "phase", 0, 0 );
+  if (args_info->rack_compare_given)
+    write_into_file(outfile, "rack-compare", 0, 0 );
+  if (args_info->tdma_pipeline_given)
+    write_into_file(outfile, "tdma-pipeline", args_info->tdma_pipeline_orig, 0);
+  if (args_info->tdma_timer_given)
+    write_into_file(outfile, "tdma-timer", 0, 0 );
+  if (args_info->tdma_phase_given)
+    write_into_file(outfile, "tdma-phase", args_info->tdma_phase_orig, 0);
+  if (args_info->tdma_capture_given)
+    write_into_file(outfile, "tdma-capture", args_info->tdma_capture_orig, 0);
+  if (args_info->tdma_replay_given)
+    write_into_file(outfile, "tdma-replay", args_info->tdma_replay_orig, 0);
+  if (args_info->tdma_replay_speed_given)
+    write_into_file(outfile, "tdma-replay-speed", args_info->tdma_replay_speed_orig, 0);
+  if (args_info->tdma_ext_given)
+    write_into_file(outfile, "tdma-ext", args_info->tdma_ext_orig, 0);
+  if (args_info->tdma_ext_query_given)
+    write_into_file(outfile, "tdma-ext-query", 0, 0 );
+  if (args_info->tdma_voices_given)
+    write_into_file(outfile, "tdma-voices", args_info->tdma_voices_orig, 0);
+  if (args_info->tdma_pattern_given)
+    write_into_file(outfile, "tdma-pattern", args_info->tdma_pattern_orig, 0);
+  if (args_info->bridge_given)
+    write_into_file(outfile, "bridge", 0, 0 );
+  if (args_info->bridge_codec_given)
+    write_into_file(outfile, "bridge-codec", args_info->bridge_codec_orig, 0);
+  if (args_info->bridge_jitter_given)
+    write_into_file(outfile, "bridge-jitter", args_info->bridge_jitter_orig, 0);
+  if (args_info->bench_given)
+    write_into_file(outfile, "bench", args_info->bench_orig, 0);
+  if (args_info->spi_dev_given)
+    write_into_file(outfile, "spi-dev", args_info->spi_dev_orig, 0);
+  if (args_info->spi_mode_given)
+    write_into_file(outfile, "spi-mode", args_info->spi_mode_orig, 0);
+  if (args_info->spi_loop_given)
+    write_into_file(outfile, "spi-loop", 0, 0 );
+  if (args_info->spi_prof_query_given)
+    write_into_file(outfile, "spi-prof-query", 0, 0 );
   if (args_info->sched_rt_given)
     write_into_file(outfile, "sched-rt", args_info->sched_rt_orig, 0);
   if (args_info->verbose_given)
@@ -404,6 +681,7 @@ int update_arg(void *field, char **orig_field,
   char *stop_char = 0;
   const char *val = value;
   int found;
+  char **string_field;
   FIX_UNUSED (field);
 
   stop_char = 0;
@@ -440,6 +718,14 @@ int update_arg(void *field, char **orig_field,
   case ARG_INT:
     if (val) *((int *)field) = strtol (val, &stop_char, 0);
     break;
+  case ARG_STRING:
+    if (val) {
+      string_field = (char **)field;
+      if (!no_free && *string_field)
+        free (*string_field); /* free previous string */
+      *string_field = gengetopt_strdup (val);
+    }
+    break;
   default:
     break;
   };
@@ -530,6 +816,42 @@ cmdline_parser_internal (
         { "uart",	0, NULL, 0 },
         { "gpio-test-only",	0, NULL, 0 },
         { "stm32",	0, NULL, 0 },
+        { "rate",	1, NULL, 0 },
+        { "rate-switch",	1, NULL, 0 },
+        { "channels",	1, NULL, 0 },
+        { "channels-sweep",	1, NULL, 0 },
+        { "glitch",	0, NULL, 0 },
+        { "warm-restart",	0, NULL, 0 },
+        { "prefill",	1, NULL, 0 },
+        { "start-threshold",	1, NULL, 0 },
+        { "telemetry",	0, NULL, 0 },
+        { "fill-trace",	1, NULL, 0 },
+        { "bw",	1, NULL, 0 },
+        { "bw-streams",	1, NULL, 0 },
+        { "pcm",	1, NULL, 0 },
+        { "load",	1, NULL, 0 },
+        { "load-kernel",	1, NULL, 0 },
+        { "load-ramp",	0, NULL, 0 },
+        { "phase",	0, NULL, 0 },
+        { "rack-compare",	0, NULL, 0 },
+        { "tdma-pipeline",	1, NULL, 0 },
+        { "tdma-timer",	0, NULL, 0 },
+        { "tdma-phase",	1, NULL, 0 },
+        { "tdma-capture",	1, NULL, 0 },
+        { "tdma-replay",	1, NULL, 0 },
+        { "tdma-replay-speed",	1, NULL, 0 },
+        { "tdma-ext",	1, NULL, 0 },
+        { "tdma-ext-query",	0, NULL, 0 },
+        { "tdma-voices",	1, NULL, 0 },
+        { "tdma-pattern",	1, NULL, 0 },
+        { "bridge",	0, NULL, 0 },
+        { "bridge-codec",	1, NULL, 0 },
+        { "bridge-jitter",	1, NULL, 0 },
+        { "bench",	1, NULL, 0 },
+        { "spi-dev",	1, NULL, 0 },
+        { "spi-mode",	1, NULL, 0 },
+        { "spi-loop",	0, NULL, 0 },
+        { "spi-prof-query",	0, NULL, 0 },
         { "sched-rt",	1, NULL, 's' },
         { "verbose",	0, NULL, 'v' },
         { 0,  0, 0, 0 }
@@ -674,6 +996,488 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* audio sample rate in Hz (44100, 48000, 88200 or 96000).  */
+          else if (strcmp (long_options[option_index].name, "rate") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->rate_arg),
+                 &(args_info->rate_orig), &(args_info->rate_given),
+                &(local_args_info.rate_given), optarg, 0, "48000", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "rate", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* switch audio rate every N periods, cycling 44.1/48/88.2/96kHz (rack clock follows with --rack).  */
+          else if (strcmp (long_options[option_index].name, "rate-switch") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->rate_switch_arg),
+                 &(args_info->rate_switch_orig), &(args_info->rate_switch_given),
+                &(local_args_info.rate_switch_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "rate-switch", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* audio channels per stream (1 to 64).  */
+          else if (strcmp (long_options[option_index].name, "channels") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->channels_arg),
+                 &(args_info->channels_orig), &(args_info->channels_given),
+                &(local_args_info.channels_given), optarg, 0, "4", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "channels", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* benchmark CPU per period for 2, 4, 8 ... up to N channels (stops at the card limit).  */
+          else if (strcmp (long_options[option_index].name, "channels-sweep") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->channels_sweep_arg),
+                 &(args_info->channels_sweep_orig), &(args_info->channels_sweep_given),
+                &(local_args_info.channels_sweep_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "channels-sweep", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* run the click/dropout detector on every captured period.  */
+          else if (strcmp (long_options[option_index].name, "glitch") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->glitch_flag), 0, &(args_info->glitch_given),
+                &(local_args_info.glitch_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "glitch", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* pause cycles (-p) use a warm restart (drop/prepare/prefill/start) instead of drain and restart.  */
+          else if (strcmp (long_options[option_index].name, "warm-restart") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->warm_restart_flag), 0, &(args_info->warm_restart_given),
+                &(local_args_info.warm_restart_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "warm-restart", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* frames of silence written before starting playback (-1: two periods, at most the buffer).  */
+          else if (strcmp (long_options[option_index].name, "prefill") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->prefill_arg),
+                 &(args_info->prefill_orig), &(args_info->prefill_given),
+                &(local_args_info.prefill_given), optarg, 0, "-1", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "prefill", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* playback start threshold in frames (0: alsa default, start is explicit).  */
+          else if (strcmp (long_options[option_index].name, "start-threshold") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->start_threshold_arg),
+                 &(args_info->start_threshold_orig), &(args_info->start_threshold_given),
+                &(local_args_info.start_threshold_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "start-threshold", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* sample capture/playback buffer fill every loop, log min/max every second.  */
+          else if (strcmp (long_options[option_index].name, "telemetry") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->telemetry_flag), 0, &(args_info->telemetry_given),
+                &(local_args_info.telemetry_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "telemetry", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* write the buffer fill timeline to this binary file at exit (implies --telemetry).  */
+          else if (strcmp (long_options[option_index].name, "fill-trace") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->fill_trace_arg),
+                 &(args_info->fill_trace_orig), &(args_info->fill_trace_given),
+                &(local_args_info.fill_trace_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "fill-trace", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* DMA bandwidth stress, 'capture' or 'playback' only, at the card max channels and rate (instead of --audio).  */
+          else if (strcmp (long_options[option_index].name, "bw") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->bw_arg),
+                 &(args_info->bw_orig), &(args_info->bw_given),
+                &(local_args_info.bw_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "bw", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* number of streams opened at once by --bw (1 to 8).  */
+          else if (strcmp (long_options[option_index].name, "bw-streams") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->bw_streams_arg),
+                 &(args_info->bw_streams_orig), &(args_info->bw_streams_given),
+                &(local_args_info.bw_streams_given), optarg, 0, "1", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "bw-streams", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* pcm name for --bw, a %d is replaced by the stream index (e.g. hw:0,0,%d for subdevices).  */
+          else if (strcmp (long_options[option_index].name, "pcm") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->pcm_arg),
+                 &(args_info->pcm_orig), &(args_info->pcm_given),
+                &(local_args_info.pcm_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "pcm", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* burn this percentage of each audio period and stm32 cycle inside the runner threads.  */
+          else if (strcmp (long_options[option_index].name, "load") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->load_arg),
+                 &(args_info->load_orig), &(args_info->load_given),
+                &(local_args_info.load_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "load", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* synthetic load kernel, 'busy' (ALU) or 'memory' (cache line walk over 8MB).  */
+          else if (strcmp (long_options[option_index].name, "load-kernel") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->load_kernel_arg),
+                 &(args_info->load_kernel_orig), &(args_info->load_kernel_given),
+                &(local_args_info.load_kernel_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "load-kernel", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* raise the load by 5% every 100 cycles until a deadline is missed, then report the maximum usable percentage.  */
+          else if (strcmp (long_options[option_index].name, "load-ramp") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->load_ramp_flag), 0, &(args_info->load_ramp_given),
+                &(local_args_info.load_ramp_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "load-ramp", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* monitor the phase, drift and jitter between the audio periods and the TDMA slave-ready edges (needs --audio and --gpiod).  */
+          else if (strcmp (long_options[option_index].name, "phase") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->phase_flag), 0, &(args_info->phase_given),
+                &(local_args_info.phase_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "phase", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* alternate peak-meter reads with one ioctl per SPI segment and batched, report the cost of both.  */
+          else if (strcmp (long_options[option_index].name, "rack-compare") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->rack_compare_flag), 0, &(args_info->rack_compare_given),
+                &(local_args_info.rack_compare_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "rack-compare", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: N buffer pairs (2 to 8), TX frames built and RX frames parsed by helper threads, 0 keeps it in line in the RT thread.  */
+          else if (strcmp (long_options[option_index].name, "tdma-pipeline") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_pipeline_arg),
+                 &(args_info->tdma_pipeline_orig), &(args_info->tdma_pipeline_given),
+                &(local_args_info.tdma_pipeline_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "tdma-pipeline", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: release the transfers on absolute 10ms deadlines (clock_nanosleep) instead of the slave-ready GPIO.  */
+          else if (strcmp (long_options[option_index].name, "tdma-timer") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->tdma_timer_flag), 0, &(args_info->tdma_timer_given),
+                &(local_args_info.tdma_timer_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "tdma-timer", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: offset in us of its cycles on the 10ms grid shared with the rack runner (--rack), with --tdma-timer.  */
+          else if (strcmp (long_options[option_index].name, "tdma-phase") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_phase_arg),
+                 &(args_info->tdma_phase_orig), &(args_info->tdma_phase_given),
+                &(local_args_info.tdma_phase_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "tdma-phase", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: record every TX/RX frame pair with its timestamps to this file.  */
+          else if (strcmp (long_options[option_index].name, "tdma-capture") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_capture_arg),
+                 &(args_info->tdma_capture_orig), &(args_info->tdma_capture_given),
+                &(local_args_info.tdma_capture_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "tdma-capture", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: feed the RX frames of a capture to the runner, instead of the spidev and slave-ready GPIO.  */
+          else if (strcmp (long_options[option_index].name, "tdma-replay") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_replay_arg),
+                 &(args_info->tdma_replay_orig), &(args_info->tdma_replay_given),
+                &(local_args_info.tdma_replay_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "tdma-replay", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* 1 replays at the recorded timing, N N times faster, 0 as fast as possible.  */
+          else if (strcmp (long_options[option_index].name, "tdma-replay-speed") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_replay_speed_arg),
+                 &(args_info->tdma_replay_speed_orig), &(args_info->tdma_replay_speed_given),
+                &(local_args_info.tdma_replay_speed_given), optarg, 0, "1", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "tdma-replay-speed", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: decode the extended data of every RX frame (VU, quality per terminal, recording, PIO), publish one aggregate every N frames (1 to 1000) to /dev/shm/esg-tdma-ext, summary every 5s.  */
+          else if (strcmp (long_options[option_index].name, "tdma-ext") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_ext_arg),
+                 &(args_info->tdma_ext_orig), &(args_info->tdma_ext_given),
+                &(local_args_info.tdma_ext_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "tdma-ext", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* print the last -l aggregates published by --tdma-ext (running, or the last run), then exit.  */
+          else if (strcmp (long_options[option_index].name, "tdma-ext-query") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->tdma_ext_query_flag), 0, &(args_info->tdma_ext_query_given),
+                &(local_args_info.tdma_ext_query_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "tdma-ext-query", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* stm32: synthetic TX traffic, N voices (1 to 5) with opus 16/24kHz payloads, changing audio control and slot info, CPU cost per frame at exit (0: one counter voice).  */
+          else if (strcmp (long_options[option_index].name, "tdma-voices") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_voices_arg),
+                 &(args_info->tdma_voices_orig), &(args_info->tdma_voices_given),
+                &(local_args_info.tdma_voices_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "tdma-voices", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* voice activity of --tdma-voices: 'burst' (talk spurts and silences), 'all' (every voice talks, the peak) or 'silence'.  */
+          else if (strcmp (long_options[option_index].name, "tdma-pattern") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->tdma_pattern_arg),
+                 &(args_info->tdma_pattern_orig), &(args_info->tdma_pattern_given),
+                &(local_args_info.tdma_pattern_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "tdma-pattern", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* voice bridge: capture channel 0 to TX voice 0, RX voice 0 to playback, with mouth-to-ear latency (needs --audio and --stm32).  */
+          else if (strcmp (long_options[option_index].name, "bridge") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->bridge_flag), 0, &(args_info->bridge_given),
+                &(local_args_info.bridge_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "bridge", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* voice bridge codec, 'stub' (3.2kHz 8 bits, no dependency) or 'opus' (16kHz 16kb/s, when built with libopus).  */
+          else if (strcmp (long_options[option_index].name, "bridge-codec") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->bridge_codec_arg),
+                 &(args_info->bridge_codec_orig), &(args_info->bridge_codec_given),
+                &(local_args_info.bridge_codec_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "bridge-codec", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* voice bridge jitter buffer target, in 10ms blocks (1 to 8).  */
+          else if (strcmp (long_options[option_index].name, "bridge-jitter") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->bridge_jitter_arg),
+                 &(args_info->bridge_jitter_orig), &(args_info->bridge_jitter_given),
+                &(local_args_info.bridge_jitter_given), optarg, 0, "2", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "bridge-jitter", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* run a micro-benchmark instead of the runners, -l iterations: 'codec', 'crc', 'spi'.  */
+          else if (strcmp (long_options[option_index].name, "bench") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->bench_arg),
+                 &(args_info->bench_orig), &(args_info->bench_given),
+                &(local_args_info.bench_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "bench", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* spidev swept by --bench=spi (/dev/spidev1.0 rack, /dev/spidev3.0 STM32), 'mock' for an in-process loopback.  */
+          else if (strcmp (long_options[option_index].name, "spi-dev") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->spi_dev_arg),
+                 &(args_info->spi_dev_orig), &(args_info->spi_dev_given),
+                &(local_args_info.spi_dev_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "spi-dev", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* SPI mode (0 to 3) for --bench=spi, the rack uses 3.  */
+          else if (strcmp (long_options[option_index].name, "spi-mode") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->spi_mode_arg),
+                 &(args_info->spi_mode_orig), &(args_info->spi_mode_given),
+                &(local_args_info.spi_mode_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "spi-mode", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* --bench=spi sets SPI_LOOP and checks that what comes back is what was sent.  */
+          else if (strcmp (long_options[option_index].name, "spi-loop") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->spi_loop_flag), 0, &(args_info->spi_loop_given),
+                &(local_args_info.spi_loop_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "spi-loop", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* print the SPI ioctl profile (per thread and device: count, bytes, errors, time) of a running instance, or of the last run, then exit.  */
+          else if (strcmp (long_options[option_index].name, "spi-prof-query") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->spi_prof_query_flag), 0, &(args_info->spi_prof_query_given),
+                &(local_args_info.spi_prof_query_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "spi-prof-query", '-',
+                additional_error))
+              goto failure;
+          
           }
           
           break;
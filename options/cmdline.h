@@ -64,6 +64,103 @@ struct gengetopt_args_info
   const char *gpio_test_only_help; /**< @brief just check select() on gpio47 help description.  */
   int stm32_flag;	/**< @brief enable stm32 x-fer on spidev 3.0 (tdma spidev sim) (default=off).  */
   const char *stm32_help; /**< @brief enable stm32 x-fer on spidev 3.0 (tdma spidev sim) help description.  */
+  int rate_arg;	/**< @brief audio sample rate in Hz (44100, 48000, 88200 or 96000) (default='48000').  */
+  char * rate_orig;	/**< @brief audio sample rate in Hz (44100, 48000, 88200 or 96000) original value given at command line.  */
+  const char *rate_help; /**< @brief audio sample rate in Hz (44100, 48000, 88200 or 96000) help description.  */
+  int rate_switch_arg;	/**< @brief switch audio rate every N periods, cycling 44.1/48/88.2/96kHz (rack clock follows with --rack) (default='0').  */
+  char * rate_switch_orig;	/**< @brief switch audio rate every N periods, cycling 44.1/48/88.2/96kHz (rack clock follows with --rack) original value given at command line.  */
+  const char *rate_switch_help; /**< @brief switch audio rate every N periods, cycling 44.1/48/88.2/96kHz (rack clock follows with --rack) help description.  */
+  int channels_arg;	/**< @brief audio channels per stream (1 to 64) (default='4').  */
+  char * channels_orig;	/**< @brief audio channels per stream (1 to 64) original value given at command line.  */
+  const char *channels_help; /**< @brief audio channels per stream (1 to 64) help description.  */
+  int channels_sweep_arg;	/**< @brief benchmark CPU per period for 2, 4, 8 ... up to N channels (stops at the card limit) (default='0').  */
+  char * channels_sweep_orig;	/**< @brief benchmark CPU per period for 2, 4, 8 ... up to N channels (stops at the card limit) original value given at command line.  */
+  const char *channels_sweep_help; /**< @brief benchmark CPU per period for 2, 4, 8 ... up to N channels (stops at the card limit) help description.  */
+  int glitch_flag;	/**< @brief run the click/dropout detector on every captured period (default=off).  */
+  const char *glitch_help; /**< @brief run the click/dropout detector on every captured period help description.  */
+  int warm_restart_flag;	/**< @brief pause cycles (-p) use a warm restart (drop/prepare/prefill/start) instead of drain and restart (default=off).  */
+  const char *warm_restart_help; /**< @brief pause cycles (-p) use a warm restart (drop/prepare/prefill/start) instead of drain and restart help description.  */
+  int prefill_arg;	/**< @brief frames of silence written before starting playback (-1: two periods, at most the buffer) (default='-1').  */
+  char * prefill_orig;	/**< @brief frames of silence written before starting playback (-1: two periods, at most the buffer) original value given at command line.  */
+  const char *prefill_help; /**< @brief frames of silence written before starting playback (-1: two periods, at most the buffer) help description.  */
+  int start_threshold_arg;	/**< @brief playback start threshold in frames (0: alsa default, start is explicit) (default='0').  */
+  char * start_threshold_orig;	/**< @brief playback start threshold in frames (0: alsa default, start is explicit) original value given at command line.  */
+  const char *start_threshold_help; /**< @brief playback start threshold in frames (0: alsa default, start is explicit) help description.  */
+  int telemetry_flag;	/**< @brief sample capture/playback buffer fill every loop, log min/max every second (default=off).  */
+  const char *telemetry_help; /**< @brief sample capture/playback buffer fill every loop, log min/max every second help description.  */
+  char * fill_trace_arg;	/**< @brief write the buffer fill timeline to this binary file at exit (implies --telemetry).  */
+  char * fill_trace_orig;	/**< @brief write the buffer fill timeline to this binary file at exit (implies --telemetry) original value given at command line.  */
+  const char *fill_trace_help; /**< @brief write the buffer fill timeline to this binary file at exit (implies --telemetry) help description.  */
+  char * bw_arg;	/**< @brief DMA bandwidth stress, 'capture' or 'playback' only, at the card max channels and rate (instead of --audio).  */
+  char * bw_orig;	/**< @brief DMA bandwidth stress, 'capture' or 'playback' only, at the card max channels and rate (instead of --audio) original value given at command line.  */
+  const char *bw_help; /**< @brief DMA bandwidth stress, 'capture' or 'playback' only, at the card max channels and rate (instead of --audio) help description.  */
+  int bw_streams_arg;	/**< @brief number of streams opened at once by --bw (1 to 8) (default='1').  */
+  char * bw_streams_orig;	/**< @brief number of streams opened at once by --bw (1 to 8) original value given at command line.  */
+  const char *bw_streams_help; /**< @brief number of streams opened at once by --bw (1 to 8) help description.  */
+  char * pcm_arg;	/**< @brief pcm name for --bw, a %d is replaced by the stream index (e.g. hw:0,0,%d for subdevices).  */
+  char * pcm_orig;	/**< @brief pcm name for --bw, a %d is replaced by the stream index (e.g. hw:0,0,%d for subdevices) original value given at command line.  */
+  const char *pcm_help; /**< @brief pcm name for --bw, a %d is replaced by the stream index (e.g. hw:0,0,%d for subdevices) help description.  */
+  int load_arg;	/**< @brief burn this percentage of each audio period and stm32 cycle inside the runner threads (default='0').  */
+  char * load_orig;	/**< @brief burn this percentage of each audio period and stm32 cycle inside the runner threads original value given at command line.  */
+  const char *load_help; /**< @brief burn this percentage of each audio period and stm32 cycle inside the runner threads help description.  */
+  char * load_kernel_arg;	/**< @brief synthetic load kernel, 'busy' (ALU) or 'memory' (cache line walk over 8MB).  */
+  char * load_kernel_orig;	/**< @brief synthetic load kernel, 'busy' (ALU) or 'memory' (cache line walk over 8MB) original value given at command line.  */
+  const char *load_kernel_help; /**< @brief synthetic load kernel, 'busy' (ALU) or 'memory' (cache line walk over 8MB) help description.  */
+  int load_ramp_flag;	/**< @brief raise the load by 5% every 100 cycles until a deadline is missed, then report the maximum usable percentage (default=off).  */
+  const char *load_ramp_help; /**< @brief raise the load by 5% every 100 cycles until a deadline is missed, then report the maximum usable percentage help description.  */
+  int phase_flag;	/**< @brief monitor the phase, drift and jitter between the audio periods and the TDMA slave-ready edges (needs --audio and --gpiod) (default=off).  */
+  const char *phase_help; /**< @brief monitor the phase, drift and jitter between the audio periods and the TDMA slave-ready edges (needs --audio and --gpiod) help description.  */
+  int rack_compare_flag;	/**< @brief alternate peak-meter reads with one ioctl per SPI segment and batched, report the cost of both (default=off).  */
+  const char *rack_compare_help; /**< @brief alternate peak-meter reads with one ioctl per SPI segment and batched, report the cost of both help description.  */
+  int tdma_pipeline_arg;	/**< @brief stm32: N buffer pairs (2 to 8), TX frames built and RX frames parsed by helper threads, 0 keeps it in line in the RT thread (default='0').  */
+  char * tdma_pipeline_orig;	/**< @brief stm32: N buffer pairs (2 to 8), TX frames built and RX frames parsed by helper threads, 0 keeps it in line in the RT thread original value given at command line.  */
+  const char *tdma_pipeline_help; /**< @brief stm32: N buffer pairs (2 to 8), TX frames built and RX frames parsed by helper threads, 0 keeps it in line in the RT thread help description.  */
+  int tdma_timer_flag;	/**< @brief stm32: release the transfers on absolute 10ms deadlines (clock_nanosleep) instead of the slave-ready GPIO (default=off).  */
+  const char *tdma_timer_help; /**< @brief stm32: release the transfers on absolute 10ms deadlines (clock_nanosleep) instead of the slave-ready GPIO help description.  */
+  int tdma_phase_arg;	/**< @brief stm32: offset in us of its cycles on the 10ms grid shared with the rack runner (--rack), with --tdma-timer (default='0').  */
+  char * tdma_phase_orig;	/**< @brief stm32: offset in us of its cycles on the 10ms grid shared with the rack runner (--rack), with --tdma-timer original value given at command line.  */
+  const char *tdma_phase_help; /**< @brief stm32: offset in us of its cycles on the 10ms grid shared with the rack runner (--rack), with --tdma-timer help description.  */
+  char * tdma_capture_arg;	/**< @brief stm32: record every TX/RX frame pair with its timestamps to this file.  */
+  char * tdma_capture_orig;	/**< @brief stm32: record every TX/RX frame pair with its timestamps to this file original value given at command line.  */
+  const char *tdma_capture_help; /**< @brief stm32: record every TX/RX frame pair with its timestamps to this file help description.  */
+  char * tdma_replay_arg;	/**< @brief stm32: feed the RX frames of a capture to the runner, instead of the spidev and slave-ready GPIO.  */
+  char * tdma_replay_orig;	/**< @brief stm32: feed the RX frames of a capture to the runner, instead of the spidev and slave-ready GPIO original value given at command line.  */
+  const char *tdma_replay_help; /**< @brief stm32: feed the RX frames of a capture to the runner, instead of the spidev and slave-ready GPIO help description.  */
+  int tdma_replay_speed_arg;	/**< @brief 1 replays at the recorded timing, N N times faster, 0 as fast as possible (default='1').  */
+  char * tdma_replay_speed_orig;	/**< @brief 1 replays at the recorded timing, N N times faster, 0 as fast as possible original value given at command line.  */
+  const char *tdma_replay_speed_help; /**< @brief 1 replays at the recorded timing, N N times faster, 0 as fast as possible help description.  */
+  int tdma_ext_arg;	/**< @brief stm32: decode the extended data of every RX frame (VU, quality per terminal, recording, PIO), publish one aggregate every N frames (1 to 1000) to /dev/shm/esg-tdma-ext, summary every 5s (default='0').  */
+  char * tdma_ext_orig;	/**< @brief stm32: decode the extended data of every RX frame (VU, quality per terminal, recording, PIO), publish one aggregate every N frames (1 to 1000) to /dev/shm/esg-tdma-ext, summary every 5s original value given at command line.  */
+  const char *tdma_ext_help; /**< @brief stm32: decode the extended data of every RX frame (VU, quality per terminal, recording, PIO), publish one aggregate every N frames (1 to 1000) to /dev/shm/esg-tdma-ext, summary every 5s help description.  */
+  int tdma_ext_query_flag;	/**< @brief print the last -l aggregates published by --tdma-ext (running, or the last run), then exit (default=off).  */
+  const char *tdma_ext_query_help; /**< @brief print the last -l aggregates published by --tdma-ext (running, or the last run), then exit help description.  */
+  int tdma_voices_arg;	/**< @brief stm32: synthetic TX traffic, N voices (1 to 5) with opus 16/24kHz payloads, changing audio control and slot info, CPU cost per frame at exit (0: one counter voice) (default='0').  */
+  char * tdma_voices_orig;	/**< @brief stm32: synthetic TX traffic, N voices (1 to 5) with opus 16/24kHz payloads, changing audio control and slot info, CPU cost per frame at exit (0: one counter voice) original value given at command line.  */
+  const char *tdma_voices_help; /**< @brief stm32: synthetic TX traffic, N voices (1 to 5) with opus 16/24kHz payloads, changing audio control and slot info, CPU cost per frame at exit (0: one counter voice) help description.  */
+  char * tdma_pattern_arg;	/**< @brief voice activity of --tdma-voices: 'burst' (talk spurts and silences), 'all' (every voice talks, the peak) or 'silence'.  */
+  char * tdma_pattern_orig;	/**< @brief voice activity of --tdma-voices: 'burst' (talk spurts and silences), 'all' (every voice talks, the peak) or 'silence' original value given at command line.  */
+  const char *tdma_pattern_help; /**< @brief voice activity of --tdma-voices: 'burst' (talk spurts and silences), 'all' (every voice talks, the peak) or 'silence' help description.  */
+  int bridge_flag;	/**< @brief voice bridge: capture channel 0 to TX voice 0, RX voice 0 to playback, with mouth-to-ear latency (needs --audio and --stm32) (default=off).  */
+  const char *bridge_help; /**< @brief voice bridge: capture channel 0 to TX voice 0, RX voice 0 to playback, with mouth-to-ear latency (needs --audio and --stm32) help description.  */
+  char * bridge_codec_arg;	/**< @brief voice bridge codec, 'stub' (3.2kHz 8 bits, no dependency) or 'opus' (16kHz 16kb/s, when built with libopus).  */
+  char * bridge_codec_orig;	/**< @brief voice bridge codec, 'stub' (3.2kHz 8 bits, no dependency) or 'opus' (16kHz 16kb/s, when built with libopus) original value given at command line.  */
+  const char *bridge_codec_help; /**< @brief voice bridge codec, 'stub' (3.2kHz 8 bits, no dependency) or 'opus' (16kHz 16kb/s, when built with libopus) help description.  */
+  int bridge_jitter_arg;	/**< @brief voice bridge jitter buffer target, in 10ms blocks (1 to 8) (default='2').  */
+  char * bridge_jitter_orig;	/**< @brief voice bridge jitter buffer target, in 10ms blocks (1 to 8) original value given at command line.  */
+  const char *bridge_jitter_help; /**< @brief voice bridge jitter buffer target, in 10ms blocks (1 to 8) help description.  */
+  char * bench_arg;	/**< @brief run a micro-benchmark instead of the runners, -l iterations: 'codec', 'crc', 'spi'.  */
+  char * bench_orig;	/**< @brief run a micro-benchmark instead of the runners, -l iterations: 'codec', 'crc', 'spi' original value given at command line.  */
+  const char *bench_help; /**< @brief run a micro-benchmark instead of the runners, -l iterations: 'codec', 'crc', 'spi' help description.  */
+  char * spi_dev_arg;	/**< @brief spidev swept by --bench=spi (/dev/spidev1.0 rack, /dev/spidev3.0 STM32), 'mock' for an in-process loopback.  */
+  char * spi_dev_orig;	/**< @brief spidev swept by --bench=spi (/dev/spidev1.0 rack, /dev/spidev3.0 STM32), 'mock' for an in-process loopback original value given at command line.  */
+  const char *spi_dev_help; /**< @brief spidev swept by --bench=spi (/dev/spidev1.0 rack, /dev/spidev3.0 STM32), 'mock' for an in-process loopback help description.  */
+  int spi_mode_arg;	/**< @brief SPI mode (0 to 3) for --bench=spi, the rack uses 3 (default='0').  */
+  char * spi_mode_orig;	/**< @brief SPI mode (0 to 3) for --bench=spi, the rack uses 3 original value given at command line.  */
+  const char *spi_mode_help; /**< @brief SPI mode (0 to 3) for --bench=spi, the rack uses 3 help description.  */
+  int spi_loop_flag;	/**< @brief --bench=spi sets SPI_LOOP and checks that what comes back is what was sent (default=off).  */
+  const char *spi_loop_help; /**< @brief --bench=spi sets SPI_LOOP and checks that what comes back is what was sent help description.  */
+  int spi_prof_query_flag;	/**< @brief print the SPI ioctl profile (per thread and device: count, bytes, errors, time) of a running instance, or of the last run, then exit (default=off).  */
+  const char *spi_prof_query_help; /**< @brief print the SPI ioctl profile (per thread and device: count, bytes, errors, time) of a running instance, or of the last run, then exit help description.  */
   int sched_rt_arg;	/**< @brief make runner about realtime with a SCHED_FIFO prio (1 to 99) (default='50').  */
   char * sched_rt_orig;	/**< @brief make runner about realtime with a SCHED_FIFO prio (1 to 99) original value given at command line.  */
   const char *sched_rt_help; /**< @brief make runner about realtime with a SCHED_FIFO prio (1 to 99) help description.  */
@@ -79,6 +176,42 @@ struct gengetopt_args_info
   unsigned int uart_given ;	/**< @brief Whether uart was given.  */
   unsigned int gpio_test_only_given ;	/**< @brief Whether gpio-test-only was given.  */
   unsigned int stm32_given ;	/**< @brief Whether stm32 was given.  */
+  unsigned int rate_given ;	/**< @brief Whether rate was given.  */
+  unsigned int rate_switch_given ;	/**< @brief Whether rate-switch was given.  */
+  unsigned int channels_given ;	/**< @brief Whether channels was given.  */
+  unsigned int channels_sweep_given ;	/**< @brief Whether channels-sweep was given.  */
+  unsigned int glitch_given ;	/**< @brief Whether glitch was given.  */
+  unsigned int warm_restart_given ;	/**< @brief Whether warm-restart was given.  */
+  unsigned int prefill_given ;	/**< @brief Whether prefill was given.  */
+  unsigned int start_threshold_given ;	/**< @brief Whether start-threshold was given.  */
+  unsigned int telemetry_given ;	/**< @brief Whether telemetry was given.  */
+  unsigned int fill_trace_given ;	/**< @brief Whether fill-trace was given.  */
+  unsigned int bw_given ;	/**< @brief Whether bw was given.  */
+  unsigned int bw_streams_given ;	/**< @brief Whether bw-streams was given.  */
+  unsigned int pcm_given ;	/**< @brief Whether pcm was given.  */
+  unsigned int load_given ;	/**< @brief Whether load was given.  */
+  unsigned int load_kernel_given ;	/**< @brief Whether load-kernel was given.  */
+  unsigned int load_ramp_given ;	/**< @brief Whether load-ramp was given.  */
+  unsigned int phase_given ;	/**< @brief Whether phase was given.  */
+  unsigned int rack_compare_given ;	/**< @brief Whether rack-compare was given.  */
+  unsigned int tdma_pipeline_given ;	/**< @brief Whether tdma-pipeline was given.  */
+  unsigned int tdma_timer_given ;	/**< @brief Whether tdma-timer was given.  */
+  unsigned int tdma_phase_given ;	/**< @brief Whether tdma-phase was given.  */
+  unsigned int tdma_capture_given ;	/**< @brief Whether tdma-capture was given.  */
+  unsigned int tdma_replay_given ;	/**< @brief Whether tdma-replay was given.  */
+  unsigned int tdma_replay_speed_given ;	/**< @brief Whether tdma-replay-speed was given.  */
+  unsigned int tdma_ext_given ;	/**< @brief Whether tdma-ext was given.  */
+  unsigned int tdma_ext_query_given ;	/**< @brief Whether tdma-ext-query was given.  */
+  unsigned int tdma_voices_given ;	/**< @brief Whether tdma-voices was given.  */
+  unsigned int tdma_pattern_given ;	/**< @brief Whether tdma-pattern was given.  */
+  unsigned int bridge_given ;	/**< @brief Whether bridge was given.  */
+  unsigned int bridge_codec_given ;	/**< @brief Whether bridge-codec was given.  */
+  unsigned int bridge_jitter_given ;	/**< @brief Whether bridge-jitter was given.  */
+  unsigned int bench_given ;	/**< @brief Whether bench was given.  */
+  unsigned int spi_dev_given ;	/**< @brief Whether spi-dev was given.  */
+  unsigned int spi_mode_given ;	/**< @brief Whether spi-mode was given.  */
+  unsigned int spi_loop_given ;	/**< @brief Whether spi-loop was given.  */
+  unsigned int spi_prof_query_given ;	/**< @brief Whether spi-prof-query was given.  */
   unsigned int sched_rt_given ;	/**< @brief Whether sched-rt was given.  */
   unsigned int verbose_given ;	/**< @brief Whether verbose was given.  */
 
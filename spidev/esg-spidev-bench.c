@@ -0,0 +1,244 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-bench.c
+ Version     :
+ Copyright   : Closed
+ Description : spidev bus characterization, run with --bench=spi
+
+ Starting from the STM32 operating point, sweeps one parameter at a time:
+ clock speed, transfer size, bits per word and segments per SPI_IOC_MESSAGE(N),
+ then the same point from locked, page aligned buffers and from unaligned ones.
+ For each point: ioctl latency (p50/p99/max), throughput, bus use (wire time
+ over ioctl time) and CPU time of the calling thread over wall time.
+ ============================================================================
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "esg-spidev.h"
+#include "esg-spidev-bench.h"
+#include "wi_time.h"
+
+/* twice the default spidev bufsiz, the largest size is split in two messages */
+#define SPI_BENCH_MAX_SIZE 8192U
+
+static const uint32_t bench_speeds[] = {1000000U, 2000000U, 4000000U, 8000000U, 12000000U, 16000000U, 24000000U, 32000000U};
+static const uint32_t bench_sizes[] = {4U, 16U, 64U, SPI_BENCH_BASE_SIZE, 1024U, 4096U, SPI_BENCH_MAX_SIZE};
+static const uint32_t bench_bits[] = {8U, 16U, 32U};
+static const uint32_t bench_segs[] = {1U, 2U, 4U, SPI_SEGS_MAX};
+
+#define SPI_BENCH_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+/* one segment per slot, so that a message never reuses a buffer: TX then RX slots,
+ * in spi_buf_alloc() buffers, or one byte off the alignment of a malloc()
+ */
+#define SPI_BENCH_BUF_SIZE (2U * SPI_SEGS_MAX * SPI_BENCH_MAX_SIZE)
+
+static uint8_t *bench_tx[SPI_SEGS_MAX];
+static uint8_t *bench_rx[SPI_SEGS_MAX];
+
+static void spi_bench_buffers(uint8_t *buf)
+{
+    for (uint32_t s = 0U; s < SPI_SEGS_MAX; s++)
+    {
+        bench_tx[s] = buf + s * SPI_BENCH_MAX_SIZE;
+        bench_rx[s] = buf + (SPI_SEGS_MAX + s) * SPI_BENCH_MAX_SIZE;
+
+        for (uint32_t i = 0U; i < SPI_BENCH_MAX_SIZE; i++)
+        {
+            bench_tx[s][i] = (uint8_t)(i * 7U + s * 31U + 1U);
+        }
+    }
+}
+
+static int spi_bench_cmp(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* a single segment goes through spi_transfer(), split above bufsiz */
+static int spi_bench_transfer(spi_dev_t *dev, const spi_seg_t *seg, uint32_t segs)
+{
+    return (1U == segs) ? spi_transfer(dev, seg[0].tx, seg[0].rx, seg[0].len) : spi_transfer_segs(dev, seg, segs);
+}
+
+//==============================================================================
+//! \brief Measure one point of a sweep
+//!
+//! \param  lat_ns: room for iterations latencies
+//! \return 0 if measured or not supported by the controller (logged), -EIO on transfer errors or loopback mismatches
+//==============================================================================
+static int spi_bench_point(spi_dev_t *dev, const char *axis, uint32_t speed, uint32_t size, uint32_t bits, uint32_t segs,
+                           uint32_t iterations, uint32_t *lat_ns)
+{
+    spi_seg_t seg[SPI_SEGS_MAX];
+    uint8_t check = ((0U != dev->mock) || (0U != (dev->mode & SPI_LOOP))) ? 1U : 0U;
+    uint32_t errors = 0U, mismatches = 0U;
+    uint64_t sum_ns = 0U, cpu_ns, wall_ns, wire_ns, avg_ns;
+
+    dev->speed = speed;
+    dev->bits = (uint8_t)bits;
+
+    for (uint32_t s = 0U; s < segs; s++)
+    {
+        seg[s].tx = bench_tx[s];
+        seg[s].rx = bench_rx[s];
+        seg[s].len = size;
+        seg[s].delay_us = 0U;
+    }
+
+    /* the controller may refuse the word size or the speed, that is a result too */
+    if (0 > spi_bench_transfer(dev, seg, segs))
+    {
+        DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("bench spi"), DLT_STRING(axis), DLT_STRING("(speed/size/bits/segs)"),
+                DLT_UINT32(speed), DLT_UINT32(size), DLT_UINT32(bits), DLT_UINT32(segs), DLT_STRING("not supported"));
+        return 0;
+    }
+
+    cpu_ns = time_getThreadCpu_ns();
+    wall_ns = time_getClock_ns();
+
+    for (uint32_t i = 0U; i < iterations; i++)
+    {
+        uint64_t t_start;
+        int ret;
+
+        if (0U != check)
+        {
+            for (uint32_t s = 0U; s < segs; s++)
+            {
+                memset(bench_rx[s], 0, size);
+            }
+        }
+
+        t_start = time_getClock_ns();
+        ret = spi_bench_transfer(dev, seg, segs);
+        lat_ns[i] = (uint32_t)(time_getClock_ns() - t_start);
+        sum_ns += lat_ns[i];
+
+        if (0 > ret)
+        {
+            errors++;
+        }
+        else if (0U != check)
+        {
+            for (uint32_t s = 0U; s < segs; s++)
+            {
+                mismatches += (0 != memcmp(bench_tx[s], bench_rx[s], size));
+            }
+        }
+    }
+
+    wall_ns = time_getClock_ns() - wall_ns;
+    cpu_ns = time_getThreadCpu_ns() - cpu_ns;
+
+    qsort(lat_ns, iterations, sizeof(lat_ns[0]), spi_bench_cmp);
+
+    avg_ns = sum_ns / iterations;
+    wire_ns = (uint64_t)size * segs * 8U * 1000000000ULL / speed;
+
+    DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("bench spi"), DLT_STRING(axis), DLT_STRING("(speed/size/bits/segs)"),
+            DLT_UINT32(speed), DLT_UINT32(size), DLT_UINT32(bits), DLT_UINT32(segs),
+            DLT_STRING("ioctl ns (p50/p99/max)"),
+            DLT_UINT32(lat_ns[iterations / 2U]), DLT_UINT32(lat_ns[((uint64_t)iterations * 99U) / 100U]), DLT_UINT32(lat_ns[iterations - 1U]),
+            DLT_STRING("kB/s"), DLT_UINT64((0U < wall_ns) ? ((uint64_t)size * segs * iterations * 1000000ULL / wall_ns) : 0U),
+            DLT_STRING("bus use %"), DLT_UINT64((0U < avg_ns) ? (wire_ns * 100U / avg_ns) : 0U),
+            DLT_STRING("cpu %"), DLT_UINT64((0U < wall_ns) ? (cpu_ns * 100U / wall_ns) : 0U),
+            DLT_STRING("errors/mismatches"), DLT_UINT32(errors), DLT_UINT32(mismatches));
+
+    return ((0U == errors) && (0U == mismatches)) ? 0 : -EIO;
+}
+
+//==============================================================================
+//! \brief Sweep speed, size, bits per word and segments on one spidev
+//!
+//! \param  device: /dev/spidevX.Y, or SPI_MOCK_DEVICE
+//! \param  mode: SPI_MODE_x, with SPI_LOOP the received data is checked
+//! \param  iterations: messages per point
+//! \return 0 in case of success, < 0 if the device can't be used or a point failed
+//==============================================================================
+int spi_bench(const char *device, uint32_t mode, uint32_t iterations)
+{
+    spi_dev_t dev = {0};
+    uint8_t *locked = NULL;
+    uint8_t *unaligned = NULL;
+    uint32_t *lat_ns = NULL;
+    uint32_t max_speed = 0U;
+    int ret = EXIT_SUCCESS;
+
+    if (0U == iterations)
+    {
+        ret = -EINVAL;
+    }
+
+    if (EXIT_SUCCESS == ret)
+    {
+        lat_ns = malloc(iterations * sizeof(*lat_ns));
+        locked = spi_buf_alloc(SPI_BENCH_BUF_SIZE);
+        unaligned = malloc(SPI_BENCH_BUF_SIZE + 1U);
+        ret = ((NULL != lat_ns) && (NULL != locked) && (NULL != unaligned)) ? EXIT_SUCCESS : -ENOMEM;
+    }
+
+    /* ask for the top of the sweep, the driver answers with what the controller can do */
+    if (EXIT_SUCCESS == ret)
+    {
+        ret = spi_init(&dev, (char *)device, bench_speeds[SPI_BENCH_COUNT(bench_speeds) - 1U], mode);
+        max_speed = dev.speed;
+    }
+
+    if (EXIT_SUCCESS == ret)
+    {
+        spi_bench_buffers(locked);
+
+        DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("bench spi"), DLT_STRING(device),
+                DLT_STRING("(mode/max speed/iterations/bufsiz)"), DLT_HEX32(dev.mode), DLT_UINT32(max_speed), DLT_UINT32(iterations),
+                DLT_UINT32(dev.bufsiz));
+
+        for (uint32_t i = 0U; i < SPI_BENCH_COUNT(bench_speeds); i++)
+        {
+            if (bench_speeds[i] <= max_speed)
+            {
+                ret |= spi_bench_point(&dev, "speed", bench_speeds[i], SPI_BENCH_BASE_SIZE, SPI_BENCH_BASE_BITS, SPI_BENCH_BASE_SEGS, iterations, lat_ns);
+            }
+        }
+
+        for (uint32_t i = 0U; i < SPI_BENCH_COUNT(bench_sizes); i++)
+        {
+            ret |= spi_bench_point(&dev, "size", SPI_STM_SPEED, bench_sizes[i], SPI_BENCH_BASE_BITS, SPI_BENCH_BASE_SEGS, iterations, lat_ns);
+        }
+
+        for (uint32_t i = 0U; i < SPI_BENCH_COUNT(bench_bits); i++)
+        {
+            ret |= spi_bench_point(&dev, "bits", SPI_STM_SPEED, SPI_BENCH_BASE_SIZE, bench_bits[i], SPI_BENCH_BASE_SEGS, iterations, lat_ns);
+        }
+
+        for (uint32_t i = 0U; i < SPI_BENCH_COUNT(bench_segs); i++)
+        {
+            ret |= spi_bench_point(&dev, "segs", SPI_STM_SPEED, SPI_BENCH_BASE_SIZE, SPI_BENCH_BASE_BITS, bench_segs[i], iterations, lat_ns);
+        }
+
+        /* the sweeps above ran from the locked buffers, the STM32 operating point once more from plain ones */
+        ret |= spi_bench_point(&dev, "aligned", SPI_STM_SPEED, SPI_BENCH_BASE_SIZE, SPI_BENCH_BASE_BITS, SPI_BENCH_BASE_SEGS, iterations, lat_ns);
+        spi_bench_buffers(unaligned + 1);
+        ret |= spi_bench_point(&dev, "unaligned", SPI_STM_SPEED, SPI_BENCH_BASE_SIZE, SPI_BENCH_BASE_BITS, SPI_BENCH_BASE_SEGS, iterations, lat_ns);
+
+        /* -EIO or'ed with itself */
+        ret = (EXIT_SUCCESS == ret) ? EXIT_SUCCESS : -EIO;
+    }
+    else
+    {
+        DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("bench spi: can't use"), DLT_STRING((NULL != device) ? device : "-"), DLT_INT32(ret));
+    }
+
+    spi_close(&dev);
+    spi_buf_free(locked, SPI_BENCH_BUF_SIZE);
+    free(unaligned);
+    free(lat_ns);
+
+    return ret;
+}
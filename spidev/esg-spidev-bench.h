@@ -0,0 +1,24 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-bench.h
+ Version     :
+ Copyright   : Closed
+ Description : spidev bus characterization, run with --bench=spi
+ ============================================================================
+ */
+#ifndef ESG_SPIDEV_BENCH
+#define ESG_SPIDEV_BENCH
+#pragma once
+
+#include <stdint.h>
+
+#include "tdma-codec.h"
+
+/* operating point the sweeps start from: the STM32 speed, one TDMA frame, bytes, one segment */
+#define SPI_BENCH_BASE_SIZE ((uint32_t)sizeof(protdspSpiFrame_t))
+#define SPI_BENCH_BASE_BITS 8U
+#define SPI_BENCH_BASE_SEGS 1U
+
+int spi_bench(const char *device, uint32_t mode, uint32_t iterations);
+
+#endif // ESG_SPIDEV_BENCH
@@ -0,0 +1,252 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-exec.c
+ Version     :
+ Copyright   : Closed
+ Description : per bus SPI transaction executor
+
+ The callers block in spi_exec_run() while the owning thread runs their
+ transaction, so the rack API stays synchronous. The owning thread always
+ takes the first transaction of the most urgent non empty class: bulk
+ traffic only delays a mute by the bulk transaction already on the bus.
+ A transaction queued from the owning thread itself (a rack function
+ calling another one) runs in place.
+ ============================================================================
+ */
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+#include "esg-bsp-test.h"
+#include "esg-spidev-exec.h"
+#include "wi_time.h"
+
+DLT_IMPORT_CONTEXT(dlt_ctxt_rack);
+
+static const char *const spi_exec_class_names[SPI_EXEC_CLASSES] = {"urgent", "control", "bulk"};
+
+/* under lock: the head of the most urgent class */
+static spi_exec_txn_t *spi_exec_pop(spi_exec_t *exec)
+{
+    for (uint32_t c = 0U; c < SPI_EXEC_CLASSES; c++)
+    {
+        spi_exec_txn_t *txn = exec->queue[c];
+
+        if (NULL != txn)
+        {
+            exec->queue[c] = txn->next;
+            return txn;
+        }
+    }
+
+    return NULL;
+}
+
+static void *spi_exec_thread(void *p_data)
+{
+    spi_exec_t *exec = (spi_exec_t *)p_data;
+
+    /* the rack accesses show up under this name in the spi profile */
+    (void)prctl(PR_SET_NAME, "spi-exec", 0, 0, 0);
+
+    pthread_mutex_lock(&exec->lock);
+
+    /* a stop still drains the queue */
+    for (;;)
+    {
+        spi_exec_txn_t *txn = spi_exec_pop(exec);
+        uint64_t t_start, t_end;
+
+        if (NULL == txn)
+        {
+            if (0U == exec->running)
+            {
+                break;
+            }
+            pthread_cond_wait(&exec->queued, &exec->lock);
+            continue;
+        }
+
+        pthread_mutex_unlock(&exec->lock);
+
+        t_start = time_getClock_ns();
+        txn->result = txn->fn(txn->arg);
+        t_end = time_getClock_ns();
+
+        pthread_mutex_lock(&exec->lock);
+
+        exec->runs[txn->cls]++;
+        exec->late[txn->cls] += (t_start > txn->deadline_ns) ? 1U : 0U;
+        esg_hist_add(&exec->wait_us[txn->cls], (int64_t)(t_start - txn->submit_ns) / 1000);
+        esg_hist_add(&exec->run_us[txn->cls], (int64_t)(t_end - t_start) / 1000);
+
+        txn->done = 1U;
+        pthread_cond_broadcast(&exec->completed);
+    }
+
+    pthread_mutex_unlock(&exec->lock);
+
+    return NULL;
+}
+
+//==============================================================================
+//! \brief Start the thread owning a bus
+//!
+//! \param  name: for the report
+//! \param  rt_priority: SCHED_FIFO priority, 0 to inherit the policy of the caller
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int spi_exec_start(spi_exec_t *exec, const char *name, int rt_priority)
+{
+    pthread_attr_t attr;
+    int ret;
+
+    memset(exec, 0, sizeof(*exec));
+    exec->name = name;
+
+    for (uint32_t c = 0U; c < SPI_EXEC_CLASSES; c++)
+    {
+        esg_hist_reset(&exec->wait_us[c]);
+        esg_hist_reset(&exec->run_us[c]);
+    }
+
+    pthread_mutex_init(&exec->lock, NULL);
+    pthread_cond_init(&exec->queued, NULL);
+    pthread_cond_init(&exec->completed, NULL);
+    exec->running = 1U;
+
+    pthread_attr_init(&attr);
+
+    if (0 < rt_priority)
+    {
+        struct sched_param param = {.sched_priority = rt_priority};
+
+        pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+        pthread_attr_setschedparam(&attr, &param);
+        pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+    }
+
+    ret = -pthread_create(&exec->thread, &attr, spi_exec_thread, exec);
+
+    /* not allowed to be real-time: still serialized, in the caller's class */
+    if ((-EPERM == ret) && (0 < rt_priority))
+    {
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("spi exec: SCHED_FIFO refused, inherited policy"), DLT_STRING(name));
+        ret = -pthread_create(&exec->thread, NULL, spi_exec_thread, exec);
+    }
+
+    pthread_attr_destroy(&attr);
+
+    if (EXIT_SUCCESS != ret)
+    {
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_ERROR, DLT_STRING("spi exec: can't start"), DLT_STRING(name), DLT_INT32(ret));
+        exec->running = 0U;
+        pthread_cond_destroy(&exec->completed);
+        pthread_cond_destroy(&exec->queued);
+        pthread_mutex_destroy(&exec->lock);
+    }
+
+    return ret;
+}
+
+//==============================================================================
+//! \brief Run a transaction on the bus owning thread, and wait for its result
+//!
+//! Runs in place when the executor is not started (init, release) or when
+//! called from a transaction.
+//!
+//! \param  cls: priority class
+//! \param  deadline_us: from now, 0 for none; a late transaction still runs, it is counted
+//! \param  fn: the transaction
+//! \return the result of fn
+//==============================================================================
+int spi_exec_run(spi_exec_t *exec, spi_exec_class_t cls, uint32_t deadline_us, spi_exec_fn_t fn, void *arg)
+{
+    spi_exec_txn_t txn = {.fn = fn, .arg = arg, .cls = cls};
+    spi_exec_txn_t **pos;
+
+    if (SPI_EXEC_CLASSES <= cls)
+    {
+        return -EINVAL;
+    }
+
+    if ((0U == __atomic_load_n(&exec->running, __ATOMIC_ACQUIRE)) || (0 != pthread_equal(pthread_self(), exec->thread)))
+    {
+        return fn(arg);
+    }
+
+    txn.submit_ns = time_getClock_ns();
+    txn.deadline_ns = (0U < deadline_us) ? (txn.submit_ns + (uint64_t)deadline_us * 1000U) : UINT64_MAX;
+
+    pthread_mutex_lock(&exec->lock);
+
+    /* stopped since the check above: the owning thread may be gone, nobody would run it */
+    if (0U == exec->running)
+    {
+        pthread_mutex_unlock(&exec->lock);
+        return fn(arg);
+    }
+
+    /* earliest deadline first within the class, after those with the same deadline */
+    for (pos = &exec->queue[cls]; (NULL != *pos) && ((*pos)->deadline_ns <= txn.deadline_ns); pos = &(*pos)->next)
+    {
+    }
+    txn.next = *pos;
+    *pos = &txn;
+    pthread_cond_signal(&exec->queued);
+
+    while (0U == txn.done)
+    {
+        pthread_cond_wait(&exec->completed, &exec->lock);
+    }
+
+    pthread_mutex_unlock(&exec->lock);
+
+    return txn.result;
+}
+
+//==============================================================================
+//! \brief Stop the owning thread, once the queued transactions are done
+//==============================================================================
+void spi_exec_stop(spi_exec_t *exec)
+{
+    if (0U != exec->running)
+    {
+        pthread_mutex_lock(&exec->lock);
+        __atomic_store_n(&exec->running, 0U, __ATOMIC_RELEASE);
+        pthread_cond_signal(&exec->queued);
+        pthread_mutex_unlock(&exec->lock);
+
+        pthread_join(exec->thread, NULL);
+
+        /* the lock and conditions stay valid for a caller racing the stop, spi_exec_start() sets them up again */
+    }
+}
+
+//==============================================================================
+//! \brief Log the queueing delay (queued to started) and run time per class
+//!
+//! Call once stopped.
+//==============================================================================
+void spi_exec_report(const spi_exec_t *exec)
+{
+    for (uint32_t c = 0U; c < SPI_EXEC_CLASSES; c++)
+    {
+        const esg_hist_t *wait = &exec->wait_us[c];
+        char label[64];
+
+        if (0U == exec->runs[c])
+        {
+            continue;
+        }
+
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("spi exec"), DLT_STRING(exec->name), DLT_STRING(spi_exec_class_names[c]),
+                DLT_STRING("(runs/late)"), DLT_UINT64(exec->runs[c]), DLT_UINT64(exec->late[c]),
+                DLT_STRING("queued us (min/avg/max)"), DLT_INT64(wait->stats.min), DLT_INT64(esg_stats_avg(&wait->stats)), DLT_INT64(wait->stats.max),
+                DLT_STRING("run us (avg/max)"), DLT_INT64(esg_stats_avg(&exec->run_us[c].stats)), DLT_INT64(exec->run_us[c].stats.max));
+
+        snprintf(label, sizeof(label), "spi exec %s %s queued us", exec->name, spi_exec_class_names[c]);
+        esg_hist_report(&dlt_ctxt_rack, label, wait);
+    }
+}
@@ -0,0 +1,70 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-exec.h
+ Version     :
+ Copyright   : Closed
+ Description : per bus SPI transaction executor: one thread owns the spidev,
+               the other threads queue their transactions to it by priority
+               class, earliest deadline first within a class
+ ============================================================================
+ */
+#ifndef ESG_SPIDEV_EXEC
+#define ESG_SPIDEV_EXEC
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "esg-stats.h"
+
+/* lower is served first; a transaction is never preempted, so an urgent one waits at most for the one running */
+typedef enum
+{
+    SPI_EXEC_URGENT = 0,        //! mutes
+    SPI_EXEC_CONTROL,           //! gains, pads, sampling rate, matrix routes
+    SPI_EXEC_BULK,              //! meters, versions, matrix clear
+    SPI_EXEC_CLASSES
+} spi_exec_class_t;
+
+/* default relative deadlines, per class */
+#define SPI_EXEC_DEADLINE_URGENT_US  2000U
+#define SPI_EXEC_DEADLINE_CONTROL_US 20000U
+#define SPI_EXEC_DEADLINE_BULK_US    200000U
+
+/* one transaction: all that fn sends on the bus goes out with nothing else in between */
+typedef int (*spi_exec_fn_t)(void *arg);
+
+typedef struct spi_exec_txn
+{
+    struct spi_exec_txn *next;
+    spi_exec_fn_t fn;
+    void *arg;
+    spi_exec_class_t cls;
+    uint64_t submit_ns;
+    uint64_t deadline_ns;       //! CLOCK_MONOTONIC, UINT64_MAX for none
+    int result;
+    uint8_t done;
+} spi_exec_txn_t;
+
+typedef struct
+{
+    const char *name;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t queued;
+    pthread_cond_t completed;
+    spi_exec_txn_t *queue[SPI_EXEC_CLASSES];    //! by deadline, FIFO for equal ones
+    uint8_t running;
+    /* per class, updated by the owning thread under lock */
+    uint64_t runs[SPI_EXEC_CLASSES];
+    uint64_t late[SPI_EXEC_CLASSES];            //! started after their deadline
+    esg_hist_t wait_us[SPI_EXEC_CLASSES];       //! queued to started
+    esg_hist_t run_us[SPI_EXEC_CLASSES];        //! started to completed
+} spi_exec_t;
+
+int spi_exec_start(spi_exec_t *exec, const char *name, int rt_priority);
+int spi_exec_run(spi_exec_t *exec, spi_exec_class_t cls, uint32_t deadline_us, spi_exec_fn_t fn, void *arg);
+void spi_exec_stop(spi_exec_t *exec);
+void spi_exec_report(const spi_exec_t *exec);
+
+#endif // ESG_SPIDEV_EXEC
@@ -0,0 +1,356 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-prof.c
+ Version     :
+ Copyright   : Closed
+ Description : always-on SPI_IOC_MESSAGE profile
+
+ Each thread claims a slot of the table on its first ioctl and is the only
+ one to write it: no lock nor atomic read-modify-write on the SPI path, just
+ the seqlock stores around the counter updates. The table lives in POSIX
+ shared memory, --spi-prof-query reads it from another process while the
+ runners go on; it is process memory if the shared memory can't be created.
+ ============================================================================
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "esg-bsp-test.h"
+
+#include "esg-spidev-prof.h"
+
+DLT_IMPORT_CONTEXT(dlt_ctxt_rack);
+
+#define SPI_PROF_READ_RETRIES 100U
+
+static spi_prof_table_t *prof_table = NULL;
+static spi_prof_table_t prof_local;
+static pthread_once_t prof_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t prof_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static __thread spi_prof_slot_t *prof_self = NULL;
+static __thread uint8_t prof_claimed = 0U;
+
+/* the table of the previous run is replaced */
+static void spi_prof_open(void)
+{
+    spi_prof_table_t *table = NULL;
+    int fd = shm_open(SPI_PROF_SHM_NAME, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if ((0 <= fd) && (0 == ftruncate(fd, sizeof(spi_prof_table_t))))
+    {
+        table = mmap(NULL, sizeof(spi_prof_table_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        table = (MAP_FAILED == table) ? NULL : table;
+    }
+
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+
+    if (NULL == table)
+    {
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("spi prof: no shared memory, not queryable"), DLT_STRING(SPI_PROF_SHM_NAME), DLT_INT32(-errno));
+        table = &prof_local;
+    }
+
+    /* zero filled, the header goes last */
+    table->slot_size = sizeof(spi_prof_slot_t);
+    table->pid = (int32_t)getpid();
+    table->version = SPI_PROF_VERSION;
+    __atomic_store_n(&table->magic, SPI_PROF_MAGIC, __ATOMIC_RELEASE);
+
+    prof_table = table;
+}
+
+//==============================================================================
+//! \brief Id of a device in the profile, registered on its first call
+//!
+//! \param  device: spidev path, or SPI_MOCK_DEVICE
+//! \return its id, SPI_PROF_DEVICES if the table is full
+//==============================================================================
+uint8_t spi_prof_device(const char *device)
+{
+    uint32_t id;
+
+    pthread_once(&prof_once, spi_prof_open);
+    pthread_mutex_lock(&prof_lock);
+
+    for (id = 0U; id < prof_table->devices; id++)
+    {
+        if (0 == strncmp(prof_table->device[id], device, SPI_PROF_NAME_LEN - 1U))
+        {
+            break;
+        }
+    }
+
+    if ((id == prof_table->devices) && (id < SPI_PROF_DEVICES))
+    {
+        strncpy(prof_table->device[id], device, SPI_PROF_NAME_LEN - 1U);
+        __atomic_store_n(&prof_table->devices, id + 1U, __ATOMIC_RELEASE);
+    }
+
+    pthread_mutex_unlock(&prof_lock);
+
+    return (uint8_t)((id < SPI_PROF_DEVICES) ? id : SPI_PROF_DEVICES);
+}
+
+/* first ioctl of this thread */
+static spi_prof_slot_t *spi_prof_claim(void)
+{
+    uint32_t n = __atomic_fetch_add(&prof_table->threads, 1U, __ATOMIC_RELAXED);
+    spi_prof_slot_t *slot = NULL;
+
+    if (n < SPI_PROF_THREADS)
+    {
+        slot = &prof_table->slot[n];
+        slot->tid = (int32_t)syscall(SYS_gettid);
+        for (uint32_t d = 0U; d < SPI_PROF_DEVICES; d++)
+        {
+            esg_hist_reset(&slot->dev[d].ioctl_us);
+        }
+        (void)prctl(PR_GET_NAME, slot->thread, 0, 0, 0);
+    }
+
+    return slot;
+}
+
+//==============================================================================
+//! \brief Account one SPI_IOC_MESSAGE of the calling thread
+//!
+//! \param  device: from spi_prof_device()
+//! \param  ret: what the ioctl returned
+//! \param  ns: spent in the ioctl
+//==============================================================================
+void spi_prof_add(uint8_t device, int ret, uint64_t ns)
+{
+    spi_prof_slot_t *slot;
+    spi_prof_counters_t *c;
+    uint32_t seq;
+
+    if (NULL == prof_table)
+    {
+        return;
+    }
+
+    if (0U == prof_claimed)
+    {
+        prof_claimed = 1U;
+        prof_self = spi_prof_claim();
+    }
+
+    slot = prof_self;
+    if ((NULL == slot) || (SPI_PROF_DEVICES <= device))
+    {
+        __atomic_fetch_add(&prof_table->unprofiled, 1U, __ATOMIC_RELAXED);
+        return;
+    }
+
+    c = &slot->dev[device];
+    seq = slot->seq;
+
+    __atomic_store_n(&slot->seq, seq + 1U, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    c->ioctls++;
+    c->ns += ns;
+    c->max_ns = (ns > c->max_ns) ? ns : c->max_ns;
+    esg_hist_add(&c->ioctl_us, (int64_t)(ns / 1000U));
+    if (ret < 1)
+    {
+        c->errors++;
+    }
+    else
+    {
+        c->bytes += (uint64_t)ret;
+    }
+
+    __atomic_store_n(&slot->seq, seq + 2U, __ATOMIC_RELEASE);
+}
+
+/* reader side of the seqlock, the thread of the slot may be running */
+static int spi_prof_read(const spi_prof_slot_t *slot, spi_prof_slot_t *copy)
+{
+    for (uint32_t i = 0U; i < SPI_PROF_READ_RETRIES; i++)
+    {
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+        if (0U != (seq & 1U))
+        {
+            continue;
+        }
+
+        memcpy(copy, slot, sizeof(*copy));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if (seq == __atomic_load_n(&slot->seq, __ATOMIC_RELAXED))
+        {
+            return 0;
+        }
+    }
+
+    return -EAGAIN;
+}
+
+/* slots claimed and devices registered so far, at most the table size */
+static void spi_prof_extent(const spi_prof_table_t *table, uint32_t *threads, uint32_t *devices)
+{
+    *threads = __atomic_load_n(&table->threads, __ATOMIC_RELAXED);
+    *threads = (SPI_PROF_THREADS < *threads) ? SPI_PROF_THREADS : *threads;
+    *devices = __atomic_load_n(&table->devices, __ATOMIC_ACQUIRE);
+    *devices = (SPI_PROF_DEVICES < *devices) ? SPI_PROF_DEVICES : *devices;
+}
+
+void spi_prof_report(void)
+{
+    uint32_t threads, devices;
+
+    if (NULL == prof_table)
+    {
+        return;
+    }
+
+    spi_prof_extent(prof_table, &threads, &devices);
+
+    for (uint32_t t = 0U; t < threads; t++)
+    {
+        spi_prof_slot_t s;
+
+        if (0 != spi_prof_read(&prof_table->slot[t], &s))
+        {
+            continue;
+        }
+
+        for (uint32_t d = 0U; d < devices; d++)
+        {
+            const spi_prof_counters_t *c = &s.dev[d];
+
+            if (0U == c->ioctls)
+            {
+                continue;
+            }
+
+            DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("spi prof (thread/tid/device)"), DLT_STRING(s.thread), DLT_INT32(s.tid),
+                    DLT_STRING(prof_table->device[d]), DLT_STRING("(ioctls/bytes/errors/avg ns/max ns)"), DLT_UINT64(c->ioctls),
+                    DLT_UINT64(c->bytes), DLT_UINT64(c->errors), DLT_UINT64(c->ns / c->ioctls), DLT_UINT64(c->max_ns));
+
+            esg_hist_report(&dlt_ctxt_rack, "spi prof ioctl us", &c->ioctl_us);
+        }
+    }
+
+    if (0U != prof_table->unprofiled)
+    {
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("spi prof: ioctls without a slot"), DLT_UINT64(prof_table->unprofiled));
+    }
+}
+
+//==============================================================================
+//! \brief Print the profile of a running instance, or of the last run
+//!
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int spi_prof_query(void)
+{
+    const spi_prof_table_t *table = NULL;
+    struct stat st;
+    int ret = EXIT_SUCCESS;
+    int fd;
+
+    fd = shm_open(SPI_PROF_SHM_NAME, O_RDONLY, 0);
+    if (0 > fd)
+    {
+        ret = -errno;
+    }
+
+    if ((EXIT_SUCCESS == ret) && ((0 != fstat(fd, &st)) || ((size_t)st.st_size < sizeof(spi_prof_table_t))))
+    {
+        ret = -EINVAL;
+    }
+
+    if (EXIT_SUCCESS == ret)
+    {
+        table = mmap(NULL, sizeof(spi_prof_table_t), PROT_READ, MAP_SHARED, fd, 0);
+        if (MAP_FAILED == table)
+        {
+            table = NULL;
+            ret = -errno;
+        }
+    }
+
+    if (0 <= fd)
+    {
+        close(fd);
+    }
+
+    if ((EXIT_SUCCESS == ret) &&
+        ((SPI_PROF_MAGIC != __atomic_load_n(&table->magic, __ATOMIC_ACQUIRE)) || (SPI_PROF_VERSION != table->version) ||
+         (sizeof(spi_prof_slot_t) != table->slot_size)))
+    {
+        ret = -EINVAL;
+    }
+
+    if (EXIT_SUCCESS == ret)
+    {
+        uint32_t threads, devices;
+
+        spi_prof_extent(table, &threads, &devices);
+
+        printf("%s: pid %d, %u threads, %llu ioctls without a slot\n", SPI_PROF_SHM_NAME, table->pid, threads,
+               (unsigned long long)__atomic_load_n(&table->unprofiled, __ATOMIC_RELAXED));
+        printf("thread           tid     device              ioctls     bytes        errors  avg ns   max ns   ioctl us <2^n: count\n");
+
+        for (uint32_t t = 0U; t < threads; t++)
+        {
+            spi_prof_slot_t s;
+
+            if (0 != spi_prof_read(&table->slot[t], &s))
+            {
+                continue;
+            }
+
+            for (uint32_t d = 0U; d < devices; d++)
+            {
+                const spi_prof_counters_t *c = &s.dev[d];
+
+                if (0U == c->ioctls)
+                {
+                    continue;
+                }
+
+                printf("%-16.16s %-7d %-19.19s %-10llu %-12llu %-7llu %-8llu %-8llu", s.thread, s.tid, table->device[d],
+                       (unsigned long long)c->ioctls, (unsigned long long)c->bytes, (unsigned long long)c->errors,
+                       (unsigned long long)(c->ns / c->ioctls), (unsigned long long)c->max_ns);
+
+                for (uint32_t i = 0U; i < ESG_HIST_BINS; i++)
+                {
+                    if (0U < c->ioctl_us.bins[i])
+                    {
+                        printf(" %u:%u", i, c->ioctl_us.bins[i]);
+                    }
+                }
+                printf("\n");
+            }
+        }
+    }
+    else
+    {
+        fprintf(stderr, "%s: no spi profile (%d)\n", SPI_PROF_SHM_NAME, ret);
+    }
+
+    if (NULL != table)
+    {
+        munmap((void *)table, sizeof(spi_prof_table_t));
+    }
+
+    return ret;
+}
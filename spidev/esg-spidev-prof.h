@@ -0,0 +1,65 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-prof.h
+ Version     :
+ Copyright   : Closed
+ Description : always-on SPI_IOC_MESSAGE profile, per thread and per device:
+               ioctls, bytes, errors, time in the ioctl and its histogram,
+               in shared memory so that it can be read while running
+ ============================================================================
+ */
+#ifndef ESG_SPIDEV_PROF
+#define ESG_SPIDEV_PROF
+#pragma once
+
+#include <stdint.h>
+
+#include "esg-stats.h"
+
+#define SPI_PROF_SHM_NAME "/esg-spi-prof"
+#define SPI_PROF_MAGIC 0x50535345U /* "ESSP" */
+#define SPI_PROF_VERSION 2U
+/* threads and devices of one process, a thread past the last slot is only counted */
+#define SPI_PROF_THREADS 16U
+#define SPI_PROF_DEVICES 4U
+#define SPI_PROF_NAME_LEN 32U
+
+typedef struct
+{
+    uint64_t ioctls;
+    uint64_t bytes;             //! returned by the ioctls
+    uint64_t errors;            //! ioctls that returned < 1
+    uint64_t ns;                //! spent in the ioctls
+    uint64_t max_ns;
+    esg_hist_t ioctl_us;        //! time in the ioctl, log2 us
+} spi_prof_counters_t;
+
+/* written by its thread only, behind a seqlock: seq is odd while it is updated */
+typedef struct
+{
+    uint32_t seq;
+    int32_t tid;
+    char thread[SPI_PROF_NAME_LEN];
+    spi_prof_counters_t dev[SPI_PROF_DEVICES];
+} spi_prof_slot_t;
+
+/* shared memory layout */
+typedef struct
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t slot_size;
+    int32_t pid;
+    uint32_t threads;           //! slots claimed, may exceed SPI_PROF_THREADS
+    uint32_t devices;
+    char device[SPI_PROF_DEVICES][SPI_PROF_NAME_LEN];
+    uint64_t unprofiled;        //! ioctls of the threads without a slot, or of a device past the last one
+    spi_prof_slot_t slot[SPI_PROF_THREADS];
+} spi_prof_table_t;
+
+uint8_t spi_prof_device(const char *device);
+void spi_prof_add(uint8_t device, int ret, uint64_t ns);
+void spi_prof_report(void);
+int spi_prof_query(void);
+
+#endif // ESG_SPIDEV_PROF
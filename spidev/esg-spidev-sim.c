@@ -0,0 +1,586 @@
+/*
+ ============================================================================
+ Name        : esg-spidev-sim.c
+ Version     :
+ Copyright   : Closed
+ Description : STM32 TDMA peer emulator, LD_PRELOAD'ed in front of esg-bsp-test
+
+ Runs the stm32 runner on any Linux machine, without an Elite board:
+ - open() of the STM32 spidev gives a stand-in fd, SPI_IOC_MESSAGE(N) on it
+   checks the TX frame with the codec and answers a protocol-correct RX frame
+   (voices, header index, extended data, CRC), after the wire time at the
+   requested speed plus an optional latency.
+ - the slave-ready sysfs GPIO (export, direction, edge, value) is emulated:
+   the value fd is a timerfd firing every 10ms, select() on its exceptfds is
+   turned into a read wait, reading it acknowledges the edge.
+ Configured from the environment (see the README), counters printed at close.
+
+   LD_PRELOAD=./libesg-spidev-sim.so ESG_SIM_ERROR_PPM=100 ./esg-bsp-test --stm32
+ ============================================================================
+ */
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <sys/timerfd.h>
+#include <linux/spi/spidev.h>
+
+#include "esg-bsp-test.h"
+#include "esg-spidev.h"
+#include "tdma-codec.h"
+#include "tdma-crc.h"
+
+/* the codec and CRC modules log there, the shim has its own copy */
+DLT_DECLARE_CONTEXT(dlt_ctxt_btst);
+
+#define SIM_GPIO_DIR    "/sys/class/gpio/"
+#define SIM_PPM         1000000U
+/* TX voices remembered for ESG_SIM_ECHO, a power of 2 */
+#define SIM_ECHO_MAX    16U
+
+typedef struct
+{
+    uint8_t audio[COMMPAR_AUDIO_DATA_SIZE_MAX];
+    uint16_t len;
+} sim_voice_t;
+
+typedef struct
+{
+    /* configuration */
+    const char *spidev;
+    char gpio_dir[64];          /* /sys/class/gpio/gpioN/ */
+    uint64_t period_ns;
+    uint64_t jitter_ns;
+    uint64_t latency_ns;
+    uint32_t miss_ppm;
+    uint32_t error_ppm;
+    uint32_t corrupt_ppm;
+    uint8_t voices;
+    uint32_t echo;              /* cycles before TX voice 0 comes back in RX voice 0, 0: off */
+    uint8_t mco;                /* extended data with the DSP to STM payload instead */
+    uint32_t seed;
+
+    /* emulated devices */
+    int spi_fd;
+    int gpio_fd;
+    uint32_t mode;
+    uint8_t bits;
+    uint32_t speed;
+    uint64_t next_edge_ns;      /* nominal, jitter is only applied when arming */
+    uint8_t index;
+    sim_voice_t echo_ring[SIM_ECHO_MAX];
+
+    /* counters */
+    uint64_t messages;
+    uint64_t errors;
+    uint64_t corrupted;
+    uint64_t edges;
+    uint64_t edges_missed;      /* skipped on purpose, ESG_SIM_MISS_PPM */
+    uint64_t edges_late;        /* already past when the previous one was acknowledged */
+    tdma_codec_stats_t tx_stats;
+} sim_peer_t;
+
+static sim_peer_t sim = {.spi_fd = -1, .gpio_fd = -1};
+
+static int (*real_open)(const char *, int, ...);
+static int (*real_close)(int);
+static ssize_t (*real_read)(int, void *, size_t);
+static off_t (*real_lseek)(int, off_t, int);
+static off64_t (*real_lseek64)(int, off64_t, int);
+static int (*real_ioctl)(int, unsigned long, ...);
+static int (*real_select)(int, fd_set *, fd_set *, fd_set *, struct timeval *);
+
+static uint64_t sim_env(const char *name, uint64_t def)
+{
+    const char *val = getenv(name);
+
+    return (NULL != val) ? strtoull(val, NULL, 0) : def;
+}
+
+static uint64_t sim_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+/* xorshift32, reproducible with ESG_SIM_SEED */
+static uint32_t sim_rand(void)
+{
+    sim.seed ^= sim.seed << 13;
+    sim.seed ^= sim.seed >> 17;
+    sim.seed ^= sim.seed << 5;
+    return sim.seed;
+}
+
+static int sim_chance(uint32_t ppm)
+{
+    return (0U != ppm) && ((sim_rand() % SIM_PPM) < ppm);
+}
+
+static void sim_sleep_ns(uint64_t ns)
+{
+    struct timespec ts = {.tv_sec = (time_t)(ns / 1000000000ULL), .tv_nsec = (long)(ns % 1000000000ULL)};
+
+    while (EINTR == clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, &ts))
+    {
+    }
+}
+
+__attribute__((constructor)) static void sim_init(void)
+{
+    real_open = dlsym(RTLD_NEXT, "open");
+    real_close = dlsym(RTLD_NEXT, "close");
+    real_read = dlsym(RTLD_NEXT, "read");
+    real_lseek = dlsym(RTLD_NEXT, "lseek");
+    real_lseek64 = dlsym(RTLD_NEXT, "lseek64");
+    real_ioctl = dlsym(RTLD_NEXT, "ioctl");
+    real_select = dlsym(RTLD_NEXT, "select");
+
+    sim.spidev = (NULL != getenv("ESG_SIM_SPIDEV")) ? getenv("ESG_SIM_SPIDEV") : SPI_STM_DEVICE;
+    snprintf(sim.gpio_dir, sizeof(sim.gpio_dir), SIM_GPIO_DIR "gpio%u/", (unsigned)sim_env("ESG_SIM_GPIO", 32U + 15U));
+    sim.period_ns = sim_env("ESG_SIM_PERIOD_US", 10000U) * 1000U;
+    sim.jitter_ns = sim_env("ESG_SIM_JITTER_US", 0U) * 1000U;
+    sim.latency_ns = sim_env("ESG_SIM_LATENCY_US", 0U) * 1000U;
+    sim.miss_ppm = (uint32_t)sim_env("ESG_SIM_MISS_PPM", 0U);
+    sim.error_ppm = (uint32_t)sim_env("ESG_SIM_ERROR_PPM", 0U);
+    sim.corrupt_ppm = (uint32_t)sim_env("ESG_SIM_CORRUPT_PPM", 0U);
+    sim.voices = (uint8_t)sim_env("ESG_SIM_VOICES", COMMPAR_AUDIO_VOIX_MAX);
+    sim.voices = (COMMPAR_AUDIO_VOIX_MAX < sim.voices) ? COMMPAR_AUDIO_VOIX_MAX : sim.voices;
+    sim.echo = (uint32_t)sim_env("ESG_SIM_ECHO", 0U);
+    sim.echo = (SIM_ECHO_MAX <= sim.echo) ? (SIM_ECHO_MAX - 1U) : sim.echo;
+    sim.mco = (0U != sim_env("ESG_SIM_MCO", 0U)) ? 1U : 0U;
+    sim.seed = (uint32_t)sim_env("ESG_SIM_SEED", 0x2545F491U) | 1U;
+    sim.bits = 8U;
+
+    tdma_crc_init();
+}
+
+/*
+ * slave-ready edges
+ */
+
+static void sim_edge_arm(void)
+{
+    uint64_t at = sim.next_edge_ns;
+    struct itimerspec its = {0};
+
+    if (0U != sim.jitter_ns)
+    {
+        at = at - sim.jitter_ns + (sim_rand() % (2U * sim.jitter_ns + 1U));
+    }
+
+    its.it_value.tv_sec = (time_t)(at / 1000000000ULL);
+    its.it_value.tv_nsec = (long)(at % 1000000000ULL);
+    timerfd_settime(sim.gpio_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/* next edge on the 10ms grid, the STM32 does not wait for us */
+static void sim_edge_next(void)
+{
+    uint64_t now = sim_now_ns();
+
+    sim.next_edge_ns += sim.period_ns;
+
+    while (sim.next_edge_ns <= now)
+    {
+        sim.next_edge_ns += sim.period_ns;
+        sim.edges_late++;
+    }
+
+    while (sim_chance(sim.miss_ppm))
+    {
+        sim.next_edge_ns += sim.period_ns;
+        sim.edges_missed++;
+    }
+
+    sim_edge_arm();
+}
+
+static int sim_gpio_open(void)
+{
+    sim.gpio_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+    if (0 <= sim.gpio_fd)
+    {
+        sim.next_edge_ns = sim_now_ns();
+        sim_edge_next();
+    }
+
+    return sim.gpio_fd;
+}
+
+/* the level: '0' right after the (falling) edge, which is acknowledged, '1' otherwise */
+static ssize_t sim_gpio_read(void *buf, size_t count)
+{
+    uint64_t expirations;
+    char level = '1';
+
+    if (sizeof(expirations) == real_read(sim.gpio_fd, &expirations, sizeof(expirations)))
+    {
+        sim.edges++;
+        level = '0';
+        sim_edge_next();
+    }
+
+    if (0U < count)
+    {
+        *(char *)buf = level;
+    }
+
+    return (0U < count) ? 1 : 0;
+}
+
+/*
+ * spidev
+ */
+
+/* VU meters ramping with the frame index, terminal n heard at quality n % 4, now and then recording */
+static void sim_peer_mco(protdspSpiAudioExtDataDsp2Stm_mco_t *mco)
+{
+    int16_t level = (int16_t)((sim.index % 64U) * 100U);
+
+    mco->vu_mic.currentValue = level;
+    mco->vu_mic.min = 0;
+    mco->vu_mic.max = 6300;
+    mco->vu_mic.lowThreshold = 500;
+    mco->vu_mic.highThreshold = 6000;
+    mco->vu_hp = mco->vu_mic;
+    mco->vu_hp.currentValue = (int16_t)(6300 - level);
+
+    mco->mco1.audioQ.u16 = 0U;
+    mco->mco1.audioQ2.u16 = 0U;
+    for (uint32_t id = 0U; id < 8U; id++)
+    {
+        mco->mco1.audioQ.u16 |= (uint16_t)(((id + 1U) % 4U) << (2U * id));
+        mco->mco1.audioQ2.u16 |= (uint16_t)((((id + 9U) % 4U) << (2U * id)) & 0x3FFFU);
+    }
+    mco->mco1.misc.micLevel = (sim.index >> 6) & 3U;
+    mco->mco1.misc.micSat = (6000 < level) ? 1U : 0U;
+    mco->rec_status = (128U <= sim.index) ? record_on : record_off;
+}
+
+/* what the STM32 sends: all the voices it relays, a counter in the audio, its TX slots in the extended data */
+static void sim_peer_frame(protdspSpiFrame_t *frame)
+{
+    tdma_frame_view_t view;
+
+    memset(frame, 0, sizeof(*frame));
+
+    if (0 == tdma_codec_encode(frame, sim.voices, sim.index, &view))
+    {
+        for (uint8_t v = 0U; v < view.nb_voices; v++)
+        {
+            view.voice[v]->hdr.userId = (uint8_t)(v + 1U);
+            memset(view.voice[v]->Audio, (int)(uint8_t)(sim.index + v), COMMPAR_AUDIO_DATA_SIZE_MAX);
+        }
+
+        /* the voice bridge hears itself, ESG_SIM_ECHO cycles later */
+        if ((0U != sim.echo) && (0U < view.nb_voices))
+        {
+            const sim_voice_t *echo = &sim.echo_ring[(sim.messages - sim.echo) & (SIM_ECHO_MAX - 1U)];
+
+            memcpy(view.voice[0]->Audio, echo->audio, echo->len);
+            view.voice[0]->hdr.AudioBuffSize = echo->len;
+        }
+
+        if (0U != sim.mco)
+        {
+            sim_peer_mco(&view.ext->mco);
+            view.ext->dataCode = PROTDSP_SPI_AUDIO_EXTDATA_CODE_MCO;
+        }
+        else
+        {
+            view.ext->dataCode = PROTDSP_SPI_AUDIO_EXTDATA_STM_TO_DSP;
+            for (uint32_t i = 0U; i < PROTDSP_CYCLE_NB_TX_MAX; i++)
+            {
+                view.ext->ext_data.StartTx[i] = (int32_t)(i * 3000U + sim.index);
+                view.ext->ext_data.DureeTx[i] = 2500;
+            }
+            view.ext->ext_data.pio_field = (uint16_t)(1U << (sim.index % 16U));
+            view.ext->ext_data.pio_valid = 0xFFFFU;
+        }
+
+        tdma_crc_stamp(frame);
+    }
+
+    if (sim_chance(sim.corrupt_ppm))
+    {
+        frame->frame[sim_rand() % sizeof(frame->frame)] ^= 0x01U;
+        sim.corrupted++;
+    }
+
+    sim.index++;
+}
+
+static int sim_spi_message(struct spi_ioc_transfer *tr, uint32_t nb)
+{
+    uint64_t wire_ns = 0U;
+    int ret = 0;
+
+    sim.messages++;
+
+    for (uint32_t i = 0U; i < nb; i++)
+    {
+        uint32_t speed = (0U != tr[i].speed_hz) ? tr[i].speed_hz : sim.speed;
+
+        if (sizeof(protdspSpiFrame_t) == tr[i].len)
+        {
+            if (0U != tr[i].tx_buf)
+            {
+                static protdspSpiFrame_t tx;
+                tdma_frame_view_t view;
+                sim_voice_t *echo = &sim.echo_ring[sim.messages & (SIM_ECHO_MAX - 1U)];
+
+                /* decode a copy, the TX buffer is the caller's */
+                memcpy(&tx, (const void *)(uintptr_t)tr[i].tx_buf, sizeof(tx));
+                echo->len = 0U;
+                if ((0U == tx.header.hdrVersion) || (0 == tdma_crc_check(&tx)))
+                {
+                    if ((0 == tdma_codec_decode(&tx, &view, &sim.tx_stats)) && (0U < view.nb_voices))
+                    {
+                        echo->len = view.voice[0]->hdr.AudioBuffSize;
+                        memcpy(echo->audio, view.voice[0]->Audio, echo->len);
+                    }
+                }
+                else
+                {
+                    sim.tx_stats.crc_errors++;
+                }
+            }
+
+            if (0U != tr[i].rx_buf)
+            {
+                sim_peer_frame((protdspSpiFrame_t *)(uintptr_t)tr[i].rx_buf);
+            }
+        }
+        else if (0U != tr[i].rx_buf)
+        {
+            memset((void *)(uintptr_t)tr[i].rx_buf, 0, tr[i].len);
+        }
+
+        wire_ns += (0U != speed) ? ((uint64_t)tr[i].len * 8U * 1000000000ULL / speed) : 0U;
+        wire_ns += (uint64_t)tr[i].delay_usecs * 1000U;
+        ret += (int)tr[i].len;
+    }
+
+    sim_sleep_ns(wire_ns + sim.latency_ns);
+
+    if (sim_chance(sim.error_ppm))
+    {
+        sim.errors++;
+        errno = EIO;
+        ret = -1;
+    }
+
+    return ret;
+}
+
+static int sim_spi_ioctl(unsigned long request, void *arg)
+{
+    int ret = 0;
+
+    if ((SPI_IOC_MAGIC == _IOC_TYPE(request)) && (0U == _IOC_NR(request)) && (_IOC_WRITE == _IOC_DIR(request)))
+    {
+        return sim_spi_message(arg, _IOC_SIZE(request) / sizeof(struct spi_ioc_transfer));
+    }
+
+    switch (request)
+    {
+    case SPI_IOC_WR_MODE32:
+        sim.mode = *(uint32_t *)arg;
+        break;
+    case SPI_IOC_RD_MODE32:
+        *(uint32_t *)arg = sim.mode;
+        break;
+    case SPI_IOC_WR_MODE:
+        sim.mode = *(uint8_t *)arg;
+        break;
+    case SPI_IOC_RD_MODE:
+        *(uint8_t *)arg = (uint8_t)sim.mode;
+        break;
+    case SPI_IOC_WR_BITS_PER_WORD:
+        sim.bits = (0U != *(uint8_t *)arg) ? *(uint8_t *)arg : 8U;
+        break;
+    case SPI_IOC_RD_BITS_PER_WORD:
+        *(uint8_t *)arg = sim.bits;
+        break;
+    case SPI_IOC_WR_MAX_SPEED_HZ:
+        sim.speed = *(uint32_t *)arg;
+        break;
+    case SPI_IOC_RD_MAX_SPEED_HZ:
+        *(uint32_t *)arg = sim.speed;
+        break;
+    default:
+        errno = ENOTTY;
+        ret = -1;
+        break;
+    }
+
+    return ret;
+}
+
+static void sim_report(void)
+{
+    fprintf(stderr, "spidev sim: messages %llu, injected errors %llu, corrupted rx %llu\n",
+            (unsigned long long)sim.messages, (unsigned long long)sim.errors, (unsigned long long)sim.corrupted);
+    fprintf(stderr, "spidev sim: tx frames %llu (empty %llu, malformed %llu, crc errors %llu)\n",
+            (unsigned long long)sim.tx_stats.frames, (unsigned long long)sim.tx_stats.empty,
+            (unsigned long long)sim.tx_stats.malformed, (unsigned long long)sim.tx_stats.crc_errors);
+    fprintf(stderr, "spidev sim: slave-ready edges %llu (missed on purpose %llu, late %llu)\n",
+            (unsigned long long)sim.edges, (unsigned long long)sim.edges_missed, (unsigned long long)sim.edges_late);
+}
+
+/*
+ * interposed libc entry points
+ */
+
+int open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    int fd;
+
+    if (0 != (flags & O_CREAT))
+    {
+        va_list ap;
+
+        va_start(ap, flags);
+        mode = va_arg(ap, mode_t);
+        va_end(ap);
+    }
+
+    if (0 == strcmp(path, sim.spidev))
+    {
+        /* any fd will do, only ioctl() is used on it */
+        fd = real_open("/dev/null", O_RDWR | O_CLOEXEC);
+        sim.spi_fd = fd;
+    }
+    else if ((0 == strncmp(path, sim.gpio_dir, strlen(sim.gpio_dir))) && (0 == strcmp(path + strlen(sim.gpio_dir), "value")))
+    {
+        fd = sim_gpio_open();
+    }
+    else if ((0 == strncmp(path, sim.gpio_dir, strlen(sim.gpio_dir))) ||
+             (0 == strcmp(path, SIM_GPIO_DIR "export")) || (0 == strcmp(path, SIM_GPIO_DIR "unexport")))
+    {
+        /* export, direction, edge: written once, nothing to emulate */
+        fd = real_open("/dev/null", O_WRONLY | O_CLOEXEC);
+    }
+    else
+    {
+        fd = real_open(path, flags, mode);
+    }
+
+    return fd;
+}
+
+int open64(const char *path, int flags, ...) __attribute__((alias("open")));
+
+int close(int fd)
+{
+    if ((0 <= fd) && (fd == sim.spi_fd))
+    {
+        sim_report();
+        sim.spi_fd = -1;
+    }
+    else if ((0 <= fd) && (fd == sim.gpio_fd))
+    {
+        sim.gpio_fd = -1;
+    }
+
+    return real_close(fd);
+}
+
+ssize_t read(int fd, void *buf, size_t count)
+{
+    if ((0 <= fd) && (fd == sim.gpio_fd))
+    {
+        return sim_gpio_read(buf, count);
+    }
+
+    return real_read(fd, buf, count);
+}
+
+off_t lseek(int fd, off_t offset, int whence)
+{
+    if ((0 <= fd) && (fd == sim.gpio_fd))
+    {
+        return 0;
+    }
+
+    return real_lseek(fd, offset, whence);
+}
+
+off64_t lseek64(int fd, off64_t offset, int whence)
+{
+    if ((0 <= fd) && (fd == sim.gpio_fd))
+    {
+        return 0;
+    }
+
+    return real_lseek64(fd, offset, whence);
+}
+
+int ioctl(int fd, unsigned long request, ...)
+{
+    va_list ap;
+    void *arg;
+
+    va_start(ap, request);
+    arg = va_arg(ap, void *);
+    va_end(ap);
+
+    if ((0 <= fd) && (fd == sim.spi_fd))
+    {
+        return sim_spi_ioctl(request, arg);
+    }
+
+    return real_ioctl(fd, request, arg);
+}
+
+/* a sysfs GPIO edge shows in exceptfds, a timerfd expiry in readfds */
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds, struct timeval *timeout)
+{
+    fd_set reads;
+    int ret;
+
+    if ((0 > sim.gpio_fd) || (NULL == exceptfds) || (0 == FD_ISSET(sim.gpio_fd, exceptfds)))
+    {
+        return real_select(nfds, readfds, writefds, exceptfds, timeout);
+    }
+
+    if (NULL != readfds)
+    {
+        reads = *readfds;
+    }
+    else
+    {
+        FD_ZERO(&reads);
+    }
+
+    FD_CLR(sim.gpio_fd, exceptfds);
+    FD_SET(sim.gpio_fd, &reads);
+
+    ret = real_select(nfds, &reads, writefds, exceptfds, timeout);
+
+    if ((0 < ret) && (0 != FD_ISSET(sim.gpio_fd, &reads)))
+    {
+        FD_CLR(sim.gpio_fd, &reads);
+        FD_SET(sim.gpio_fd, exceptfds);
+    }
+
+    if (NULL != readfds)
+    {
+        *readfds = reads;
+    }
+
+    return ret;
+}
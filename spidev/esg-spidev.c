@@ -13,18 +13,22 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <getopt.h>
 #include <fcntl.h>
 #include <time.h>
 #include <sys/ioctl.h>
 #include <linux/ioctl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <linux/types.h>
 #include <linux/spi/spidev.h>
 
 #include "esg-bsp-test.h"
 
 #include "esg-spidev.h"
+#include "esg-spidev-prof.h"
+#include "wi_time.h"
 
 DLT_IMPORT_CONTEXT(dlt_ctxt_rack);
 
@@ -62,61 +66,206 @@ static void hex_dump(const void *src, size_t length, size_t line_size,
 }
 #endif // spi_init debug_verbose
 
-//==============================================================================
-//! \brief Start an SPI IOCTL transfert
-//!
-//! \param  fd: SPI file descriptor
-//! \param  tx: Data to transmit
-//! \param  rx: Data received
-//! \param  len: data len to transmit
-//! \return Data size receive on success; 0 if no data is received; < 0 if error
-//==============================================================================
-int spi_transfer(spi_dev_t *spi_struct, uint8_t const *tx, uint8_t const *rx, size_t len)
+static void spi_fill_transfer(spi_dev_t *spi_struct, struct spi_ioc_transfer *tr, uint8_t const *tx, uint8_t const *rx, size_t len)
 {
-    int ret;
-#ifdef debug_verbose
-    struct timespec tx_time, rx_time;
-#endif // debug_verbose
-    struct spi_ioc_transfer tr = {
-        .tx_buf = (unsigned long)tx,
-        .rx_buf = (unsigned long)rx,
-        .len = len,
-        .delay_usecs = spi_struct->delay,
-        .speed_hz = spi_struct->speed,
-        .bits_per_word = spi_struct->bits,
-    };
+    memset(tr, 0, sizeof(*tr));
+    tr->tx_buf = (unsigned long)tx;
+    tr->rx_buf = (unsigned long)rx;
+    tr->len = len;
+    tr->delay_usecs = spi_struct->delay;
+    tr->speed_hz = spi_struct->speed;
+    tr->bits_per_word = spi_struct->bits;
 
     if (spi_struct->mode & SPI_TX_QUAD)
-        tr.tx_nbits = 4;
+        tr->tx_nbits = 4;
     else if (spi_struct->mode & SPI_TX_DUAL)
-        tr.tx_nbits = 2;
+        tr->tx_nbits = 2;
     if (spi_struct->mode & SPI_RX_QUAD)
-        tr.rx_nbits = 4;
+        tr->rx_nbits = 4;
     else if (spi_struct->mode & SPI_RX_DUAL)
-        tr.rx_nbits = 2;
+        tr->rx_nbits = 2;
     if (!(spi_struct->mode & SPI_LOOP))
     {
         if (spi_struct->mode & (SPI_TX_QUAD | SPI_TX_DUAL))
-            tr.rx_buf = 0;
+            tr->rx_buf = 0;
         else if (spi_struct->mode & (SPI_RX_QUAD | SPI_RX_DUAL))
-            tr.tx_buf = 0;
+            tr->tx_buf = 0;
     }
+}
+
+/* what SPI_IOC_MESSAGE(nb) would do with the TX/RX shorted, spinning for the wire time of each segment */
+static int spi_mock_message(struct spi_ioc_transfer *tr, uint32_t nb)
+{
+    int ret = 0;
+
+    for (uint32_t i = 0U; i < nb; i++)
+    {
+        uint64_t wire_ns = (0U < tr[i].speed_hz) ? ((uint64_t)tr[i].len * 8U * 1000000000ULL / tr[i].speed_hz) : 0U;
+        uint64_t t_end = time_getClock_ns() + wire_ns + (uint64_t)tr[i].delay_usecs * 1000U;
+
+        if (0U != tr[i].rx_buf)
+        {
+            if (0U != tr[i].tx_buf)
+                memcpy((void *)(uintptr_t)tr[i].rx_buf, (const void *)(uintptr_t)tr[i].tx_buf, tr[i].len);
+            else
+                memset((void *)(uintptr_t)tr[i].rx_buf, 0, tr[i].len);
+        }
+
+        while (time_getClock_ns() < t_end)
+        {
+        }
+
+        ret += (int)tr[i].len;
+    }
+
+    return ret;
+}
+
+static int spi_message(spi_dev_t *spi_struct, struct spi_ioc_transfer *tr, uint32_t nb)
+{
+    int ret;
+    uint64_t t_start = time_getClock_ns();
+    uint64_t ns;
+
+    if (0U != spi_struct->mock)
+        ret = spi_mock_message(tr, nb);
+    else
+        ret = ioctl(spi_struct->fd, SPI_IOC_MESSAGE(nb), tr);
+
+    ns = time_getClock_ns() - t_start;
+    spi_struct->bus_ns += ns;
+    spi_struct->ioctls++;
+    spi_prof_add(spi_struct->prof_id, ret, ns);
 
-#ifdef debug_verbose
-    clock_gettime(CLOCK_MONOTONIC, &tx_time);
-#endif // debug_verbose
-    ret = ioctl(spi_struct->fd, SPI_IOC_MESSAGE(1), &tr);
     if (ret < 1)
     {
         DLT_LOG(dlt_ctxt_rack, DLT_LOG_VERBOSE, DLT_STRING("can't send spi message"));
     }
+    else
+    {
+        spi_struct->bytes += (uint64_t)ret;
+    }
 
-#ifdef debug_verbose
-    clock_gettime(CLOCK_MONOTONIC, &rx_time);
-    printf("SPI %d:\nTemps entre tx et rx pour transmettre %d octets: %lds %ldµs", fd, len, rx_time.tv_sec - tx_time.tv_sec, (rx_time.tv_nsec - tx_time.tv_nsec) / 1000);
-#endif // debug_verbose
+    return ret;
+}
+
+/* the bufsiz parameter of the spidev module, its default when it can't be read (no module, mock) */
+static uint32_t spi_read_bufsiz(void)
+{
+    uint32_t bufsiz = SPI_BUFSIZ_DEFAULT;
+    FILE *f = fopen(SPI_BUFSIZ_PATH, "r");
+
+    if (NULL != f)
+    {
+        if ((1 != fscanf(f, "%u", &bufsiz)) || (0U == bufsiz))
+        {
+            bufsiz = SPI_BUFSIZ_DEFAULT;
+        }
+        fclose(f);
+    }
+
+    return bufsiz;
+}
 
+/* a whole number of pages, so that no other data shares the cache lines nor the locked pages */
+static size_t spi_buf_size(size_t len, size_t *page)
+{
+    long sz = sysconf(_SC_PAGESIZE);
+
+    *page = (0 < sz) ? (size_t)sz : 4096U;
+
+    return (len + *page - 1U) & ~(*page - 1U);
+}
+
+//==============================================================================
+//! \brief Allocate a buffer for the SPI path
+//!
+//! Page aligned, padded to whole pages, zeroed and locked in RAM: the ioctl
+//! copies from/to it without a page fault nor a split cache line. A failed
+//! mlock (no CAP_IPC_LOCK, RLIMIT_MEMLOCK) is logged, the buffer is still
+//! prefaulted.
+//!
+//! \param  len: bytes needed
+//! \return the buffer, NULL if out of memory; free it with spi_buf_free()
+//==============================================================================
+void *spi_buf_alloc(size_t len)
+{
+    size_t page;
+    size_t size = spi_buf_size(len, &page);
+    void *buf = NULL;
+
+    if ((0U == len) || (0 != posix_memalign(&buf, page, size)))
+    {
+        return NULL;
+    }
+
+    memset(buf, 0, size);
+
+    if (0 != mlock(buf, size))
+    {
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_WARN, DLT_STRING("spi buffer not locked (bytes/err)"), DLT_UINT32((uint32_t)size), DLT_INT32(-errno));
+    }
+
+    return buf;
+}
+
+void spi_buf_free(void *buf, size_t len)
+{
+    size_t page;
+
+    if (NULL != buf)
+    {
+        (void)munlock(buf, spi_buf_size(len, &page));
+        free(buf);
+    }
+}
+
+//==============================================================================
+//! \brief Start an SPI IOCTL transfert
+//!
+//! Above the spidev bufsiz, the transfer is sent as several messages of up to
+//! bufsiz bytes, CS kept asserted between them (cs_change on the last transfer
+//! of a message), so that the slave sees a single transfer.
+//!
+//! \param  spi_struct: SPI device
+//! \param  tx: Data to transmit
+//! \param  rx: Data received
+//! \param  len: data len to transmit
+//! \return Data size receive on success; 0 if no data is received; < 0 if error
+//==============================================================================
+int spi_transfer(spi_dev_t *spi_struct, uint8_t const *tx, uint8_t const *rx, size_t len)
+{
+    int ret = 0;
+    struct spi_ioc_transfer tr;
+    size_t done = 0U;
+
+    if (len > spi_struct->bufsiz)
+    {
+        spi_struct->splits++;
+    }
+
+    do
+    {
+        size_t chunk = ((len - done) > spi_struct->bufsiz) ? spi_struct->bufsiz : (len - done);
+        int val;
+
+        spi_fill_transfer(spi_struct, &tr, (NULL != tx) ? (tx + done) : NULL, (NULL != rx) ? (rx + done) : NULL, chunk);
+        tr.cs_change = ((done + chunk) < len) ? 1U : 0U;
+
+        val = spi_message(spi_struct, &tr, 1);
+        if (0 > val)
+        {
+            ret = val;
+            break;
+        }
+
+        ret += val;
+        done += chunk;
+    } while (done < len);
+
+    /* the time of each ioctl is in the spi profile (spi_prof_report(), --spi-prof-query) */
 #ifdef debug_verbose
+    printf("SPI %s: %zu bytes, ret %d\n", spi_struct->device, len, ret);
     hex_dump(tx, len, 32, "TX");
 #endif // debug_verbose
 
@@ -126,13 +275,93 @@ int spi_transfer(spi_dev_t *spi_struct, uint8_t const *tx, uint8_t const *rx, si
     return ret;
 }
 
+//==============================================================================
+//! \brief Chain several transfers in a single SPI_IOC_MESSAGE(N) syscall
+//!
+//! CS is released between segments (cs_change), so that each segment is seen
+//! by the slave exactly as a separate spi_transfer() would be. Segments that
+//! add up to more than the spidev bufsiz go out as several messages, cut
+//! between segments.
+//!
+//! \param  spi_struct: SPI device
+//! \param  segs: segments, in bus order
+//! \param  nb_segs: 1 to SPI_SEGS_MAX
+//! \return total size transferred on success; -EMSGSIZE if one segment is above bufsiz; < 0 if error
+//==============================================================================
+int spi_transfer_segs(spi_dev_t *spi_struct, const spi_seg_t *segs, uint32_t nb_segs)
+{
+    struct spi_ioc_transfer tr[SPI_SEGS_MAX];
+    uint32_t first = 0U;
+    size_t bytes = 0U;
+    int ret = 0;
+
+    if ((NULL == segs) || (0U == nb_segs) || (SPI_SEGS_MAX < nb_segs))
+    {
+        return -EINVAL;
+    }
+
+    for (uint32_t i = 0U; i < nb_segs; i++)
+    {
+        if (segs[i].len > spi_struct->bufsiz)
+        {
+            return -EMSGSIZE;
+        }
+
+        spi_fill_transfer(spi_struct, &tr[i], segs[i].tx, segs[i].rx, segs[i].len);
+        tr[i].cs_change = 1U;
+        if (0U != segs[i].delay_us)
+        {
+            tr[i].delay_usecs = segs[i].delay_us;
+        }
+    }
+
+    for (uint32_t i = 0U; (i <= nb_segs) && (0 <= ret); i++)
+    {
+        /* CS released at the end of each message, as between its segments */
+        if ((i == nb_segs) || ((bytes + segs[i].len) > spi_struct->bufsiz))
+        {
+            int val;
+
+            tr[i - 1U].cs_change = 0U;
+            spi_struct->splits += ((i < nb_segs) && (0U == first)) ? 1U : 0U;
+
+            val = spi_message(spi_struct, &tr[first], i - first);
+            ret = (0 > val) ? val : (ret + val);
+
+            first = i;
+            bytes = 0U;
+        }
+
+        if (i < nb_segs)
+        {
+            bytes += segs[i].len;
+        }
+    }
+
+    return ret;
+}
+
 int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32_t spi_mode)
 {
     int ret = EXIT_SUCCESS;
 
     // parse_opts(argc, argv);
     spi_struct->device = spi_device;
-    spi_struct->fd = open(spi_struct->device, O_RDWR);
+    spi_struct->mock = (0 == strcmp(spi_device, SPI_MOCK_DEVICE)) ? 1U : 0U;
+    spi_struct->bufsiz = spi_read_bufsiz();
+    spi_struct->prof_id = spi_prof_device(spi_device);
+
+    if (0U != spi_struct->mock)
+    {
+        /* nothing to open nor to negotiate, the settings are taken as they are */
+        spi_struct->fd = 0;
+        spi_struct->bits = (0U != spi_struct->bits) ? spi_struct->bits : 8U;
+    }
+    else
+    {
+        spi_struct->fd = open(spi_struct->device, O_RDWR);
+    }
+
     if (spi_struct->fd < 0)
     {
         DLT_LOG(dlt_ctxt_rack, DLT_LOG_VERBOSE, DLT_STRING("can't open device"));
@@ -146,7 +375,7 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
      */
     spi_struct->mode = spi_mode;
 
-    if (EXIT_SUCCESS == ret)
+    if ((EXIT_SUCCESS == ret) && (0U == spi_struct->mock))
     {
         int32_t val = ioctl(spi_struct->fd, SPI_IOC_WR_MODE32, &spi_struct->mode);
         if (0 > val)
@@ -156,7 +385,7 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
         }
     }
 
-    if (EXIT_SUCCESS == ret)
+    if ((EXIT_SUCCESS == ret) && (0U == spi_struct->mock))
     {
         int32_t val = ioctl(spi_struct->fd, SPI_IOC_RD_MODE32, &spi_struct->mode);
         if (0 > val)
@@ -166,7 +395,7 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
         }
     }
 
-    if (EXIT_SUCCESS == ret)
+    if ((EXIT_SUCCESS == ret) && (0U == spi_struct->mock))
     {
         int32_t val = ioctl(spi_struct->fd, SPI_IOC_WR_BITS_PER_WORD, &spi_struct->bits);
         if (0 > val)
@@ -176,7 +405,7 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
         }
     }
 
-    if (EXIT_SUCCESS == ret)
+    if ((EXIT_SUCCESS == ret) && (0U == spi_struct->mock))
     {
         int32_t val = ioctl(spi_struct->fd, SPI_IOC_RD_BITS_PER_WORD, &spi_struct->bits);
         if (0 > val)
@@ -191,7 +420,7 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
      */
 
     spi_struct->speed = spi_speed;
-    if (EXIT_SUCCESS == ret)
+    if ((EXIT_SUCCESS == ret) && (0U == spi_struct->mock))
     {
         int32_t val = ioctl(spi_struct->fd, SPI_IOC_WR_MAX_SPEED_HZ, &spi_struct->speed);
         if (0 > val)
@@ -201,7 +430,7 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
         }
     }
 
-    if (EXIT_SUCCESS == ret)
+    if ((EXIT_SUCCESS == ret) && (0U == spi_struct->mock))
     {
         int32_t val = ioctl(spi_struct->fd, SPI_IOC_RD_MAX_SPEED_HZ, &spi_struct->speed);
         if (0 > val)
@@ -214,12 +443,18 @@ int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32
     DLT_LOG(dlt_ctxt_rack, DLT_LOG_INFO, DLT_STRING("spi mode"), DLT_UINT32(spi_struct->mode));
     DLT_LOG(dlt_ctxt_rack, DLT_LOG_INFO, DLT_STRING("bits per word"), DLT_UINT32(spi_struct->bits));
     DLT_LOG(dlt_ctxt_rack, DLT_LOG_INFO, DLT_STRING("max speed"), DLT_UINT32(spi_struct->speed));
+    DLT_LOG(dlt_ctxt_rack, DLT_LOG_INFO, DLT_STRING("spidev bufsiz"), DLT_UINT32(spi_struct->bufsiz));
 
     return ret;
 }
 
 void spi_close(spi_dev_t *spi_struct)
 {
+    if (0U != spi_struct->splits)
+    {
+        DLT_LOG(dlt_ctxt_rack, DLT_LOG_INFO, DLT_STRING("spi transfers split above bufsiz"), DLT_UINT32(spi_struct->splits));
+    }
+
     if (spi_struct->fd)
     {
         close(spi_struct->fd);
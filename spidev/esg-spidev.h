@@ -2,9 +2,22 @@
 #define ESG_SPIDEV
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
 #include "linux/spi/spidev.h"
 
 #define SPI_STM_SPEED  4000000
+#define SPI_STM_DEVICE "/dev/spidev3.0"
+
+/* segments in one SPI_IOC_MESSAGE(N), CS is released between each of them */
+#define SPI_SEGS_MAX   8U
+
+/* spidev copies each message through a kernel buffer of this size, larger messages get -EMSGSIZE */
+#define SPI_BUFSIZ_PATH "/sys/module/spidev/parameters/bufsiz"
+#define SPI_BUFSIZ_DEFAULT 4096U
+
+/* device name of an in-process loopback: no ioctl, RX is a copy of TX, the wire time is spent spinning */
+#define SPI_MOCK_DEVICE "mock"
 
 typedef struct{
     int fd;                     //! Spi file descriptor
@@ -13,10 +26,27 @@ typedef struct{
 	uint8_t bits;				//! Spi word size in bits (8, 16, 32);
 	uint32_t speed;				//! Spi speed in Hz (ex: 4000000)
 	uint16_t delay;				//! If nonzero, how long to delay after the last bit transfer before optionally deselecting the device before the next transfer. (in µ sec)
+	uint32_t ioctls;			//! SPI_IOC_MESSAGE syscalls issued so far
+	uint64_t bytes;				//! bytes clocked on the bus so far
+	uint64_t bus_ns;			//! time spent inside those syscalls
+	uint8_t mock;				//! opened as SPI_MOCK_DEVICE
+	uint32_t bufsiz;			//! spidev module bufsiz, the largest message
+	uint32_t splits;			//! transfers or segment lists sent as several messages because of it
+	uint8_t prof_id;			//! device id in the spi profile (esg-spidev-prof.h)
 }spi_dev_t;
 
+typedef struct{
+	const uint8_t *tx;			//! NULL clocks zeros out
+	uint8_t *rx;				//! NULL drops what comes in
+	size_t len;
+	uint16_t delay_us;			//! after this segment, before the next one (0: the device delay)
+}spi_seg_t;
+
 int spi_init(spi_dev_t *spi_struct, char *spi_device, uint32_t spi_speed, uint32_t spi_mode);
 int spi_transfer(spi_dev_t *spi_struct, uint8_t const *tx, uint8_t const *rx, size_t len);
+int spi_transfer_segs(spi_dev_t *spi_struct, const spi_seg_t *segs, uint32_t nb_segs);
 void spi_close(spi_dev_t *spi_struct);
+void *spi_buf_alloc(size_t len);
+void spi_buf_free(void *buf, size_t len);
 
 #endif //ESG_SPIDEV
\ No newline at end of file
@@ -0,0 +1,95 @@
+/*
+ ============================================================================
+ Name        : esg-stats.c
+ Version     :
+ Copyright   : Closed
+ Description : tiny min/avg/max accumulators for the test runners
+ ============================================================================
+ */
+#include <stddef.h>
+
+#include "esg-stats.h"
+
+void esg_stats_reset(esg_stats_t *stats)
+{
+	if (NULL != stats)
+	{
+		stats->count = 0U;
+		stats->min = INT64_MAX;
+		stats->max = INT64_MIN;
+		stats->sum = 0;
+	}
+}
+
+void esg_stats_add(esg_stats_t *stats, int64_t value)
+{
+	if (NULL != stats)
+	{
+		stats->count++;
+		stats->sum += value;
+
+		if (value < stats->min)
+		{
+			stats->min = value;
+		}
+
+		if (value > stats->max)
+		{
+			stats->max = value;
+		}
+	}
+}
+
+int64_t esg_stats_avg(const esg_stats_t *stats)
+{
+	return ((NULL != stats) && (0U < stats->count)) ? (stats->sum / (int64_t)stats->count) : 0;
+}
+
+void esg_hist_reset(esg_hist_t *hist)
+{
+	if (NULL != hist)
+	{
+		esg_stats_reset(&hist->stats);
+
+		for (uint32_t i = 0U; i < ESG_HIST_BINS; i++)
+		{
+			hist->bins[i] = 0U;
+		}
+	}
+}
+
+void esg_hist_add(esg_hist_t *hist, int64_t value)
+{
+	if (NULL != hist)
+	{
+		uint32_t bin = 0U;
+
+		esg_stats_add(&hist->stats, value);
+
+		while ((0 < value) && (bin < (ESG_HIST_BINS - 1U)))
+		{
+			value >>= 1;
+			bin++;
+		}
+
+		hist->bins[bin]++;
+	}
+}
+
+//==============================================================================
+//! \brief Log the non empty bins of a histogram, one line each: name, upper bound, count
+//!
+//! \param  ctx: DLT context of the caller
+//! \param  name: what is counted, with its unit
+//==============================================================================
+void esg_hist_report(DltContext *ctx, const char *name, const esg_hist_t *hist)
+{
+	for (uint32_t i = 0U; i < ESG_HIST_BINS; i++)
+	{
+		if (0U < hist->bins[i])
+		{
+			DLT_LOG(*ctx, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("<"),
+					DLT_UINT32((i < (ESG_HIST_BINS - 1U)) ? (1U << i) : UINT32_MAX), DLT_UINT32(hist->bins[i]));
+		}
+	}
+}
@@ -0,0 +1,42 @@
+/*
+ ============================================================================
+ Name        : esg-stats.h
+ Version     :
+ Copyright   : Closed
+ Description : tiny min/avg/max accumulators for the test runners
+ ============================================================================
+ */
+#ifndef ESG_STATS
+#define ESG_STATS
+#pragma once
+
+#include <stdint.h>
+
+#include "dlt-client.h"
+
+typedef struct
+{
+	uint32_t count;
+	int64_t min;
+	int64_t max;
+	int64_t sum;
+} esg_stats_t;
+
+void esg_stats_reset(esg_stats_t *stats);
+void esg_stats_add(esg_stats_t *stats, int64_t value);
+int64_t esg_stats_avg(const esg_stats_t *stats);
+
+/* log2 histogram: bin 0 counts values < 1, bin k counts [2^(k-1), 2^k), the last bin is open ended */
+#define ESG_HIST_BINS 16U
+
+typedef struct
+{
+	esg_stats_t stats;
+	uint32_t bins[ESG_HIST_BINS];
+} esg_hist_t;
+
+void esg_hist_reset(esg_hist_t *hist);
+void esg_hist_add(esg_hist_t *hist, int64_t value);
+void esg_hist_report(DltContext *ctx, const char *name, const esg_hist_t *hist);
+
+#endif // ESG_STATS
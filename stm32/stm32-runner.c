@@ -16,22 +16,173 @@
 #include <sys/types.h>	  //4 signals
 #include <signal.h>		  //4 signals
 #include <sys/signalfd.h> //4 signalfd
-
-#include "Common/commParam.h"
-#include "Common/protocoleDSP.h"
+#include <sys/prctl.h>
+
+#include "tdma-codec.h"
+#include "tdma-crc.h"
+#include "tdma-pipe.h"
+#include "tdma-sched.h"
+#include "tdma-capture.h"
+#include "tdma-bridge.h"
+#include "tdma-extdata.h"
+#include "tdma-load.h"
+#include "tdma-seq.h"
+
+#include "wi_time.h"
+#include "esg-load.h"
+#include "esg-stats.h"
+#include "elite-slave-ready-gpio.h"
 
 DLT_DECLARE_CONTEXT(dlt_ctxt_stm32);
 
+/* TDMA cycle, the deadline of one SPI exchange */
+#define STM32_CYCLE_US 10000U
+
+static uint8_t injecting = 0U;
+static esg_load_t injector;
+
 #define SPI_BUFF_NB_TX 2
 
-static protdspSpiFrame_t SpiTxFrame = {0};
-static protdspSpiFrame_t SpiRxFrame = {0};
+/* spi_buf_alloc()'ed at init, locked: no page fault in the ioctl copies */
+static protdspSpiFrame_t *SpiTxFrame = NULL;
+static protdspSpiFrame_t *SpiRxFrame = NULL;
+
+/* the linux side plays the DSP: one voice out (TX0), whatever the STM32 relays back */
+#define STM32_TX_VOICES 1U
+
+static tdma_codec_stats_t rx_stats;
+static uint8_t tx_index = 0U;
+static uint8_t bridging = 0U;
+static uint8_t ext_decoding = 0U;
+static tdma_ext_t ext_stream;
+static uint8_t loading = 0U;
+static tdma_load_t tx_load;
+static tdma_seq_t rx_seq;
+
+/* lay out the next TX frame in place, with a counter in the payload, the synthetic voices (--tdma-voices)
+ * or the captured voice (--bridge)
+ */
+static void stm32_runner_encode(protdspSpiFrame_t *frame)
+{
+	tdma_frame_view_t tx;
+	uint64_t cpu_ns = (0U != loading) ? time_getThreadCpu_ns() : 0U;
+
+	if (0 == tdma_codec_encode(frame, (0U != loading) ? tx_load.nb_voices : STM32_TX_VOICES, tx_index, &tx))
+	{
+		if (0U != loading)
+		{
+			tdma_load_fill(&tx_load, &tx);
+		}
+		else
+		{
+			for (uint8_t v = 0U; v < tx.nb_voices; v++)
+			{
+				memset(tx.voice[v]->Audio, tx_index, tx.voice[v]->hdr.AudioBuffSize);
+			}
+		}
+
+		if (0U != bridging)
+		{
+			tx.voice[0]->hdr.AudioBuffSize = tdma_bridge_tx(tx.voice[0]->Audio);
+			tx.voice[0]->hdr.AudioCtrl = tdma_bridge_audio_ctrl();
+		}
+
+		tdma_crc_stamp(frame);
+	}
+
+	if (0U != loading)
+	{
+		esg_stats_add(&tx_load.build_ns, (int64_t)(time_getThreadCpu_ns() - cpu_ns));
+	}
+
+	tx_index++;
+}
+
+static void stm32_runner_decode(protdspSpiFrame_t *frame)
+{
+	tdma_frame_view_t rx;
+	int ret;
+
+	/* an empty frame carries no crc, let the decoder count it */
+	if ((0U != frame->header.hdrVersion) && (0 != tdma_crc_check(frame)))
+	{
+		rx_stats.frames++;
+		rx_stats.crc_errors++;
+		DLT_LOG(dlt_ctxt_stm32, DLT_LOG_DEBUG, DLT_STRING("rx frame crc error (index)"), DLT_UINT8(frame->header.index));
+		ret = -EBADMSG;
+	}
+	else
+	{
+		ret = tdma_codec_decode(frame, &rx, &rx_stats);
+
+		if (-EBADMSG == ret)
+		{
+			DLT_LOG(dlt_ctxt_stm32, DLT_LOG_DEBUG, DLT_STRING("malformed rx frame (version/code/size/nb/ext)"),
+					DLT_UINT8(frame->header.hdrVersion), DLT_UINT8(frame->header.hdrCode),
+					DLT_UINT16(frame->header.frameSize), DLT_UINT8(frame->header.frameNb), DLT_UINT8(frame->header.extSize));
+		}
+	}
+
+	/* an undecodable exchange may still hide an index, but not one to trust */
+	if (0 == ret)
+	{
+		tdma_seq_rx(&rx_seq, frame->header.index, time_getClock_ns());
+	}
+	else
+	{
+		tdma_seq_unreadable(&rx_seq);
+	}
+
+	if ((0U != ext_decoding) && (0 == ret))
+	{
+		tdma_ext_frame(&ext_stream, rx.ext);
+	}
+
+	/* a lost voice still takes its 10ms in the jitter buffer, the decoder conceals it */
+	if (0U != bridging)
+	{
+		if ((0 == ret) && (0U < rx.nb_voices))
+		{
+			tdma_bridge_rx(rx.voice[0]->Audio, rx.voice[0]->hdr.AudioBuffSize);
+		}
+		else
+		{
+			tdma_bridge_rx(NULL, 0U);
+		}
+	}
+}
 
-#define TSK_TIME_LOOP 1000
-#define STM_SPIDEV "/dev/spidev3.0"
+#define STM_SPIDEV SPI_STM_DEVICE
 
 static spi_dev_t spi_dev = {0};
 
+/* the STM32 asserts slave-ready once per TDMA cycle, a few cycles without it means it is gone */
+#define STM32_SREADY_TIMEOUT_US (10U * STM32_CYCLE_US)
+
+static elite_gpio_t sready_gpio = {0};
+static esg_hist_t edge_to_start_us;
+static esg_hist_t edge_to_end_us;
+static esg_hist_t edge_to_idle_us;
+static tdma_pipe_t frame_pipe;
+static tdma_sched_t cycle_sched;
+static tdma_capture_t capture;
+static tdma_replay_t replay;
+static uint8_t capturing = 0U;
+static uint8_t replaying = 0U;
+static uint32_t sready_timeouts = 0U;
+
+static void stm32_runner_hist_report(const char *name, const esg_hist_t *hist)
+{
+	char label[64];
+
+	DLT_LOG(dlt_ctxt_stm32, DLT_LOG_WARN, DLT_STRING(name), DLT_UINT32(hist->stats.count),
+			DLT_STRING("us (min/avg/max)"),
+			DLT_INT64(hist->stats.min), DLT_INT64(esg_stats_avg(&hist->stats)), DLT_INT64(hist->stats.max));
+
+	snprintf(label, sizeof(label), "%s us", name);
+	esg_hist_report(&dlt_ctxt_stm32, label, hist);
+}
+
 #define POLL_VERSION
 #ifdef POLL_VERSION
 
@@ -40,10 +191,7 @@ static spi_dev_t spi_dev = {0};
 static void *stm32_runner(void *p_data)
 {
 	int ret = EXIT_SUCCESS;
-	struct timeval t_in, timeout = {0};
 	ebt_settings_t *settings = (ebt_settings_t *)p_data;
-	fd_set read_fds, write_fds, except_fds;
-	int max_fd;
 
 	if (NULL == settings)
 	{
@@ -54,56 +202,196 @@ static void *stm32_runner(void *p_data)
 	if (EXIT_SUCCESS == ret)
 	{
 		uint32_t nb_loops = settings->nb_loops;
+		uint32_t cycle = 0U;
 		ssize_t byte_rx = 0;
 
 		DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("START"), DLT_UINT32(nb_loops));
+		/* names its slot of the spi profile */
+		(void)prctl(PR_SET_NAME, "stm32", 0, 0, 0);
+
+		esg_hist_reset(&edge_to_start_us);
+		esg_hist_reset(&edge_to_end_us);
+		esg_hist_reset(&edge_to_idle_us);
+		memset(&rx_stats, 0, sizeof(rx_stats));
+		tdma_seq_init(&rx_seq);
+
+		if (0U != settings->tdma_pipeline)
+		{
+			ret = tdma_pipe_start(&frame_pipe, settings->tdma_pipeline, stm32_runner_encode, stm32_runner_decode);
+			byte_rx = (EXIT_SUCCESS == ret) ? 0 : -1;
+		}
+		else
+		{
+			stm32_runner_encode(SpiTxFrame);
+		}
+
+		if (0U != settings->tdma_timer)
+		{
+			tdma_sched_init(&cycle_sched, STM32_CYCLE_US * 1000ULL, (uint64_t)settings->tdma_phase_us * 1000U);
+		}
 
 		while ((nb_loops--) && (0 <= byte_rx))
 		{
-			// TODO : block on sready gpio somehow.
-			FD_ZERO(&read_fds);
-			FD_ZERO(&write_fds);
-			FD_ZERO(&except_fds);
-			// Avec le descripteur de fichier de la file de messages
-			//	FD_SET(spi_dev.fd, &except_fds);
-			FD_SET(spi_dev.fd, &read_fds);
-			//	FD_SET(spi_dev.fd, &write_fds);
+			uint64_t t_start, t_end;
+			protdspSpiFrame_t *tx = SpiTxFrame;
+			protdspSpiFrame_t *rx = SpiRxFrame;
+			int val;
 
-			max_fd = spi_dev.fd + 1;
+			if (0U != replaying)
+			{
+				/* the recorded edges, at the replay speed */
+				val = tdma_replay_wait(&replay);
+				sready_gpio.edge_ns = time_getClockRaw_ns();
+			}
+			else if (0U != settings->tdma_timer)
+			{
+				/* no GPIO: released on the 10ms grid, the histograms count from the release */
+				val = tdma_sched_wait(&cycle_sched);
+				sready_gpio.edge_ns = time_getClockRaw_ns();
+			}
+			else
+			{
+				/* one SPI exchange per slave-ready edge, nothing in between */
+				val = elite_slave_ready_wait_timeout(&sready_gpio, STM32_SREADY_TIMEOUT_US);
+			}
 
-			timeout.tv_sec = 0;
-			timeout.tv_usec = 100;
+			if (-ETIMEDOUT == val)
+			{
+				sready_timeouts++;
+				DLT_LOG(dlt_ctxt_stm32, DLT_LOG_WARN, DLT_STRING("slave-ready timeout"), DLT_UINT(nb_loops));
+				continue;
+			}
+			else if (-ENODATA == val)
+			{
+				DLT_LOG(dlt_ctxt_stm32, DLT_LOG_WARN, DLT_STRING("end of the replayed capture"), DLT_UINT32(cycle));
+				break;
+			}
+			else if (0 > val)
+			{
+				byte_rx = val;
+				break;
+			}
+
+			DLT_LOG(dlt_ctxt_stm32, DLT_LOG_DEBUG, DLT_STRING("spi_transfer"), DLT_UINT(nb_loops));
+
+			if (0U != settings->tdma_pipeline)
+			{
+				tx = tdma_pipe_tx(&frame_pipe);
+				rx = tdma_pipe_rx(&frame_pipe);
+			}
+
+			t_start = time_getClockRaw_ns();
+
+			if (0U != replaying)
+			{
+				byte_rx = tdma_replay_transfer(&replay, rx);
+			}
+			else
+			{
+				uint64_t cpu_ns = (0U != loading) ? time_getThreadCpu_ns() : 0U;
+
+				// vanilla SPI_IOC_MESSAGE
+				byte_rx = spi_transfer(&spi_dev,
+									   (const uint8_t *)tx,
+									   (const uint8_t *)rx,
+									   sizeof(protdspSpiFrame_t));
+
+				if (0U != loading)
+				{
+					esg_stats_add(&tx_load.transfer_ns, (int64_t)(time_getThreadCpu_ns() - cpu_ns));
+				}
+			}
+
+			t_end = time_getClockRaw_ns();
+
+			if (0U != capturing)
+			{
+				tdma_capture_add(&capture, cycle, sready_gpio.edge_ns, t_start, t_end, (int32_t)byte_rx, tx, rx);
+			}
+			cycle++;
+
+			esg_hist_add(&edge_to_start_us, (int64_t)(t_start - sready_gpio.edge_ns) / 1000);
+			esg_hist_add(&edge_to_end_us, (int64_t)(t_end - sready_gpio.edge_ns) / 1000);
 
-			int ret_select = select(max_fd, &read_fds, NULL, NULL, &timeout);
-			if (ret_select == -1)
+			if (0U != settings->tdma_pipeline)
 			{
-				fprintf(stderr, "stm32_runner: timeout!\n");
-				fflush(stderr);
-				DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("timeout"), DLT_UINT(nb_loops));
+				/* the helper threads check what came in and prepare the next ones */
+				tdma_pipe_done(&frame_pipe, rx, (0 <= byte_rx));
 			}
 			else
 			{
-				// if (FD_ISSET(spi_dev.fd, &read_fds))
+				/* in line: check what came in, prepare the next one */
+				if (0 <= byte_rx)
 				{
-					DLT_LOG(dlt_ctxt_stm32, DLT_LOG_INFO, DLT_STRING("spi_transfer"), DLT_UINT(nb_loops));
+					stm32_runner_decode(rx);
+				}
+				stm32_runner_encode(tx);
+			}
 
-					// vanilla SPI_IOC_MESSAGE
-					byte_rx = spi_transfer(&spi_dev,
-										   (const uint8_t *)&SpiTxFrame,
-										   (const uint8_t *)&SpiRxFrame,
-										   sizeof(protdspSpiFrame_t));
+			/* RT thread work of this cycle, until it can wait for the next edge */
+			esg_hist_add(&edge_to_idle_us, (int64_t)(time_getClockRaw_ns() - sready_gpio.edge_ns) / 1000);
+
+			/* synthetic load, the cycle must still fit in the TDMA slot, counted from the edge */
+			if (0U != injecting)
+			{
+				esg_load_burn(&injector, STM32_CYCLE_US);
+
+				if (0U != esg_load_cycle_end(&injector, (0 > byte_rx) || ((time_getClockRaw_ns() - sready_gpio.edge_ns) > (STM32_CYCLE_US * 1000ULL))))
+				{
+					nb_loops = 0U;
 				}
 			}
 
-			// do some syscalls, to fake load
-			struct timespec res;
-			clock_gettime(CLOCK_MONOTONIC, &res);
+			if (0U != settings->tdma_timer)
+			{
+				tdma_sched_done(&cycle_sched);
+			}
 		};
+
+		/* the helper threads are joined before their counters are read */
+		tdma_pipe_stop(&frame_pipe);
+		tdma_capture_close(&capture);
+		tdma_replay_close(&replay);
+		tdma_ext_close(&ext_stream);
+
+		if (0U != settings->tdma_timer)
+		{
+			tdma_sched_report("stm32", &cycle_sched);
+		}
+		else
+		{
+			DLT_LOG(dlt_ctxt_stm32, DLT_LOG_WARN, DLT_STRING("slave-ready timeouts"), DLT_UINT32(sready_timeouts));
+		}
+		stm32_runner_hist_report("edge to transfer start", &edge_to_start_us);
+		stm32_runner_hist_report("edge to transfer complete", &edge_to_end_us);
+		stm32_runner_hist_report((0U != settings->tdma_pipeline) ? "edge to idle (pipelined)" : "edge to idle (in line)", &edge_to_idle_us);
+		tdma_codec_report("stm32 rx", &rx_stats);
+		tdma_seq_report("stm32 rx", &rx_seq);
+
+		if (0U != loading)
+		{
+			tdma_load_report(&tx_load);
+		}
+
+		if (0U != injecting)
+		{
+			esg_load_report(&injector);
+		}
+	}
+
+	if (0U != injecting)
+	{
+		esg_load_free(&injector);
+		injecting = 0U;
 	}
 
 	DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("EXIT"), DLT_UINT32(ret));
 
 	spi_close(&spi_dev);
+	/* the gpiod runner (--gpiod) waits on the same GPIO, leave it exported */
+	elite_gpio_release(&sready_gpio);
+	spi_buf_free(SpiTxFrame, sizeof(protdspSpiFrame_t));
+	spi_buf_free(SpiRxFrame, sizeof(protdspSpiFrame_t));
 
 	return (void *)ret;
 }
@@ -128,6 +416,8 @@ static void *stm32_runner(void *p_data)
 		ssize_t byte_rx = 0;
 
 		DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("START"), DLT_UINT32(nb_loops));
+		/* names its slot of the spi profile */
+		(void)prctl(PR_SET_NAME, "stm32", 0, 0, 0);
 
 		while ((nb_loops--) && (0 <= byte_rx))
 		{
@@ -135,8 +425,8 @@ static void *stm32_runner(void *p_data)
 
 			// SPI_IOC_MESSAGE with embedded slaveready wait.
 			byte_rx = spi_transfer(&spi_dev,
-								   (const uint8_t *)&SpiTxFrame,
-								   (const uint8_t *)&SpiRxFrame,
+								   (const uint8_t *)SpiTxFrame,
+								   (const uint8_t *)SpiRxFrame,
 								   sizeof(protdspSpiFrame_t));
 		}
 	};
@@ -144,6 +434,8 @@ static void *stm32_runner(void *p_data)
 	DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("EXIT"), DLT_UINT32(ret));
 
 	spi_close(&spi_dev);
+	spi_buf_free(SpiTxFrame, sizeof(protdspSpiFrame_t));
+	spi_buf_free(SpiRxFrame, sizeof(protdspSpiFrame_t));
 
 	return (void *)ret;
 }
@@ -163,11 +455,66 @@ int stm32_runner_init(pthread_t *runner, ebt_settings_t *settings)
 	{
 		DLT_REGISTER_CONTEXT_LL_TS(dlt_ctxt_stm32, "ELIT", "ESG BSP STM32 Context", settings->verbosity, DLT_TRACE_STATUS_DEFAULT);
 
-		ret = spi_init(&spi_dev, STM_SPIDEV, SPI_STM_SPEED, SPI_NO_CS | SPI_MODE_0);
-		if (0 > ret)
+		tdma_crc_init();
+
+		if (NULL != settings->tdma_replay)
 		{
-			DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("Failed to initialize SPI device"), DLT_STRING(STM_SPIDEV));
+			/* a capture stands in for the spidev and the slave-ready edges */
+			ret = tdma_replay_open(&replay, settings->tdma_replay, settings->replay_speed);
+			replaying = (EXIT_SUCCESS == ret) ? 1U : 0U;
 		}
+		else
+		{
+			ret = spi_init(&spi_dev, STM_SPIDEV, SPI_STM_SPEED, SPI_NO_CS | SPI_MODE_0);
+			if (0 > ret)
+			{
+				DLT_LOG(dlt_ctxt_stm32, DLT_LOG_ERROR, DLT_STRING("Failed to initialize SPI device"), DLT_STRING(STM_SPIDEV));
+			}
+		}
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		SpiTxFrame = spi_buf_alloc(sizeof(protdspSpiFrame_t));
+		SpiRxFrame = spi_buf_alloc(sizeof(protdspSpiFrame_t));
+		ret = ((NULL != SpiTxFrame) && (NULL != SpiRxFrame)) ? EXIT_SUCCESS : -ENOMEM;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (NULL != settings->tdma_capture))
+	{
+		ret = tdma_capture_open(&capture, settings->tdma_capture, STM32_CYCLE_US);
+		capturing = (EXIT_SUCCESS == ret) ? 1U : 0U;
+	}
+
+#ifdef POLL_VERSION
+	/* the transfers are paced by the slave-ready edges, unless by the cycle scheduler or a replay */
+	if ((EXIT_SUCCESS == ret) && (0U == settings->tdma_timer) && (0U == replaying))
+	{
+		ret = elite_slave_ready_gpio_init(&sready_gpio, settings);
+	}
+#endif // POLL_VERSION
+
+	if (EXIT_SUCCESS == ret)
+	{
+		bridging = settings->bridge;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (0U < settings->tdma_voices))
+	{
+		tdma_load_init(&tx_load, (uint8_t)settings->tdma_voices, (tdma_load_pattern_t)settings->tdma_pattern);
+		loading = 1U;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (0U != settings->tdma_ext))
+	{
+		ret = tdma_ext_open(&ext_stream, settings->tdma_ext);
+		ext_decoding = (EXIT_SUCCESS == ret) ? 1U : 0U;
+	}
+
+	if ((EXIT_SUCCESS == ret) && ((0U < settings->load_percent) || (0U != settings->load_ramp)))
+	{
+		ret = esg_load_init(&injector, "stm32", settings->load_kernel, settings->load_percent, settings->load_ramp);
+		injecting = (EXIT_SUCCESS == ret) ? 1U : 0U;
 	}
 
 	if (EXIT_SUCCESS == ret)
@@ -0,0 +1,615 @@
+/*
+ ============================================================================
+ Name        : tdma-bridge.c
+ Version     :
+ Copyright   : Closed
+ Description : voice bridge between the ALSA runner (20ms periods) and the
+               STM32 runner (10ms TDMA cycles)
+
+ Uplink: capture channel 0 is resampled to 16kHz, cut in 10ms blocks and
+ encoded in the audio thread, the STM32 thread takes one block per cycle for
+ TX voice 0. Downlink: the STM32 thread queues RX voice 0 as it comes, the
+ audio thread decodes and resamples it into the playback period.
+ Each direction has a lock-free SPSC jitter buffer: the consumer waits for
+ the target fill before it starts, conceals an underrun and builds the
+ target up again, and drops the oldest block when the fill keeps growing
+ (clock drift between the two runners).
+ Once a second a full scale Barker code replaces the start of an uplink block,
+ stamped with its capture time; the first downlink samples matching it give
+ the mouth-to-ear latency, from the ADC to the DAC through the STM32.
+ Loud speech reaches the level too, but not with the signs and the flat
+ chips of the code.
+ ============================================================================
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_OPUS
+#include <opus.h>
+#endif
+
+#include "esg-bsp-test.h"
+#include "esg-stats.h"
+#include "tdma-codec.h"
+#include "tdma-bridge.h"
+
+typedef struct
+{
+	uint8_t data[COMMPAR_AUDIO_DATA_SIZE_MAX];
+	uint16_t len;					/* 0: lost on the way, concealed by the decoder */
+} bridge_block_t;
+
+/* head is only written by the producer, tail by the consumer */
+typedef struct
+{
+	bridge_block_t slot[TDMA_BRIDGE_SLOTS];
+	uint32_t head;
+	uint32_t tail;
+	uint32_t target;
+	/* consumer */
+	uint8_t primed;
+	uint64_t blocks;
+	uint64_t underruns;
+	uint64_t slips;
+	esg_stats_t fill;
+	/* producer */
+	uint64_t overruns;
+} bridge_jitter_t;
+
+/* linear interpolation, pos is in Q16 input samples from the last sample of the previous call */
+typedef struct
+{
+	uint32_t rate_in;
+	uint32_t rate_out;
+	uint32_t step;
+	uint32_t pos;
+	int16_t last;
+	int16_t cur;
+} bridge_resampler_t;
+
+typedef struct
+{
+	const char *name;
+	uint8_t audio_ctrl;				/* PROTDSP_AUDIO_CTRL_TYPE_ of the slot its payload fills */
+	int (*open)(void);
+	uint16_t (*encode)(const int16_t *pcm, uint8_t *data);
+	void (*decode)(const uint8_t *data, uint16_t len, int16_t *pcm);		/* NULL data: conceal */
+	void (*close)(void);
+} bridge_codec_t;
+
+typedef struct
+{
+	uint8_t enabled;
+	const bridge_codec_t *codec;
+	bridge_jitter_t up;
+	bridge_jitter_t down;
+	/* audio thread only */
+	bridge_resampler_t up_rs;
+	bridge_resampler_t down_rs;
+	int16_t up_pcm[TDMA_BRIDGE_BLOCK];
+	uint32_t up_fill;
+	uint64_t up_block_ns;			/* capture time of up_pcm[0] */
+	int16_t down_pcm[TDMA_BRIDGE_BLOCK];
+	int16_t down_tail[TDMA_BRIDGE_MARK_LEN - 1U];	/* end of the previous block, for a marker across two */
+	uint32_t down_pos;
+	uint64_t play_ns;				/* playback time of the first frame of the current period */
+	uint32_t play_rate;
+	/* latency markers */
+	uint32_t mark_blocks;
+	uint64_t mark_ns;				/* capture time of the marker in flight, 0 if none */
+	uint64_t marks_sent;
+	uint64_t marks_lost;
+	esg_stats_t mouth_to_ear_us;
+	esg_hist_t mouth_to_ear_ms;		/* tens of ms, past the last log2 us bin */
+} tdma_bridge_t;
+
+static tdma_bridge_t bridge = {0};
+
+/*
+ * codecs
+ */
+
+/* no dependency: 5:1 decimation to 3.2kHz, 8 bits, fills the 32 bytes of a slot */
+#define BRIDGE_STUB_DECIMATION (TDMA_BRIDGE_BLOCK / COMMPAR_AUDIO_DATA_SIZE_MAX)
+
+static int bridge_stub_open(void)
+{
+	return 0;
+}
+
+static uint16_t bridge_stub_encode(const int16_t *pcm, uint8_t *data)
+{
+	for (uint32_t i = 0U; i < COMMPAR_AUDIO_DATA_SIZE_MAX; i++)
+	{
+		int32_t sum = 0;
+
+		for (uint32_t j = 0U; j < BRIDGE_STUB_DECIMATION; j++)
+		{
+			sum += pcm[i * BRIDGE_STUB_DECIMATION + j];
+		}
+
+		data[i] = (uint8_t)(int8_t)((sum / (int32_t)BRIDGE_STUB_DECIMATION) >> 8);
+	}
+
+	return COMMPAR_AUDIO_DATA_SIZE_MAX;
+}
+
+static void bridge_stub_decode(const uint8_t *data, uint16_t len, int16_t *pcm)
+{
+	if ((NULL == data) || (COMMPAR_AUDIO_DATA_SIZE_MAX != len))
+	{
+		memset(pcm, 0, TDMA_BRIDGE_BLOCK * sizeof(*pcm));
+		return;
+	}
+
+	for (uint32_t i = 0U; i < COMMPAR_AUDIO_DATA_SIZE_MAX; i++)
+	{
+		for (uint32_t j = 0U; j < BRIDGE_STUB_DECIMATION; j++)
+		{
+			pcm[i * BRIDGE_STUB_DECIMATION + j] = (int16_t)((int8_t)data[i] * 256);
+		}
+	}
+}
+
+static void bridge_stub_close(void)
+{
+}
+
+#ifdef HAVE_OPUS
+/* 16kHz wideband, 10ms frames, CBR at the size of an opus16 slot */
+static OpusEncoder *opus_enc = NULL;
+static OpusDecoder *opus_dec = NULL;
+
+static int bridge_opus_open(void)
+{
+	int err = OPUS_OK;
+
+	opus_enc = opus_encoder_create(TDMA_BRIDGE_RATE, 1, OPUS_APPLICATION_VOIP, &err);
+
+	if (OPUS_OK == err)
+	{
+		(void)opus_encoder_ctl(opus_enc, OPUS_SET_BITRATE(COMMPAR_OPUS16_AUDIO_SIZE * 8 * 100));
+		(void)opus_encoder_ctl(opus_enc, OPUS_SET_VBR(0));
+		opus_dec = opus_decoder_create(TDMA_BRIDGE_RATE, 1, &err);
+	}
+
+	return (OPUS_OK == err) ? 0 : -EINVAL;
+}
+
+static uint16_t bridge_opus_encode(const int16_t *pcm, uint8_t *data)
+{
+	opus_int32 len = opus_encode(opus_enc, pcm, TDMA_BRIDGE_BLOCK, data, COMMPAR_OPUS16_AUDIO_SIZE);
+
+	return (0 < len) ? (uint16_t)len : 0U;
+}
+
+static void bridge_opus_decode(const uint8_t *data, uint16_t len, int16_t *pcm)
+{
+	/* no data: packet loss concealment */
+	int n = opus_decode(opus_dec, (0U != len) ? data : NULL, len, pcm, TDMA_BRIDGE_BLOCK, 0);
+
+	if ((int)TDMA_BRIDGE_BLOCK != n)
+	{
+		memset(pcm, 0, TDMA_BRIDGE_BLOCK * sizeof(*pcm));
+	}
+}
+
+static void bridge_opus_close(void)
+{
+	opus_encoder_destroy(opus_enc);
+	opus_decoder_destroy(opus_dec);
+	opus_enc = NULL;
+	opus_dec = NULL;
+}
+#endif // HAVE_OPUS
+
+static const bridge_codec_t bridge_codecs[] = {
+	/* 32 bytes: the size of a 24kHz opus slot */
+	{"stub", PROTDSP_AUDIO_CTRL_TYPE_24K, bridge_stub_open, bridge_stub_encode, bridge_stub_decode, bridge_stub_close},
+#ifdef HAVE_OPUS
+	{"opus", PROTDSP_AUDIO_CTRL_TYPE_16K, bridge_opus_open, bridge_opus_encode, bridge_opus_decode, bridge_opus_close},
+#endif
+};
+
+#define BRIDGE_CODECS_NB (sizeof(bridge_codecs) / sizeof(bridge_codecs[0]))
+
+/*
+ * jitter buffer
+ */
+
+/* producer: free slot, or NULL (counted) if the consumer is too far behind */
+static bridge_block_t *bridge_jitter_slot(bridge_jitter_t *jb)
+{
+	uint32_t head = __atomic_load_n(&jb->head, __ATOMIC_RELAXED);
+
+	if ((head - __atomic_load_n(&jb->tail, __ATOMIC_ACQUIRE)) >= TDMA_BRIDGE_SLOTS)
+	{
+		jb->overruns++;
+		return NULL;
+	}
+
+	return &jb->slot[head & (TDMA_BRIDGE_SLOTS - 1U)];
+}
+
+static void bridge_jitter_push(bridge_jitter_t *jb)
+{
+	__atomic_store_n(&jb->head, jb->head + 1U, __ATOMIC_RELEASE);
+}
+
+/* consumer: next block to play, NULL while priming or on underrun */
+static const bridge_block_t *bridge_jitter_peek(bridge_jitter_t *jb)
+{
+	uint32_t tail = __atomic_load_n(&jb->tail, __ATOMIC_RELAXED);
+	uint32_t fill = __atomic_load_n(&jb->head, __ATOMIC_ACQUIRE) - tail;
+
+	esg_stats_add(&jb->fill, fill);
+
+	if ((0U == jb->primed) && (fill < jb->target))
+	{
+		return NULL;
+	}
+
+	if (0U == fill)
+	{
+		/* conceal, and build the target up again */
+		jb->underruns++;
+		jb->primed = 0U;
+		return NULL;
+	}
+
+	jb->primed = 1U;
+
+	if (fill > (jb->target + TDMA_BRIDGE_SLIP))
+	{
+		tail++;
+		jb->slips++;
+		__atomic_store_n(&jb->tail, tail, __ATOMIC_RELEASE);
+	}
+
+	return &jb->slot[tail & (TDMA_BRIDGE_SLOTS - 1U)];
+}
+
+static void bridge_jitter_release(bridge_jitter_t *jb)
+{
+	jb->blocks++;
+	__atomic_store_n(&jb->tail, jb->tail + 1U, __ATOMIC_RELEASE);
+}
+
+static void bridge_jitter_init(bridge_jitter_t *jb, uint32_t target)
+{
+	memset(jb, 0, sizeof(*jb));
+	jb->target = target;
+	esg_stats_reset(&jb->fill);
+}
+
+static void bridge_resampler_rate(bridge_resampler_t *rs, uint32_t rate_in, uint32_t rate_out)
+{
+	if ((rs->rate_in != rate_in) || (rs->rate_out != rate_out))
+	{
+		/* a rate switch restarts the interpolation, one click at most */
+		rs->rate_in = rate_in;
+		rs->rate_out = rate_out;
+		rs->step = (uint32_t)(((uint64_t)rate_in << 16) / rate_out);
+		rs->pos = 0U;
+	}
+}
+
+static int16_t bridge_lerp(int16_t a, int16_t b, uint32_t pos)
+{
+	return (int16_t)(a + (int16_t)(((int64_t)(b - a) * (pos & 0xFFFFU)) >> 16));
+}
+
+/*
+ * uplink
+ */
+
+static const int8_t bridge_mark_code[TDMA_BRIDGE_MARK_CHIPS] = {1, 1, 1, -1, -1, 1, -1};
+
+/* the marker from pcm[0]; the 2 samples at each chip edge are not checked, the codecs smear them */
+static uint8_t bridge_mark_match(const int16_t *pcm)
+{
+	for (uint32_t c = 0U; c < TDMA_BRIDGE_MARK_CHIPS; c++)
+	{
+		for (uint32_t j = 2U; j < (TDMA_BRIDGE_MARK_CHIP_LEN - 2U); j++)
+		{
+			if (TDMA_BRIDGE_MARK_LEVEL > ((int32_t)pcm[c * TDMA_BRIDGE_MARK_CHIP_LEN + j] * bridge_mark_code[c]))
+			{
+				return 0U;
+			}
+		}
+	}
+
+	return 1U;
+}
+
+/* a full 16kHz block: marker, encode, queue for the STM32 thread */
+static void bridge_uplink_block(void)
+{
+	bridge_block_t *blk;
+
+	if (TDMA_BRIDGE_MARK_BLOCKS <= ++bridge.mark_blocks)
+	{
+		/* the previous one never came back */
+		bridge.marks_lost += (0U != bridge.mark_ns) ? 1U : 0U;
+
+		for (uint32_t i = 0U; i < TDMA_BRIDGE_MARK_LEN; i++)
+		{
+			bridge.up_pcm[i] = (0 < bridge_mark_code[i / TDMA_BRIDGE_MARK_CHIP_LEN]) ? INT16_MAX : INT16_MIN;
+		}
+
+		bridge.mark_blocks = 0U;
+		bridge.mark_ns = bridge.up_block_ns;
+		bridge.marks_sent++;
+	}
+
+	blk = bridge_jitter_slot(&bridge.up);
+	if (NULL != blk)
+	{
+		blk->len = bridge.codec->encode(bridge.up_pcm, blk->data);
+		bridge_jitter_push(&bridge.up);
+	}
+}
+
+//==============================================================================
+//! \brief Take a captured period: resample to 16kHz, encode and queue the 10ms blocks
+//!
+//! \param  pcm: one S32 channel
+//! \param  first_ns: CLOCK_MONOTONIC time pcm[0] was sampled
+//==============================================================================
+void tdma_bridge_capture(const int32_t *pcm, uint32_t frames, uint32_t rate, uint64_t first_ns)
+{
+	bridge_resampler_t *rs = &bridge.up_rs;
+
+	if ((0U == bridge.enabled) || (0U == frames))
+	{
+		return;
+	}
+
+	bridge_resampler_rate(rs, rate, TDMA_BRIDGE_RATE);
+
+	/* between the input samples i - 1 and i, i = 0 being the last one of the previous period */
+	while ((rs->pos >> 16) < frames)
+	{
+		uint32_t i = rs->pos >> 16;
+		int16_t a = (0U == i) ? rs->last : (int16_t)(pcm[i - 1U] >> 16);
+
+		if (0U == bridge.up_fill)
+		{
+			bridge.up_block_ns = first_ns + (uint64_t)i * 1000000000ULL / rate;
+		}
+
+		bridge.up_pcm[bridge.up_fill++] = bridge_lerp(a, (int16_t)(pcm[i] >> 16), rs->pos);
+
+		if (TDMA_BRIDGE_BLOCK == bridge.up_fill)
+		{
+			bridge_uplink_block();
+			bridge.up_fill = 0U;
+		}
+
+		rs->pos += rs->step;
+	}
+
+	rs->pos -= frames << 16;
+	rs->last = (int16_t)(pcm[frames - 1U] >> 16);
+}
+
+/* STM32 thread: one block per cycle into the TX voice, 0 bytes while there is none */
+uint16_t tdma_bridge_tx(uint8_t *data)
+{
+	const bridge_block_t *blk;
+	uint16_t len = 0U;
+
+	if (0U != bridge.enabled)
+	{
+		blk = bridge_jitter_peek(&bridge.up);
+		if (NULL != blk)
+		{
+			len = blk->len;
+			memcpy(data, blk->data, len);
+			bridge_jitter_release(&bridge.up);
+		}
+	}
+
+	return len;
+}
+
+/* STM32 thread: AudioCtrl of the TX voice, for the codec in use */
+uint8_t tdma_bridge_audio_ctrl(void)
+{
+	return (NULL != bridge.codec) ? bridge.codec->audio_ctrl : PROTDSP_AUDIO_CTRL_TYPE_16K;
+}
+
+/*
+ * downlink
+ */
+
+/* STM32 thread: RX voice as received, NULL for a lost frame so that the timeline holds */
+void tdma_bridge_rx(const uint8_t *data, uint16_t len)
+{
+	bridge_block_t *blk;
+
+	if (0U != bridge.enabled)
+	{
+		blk = bridge_jitter_slot(&bridge.down);
+		if (NULL != blk)
+		{
+			blk->len = ((NULL != data) && (COMMPAR_AUDIO_DATA_SIZE_MAX >= len)) ? len : 0U;
+			if (0U != blk->len)
+			{
+				memcpy(blk->data, data, blk->len);
+			}
+			bridge_jitter_push(&bridge.down);
+		}
+	}
+}
+
+/* next block to play, decoded; k is the output frame it starts under */
+static void bridge_downlink_block(uint32_t k)
+{
+	const bridge_block_t *blk = bridge_jitter_peek(&bridge.down);
+
+	if (NULL != blk)
+	{
+		bridge.codec->decode(blk->data, blk->len, bridge.down_pcm);
+		bridge_jitter_release(&bridge.down);
+	}
+	else
+	{
+		bridge.codec->decode(NULL, 0U, bridge.down_pcm);
+	}
+
+	/* the codec delay may put the marker across this block and the previous one */
+	if (0U != bridge.mark_ns)
+	{
+		int16_t win[(TDMA_BRIDGE_MARK_LEN - 1U) + TDMA_BRIDGE_BLOCK];
+
+		memcpy(win, bridge.down_tail, sizeof(bridge.down_tail));
+		memcpy(&win[TDMA_BRIDGE_MARK_LEN - 1U], bridge.down_pcm, sizeof(bridge.down_pcm));
+
+		for (uint32_t s = 0U; s < TDMA_BRIDGE_BLOCK; s++)
+		{
+			if (0U != bridge_mark_match(&win[s]))
+			{
+				/* s - (TDMA_BRIDGE_MARK_LEN - 1) samples from the start of this block */
+				uint64_t ear_ns = bridge.play_ns + (uint64_t)k * 1000000000ULL / bridge.play_rate +
+								  (uint64_t)s * 1000000000ULL / TDMA_BRIDGE_RATE -
+								  (uint64_t)(TDMA_BRIDGE_MARK_LEN - 1U) * 1000000000ULL / TDMA_BRIDGE_RATE;
+
+				if (ear_ns > bridge.mark_ns)
+				{
+					esg_stats_add(&bridge.mouth_to_ear_us, (int64_t)(ear_ns - bridge.mark_ns) / 1000);
+					esg_hist_add(&bridge.mouth_to_ear_ms, (int64_t)(ear_ns - bridge.mark_ns) / 1000000);
+				}
+				bridge.mark_ns = 0U;
+				break;
+			}
+		}
+	}
+
+	memcpy(bridge.down_tail, &bridge.down_pcm[TDMA_BRIDGE_BLOCK - (TDMA_BRIDGE_MARK_LEN - 1U)], sizeof(bridge.down_tail));
+
+	bridge.down_pos = 0U;
+}
+
+//==============================================================================
+//! \brief Fill a playback period from the downlink, resampled from 16kHz
+//!
+//! \param  pcm: one S32 channel, frames long
+//! \param  first_ns: CLOCK_MONOTONIC time pcm[0] will reach the DAC
+//==============================================================================
+void tdma_bridge_playback(int32_t *pcm, uint32_t frames, uint32_t rate, uint64_t first_ns)
+{
+	bridge_resampler_t *rs = &bridge.down_rs;
+
+	if (0U == bridge.enabled)
+	{
+		return;
+	}
+
+	bridge_resampler_rate(rs, TDMA_BRIDGE_RATE, rate);
+	bridge.play_ns = first_ns;
+	bridge.play_rate = rate;
+
+	/* pulls the 16kHz samples as the output position crosses them */
+	for (uint32_t k = 0U; k < frames; k++)
+	{
+		while (0x10000U <= rs->pos)
+		{
+			if (TDMA_BRIDGE_BLOCK <= bridge.down_pos)
+			{
+				bridge_downlink_block(k);
+			}
+
+			rs->last = rs->cur;
+			rs->cur = bridge.down_pcm[bridge.down_pos++];
+			rs->pos -= 0x10000U;
+		}
+
+		pcm[k] = (int32_t)bridge_lerp(rs->last, rs->cur, rs->pos) * 65536;
+		rs->pos += rs->step;
+	}
+}
+
+//==============================================================================
+//! \brief Select the codec and set the jitter buffers up
+//!
+//! \param  codec: "stub", or "opus" when built with libopus
+//! \param  jitter_blocks: target fill of both jitter buffers, in 10ms blocks
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_bridge_init(const char *codec, uint32_t jitter_blocks)
+{
+	int ret = -ENOTSUP;
+
+	memset(&bridge, 0, sizeof(bridge));
+
+	for (uint32_t i = 0U; i < BRIDGE_CODECS_NB; i++)
+	{
+		if (0 == strcmp(codec, bridge_codecs[i].name))
+		{
+			bridge.codec = &bridge_codecs[i];
+			ret = bridge.codec->open();
+		}
+	}
+
+	if ((EXIT_SUCCESS == ret) && ((1U > jitter_blocks) || (TDMA_BRIDGE_JITTER_MAX < jitter_blocks)))
+	{
+		bridge.codec->close();
+		ret = -EINVAL;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		bridge_jitter_init(&bridge.up, jitter_blocks);
+		bridge_jitter_init(&bridge.down, jitter_blocks);
+		/* the first downlink sample pulls the first block */
+		bridge.down_pos = TDMA_BRIDGE_BLOCK;
+		esg_stats_reset(&bridge.mouth_to_ear_us);
+		esg_hist_reset(&bridge.mouth_to_ear_ms);
+		bridge.enabled = 1U;
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("tdma bridge (codec/jitter blocks)"), DLT_STRING(codec), DLT_UINT32(jitter_blocks));
+	}
+	else
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("tdma bridge: can't use codec"), DLT_STRING(codec), DLT_INT32(ret));
+	}
+
+	return ret;
+}
+
+static void bridge_jitter_report(const char *name, const bridge_jitter_t *jb)
+{
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("blocks (played/underruns/overruns/slips)"),
+			DLT_UINT64(jb->blocks), DLT_UINT64(jb->underruns), DLT_UINT64(jb->overruns), DLT_UINT64(jb->slips),
+			DLT_STRING("fill (target/min/avg/max)"), DLT_UINT32(jb->target),
+			DLT_INT64(jb->fill.min), DLT_INT64(esg_stats_avg(&jb->fill)), DLT_INT64(jb->fill.max));
+}
+
+void tdma_bridge_report(void)
+{
+	const esg_stats_t *stats = &bridge.mouth_to_ear_us;
+
+	if (0U != bridge.enabled)
+	{
+		bridge_jitter_report("tdma bridge uplink", &bridge.up);
+		bridge_jitter_report("tdma bridge downlink", &bridge.down);
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma bridge mouth to ear (markers sent/lost/measured)"),
+				DLT_UINT64(bridge.marks_sent), DLT_UINT64(bridge.marks_lost), DLT_UINT32(stats->count),
+				DLT_STRING("us (min/avg/max)"),
+				DLT_INT64(stats->min), DLT_INT64(esg_stats_avg(stats)), DLT_INT64(stats->max));
+
+		esg_hist_report(&dlt_ctxt_btst, "tdma bridge mouth to ear ms", &bridge.mouth_to_ear_ms);
+	}
+}
+
+void tdma_bridge_close(void)
+{
+	if (0U != bridge.enabled)
+	{
+		bridge.enabled = 0U;
+		bridge.codec->close();
+	}
+}
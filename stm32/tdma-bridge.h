@@ -0,0 +1,45 @@
+/*
+ ============================================================================
+ Name        : tdma-bridge.h
+ Version     :
+ Copyright   : Closed
+ Description : voice bridge between the ALSA runner (20ms periods) and the
+               STM32 runner (10ms TDMA cycles): capture to TX voice 0,
+               RX voice 0 to playback, with mouth-to-ear latency
+ ============================================================================
+ */
+#ifndef TDMA_BRIDGE
+#define TDMA_BRIDGE
+#pragma once
+
+#include <stdint.h>
+
+/* the voice slots carry 10ms of 16kHz audio */
+#define TDMA_BRIDGE_RATE 16000U
+#define TDMA_BRIDGE_BLOCK 160U
+/* jitter buffer capacity in blocks, a power of 2 */
+#define TDMA_BRIDGE_SLOTS 16U
+#define TDMA_BRIDGE_JITTER_MAX 8U
+/* blocks above the target before the oldest one is dropped (producer clock faster) */
+#define TDMA_BRIDGE_SLIP 3U
+/* a latency marker every second: a 7 chip Barker code (+ + + - - + -) at full scale, 10 samples a chip
+ * (2 samples of the stub codec), every chip must come back beyond the level with its sign
+ */
+#define TDMA_BRIDGE_MARK_BLOCKS 100U
+#define TDMA_BRIDGE_MARK_CHIPS 7U
+#define TDMA_BRIDGE_MARK_CHIP_LEN 10U
+#define TDMA_BRIDGE_MARK_LEN (TDMA_BRIDGE_MARK_CHIPS * TDMA_BRIDGE_MARK_CHIP_LEN)
+#define TDMA_BRIDGE_MARK_LEVEL 8192
+
+int tdma_bridge_init(const char *codec, uint32_t jitter_blocks);
+/* audio thread */
+void tdma_bridge_capture(const int32_t *pcm, uint32_t frames, uint32_t rate, uint64_t first_ns);
+void tdma_bridge_playback(int32_t *pcm, uint32_t frames, uint32_t rate, uint64_t first_ns);
+/* stm32 thread (or its pipeline helpers) */
+uint16_t tdma_bridge_tx(uint8_t *data);
+uint8_t tdma_bridge_audio_ctrl(void);
+void tdma_bridge_rx(const uint8_t *data, uint16_t len);
+void tdma_bridge_report(void);
+void tdma_bridge_close(void);
+
+#endif // TDMA_BRIDGE
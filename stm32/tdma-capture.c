@@ -0,0 +1,350 @@
+/*
+ ============================================================================
+ Name        : tdma-capture.c
+ Version     :
+ Copyright   : Closed
+ Description : capture of the STM32 SPI traffic to a file, and its replay
+
+ Capture: the RT thread copies each TX/RX pair into a lock-free SPSC ring,
+ a writer thread appends them to the file. A full ring drops the record,
+ the RT thread never waits on the disk.
+ Replay: the file is mmap'ed, its RX frames come back at the recorded edges
+ (or faster), in place of the spidev.
+ ============================================================================
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "esg-bsp-test.h"
+#include "esg-spidev.h"
+#include "tdma-capture.h"
+#include "wi_time.h"
+
+static int tdma_capture_write(int fd, const void *buf, size_t len)
+{
+	const uint8_t *p = buf;
+
+	while (0U < len)
+	{
+		ssize_t n = write(fd, p, len);
+
+		if (0 > n)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+			return -errno;
+		}
+
+		p += n;
+		len -= (size_t)n;
+	}
+
+	return 0;
+}
+
+/* appends whatever is queued, contiguous runs of the ring in one write();
+ * the semaphore units of the records already written just give empty passes
+ */
+static void *tdma_capture_writer(void *p_data)
+{
+	tdma_capture_t *cap = (tdma_capture_t *)p_data;
+	uint8_t running = 1U;
+
+	while (0U != running)
+	{
+		uint32_t tail, head, run;
+
+		while ((0 != sem_wait(&cap->items)) && (EINTR == errno))
+		{
+		}
+
+		/* last pass after the stop, to flush the ring */
+		running = __atomic_load_n(&cap->running, __ATOMIC_ACQUIRE);
+
+		tail = __atomic_load_n(&cap->tail, __ATOMIC_RELAXED);
+		head = __atomic_load_n(&cap->head, __ATOMIC_ACQUIRE);
+
+		while (tail != head)
+		{
+			uint32_t idx = tail & (TDMA_CAPTURE_RING - 1U);
+
+			run = head - tail;
+			run = ((idx + run) > TDMA_CAPTURE_RING) ? (TDMA_CAPTURE_RING - idx) : run;
+
+			if (0 == tdma_capture_write(cap->fd, &cap->ring[idx], run * sizeof(tdma_capture_record_t)))
+			{
+				cap->written += run;
+			}
+			else
+			{
+				cap->write_errors += run;
+			}
+
+			tail += run;
+			__atomic_store_n(&cap->tail, tail, __ATOMIC_RELEASE);
+		}
+	}
+
+	return NULL;
+}
+
+//==============================================================================
+//! \brief Create the capture file and start its writer thread
+//!
+//! \param  path: capture file, truncated
+//! \param  cycle_us: TDMA cycle, for the record
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_capture_open(tdma_capture_t *cap, const char *path, uint32_t cycle_us)
+{
+	struct timespec rt;
+	tdma_capture_header_t hdr = {
+		.magic = TDMA_CAPTURE_MAGIC,
+		.version = TDMA_CAPTURE_VERSION,
+		.record_size = sizeof(tdma_capture_record_t),
+		.frame_size = sizeof(protdspSpiFrame_t),
+		.cycle_us = cycle_us,
+	};
+	int ret = EXIT_SUCCESS;
+
+	memset(cap, 0, sizeof(*cap));
+	cap->fd = -1;
+
+	/* written and locked here, the first cycles take no page fault */
+	cap->ring = spi_buf_alloc(TDMA_CAPTURE_RING * sizeof(tdma_capture_record_t));
+	if (NULL == cap->ring)
+	{
+		ret = -ENOMEM;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		cap->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+		ret = (0 <= cap->fd) ? EXIT_SUCCESS : -errno;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		cap->start_ns = time_getClockRaw_ns();
+		clock_gettime(CLOCK_REALTIME, &rt);
+		hdr.start_ns = cap->start_ns;
+		hdr.start_realtime_ns = (uint64_t)rt.tv_sec * 1000000000ULL + (uint64_t)rt.tv_nsec;
+
+		ret = tdma_capture_write(cap->fd, &hdr, sizeof(hdr));
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		sem_init(&cap->items, 0, 0);
+		cap->running = 1U;
+
+		ret = -pthread_create(&cap->writer, NULL, tdma_capture_writer, cap);
+		if (EXIT_SUCCESS != ret)
+		{
+			sem_destroy(&cap->items);
+			cap->running = 0U;
+		}
+	}
+
+	if (EXIT_SUCCESS != ret)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("tdma capture: can't open"), DLT_STRING(path), DLT_INT32(ret));
+
+		if (0 <= cap->fd)
+		{
+			close(cap->fd);
+			cap->fd = -1;
+		}
+		spi_buf_free(cap->ring, TDMA_CAPTURE_RING * sizeof(tdma_capture_record_t));
+		cap->ring = NULL;
+	}
+
+	return ret;
+}
+
+/* RT thread, after each transfer: two frame copies, no system call but a sem_post */
+void tdma_capture_add(tdma_capture_t *cap, uint32_t cycle, uint64_t edge_ns, uint64_t start_ns, uint64_t end_ns,
+					  int32_t result, const protdspSpiFrame_t *tx, const protdspSpiFrame_t *rx)
+{
+	uint32_t head = __atomic_load_n(&cap->head, __ATOMIC_RELAXED);
+	tdma_capture_record_t *rec;
+
+	if ((head - __atomic_load_n(&cap->tail, __ATOMIC_ACQUIRE)) >= TDMA_CAPTURE_RING)
+	{
+		cap->dropped++;
+		return;
+	}
+
+	rec = &cap->ring[head & (TDMA_CAPTURE_RING - 1U)];
+	rec->t_ns = edge_ns - cap->start_ns;
+	rec->start_ns = (uint32_t)(start_ns - edge_ns);
+	rec->end_ns = (uint32_t)(end_ns - edge_ns);
+	rec->cycle = cycle;
+	rec->result = result;
+	memcpy(&rec->tx, tx, sizeof(rec->tx));
+	memcpy(&rec->rx, rx, sizeof(rec->rx));
+
+	__atomic_store_n(&cap->head, head + 1U, __ATOMIC_RELEASE);
+	sem_post(&cap->items);
+}
+
+void tdma_capture_close(tdma_capture_t *cap)
+{
+	if (0U != cap->running)
+	{
+		__atomic_store_n(&cap->running, 0U, __ATOMIC_RELEASE);
+		sem_post(&cap->items);
+		pthread_join(cap->writer, NULL);
+		sem_destroy(&cap->items);
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma capture (records written/dropped/write errors)"),
+				DLT_UINT64(cap->written), DLT_UINT64(cap->dropped), DLT_UINT64(cap->write_errors));
+
+		close(cap->fd);
+		cap->fd = -1;
+		spi_buf_free(cap->ring, TDMA_CAPTURE_RING * sizeof(tdma_capture_record_t));
+		cap->ring = NULL;
+	}
+}
+
+//==============================================================================
+//! \brief Map a capture file for replay
+//!
+//! \param  speed: 1 plays at the recorded timing, N N times faster, 0 as fast as possible
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_replay_open(tdma_replay_t *rep, const char *path, uint32_t speed)
+{
+	const tdma_capture_header_t *hdr;
+	struct stat st;
+	int ret = EXIT_SUCCESS;
+	int fd;
+
+	memset(rep, 0, sizeof(*rep));
+	rep->speed = speed;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (0 > fd)
+	{
+		ret = -errno;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (0 != fstat(fd, &st)))
+	{
+		ret = -errno;
+	}
+
+	if ((EXIT_SUCCESS == ret) && ((size_t)st.st_size < sizeof(tdma_capture_header_t)))
+	{
+		ret = -EINVAL;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		rep->size = (size_t)st.st_size;
+		rep->map = mmap(NULL, rep->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (MAP_FAILED == rep->map)
+		{
+			rep->map = NULL;
+			ret = -errno;
+		}
+	}
+
+	if (0 <= fd)
+	{
+		close(fd);
+	}
+
+	/* only the records of this build can be replayed */
+	if (EXIT_SUCCESS == ret)
+	{
+		hdr = (const tdma_capture_header_t *)rep->map;
+
+		if ((TDMA_CAPTURE_MAGIC != hdr->magic) || (TDMA_CAPTURE_VERSION != hdr->version) ||
+			(sizeof(tdma_capture_record_t) != hdr->record_size) || (sizeof(protdspSpiFrame_t) != hdr->frame_size))
+		{
+			ret = -EINVAL;
+		}
+		else
+		{
+			rep->count = (rep->size - sizeof(*hdr)) / sizeof(tdma_capture_record_t);
+			(void)madvise((void *)rep->map, rep->size, MADV_SEQUENTIAL);
+		}
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("tdma replay (records/speed)"), DLT_STRING(path),
+				DLT_UINT64(rep->count), DLT_UINT32(speed));
+		rep->start_ns = time_getClock_ns();
+	}
+	else
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("tdma replay: not a capture of this build"), DLT_STRING(path), DLT_INT32(ret));
+		tdma_replay_close(rep);
+	}
+
+	return ret;
+}
+
+//==============================================================================
+//! \brief Wait for the edge of the next record
+//!
+//! \return 0 at the edge, -ENODATA at the end of the capture, or negative errno error code
+//==============================================================================
+int tdma_replay_wait(tdma_replay_t *rep)
+{
+	int ret = 0;
+
+	if (rep->next >= rep->count)
+	{
+		return -ENODATA;
+	}
+
+	rep->cur = (const tdma_capture_record_t *)(rep->map + sizeof(tdma_capture_header_t)) + rep->next++;
+
+	if (0U != rep->speed)
+	{
+		uint64_t at = rep->start_ns + rep->cur->t_ns / rep->speed;
+		struct timespec ts = {.tv_sec = (time_t)(at / 1000000000ULL), .tv_nsec = (long)(at % 1000000000ULL)};
+
+		do
+		{
+			ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+		} while (EINTR == ret);
+	}
+
+	return -ret;
+}
+
+/* what the spidev returned for this record, RX frame included */
+int tdma_replay_transfer(tdma_replay_t *rep, protdspSpiFrame_t *rx)
+{
+	if (NULL == rep->cur)
+	{
+		return -ENODATA;
+	}
+
+	memcpy(rx, &rep->cur->rx, sizeof(*rx));
+
+	return rep->cur->result;
+}
+
+void tdma_replay_close(tdma_replay_t *rep)
+{
+	if (NULL != rep->map)
+	{
+		munmap((void *)rep->map, rep->size);
+		rep->map = NULL;
+	}
+
+	rep->cur = NULL;
+}
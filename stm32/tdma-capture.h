@@ -0,0 +1,86 @@
+/*
+ ============================================================================
+ Name        : tdma-capture.h
+ Version     :
+ Copyright   : Closed
+ Description : capture of the STM32 SPI traffic to a file, and its replay
+ ============================================================================
+ */
+#ifndef TDMA_CAPTURE
+#define TDMA_CAPTURE
+#pragma once
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tdma-codec.h"
+
+#define TDMA_CAPTURE_MAGIC 0x54475345U /* "ESGT" */
+#define TDMA_CAPTURE_VERSION 1U
+/* records between the RT thread and the writer, a power of 2 (2.5s of cycles) */
+#define TDMA_CAPTURE_RING 256U
+
+/* file header, followed by fixed size records up to the end of the file: record i is at
+ * sizeof(header) + i * record_size, a capture cut short loses its last partial record only
+ */
+typedef struct __attribute__((packed))
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t record_size;
+	uint32_t frame_size;			/* sizeof(protdspSpiFrame_t) */
+	uint32_t cycle_us;
+	uint64_t start_ns;				/* CLOCK_MONOTONIC_RAW at the capture start */
+	uint64_t start_realtime_ns;		/* the same instant on CLOCK_REALTIME, to match other logs */
+} tdma_capture_header_t;
+
+typedef struct __attribute__((packed))
+{
+	uint64_t t_ns;					/* edge, since the capture start */
+	uint32_t start_ns;				/* edge -> transfer start */
+	uint32_t end_ns;				/* edge -> transfer complete */
+	uint32_t cycle;
+	int32_t result;					/* spi_transfer() return, bytes or < 0 */
+	protdspSpiFrame_t tx;
+	protdspSpiFrame_t rx;
+} tdma_capture_record_t;
+
+typedef struct
+{
+	int fd;
+	uint8_t running;
+	uint64_t start_ns;
+	tdma_capture_record_t *ring;
+	uint32_t head;					/* written by the RT thread only */
+	uint32_t tail;					/* written by the writer thread only */
+	sem_t items;
+	pthread_t writer;
+	uint64_t written;
+	uint64_t dropped;				/* ring full, the writer lags */
+	uint64_t write_errors;
+} tdma_capture_t;
+
+typedef struct
+{
+	const uint8_t *map;
+	size_t size;
+	uint64_t count;
+	uint64_t next;
+	uint32_t speed;					/* 1: recorded timing, N: N times faster, 0: as fast as possible */
+	uint64_t start_ns;				/* CLOCK_MONOTONIC at the replay start */
+	const tdma_capture_record_t *cur;
+} tdma_replay_t;
+
+int tdma_capture_open(tdma_capture_t *cap, const char *path, uint32_t cycle_us);
+void tdma_capture_add(tdma_capture_t *cap, uint32_t cycle, uint64_t edge_ns, uint64_t start_ns, uint64_t end_ns,
+					  int32_t result, const protdspSpiFrame_t *tx, const protdspSpiFrame_t *rx);
+void tdma_capture_close(tdma_capture_t *cap);
+
+int tdma_replay_open(tdma_replay_t *rep, const char *path, uint32_t speed);
+int tdma_replay_wait(tdma_replay_t *rep);
+int tdma_replay_transfer(tdma_replay_t *rep, protdspSpiFrame_t *rx);
+void tdma_replay_close(tdma_replay_t *rep);
+
+#endif // TDMA_CAPTURE
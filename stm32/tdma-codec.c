@@ -0,0 +1,241 @@
+/*
+ ============================================================================
+ Name        : tdma-codec.c
+ Version     :
+ Copyright   : Closed
+ Description : zero-copy encoder/decoder of the DSP/STM SPI frame (protdspSpiFrame_t)
+
+ header | voice 0 | ... | voice N-1 | extended data | padding
+ each voice slot is header.frameSize bytes, the extended data header.extSize bytes.
+ ============================================================================
+ */
+#include <errno.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-codec.h"
+#include "wi_time.h"
+
+static const char *codec_err_names[TDMA_CODEC_ERRORS] = {
+	"hdr version", "hdr code", "frame size", "frame nb", "ext size",
+	"overflow", "audio version", "audio size", "ext version"};
+
+//==============================================================================
+//! \brief Lay a frame out in place: header, voice headers and extended data header
+//!
+//! The audio payloads are left untouched, the caller fills them through the view.
+//!
+//! \param  buf: DMA buffer
+//! \param  nb_voices: 0 to COMMPAR_AUDIO_VOIX_MAX
+//! \param  index: sender frame counter
+//! \param  view: updated with the slots inside buf
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_codec_encode(protdspSpiFrame_t *buf, uint8_t nb_voices, uint8_t index, tdma_frame_view_t *view)
+{
+	uint8_t *p;
+
+	if ((NULL == buf) || (NULL == view) || (COMMPAR_AUDIO_VOIX_MAX < nb_voices))
+	{
+		return -EINVAL;
+	}
+
+	buf->header.hdrVersion = PROTDSP_SPI_HEADER_VERSION;
+	buf->header.hdrCode = PROTDSP_SPI_HDR_CODE_AUDIO1;
+	buf->header.frameSize = sizeof(protdspSpiAudioFrame_t);
+	buf->header.frameNb = nb_voices;
+	buf->header.extSize = sizeof(protdspSpiAudioExtData_t);
+	buf->header.index = index;
+	buf->header.libre = 0U;
+
+	view->hdr = &buf->header;
+	view->nb_voices = nb_voices;
+	p = buf->frame;
+
+	for (uint8_t v = 0U; v < nb_voices; v++)
+	{
+		protdspSpiAudioFrame_t *voice = (protdspSpiAudioFrame_t *)p;
+
+		memset(&voice->hdr, 0, sizeof(voice->hdr));
+		voice->hdr.audioVersion = PROTDSP_SPI_AUDIO_VERSION;
+		voice->hdr.NumVoix = v;
+		voice->hdr.AudioBuffSize = COMMPAR_AUDIO_DATA_SIZE_MAX;
+		view->voice[v] = voice;
+		p += sizeof(protdspSpiAudioFrame_t);
+	}
+
+	view->ext = (protdspSpiAudioExtData_t *)p;
+	view->ext->audioExtVersion = PROTDSP_SPI_AUDIO_EXT_VERSION;
+	view->ext->dataCode = PROTDSP_SPI_AUDIO_EXTDATA_CODE_NULL;
+
+	return 0;
+}
+
+static int tdma_codec_error(tdma_codec_stats_t *stats, tdma_codec_err_t err)
+{
+	stats->malformed++;
+	stats->errors[err]++;
+
+	return -EBADMSG;
+}
+
+//==============================================================================
+//! \brief Check a received frame and map the views on it
+//!
+//! \param  buf: DMA buffer, as received
+//! \param  view: updated with the slots inside buf, valid only on success
+//! \param  stats: frame counters
+//! \return 0 in case of success, -ENODATA for an empty frame, -EBADMSG if malformed
+//==============================================================================
+int tdma_codec_decode(protdspSpiFrame_t *buf, tdma_frame_view_t *view, tdma_codec_stats_t *stats)
+{
+	const protdspSpiHeader_t *hdr = &buf->header;
+	uint8_t *p = buf->frame;
+
+	stats->frames++;
+
+	if ((0U == hdr->hdrVersion) && (PROTDSP_SPI_HDR_CODE_NULL == hdr->hdrCode) && (0U == hdr->frameNb))
+	{
+		stats->empty++;
+		return -ENODATA;
+	}
+
+	if (PROTDSP_SPI_HEADER_VERSION != hdr->hdrVersion)
+	{
+		return tdma_codec_error(stats, TDMA_CODEC_ERR_HDR_VERSION);
+	}
+
+	if (PROTDSP_SPI_HDR_CODE_AUDIO1 != hdr->hdrCode)
+	{
+		return tdma_codec_error(stats, TDMA_CODEC_ERR_HDR_CODE);
+	}
+
+	/* a voice slot must at least hold its header, and never more than the structure */
+	if ((sizeof(protdspSpiAudioHdrFrame_t) > hdr->frameSize) || (sizeof(protdspSpiAudioFrame_t) < hdr->frameSize))
+	{
+		return tdma_codec_error(stats, TDMA_CODEC_ERR_FRAME_SIZE);
+	}
+
+	if (COMMPAR_AUDIO_VOIX_MAX < hdr->frameNb)
+	{
+		return tdma_codec_error(stats, TDMA_CODEC_ERR_FRAME_NB);
+	}
+
+	if ((0U != hdr->extSize) && ((offsetof(protdspSpiAudioExtData_t, data) > hdr->extSize) || (sizeof(protdspSpiAudioExtData_t) < hdr->extSize)))
+	{
+		return tdma_codec_error(stats, TDMA_CODEC_ERR_EXT_SIZE);
+	}
+
+	if (((uint32_t)hdr->frameNb * hdr->frameSize + hdr->extSize) > PROTDSP_SPI_FRAME_SIZE)
+	{
+		return tdma_codec_error(stats, TDMA_CODEC_ERR_OVERFLOW);
+	}
+
+	for (uint8_t v = 0U; v < hdr->frameNb; v++)
+	{
+		protdspSpiAudioFrame_t *voice = (protdspSpiAudioFrame_t *)p;
+
+		if (PROTDSP_SPI_AUDIO_VERSION != voice->hdr.audioVersion)
+		{
+			return tdma_codec_error(stats, TDMA_CODEC_ERR_AUDIO_VERSION);
+		}
+
+		if ((hdr->frameSize - sizeof(protdspSpiAudioHdrFrame_t)) < voice->hdr.AudioBuffSize)
+		{
+			return tdma_codec_error(stats, TDMA_CODEC_ERR_AUDIO_SIZE);
+		}
+
+		view->voice[v] = voice;
+		p += hdr->frameSize;
+	}
+
+	view->ext = NULL;
+
+	if (0U != hdr->extSize)
+	{
+		protdspSpiAudioExtData_t *ext = (protdspSpiAudioExtData_t *)p;
+
+		if (PROTDSP_SPI_AUDIO_EXT_VERSION != ext->audioExtVersion)
+		{
+			return tdma_codec_error(stats, TDMA_CODEC_ERR_EXT_VERSION);
+		}
+
+		view->ext = ext;
+	}
+
+	view->hdr = &buf->header;
+	view->nb_voices = hdr->frameNb;
+
+	return 0;
+}
+
+void tdma_codec_report(const char *name, const tdma_codec_stats_t *stats)
+{
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("frames (total/empty/malformed/crc errors)"),
+			DLT_UINT64(stats->frames), DLT_UINT64(stats->empty), DLT_UINT64(stats->malformed), DLT_UINT64(stats->crc_errors));
+
+	for (uint32_t i = 0U; i < TDMA_CODEC_ERRORS; i++)
+	{
+		if (0U < stats->errors[i])
+		{
+			DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("malformed:"),
+					DLT_STRING(codec_err_names[i]), DLT_UINT64(stats->errors[i]));
+		}
+	}
+}
+
+//==============================================================================
+//! \brief Encode, fill and decode full frames, in a loop
+//!
+//! \param  iterations: number of frames
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_codec_bench(uint32_t iterations)
+{
+	static protdspSpiFrame_t frame;
+	tdma_frame_view_t tx, rx;
+	tdma_codec_stats_t stats = {0};
+	uint32_t check = 0U;
+	uint64_t t_start, elapsed_ns;
+	int ret = 0;
+
+	t_start = time_getClock_ns();
+
+	for (uint32_t i = 0U; (i < iterations) && (0 == ret); i++)
+	{
+		ret = tdma_codec_encode(&frame, COMMPAR_AUDIO_VOIX_MAX, (uint8_t)i, &tx);
+
+		for (uint8_t v = 0U; (0 == ret) && (v < tx.nb_voices); v++)
+		{
+			memset(tx.voice[v]->Audio, (int)(i + v), COMMPAR_AUDIO_DATA_SIZE_MAX);
+		}
+
+		if (0 == ret)
+		{
+			ret = tdma_codec_decode(&frame, &rx, &stats);
+		}
+
+		/* touch the payload through the decoded view, so that nothing is optimised away */
+		for (uint8_t v = 0U; (0 == ret) && (v < rx.nb_voices); v++)
+		{
+			check += rx.voice[v]->Audio[COMMPAR_AUDIO_DATA_SIZE_MAX - 1U];
+		}
+	}
+
+	elapsed_ns = time_getClock_ns() - t_start;
+
+	if (0 == ret)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("bench codec (frames/ns per frame/MB/s)"),
+				DLT_UINT32(iterations), DLT_UINT64((0U < iterations) ? (elapsed_ns / iterations) : 0U),
+				DLT_UINT64((0U < elapsed_ns) ? ((uint64_t)iterations * sizeof(protdspSpiFrame_t) * 1000U / elapsed_ns) : 0U),
+				DLT_STRING("check"), DLT_UINT32(check));
+	}
+	else
+	{
+		tdma_codec_report("bench codec", &stats);
+	}
+
+	return ret;
+}
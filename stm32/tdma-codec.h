@@ -0,0 +1,58 @@
+/*
+ ============================================================================
+ Name        : tdma-codec.h
+ Version     :
+ Copyright   : Closed
+ Description : zero-copy encoder/decoder of the DSP/STM SPI frame (protdspSpiFrame_t)
+ ============================================================================
+ */
+#ifndef TDMA_CODEC
+#define TDMA_CODEC
+#pragma once
+
+#include <stdint.h>
+
+#include "Common/commParam.h"
+#include "Common/protocoleDSP.h"
+/* protocoleDSP.h leaves pack(1) on, keep it to the protocol structures */
+#pragma pack()
+
+typedef enum
+{
+	TDMA_CODEC_ERR_HDR_VERSION = 0,
+	TDMA_CODEC_ERR_HDR_CODE = 1,
+	TDMA_CODEC_ERR_FRAME_SIZE = 2,
+	TDMA_CODEC_ERR_FRAME_NB = 3,
+	TDMA_CODEC_ERR_EXT_SIZE = 4,
+	TDMA_CODEC_ERR_OVERFLOW = 5,
+	TDMA_CODEC_ERR_AUDIO_VERSION = 6,
+	TDMA_CODEC_ERR_AUDIO_SIZE = 7,
+	TDMA_CODEC_ERR_EXT_VERSION = 8,
+	//
+	TDMA_CODEC_ERRORS = 9
+} tdma_codec_err_t;
+
+/* typed views, pointing straight into the DMA buffer, nothing is copied */
+typedef struct
+{
+	protdspSpiHeader_t *hdr;
+	protdspSpiAudioFrame_t *voice[COMMPAR_AUDIO_VOIX_MAX];
+	protdspSpiAudioExtData_t *ext;		/* NULL if the frame carries no extended data */
+	uint8_t nb_voices;
+} tdma_frame_view_t;
+
+typedef struct
+{
+	uint64_t frames;
+	uint64_t empty;						/* all zero header, the STM32 had nothing to send */
+	uint64_t malformed;
+	uint64_t crc_errors;				/* not decoded, counted apart from malformed */
+	uint64_t errors[TDMA_CODEC_ERRORS];
+} tdma_codec_stats_t;
+
+int tdma_codec_encode(protdspSpiFrame_t *buf, uint8_t nb_voices, uint8_t index, tdma_frame_view_t *view);
+int tdma_codec_decode(protdspSpiFrame_t *buf, tdma_frame_view_t *view, tdma_codec_stats_t *stats);
+void tdma_codec_report(const char *name, const tdma_codec_stats_t *stats);
+int tdma_codec_bench(uint32_t iterations);
+
+#endif // TDMA_CODEC
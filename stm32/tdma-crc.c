@@ -0,0 +1,177 @@
+/*
+ ============================================================================
+ Name        : tdma-crc.c
+ Version     :
+ Copyright   : Closed
+ Description : CRC-16/CCITT (poly 0x1021, init 0xFFFF) of the DSP/STM SPI frames
+
+ The frame field is 32 bits wide (protdspcrc16_t), the CRC sits in its low 16 bits.
+ Three implementations of the same CRC: bitwise (reference), one table lookup per
+ byte, and slice-by-8 (8 tables, 8 bytes per step, no dependency between lookups).
+ ============================================================================
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-crc.h"
+#include "wi_time.h"
+
+#define TDMA_CRC_POLY 0x1021U
+
+/* crc_tables[k][b]: byte b followed by k zero bytes */
+static uint16_t crc_tables[8][256];
+static uint8_t crc_ready = 0U;
+
+void tdma_crc_init(void)
+{
+	if (0U == crc_ready)
+	{
+		for (uint32_t b = 0U; b < 256U; b++)
+		{
+			uint8_t byte = (uint8_t)b;
+
+			crc_tables[0][b] = tdma_crc16_bitwise(&byte, 1U, 0U);
+		}
+
+		for (uint32_t k = 1U; k < 8U; k++)
+		{
+			for (uint32_t b = 0U; b < 256U; b++)
+			{
+				uint16_t prev = crc_tables[k - 1U][b];
+
+				crc_tables[k][b] = (uint16_t)(prev << 8) ^ crc_tables[0][prev >> 8];
+			}
+		}
+
+		crc_ready = 1U;
+	}
+}
+
+uint16_t tdma_crc16_bitwise(const uint8_t *data, size_t len, uint16_t crc)
+{
+	for (size_t i = 0U; i < len; i++)
+	{
+		crc ^= (uint16_t)data[i] << 8;
+
+		for (uint32_t bit = 0U; bit < 8U; bit++)
+		{
+			crc = (crc & 0x8000U) ? (uint16_t)((crc << 1) ^ TDMA_CRC_POLY) : (uint16_t)(crc << 1);
+		}
+	}
+
+	return crc;
+}
+
+uint16_t tdma_crc16_table(const uint8_t *data, size_t len, uint16_t crc)
+{
+	for (size_t i = 0U; i < len; i++)
+	{
+		crc = (uint16_t)(crc << 8) ^ crc_tables[0][(crc >> 8) ^ data[i]];
+	}
+
+	return crc;
+}
+
+uint16_t tdma_crc16_slice8(const uint8_t *data, size_t len, uint16_t crc)
+{
+	while (8U <= len)
+	{
+		/* the running crc folds into the first two bytes */
+		crc = crc_tables[7][data[0] ^ (crc >> 8)] ^ crc_tables[6][data[1] ^ (crc & 0xFFU)] ^
+			  crc_tables[5][data[2]] ^ crc_tables[4][data[3]] ^
+			  crc_tables[3][data[4]] ^ crc_tables[2][data[5]] ^
+			  crc_tables[1][data[6]] ^ crc_tables[0][data[7]];
+		data += 8;
+		len -= 8U;
+	}
+
+	return tdma_crc16_table(data, len, crc);
+}
+
+void tdma_crc_stamp(protdspSpiFrame_t *buf)
+{
+	buf->crc16 = tdma_crc16_slice8((const uint8_t *)buf + TDMA_CRC_OFFSET, TDMA_CRC_LEN, TDMA_CRC_INIT);
+}
+
+//==============================================================================
+//! \brief Check the CRC of a received frame
+//!
+//! \return 0 if it matches, -EBADMSG otherwise
+//==============================================================================
+int tdma_crc_check(const protdspSpiFrame_t *buf)
+{
+	uint16_t crc = tdma_crc16_slice8((const uint8_t *)buf + TDMA_CRC_OFFSET, TDMA_CRC_LEN, TDMA_CRC_INIT);
+
+	return ((buf->crc16 & 0xFFFFU) == crc) ? 0 : -EBADMSG;
+}
+
+typedef uint16_t (*tdma_crc_fn_t)(const uint8_t *data, size_t len, uint16_t crc);
+
+static uint16_t tdma_crc_bench_one(const char *name, tdma_crc_fn_t fn, const uint8_t *frame, uint32_t iterations)
+{
+	uint16_t crc = 0U;
+	uint64_t t_start = time_getClock_ns();
+	uint64_t elapsed_ns;
+
+	for (uint32_t i = 0U; i < iterations; i++)
+	{
+		/* chain the results, so that no iteration can be skipped */
+		crc ^= fn(frame, TDMA_CRC_LEN, TDMA_CRC_INIT ^ (uint16_t)i);
+	}
+
+	elapsed_ns = time_getClock_ns() - t_start;
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("bench crc"), DLT_STRING(name),
+			DLT_STRING("(frames/ns per frame/MB/s)"), DLT_UINT32(iterations),
+			DLT_UINT64((0U < iterations) ? (elapsed_ns / iterations) : 0U),
+			DLT_UINT64((0U < elapsed_ns) ? ((uint64_t)iterations * TDMA_CRC_LEN * 1000U / elapsed_ns) : 0U));
+
+	return crc;
+}
+
+//==============================================================================
+//! \brief Compare the three implementations on full frames
+//!
+//! \param  iterations: number of frames per implementation
+//! \return 0 in case of success, -EIO if the implementations disagree
+//==============================================================================
+int tdma_crc_bench(uint32_t iterations)
+{
+	static uint8_t frame[TDMA_CRC_LEN];
+	static const uint8_t check[] = "123456789";
+	uint16_t ref, table, slice8;
+	int ret = 0;
+
+	tdma_crc_init();
+
+	for (size_t i = 0U; i < sizeof(frame); i++)
+	{
+		frame[i] = (uint8_t)(i * 37U + 11U);
+	}
+
+	/* CRC-16/CCITT-FALSE check value */
+	if ((0x29B1U != tdma_crc16_bitwise(check, 9U, TDMA_CRC_INIT)) ||
+		(0x29B1U != tdma_crc16_table(check, 9U, TDMA_CRC_INIT)) ||
+		(0x29B1U != tdma_crc16_slice8(check, 9U, TDMA_CRC_INIT)))
+	{
+		ret = -EIO;
+	}
+
+	ref = tdma_crc_bench_one("bitwise", tdma_crc16_bitwise, frame, iterations);
+	table = tdma_crc_bench_one("table", tdma_crc16_table, frame, iterations);
+	slice8 = tdma_crc_bench_one("slice-by-8", tdma_crc16_slice8, frame, iterations);
+
+	if ((ref != table) || (ref != slice8))
+	{
+		ret = -EIO;
+	}
+
+	if (0 != ret)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("bench crc: implementations disagree (bitwise/table/slice-by-8)"),
+				DLT_HEX16(ref), DLT_HEX16(table), DLT_HEX16(slice8));
+	}
+
+	return ret;
+}
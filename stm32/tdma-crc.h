@@ -0,0 +1,33 @@
+/*
+ ============================================================================
+ Name        : tdma-crc.h
+ Version     :
+ Copyright   : Closed
+ Description : CRC-16/CCITT (poly 0x1021, init 0xFFFF) of the DSP/STM SPI frames
+ ============================================================================
+ */
+#ifndef TDMA_CRC
+#define TDMA_CRC
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tdma-codec.h"
+
+#define TDMA_CRC_INIT 0xFFFFU
+
+/* everything after the crc16 word: header and frame */
+#define TDMA_CRC_OFFSET offsetof(protdspSpiFrame_t, header)
+#define TDMA_CRC_LEN (sizeof(protdspSpiFrame_t) - TDMA_CRC_OFFSET)
+
+void tdma_crc_init(void);
+uint16_t tdma_crc16_bitwise(const uint8_t *data, size_t len, uint16_t crc);
+uint16_t tdma_crc16_table(const uint8_t *data, size_t len, uint16_t crc);
+uint16_t tdma_crc16_slice8(const uint8_t *data, size_t len, uint16_t crc);
+
+void tdma_crc_stamp(protdspSpiFrame_t *buf);
+int tdma_crc_check(const protdspSpiFrame_t *buf);
+int tdma_crc_bench(uint32_t iterations);
+
+#endif // TDMA_CRC
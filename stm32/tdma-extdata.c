@@ -0,0 +1,430 @@
+/*
+ ============================================================================
+ Name        : tdma-extdata.c
+ Version     :
+ Copyright   : Closed
+ Description : decoder of the extended data of the RX frames, aggregated and
+               published to shared memory
+
+ Every RX frame is folded into two accumulators: the decimation window and
+ the summary. A full window becomes one sample of the stream, a POSIX shared
+ memory ring of the last TDMA_EXT_HISTORY samples, each slot behind a
+ seqlock: the RX thread never waits, a reader (--tdma-ext-query, or any other
+ process) copies a slot and retries if it moved meanwhile. A full summary is
+ logged, once per 5s rather than once per frame.
+ ============================================================================
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-extdata.h"
+#include "wi_time.h"
+
+/* a reader gives up on a slot held odd that long (writer gone mid-write) */
+#define TDMA_EXT_READ_RETRIES 1000U
+
+static void tdma_ext_acc_reset(tdma_ext_acc_t *acc)
+{
+	memset(acc, 0, sizeof(*acc));
+	acc->s.vu_mic.min = INT16_MAX;
+	acc->s.vu_mic.max = INT16_MIN;
+	acc->s.vu_hp.min = INT16_MAX;
+	acc->s.vu_hp.max = INT16_MIN;
+}
+
+static void tdma_ext_vu_add(tdma_ext_vu_t *vu, int64_t *sum, const protdspVumetreValues *val)
+{
+	vu->min = (val->currentValue < vu->min) ? val->currentValue : vu->min;
+	vu->max = (val->currentValue > vu->max) ? val->currentValue : vu->max;
+	vu->over += (val->currentValue > val->highThreshold) ? 1U : 0U;
+	vu->under += (val->currentValue < val->lowThreshold) ? 1U : 0U;
+	*sum += val->currentValue;
+}
+
+static void tdma_ext_acc_add(tdma_ext_acc_t *acc, const protdspSpiAudioExtData_t *data)
+{
+	tdma_ext_sample_t *s = &acc->s;
+
+	s->frames++;
+	s->event_pio = (uint8_t)data->event.bit.pio;
+
+	if (PROTDSP_SPI_AUDIO_EXTDATA_CODE_MCO == data->dataCode)
+	{
+		const protdspSpiAudioExtDataDsp2Stm_mco_t *mco = &data->mco;
+		const comMco1_t *mco1 = &mco->mco1;
+
+		s->mco++;
+		tdma_ext_vu_add(&s->vu_mic, &acc->mic_sum, &mco->vu_mic);
+		tdma_ext_vu_add(&s->vu_hp, &acc->hp_sum, &mco->vu_hp);
+
+		/* 2 bits per terminal from the LSB: id1..id8 in audioQ, id9..id15 in audioQ2 */
+		for (uint32_t id = 0U; id < TDMA_EXT_TERMINALS; id++)
+		{
+			uint16_t q = (id < 8U) ? mco1->audioQ.u16 : mco1->audioQ2.u16;
+
+			s->quality[id][(q >> (2U * (id % 8U))) & (TDMA_EXT_LEVELS - 1U)]++;
+		}
+
+		s->rec_status = mco->rec_status;
+		s->mic_level = (uint8_t)mco1->misc.micLevel;
+		s->speaker_level = (uint8_t)mco1->misc.speakerLevel;
+		s->battery_level = (uint8_t)mco1->misc.batteryLevel;
+		s->alarm |= (uint8_t)mco1->misc.alarm;
+		s->mic_sat += mco1->misc.micSat;
+	}
+	else if (PROTDSP_SPI_AUDIO_EXTDATA_STM_TO_DSP == data->dataCode)
+	{
+		const protdspSpiAudioExtDataSTMtoDSP_t *stm = &data->ext_data;
+
+		s->stm++;
+
+		if (0U != acc->has_pio)
+		{
+			s->pio_changes += (uint16_t)__builtin_popcount((s->pio_field ^ stm->pio_field) & stm->pio_valid);
+		}
+		acc->has_pio = 1U;
+		s->pio_field = stm->pio_field;
+		s->pio_valid = stm->pio_valid;
+
+		memcpy(s->start_tx_us, stm->StartTx, sizeof(s->start_tx_us));
+		memcpy(s->duree_tx_us, stm->DureeTx, sizeof(s->duree_tx_us));
+	}
+	else
+	{
+		s->other++;
+	}
+}
+
+/* closes the accumulator into a sample: averages, and no min/max without VU */
+static void tdma_ext_acc_finish(tdma_ext_acc_t *acc, tdma_ext_sample_t *s)
+{
+	*s = acc->s;
+	s->t_ns = time_getClockRaw_ns();
+
+	if (0U < s->mco)
+	{
+		s->vu_mic.avg = (int16_t)(acc->mic_sum / s->mco);
+		s->vu_hp.avg = (int16_t)(acc->hp_sum / s->mco);
+	}
+	else
+	{
+		memset(&s->vu_mic, 0, sizeof(s->vu_mic));
+		memset(&s->vu_hp, 0, sizeof(s->vu_hp));
+	}
+}
+
+/* writer side of the seqlock, the only writer of the stream */
+static void tdma_ext_publish(tdma_ext_stream_t *stream, const tdma_ext_sample_t *sample)
+{
+	uint64_t n = stream->published;
+	tdma_ext_slot_t *slot = &stream->slot[n & (TDMA_EXT_HISTORY - 1U)];
+	uint32_t seq = slot->seq;
+
+	__atomic_store_n(&slot->seq, seq + 1U, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->index = n;
+	slot->sample = *sample;
+
+	__atomic_store_n(&slot->seq, seq + 2U, __ATOMIC_RELEASE);
+	__atomic_store_n(&stream->published, n + 1U, __ATOMIC_RELEASE);
+}
+
+//==============================================================================
+//! \brief Copy sample n out of a stream, the writer may be running
+//!
+//! \return 0 in case of success, -ENODATA if already overwritten or not published, -EAGAIN if the slot stays locked
+//==============================================================================
+int tdma_ext_read(const tdma_ext_stream_t *stream, uint64_t n, tdma_ext_sample_t *sample)
+{
+	const tdma_ext_slot_t *slot = &stream->slot[n & (TDMA_EXT_HISTORY - 1U)];
+
+	for (uint32_t i = 0U; i < TDMA_EXT_READ_RETRIES; i++)
+	{
+		uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+		uint64_t index;
+
+		if (0U != (seq & 1U))
+		{
+			continue;
+		}
+
+		index = slot->index;
+		memcpy(sample, &slot->sample, sizeof(*sample));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (seq == __atomic_load_n(&slot->seq, __ATOMIC_RELAXED))
+		{
+			return (index == n) ? 0 : -ENODATA;
+		}
+	}
+
+	return -EAGAIN;
+}
+
+static void tdma_ext_summary(tdma_ext_t *ext)
+{
+	tdma_ext_sample_t s;
+
+	tdma_ext_acc_finish(&ext->summary, &s);
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma ext (frames/mco/stm/other)"),
+			DLT_UINT16(s.frames), DLT_UINT16(s.mco), DLT_UINT16(s.stm), DLT_UINT16(s.other),
+			DLT_STRING("vu mic (min/avg/max/over/under)"),
+			DLT_INT16(s.vu_mic.min), DLT_INT16(s.vu_mic.avg), DLT_INT16(s.vu_mic.max), DLT_UINT16(s.vu_mic.over), DLT_UINT16(s.vu_mic.under),
+			DLT_STRING("vu hp (min/avg/max/over/under)"),
+			DLT_INT16(s.vu_hp.min), DLT_INT16(s.vu_hp.avg), DLT_INT16(s.vu_hp.max), DLT_UINT16(s.vu_hp.over), DLT_UINT16(s.vu_hp.under));
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma ext (recording/mic level/mic sat/hp level/battery/alarms)"),
+			DLT_UINT8(s.rec_status), DLT_UINT8(s.mic_level), DLT_UINT16(s.mic_sat), DLT_UINT8(s.speaker_level),
+			DLT_UINT8(s.battery_level), DLT_HEX8(s.alarm),
+			DLT_STRING("pio (field/valid/changes/event)"),
+			DLT_HEX16(s.pio_field), DLT_HEX16(s.pio_valid), DLT_UINT16(s.pio_changes), DLT_UINT8(s.event_pio),
+			DLT_STRING("tx 0 us (start/duration)"), DLT_INT32(s.start_tx_us[0]), DLT_INT32(s.duree_tx_us[0]));
+
+	/* only the terminals heard at some point, with the change of their mean quality since the last summary */
+	for (uint32_t id = 0U; (0U < s.mco) && (id < TDMA_EXT_TERMINALS); id++)
+	{
+		uint32_t avg = 0U;
+
+		for (uint32_t l = 1U; l < TDMA_EXT_LEVELS; l++)
+		{
+			avg += l * s.quality[id][l];
+		}
+
+		avg = avg * 100U / s.mco;
+
+		if ((0U != avg) || (0U != ext->summary_avg[id]))
+		{
+			DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma ext terminal"), DLT_UINT32(id + 1U),
+					DLT_STRING("quality frames (0/1/2/3)"),
+					DLT_UINT16(s.quality[id][0]), DLT_UINT16(s.quality[id][1]), DLT_UINT16(s.quality[id][2]), DLT_UINT16(s.quality[id][3]),
+					DLT_STRING("mean x100 (now/trend)"), DLT_UINT32(avg), DLT_INT32((int32_t)avg - (int32_t)ext->summary_avg[id]));
+		}
+
+		ext->summary_avg[id] = avg;
+	}
+
+	tdma_ext_acc_reset(&ext->summary);
+}
+
+//==============================================================================
+//! \brief Create the shared memory stream and start decoding
+//!
+//! \param  decimation: frames per published sample
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_ext_open(tdma_ext_t *ext, uint32_t decimation)
+{
+	int ret = EXIT_SUCCESS;
+	int fd;
+
+	memset(ext, 0, sizeof(*ext));
+	ext->decimation = decimation;
+	tdma_ext_acc_reset(&ext->window);
+	tdma_ext_acc_reset(&ext->summary);
+
+	if ((1U > decimation) || (TDMA_EXT_DECIMATION_MAX < decimation))
+	{
+		ret = -EINVAL;
+	}
+
+	/* the stream of the previous run is replaced */
+	fd = (EXIT_SUCCESS == ret) ? shm_open(TDMA_EXT_SHM_NAME, O_RDWR | O_CREAT | O_TRUNC, 0644) : -1;
+	if ((EXIT_SUCCESS == ret) && (0 > fd))
+	{
+		ret = -errno;
+	}
+
+	if ((EXIT_SUCCESS == ret) && (0 != ftruncate(fd, sizeof(tdma_ext_stream_t))))
+	{
+		ret = -errno;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		ext->stream = mmap(NULL, sizeof(tdma_ext_stream_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (MAP_FAILED == ext->stream)
+		{
+			ext->stream = NULL;
+			ret = -errno;
+		}
+	}
+
+	if (0 <= fd)
+	{
+		close(fd);
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		/* zero filled by ftruncate(), the header goes last */
+		ext->stream->sample_size = sizeof(tdma_ext_sample_t);
+		ext->stream->slots = TDMA_EXT_HISTORY;
+		ext->stream->decimation = decimation;
+		ext->stream->version = TDMA_EXT_VERSION;
+		__atomic_store_n(&ext->stream->magic, TDMA_EXT_MAGIC, __ATOMIC_RELEASE);
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("tdma ext stream (frames per sample/samples kept)"), DLT_STRING(TDMA_EXT_SHM_NAME),
+				DLT_UINT32(decimation), DLT_UINT32(TDMA_EXT_HISTORY));
+	}
+	else
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("tdma ext: can't create the stream"), DLT_STRING(TDMA_EXT_SHM_NAME), DLT_INT32(ret));
+	}
+
+	return ret;
+}
+
+/* RX thread, for every decoded frame; NULL if it carries no extended data */
+void tdma_ext_frame(tdma_ext_t *ext, const protdspSpiAudioExtData_t *data)
+{
+	if (NULL == ext->stream)
+	{
+		return;
+	}
+
+	ext->frames++;
+
+	if (NULL == data)
+	{
+		ext->no_ext++;
+		return;
+	}
+
+	tdma_ext_acc_add(&ext->window, data);
+	tdma_ext_acc_add(&ext->summary, data);
+
+	if (ext->decimation <= ext->window.s.frames)
+	{
+		tdma_ext_sample_t sample;
+
+		tdma_ext_acc_finish(&ext->window, &sample);
+		tdma_ext_publish(ext->stream, &sample);
+		tdma_ext_acc_reset(&ext->window);
+	}
+
+	if (TDMA_EXT_SUMMARY_FRAMES <= ext->summary.s.frames)
+	{
+		tdma_ext_summary(ext);
+	}
+}
+
+/* last partial summary; the stream stays in /dev/shm for a query after the run */
+void tdma_ext_close(tdma_ext_t *ext)
+{
+	if (NULL != ext->stream)
+	{
+		if (0U < ext->summary.s.frames)
+		{
+			tdma_ext_summary(ext);
+		}
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma ext (frames/without ext data/samples published)"),
+				DLT_UINT64(ext->frames), DLT_UINT64(ext->no_ext), DLT_UINT64(ext->stream->published));
+
+		munmap(ext->stream, sizeof(tdma_ext_stream_t));
+		ext->stream = NULL;
+	}
+}
+
+//==============================================================================
+//! \brief Print the last samples of the stream, from another process
+//!
+//! \param  count: samples, at most TDMA_EXT_HISTORY
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_ext_query(uint32_t count)
+{
+	const tdma_ext_stream_t *stream = NULL;
+	struct stat st;
+	int ret = EXIT_SUCCESS;
+	int fd;
+
+	fd = shm_open(TDMA_EXT_SHM_NAME, O_RDONLY, 0);
+	if (0 > fd)
+	{
+		ret = -errno;
+	}
+
+	if ((EXIT_SUCCESS == ret) && ((0 != fstat(fd, &st)) || ((size_t)st.st_size < sizeof(tdma_ext_stream_t))))
+	{
+		ret = -EINVAL;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		stream = mmap(NULL, sizeof(tdma_ext_stream_t), PROT_READ, MAP_SHARED, fd, 0);
+		if (MAP_FAILED == stream)
+		{
+			stream = NULL;
+			ret = -errno;
+		}
+	}
+
+	if (0 <= fd)
+	{
+		close(fd);
+	}
+
+	if ((EXIT_SUCCESS == ret) &&
+		((TDMA_EXT_MAGIC != __atomic_load_n(&stream->magic, __ATOMIC_ACQUIRE)) || (TDMA_EXT_VERSION != stream->version) ||
+		 (sizeof(tdma_ext_sample_t) != stream->sample_size) || (TDMA_EXT_HISTORY != stream->slots)))
+	{
+		ret = -EINVAL;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		uint64_t last = __atomic_load_n(&stream->published, __ATOMIC_ACQUIRE);
+		uint64_t n = (last > count) ? (last - count) : 0U;
+
+		printf("%s: %llu samples of %u frames\n", TDMA_EXT_SHM_NAME, (unsigned long long)last, stream->decimation);
+		printf("sample    t_ms    frames mco stm  mic min/avg/max   hp min/avg/max   rec alarm pio   quality x100 per terminal\n");
+
+		for (; n < last; n++)
+		{
+			tdma_ext_sample_t s;
+
+			/* the oldest may be overwritten while we print */
+			if (0 != tdma_ext_read(stream, n, &s))
+			{
+				continue;
+			}
+
+			printf("%-9llu %-7llu %-6u %-3u %-4u %6d/%6d/%6d %6d/%6d/%6d %-3u 0x%02x  0x%04x",
+				   (unsigned long long)n, (unsigned long long)(s.t_ns / 1000000U), s.frames, s.mco, s.stm,
+				   s.vu_mic.min, s.vu_mic.avg, s.vu_mic.max, s.vu_hp.min, s.vu_hp.avg, s.vu_hp.max,
+				   s.rec_status, s.alarm, s.pio_field);
+
+			for (uint32_t id = 0U; (0U < s.mco) && (id < TDMA_EXT_TERMINALS); id++)
+			{
+				uint32_t avg = (s.quality[id][1] + 2U * s.quality[id][2] + 3U * s.quality[id][3]) * 100U / s.mco;
+
+				if (0U != avg)
+				{
+					printf(" %u:%u", id + 1U, avg);
+				}
+			}
+			printf("\n");
+		}
+	}
+	else
+	{
+		fprintf(stderr, "%s: no --tdma-ext stream (%d)\n", TDMA_EXT_SHM_NAME, ret);
+	}
+
+	if (NULL != stream)
+	{
+		munmap((void *)stream, sizeof(tdma_ext_stream_t));
+	}
+
+	return ret;
+}
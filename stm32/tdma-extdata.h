@@ -0,0 +1,111 @@
+/*
+ ============================================================================
+ Name        : tdma-extdata.h
+ Version     :
+ Copyright   : Closed
+ Description : decoder of the extended data of the RX frames (VU meters,
+               per terminal audio quality, recording state, TX slots, PIO),
+               aggregated and published to shared memory
+ ============================================================================
+ */
+#ifndef TDMA_EXTDATA
+#define TDMA_EXTDATA
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "tdma-codec.h"
+
+#define TDMA_EXT_SHM_NAME "/esg-tdma-ext"
+#define TDMA_EXT_MAGIC 0x58475345U /* "ESGX" */
+#define TDMA_EXT_VERSION 1U
+/* comMco1_t: a 2 bit audio quality for each terminal id 1 to 15 */
+#define TDMA_EXT_TERMINALS 15U
+#define TDMA_EXT_LEVELS 4U
+/* published samples kept in the stream, a power of 2 (25s at 10 frames per sample) */
+#define TDMA_EXT_HISTORY 256U
+#define TDMA_EXT_DECIMATION_MAX 1000U
+/* frames per DLT summary, 5s of TDMA cycles */
+#define TDMA_EXT_SUMMARY_FRAMES 500U
+
+typedef struct
+{
+	int16_t min;					/* of currentValue */
+	int16_t max;
+	int16_t avg;
+	uint16_t over;					/* frames above highThreshold */
+	uint16_t under;					/* frames below lowThreshold */
+} tdma_ext_vu_t;
+
+/* one aggregate of 'decimation' frames */
+typedef struct
+{
+	uint64_t t_ns;					/* CLOCK_MONOTONIC_RAW, end of the window */
+	uint16_t frames;				/* with extended data */
+	uint16_t mco;					/* of them carrying the DSP to STM payload (VU, quality, recording) */
+	uint16_t stm;					/* of them carrying the STM to DSP payload (TX slots, PIO) */
+	uint16_t other;					/* unknown dataCode, or none */
+	tdma_ext_vu_t vu_mic;
+	tdma_ext_vu_t vu_hp;
+	uint16_t quality[TDMA_EXT_TERMINALS][TDMA_EXT_LEVELS];	/* frames per quality level, per terminal id - 1 */
+	uint8_t rec_status;				/* last, mco_record_status_t */
+	uint8_t mic_level;				/* last mco1 misc fields */
+	uint8_t speaker_level;
+	uint8_t battery_level;
+	uint8_t alarm;					/* or'ed over the window */
+	uint8_t event_pio;				/* last */
+	uint16_t mic_sat;				/* frames with the mic saturated */
+	uint16_t pio_field;				/* last */
+	uint16_t pio_valid;
+	uint16_t pio_changes;			/* valid pio_field bits that toggled */
+	int32_t start_tx_us[PROTDSP_CYCLE_NB_TX_MAX];	/* last */
+	int32_t duree_tx_us[PROTDSP_CYCLE_NB_TX_MAX];
+} tdma_ext_sample_t;
+
+/* seqlock: seq is odd while the slot is being written, the reader retries */
+typedef struct
+{
+	uint32_t seq;
+	uint64_t index;					/* sample number, tells an overwritten slot */
+	tdma_ext_sample_t sample;
+} tdma_ext_slot_t;
+
+/* shared memory layout, one writer (the RX decode thread), any number of readers */
+typedef struct
+{
+	uint32_t magic;
+	uint16_t version;
+	uint16_t sample_size;
+	uint32_t slots;
+	uint32_t decimation;
+	uint64_t published;				/* the last sample is published - 1 */
+	tdma_ext_slot_t slot[TDMA_EXT_HISTORY];
+} tdma_ext_stream_t;
+
+typedef struct
+{
+	tdma_ext_sample_t s;
+	int64_t mic_sum;
+	int64_t hp_sum;
+	uint8_t has_pio;
+} tdma_ext_acc_t;
+
+typedef struct
+{
+	tdma_ext_stream_t *stream;
+	uint32_t decimation;
+	tdma_ext_acc_t window;
+	tdma_ext_acc_t summary;
+	uint32_t summary_avg[TDMA_EXT_TERMINALS];	/* quality x100 of the previous summary, for the trend */
+	uint64_t frames;
+	uint64_t no_ext;				/* decoded frames without extended data */
+} tdma_ext_t;
+
+int tdma_ext_open(tdma_ext_t *ext, uint32_t decimation);
+void tdma_ext_frame(tdma_ext_t *ext, const protdspSpiAudioExtData_t *data);
+void tdma_ext_close(tdma_ext_t *ext);
+int tdma_ext_read(const tdma_ext_stream_t *stream, uint64_t n, tdma_ext_sample_t *sample);
+int tdma_ext_query(uint32_t count);
+
+#endif // TDMA_EXTDATA
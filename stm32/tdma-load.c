@@ -0,0 +1,182 @@
+/*
+ ============================================================================
+ Name        : tdma-load.c
+ Version     :
+ Copyright   : Closed
+ Description : synthetic TDMA traffic for the STM32 runner
+
+ Each voice of the TX frame is talking or silent. A talking voice carries an
+ opus 16kHz (20 bytes) or 24kHz (32 bytes) payload of random bytes, with its
+ audio control (mode, PLC look ahead) and slot info (repetition, errors)
+ moving from cycle to cycle; a silent one is flagged as no audio.
+ ============================================================================
+ */
+#include <errno.h>
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-load.h"
+
+static const char *const load_pattern_names[TDMA_LOAD_PATTERNS] = {"burst", "all", "silence"};
+
+/* xorshift32, never 0 */
+static uint32_t tdma_load_rand(tdma_load_t *load)
+{
+	uint32_t x = load->rng;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	load->rng = x;
+
+	return x;
+}
+
+//==============================================================================
+//! \brief Pattern from its --tdma-pattern name
+//!
+//! \return tdma_load_pattern_t, or -EINVAL
+//==============================================================================
+int tdma_load_pattern(const char *name)
+{
+	for (uint32_t i = 0U; i < TDMA_LOAD_PATTERNS; i++)
+	{
+		if (0 == strcmp(name, load_pattern_names[i]))
+		{
+			return (int)i;
+		}
+	}
+
+	return -EINVAL;
+}
+
+/* next talk spurt or silence of a voice */
+static void tdma_load_switch(tdma_load_t *load, tdma_load_voice_t *voice)
+{
+	uint32_t mean;
+
+	switch (load->pattern)
+	{
+	case TDMA_LOAD_ALL:
+		voice->talking = 1U;
+		break;
+
+	case TDMA_LOAD_SILENCE:
+		voice->talking = 0U;
+		break;
+
+	default:
+		voice->talking = (0U == voice->talking) ? 1U : 0U;
+		break;
+	}
+
+	if (0U != voice->talking)
+	{
+		/* mostly 16kHz, one spurt out of 4 at 24kHz */
+		voice->mode = (0U == (tdma_load_rand(load) & 3U)) ? PROTDSP_AUDIO_CTRL_TYPE_24K : PROTDSP_AUDIO_CTRL_TYPE_16K;
+		voice->spurts++;
+	}
+
+	mean = (0U != voice->talking) ? TDMA_LOAD_TALK_CYCLES : TDMA_LOAD_SILENCE_CYCLES;
+	voice->left = 1U + tdma_load_rand(load) % (2U * mean);
+}
+
+void tdma_load_init(tdma_load_t *load, uint8_t nb_voices, tdma_load_pattern_t pattern)
+{
+	memset(load, 0, sizeof(*load));
+	load->pattern = pattern;
+	load->nb_voices = (COMMPAR_AUDIO_VOIX_MAX < nb_voices) ? COMMPAR_AUDIO_VOIX_MAX : nb_voices;
+	load->rng = 0x2545F491U;
+
+	esg_stats_reset(&load->build_ns);
+	esg_stats_reset(&load->transfer_ns);
+
+	/* the burst voices start silent and out of phase, the others right away */
+	for (uint8_t v = 0U; v < load->nb_voices; v++)
+	{
+		if (TDMA_LOAD_BURST == pattern)
+		{
+			load->voice[v].left = 1U + tdma_load_rand(load) % TDMA_LOAD_SILENCE_CYCLES;
+		}
+		else
+		{
+			tdma_load_switch(load, &load->voice[v]);
+		}
+	}
+}
+
+//==============================================================================
+//! \brief Fill the voices of a frame laid out by tdma_codec_encode()
+//!
+//! \param  view: TX frame, load->nb_voices voices
+//==============================================================================
+void tdma_load_fill(tdma_load_t *load, tdma_frame_view_t *view)
+{
+	for (uint8_t v = 0U; (v < view->nb_voices) && (v < load->nb_voices); v++)
+	{
+		tdma_load_voice_t *voice = &load->voice[v];
+		protdspSpiAudioFrame_t *frame = view->voice[v];
+		uint8_t start = 0U;
+
+		if (0U == voice->left--)
+		{
+			tdma_load_switch(load, voice);
+			start = voice->talking;
+		}
+
+		frame->hdr.id = (uint8_t)(v + 1U);
+		frame->hdr.role = (uint8_t)(v & 7U);
+		frame->hdr.startOfVocoder = start;
+		frame->hdr.slotAllocation = (0U == v) ? PROTDSP_SPI_SLOT_ALLOC_PRIVILEGED1 : PROTDSP_SPI_SLOT_ALLOC_DYNAMIC;
+		frame->hdr.rxSlot.u8 = 0U;
+
+		if (0U != voice->talking)
+		{
+			uint32_t r = tdma_load_rand(load);
+			uint16_t size = (PROTDSP_AUDIO_CTRL_TYPE_24K == voice->mode) ? COMMPAR_OPUS24_AUDIO_SIZE : COMMPAR_OPUS16_AUDIO_SIZE;
+
+			frame->hdr.AudioBuffSize = size;
+			frame->hdr.AudioCtrl = (uint8_t)(voice->mode | (r & PROTDSP_AUDIO_CTRL_PLC_MASK));
+			frame->hdr.rxSlot.audio = 1U;
+			frame->hdr.rxSlot.repetition = (0U == ((r >> 8) & 7U)) ? 1U : 0U;
+			frame->hdr.rxSlot.audioErr = (0U == ((r >> 12) & 63U)) ? 1U : 0U;
+
+			/* an encoded voice looks like noise, 4 bytes at a time */
+			for (uint16_t i = 0U; i < size; i += 4U)
+			{
+				uint32_t left = (uint32_t)(size - i);
+
+				r = tdma_load_rand(load);
+				memcpy(&frame->Audio[i], &r, (left < 4U) ? left : 4U);
+			}
+
+			voice->talk_cycles++;
+			load->payload_bytes += size;
+		}
+		else
+		{
+			ProtDspAudioSetFrameNoAudio(frame);
+			frame->hdr.AudioBuffSize = 0U;
+		}
+	}
+
+	load->frames++;
+}
+
+void tdma_load_report(const tdma_load_t *load)
+{
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma load (voices/pattern/frames)"), DLT_UINT8(load->nb_voices),
+			DLT_STRING(load_pattern_names[load->pattern]), DLT_UINT64(load->frames),
+			DLT_STRING("payload bytes per frame"), DLT_UINT64((0U < load->frames) ? (load->payload_bytes / load->frames) : 0U));
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma load cpu ns per frame, build (min/avg/max)"),
+			DLT_INT64(load->build_ns.min), DLT_INT64(esg_stats_avg(&load->build_ns)), DLT_INT64(load->build_ns.max),
+			DLT_STRING("transfer (min/avg/max)"),
+			DLT_INT64(load->transfer_ns.min), DLT_INT64(esg_stats_avg(&load->transfer_ns)), DLT_INT64(load->transfer_ns.max));
+
+	for (uint8_t v = 0U; v < load->nb_voices; v++)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma load voice (#/talk %/spurts)"), DLT_UINT8(v),
+				DLT_UINT64((0U < load->frames) ? (load->voice[v].talk_cycles * 100U / load->frames) : 0U), DLT_UINT64(load->voice[v].spurts));
+	}
+}
@@ -0,0 +1,59 @@
+/*
+ ============================================================================
+ Name        : tdma-load.h
+ Version     :
+ Copyright   : Closed
+ Description : synthetic TDMA traffic: up to COMMPAR_AUDIO_VOIX_MAX TX voices
+               with opus 16/24kHz payloads, talk spurts, changing audio control
+               and slot info, and the CPU cost per frame
+ ============================================================================
+ */
+#ifndef TDMA_LOAD
+#define TDMA_LOAD
+#pragma once
+
+#include <stdint.h>
+
+#include "esg-stats.h"
+#include "tdma-codec.h"
+
+typedef enum
+{
+	TDMA_LOAD_BURST = 0,			/* talk spurts and silences, independent per voice */
+	TDMA_LOAD_ALL = 1,				/* every voice talks every cycle, the peak */
+	TDMA_LOAD_SILENCE = 2,			/* the voices are there, without audio */
+	//
+	TDMA_LOAD_PATTERNS = 3
+} tdma_load_pattern_t;
+
+/* mean talk spurt and silence, in 10ms cycles (uniform over 1..2 x mean) */
+#define TDMA_LOAD_TALK_CYCLES 100U
+#define TDMA_LOAD_SILENCE_CYCLES 150U
+
+typedef struct
+{
+	uint8_t talking;
+	uint8_t mode;					/* PROTDSP_AUDIO_CTRL_TYPE_16K or _24K, drawn at each talk spurt */
+	uint32_t left;					/* cycles before the next switch */
+	uint64_t talk_cycles;
+	uint64_t spurts;
+} tdma_load_voice_t;
+
+typedef struct
+{
+	tdma_load_pattern_t pattern;
+	uint8_t nb_voices;
+	uint32_t rng;
+	uint64_t frames;
+	uint64_t payload_bytes;
+	tdma_load_voice_t voice[COMMPAR_AUDIO_VOIX_MAX];
+	esg_stats_t build_ns;			/* thread CPU: layout, payloads and CRC of one frame */
+	esg_stats_t transfer_ns;		/* thread CPU: its SPI transfer */
+} tdma_load_t;
+
+int tdma_load_pattern(const char *name);
+void tdma_load_init(tdma_load_t *load, uint8_t nb_voices, tdma_load_pattern_t pattern);
+void tdma_load_fill(tdma_load_t *load, tdma_frame_view_t *view);
+void tdma_load_report(const tdma_load_t *load);
+
+#endif // TDMA_LOAD
@@ -0,0 +1,155 @@
+/*
+ ============================================================================
+ Name        : tdma-phase.c
+ Version     :
+ Copyright   : Closed
+ Description : phase monitor between the ALSA period clock and the STM32
+               TDMA (slave-ready) clock, both stamped on CLOCK_MONOTONIC_RAW
+
+ The slave-ready thread only publishes its last edge; all the maths runs in
+ the audio thread, once per period: phase = (audio - last edge) mod 10ms,
+ unwrapped, then a least square fit per window gives the drift (slope, ppm)
+ and the jitter (rms of the residual).
+ ============================================================================
+ */
+#include <math.h>
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-phase.h"
+
+typedef struct
+{
+	uint32_t n;
+	double st, sp, stt, stp, spp;	/* t and phase in us, t relative to the window start */
+	double p_min, p_max;
+} phase_window_t;
+
+typedef struct
+{
+	uint8_t enabled;
+	uint64_t last_edge_ns;			/* written by the slave-ready thread */
+	uint64_t edges;
+	uint64_t first_edge_ns;
+	/* audio thread only */
+	uint8_t started;
+	uint64_t audio_events;
+	uint64_t first_audio_ns;
+	uint64_t last_audio_ns;
+	uint64_t window_start_ns;
+	double phase_us;				/* unwrapped */
+	double first_phase_us;
+	phase_window_t win;
+} tdma_phase_t;
+
+static tdma_phase_t phase = {0};
+
+static void phase_window_reset(phase_window_t *win)
+{
+	memset(win, 0, sizeof(*win));
+	win->p_min = INFINITY;
+	win->p_max = -INFINITY;
+}
+
+void tdma_phase_init(void)
+{
+	memset(&phase, 0, sizeof(phase));
+	phase_window_reset(&phase.win);
+	phase.enabled = 1U;
+}
+
+void tdma_phase_sready(uint64_t raw_ns)
+{
+	if (0U != phase.enabled)
+	{
+		if (0U == phase.edges)
+		{
+			phase.first_edge_ns = raw_ns;
+		}
+		phase.edges++;
+		__atomic_store_n(&phase.last_edge_ns, raw_ns, __ATOMIC_RELEASE);
+	}
+}
+
+static void tdma_phase_window_end(void)
+{
+	phase_window_t *win = &phase.win;
+	double n = (double)win->n;
+	double den = n * win->stt - win->st * win->st;
+	double slope = (0.0 != den) ? ((n * win->stp - win->st * win->sp) / den) : 0.0;
+	double offset = (win->sp - slope * win->st) / n;
+	/* residual of the linear fit */
+	double rss = win->spp - offset * win->sp - slope * win->stp;
+	double jitter_us = (0.0 < rss) ? sqrt(rss / n) : 0.0;
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_INFO, DLT_STRING("tdma phase us (min/max)"),
+			DLT_FLOAT32(fmod(win->p_min, TDMA_CYCLE_NS / 1000.0)), DLT_FLOAT32(fmod(win->p_max, TDMA_CYCLE_NS / 1000.0)),
+			DLT_STRING("drift ppm"), DLT_FLOAT32(slope * 1e6),
+			DLT_STRING("jitter us rms"), DLT_FLOAT32(jitter_us));
+
+	phase_window_reset(win);
+}
+
+void tdma_phase_audio(uint64_t raw_ns)
+{
+	uint64_t edge_ns = __atomic_load_n(&phase.last_edge_ns, __ATOMIC_ACQUIRE);
+
+	if ((0U != phase.enabled) && (0U != edge_ns) && (raw_ns > edge_ns))
+	{
+		double p = (double)((raw_ns - edge_ns) % TDMA_CYCLE_NS) / 1000.0;
+		double t;
+
+		if (0U == phase.started)
+		{
+			phase.started = 1U;
+			phase.phase_us = p;
+			phase.first_phase_us = p;
+			phase.first_audio_ns = raw_ns;
+			phase.window_start_ns = raw_ns;
+		}
+		else
+		{
+			/* unwrap around the 10ms cycle */
+			double d = p - fmod(phase.phase_us, TDMA_CYCLE_NS / 1000.0);
+			d += (d > (TDMA_CYCLE_NS / 2000.0)) ? -(TDMA_CYCLE_NS / 1000.0) : 0.0;
+			d += (d < -(TDMA_CYCLE_NS / 2000.0)) ? (TDMA_CYCLE_NS / 1000.0) : 0.0;
+			phase.phase_us += d;
+		}
+
+		phase.audio_events++;
+		phase.last_audio_ns = raw_ns;
+
+		t = (double)(raw_ns - phase.window_start_ns) / 1000.0;
+		phase.win.n++;
+		phase.win.st += t;
+		phase.win.sp += phase.phase_us;
+		phase.win.stt += t * t;
+		phase.win.stp += t * phase.phase_us;
+		phase.win.spp += phase.phase_us * phase.phase_us;
+		phase.win.p_min = (phase.phase_us < phase.win.p_min) ? phase.phase_us : phase.win.p_min;
+		phase.win.p_max = (phase.phase_us > phase.win.p_max) ? phase.phase_us : phase.win.p_max;
+
+		if (TDMA_PHASE_WINDOW <= phase.win.n)
+		{
+			tdma_phase_window_end();
+			phase.window_start_ns = raw_ns;
+		}
+	}
+}
+
+void tdma_phase_report(void)
+{
+	if ((0U != phase.enabled) && (0U != phase.started) && (phase.last_audio_ns > phase.first_audio_ns))
+	{
+		double span_us = (double)(phase.last_audio_ns - phase.first_audio_ns) / 1000.0;
+		uint64_t last_edge_ns = __atomic_load_n(&phase.last_edge_ns, __ATOMIC_ACQUIRE);
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma phase total (audio periods/edges/s)"),
+				DLT_UINT64(phase.audio_events), DLT_UINT64(phase.edges), DLT_FLOAT32(span_us / 1e6),
+				DLT_STRING("phase drift us"), DLT_FLOAT32(phase.phase_us - phase.first_phase_us),
+				DLT_STRING("drift ppm"), DLT_FLOAT32((phase.phase_us - phase.first_phase_us) * 1e6 / span_us),
+				DLT_STRING("mean periods ns (audio/tdma)"),
+				DLT_UINT64((phase.last_audio_ns - phase.first_audio_ns) / ((1U < phase.audio_events) ? (phase.audio_events - 1U) : 1U)),
+				DLT_UINT64((1U < phase.edges) ? (last_edge_ns - phase.first_edge_ns) / (phase.edges - 1U) : 0U));
+	}
+}
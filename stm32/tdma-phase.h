@@ -0,0 +1,25 @@
+/*
+ ============================================================================
+ Name        : tdma-phase.h
+ Version     :
+ Copyright   : Closed
+ Description : phase monitor between the ALSA period clock and the STM32
+               TDMA (slave-ready) clock, both stamped on CLOCK_MONOTONIC_RAW
+ ============================================================================
+ */
+#ifndef TDMA_PHASE
+#define TDMA_PHASE
+#pragma once
+
+#include <stdint.h>
+
+#define TDMA_CYCLE_NS 10000000ULL
+/* audio periods per reporting window, 5s at 20ms */
+#define TDMA_PHASE_WINDOW 250U
+
+void tdma_phase_init(void);
+void tdma_phase_sready(uint64_t raw_ns);
+void tdma_phase_audio(uint64_t raw_ns);
+void tdma_phase_report(void);
+
+#endif // TDMA_PHASE
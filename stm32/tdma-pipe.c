@@ -0,0 +1,264 @@
+/*
+ ============================================================================
+ Name        : tdma-pipe.c
+ Version     :
+ Copyright   : Closed
+ Description : SPI frame pipeline: TX frames built and RX frames parsed by two
+               helper threads while the RT thread is in the transfer
+
+ The RT thread never blocks here: it takes the next ready TX frame (or sends
+ the previous one again), a free RX buffer (or a scratch one), and hands both
+ back after the transfer. Buffers only move through lock-free SPSC rings; the
+ semaphores are there to put the helper threads to sleep.
+ ============================================================================
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "esg-spidev.h"
+#include "tdma-pipe.h"
+
+static void tdma_spsc_init(tdma_spsc_t *q)
+{
+	memset(q->slots, 0, sizeof(q->slots));
+	q->head = 0U;
+	q->tail = 0U;
+	sem_init(&q->items, 0, 0);
+}
+
+/* never full: each ring holds at most depth <= TDMA_PIPE_SLOTS frames */
+static void tdma_spsc_push(tdma_spsc_t *q, protdspSpiFrame_t *frame)
+{
+	uint32_t head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+
+	q->slots[head & (TDMA_PIPE_SLOTS - 1U)] = frame;
+	__atomic_store_n(&q->head, head + 1U, __ATOMIC_RELEASE);
+	sem_post(&q->items);
+}
+
+/* to be called once a unit of q->items was taken */
+static protdspSpiFrame_t *tdma_spsc_pop(tdma_spsc_t *q)
+{
+	uint32_t tail = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+	protdspSpiFrame_t *frame = NULL;
+
+	if (tail != __atomic_load_n(&q->head, __ATOMIC_ACQUIRE))
+	{
+		frame = q->slots[tail & (TDMA_PIPE_SLOTS - 1U)];
+		__atomic_store_n(&q->tail, tail + 1U, __ATOMIC_RELEASE);
+	}
+
+	return frame;
+}
+
+static protdspSpiFrame_t *tdma_spsc_wait(tdma_pipe_t *pipe, tdma_spsc_t *q)
+{
+	while ((0 != sem_wait(&q->items)) && (EINTR == errno))
+	{
+	}
+
+	return (0U != __atomic_load_n(&pipe->running, __ATOMIC_ACQUIRE)) ? tdma_spsc_pop(q) : NULL;
+}
+
+static protdspSpiFrame_t *tdma_spsc_try(tdma_spsc_t *q)
+{
+	return (0 == sem_trywait(&q->items)) ? tdma_spsc_pop(q) : NULL;
+}
+
+static void *tdma_pipe_producer(void *p_data)
+{
+	tdma_pipe_t *pipe = (tdma_pipe_t *)p_data;
+	protdspSpiFrame_t *frame;
+
+	while (NULL != (frame = tdma_spsc_wait(pipe, &pipe->free_tx)))
+	{
+		pipe->build(frame);
+		tdma_spsc_push(&pipe->ready_tx, frame);
+	}
+
+	return NULL;
+}
+
+static void *tdma_pipe_consumer(void *p_data)
+{
+	tdma_pipe_t *pipe = (tdma_pipe_t *)p_data;
+	protdspSpiFrame_t *frame;
+
+	while (NULL != (frame = tdma_spsc_wait(pipe, &pipe->full_rx)))
+	{
+		pipe->parse(frame);
+		tdma_spsc_push(&pipe->free_rx, frame);
+	}
+
+	return NULL;
+}
+
+static void tdma_pipe_destroy(tdma_pipe_t *pipe)
+{
+	sem_destroy(&pipe->free_tx.items);
+	sem_destroy(&pipe->ready_tx.items);
+	sem_destroy(&pipe->free_rx.items);
+	sem_destroy(&pipe->full_rx.items);
+}
+
+//==============================================================================
+//! \brief Allocate the buffer pairs and start the helper threads
+//!
+//! \param  pipe: pipeline
+//! \param  depth: buffer pairs, 2 to TDMA_PIPE_SLOTS
+//! \param  build: fills a TX frame, producer thread
+//! \param  parse: checks a RX frame, consumer thread
+//! \return 0 in case of success, or negative errno error code
+//==============================================================================
+int tdma_pipe_start(tdma_pipe_t *pipe, uint32_t depth, tdma_pipe_fn_t build, tdma_pipe_fn_t parse)
+{
+	int ret = EXIT_SUCCESS;
+
+	memset(pipe, 0, sizeof(*pipe));
+
+	if ((2U > depth) || (TDMA_PIPE_SLOTS < depth) || (NULL == build) || (NULL == parse))
+	{
+		ret = -EINVAL;
+	}
+
+	/* + 1 scratch RX, zeroed and locked: the spidev copies from/to them on the RT thread */
+	if (EXIT_SUCCESS == ret)
+	{
+		pipe->frames = spi_buf_alloc((2U * depth + 1U) * sizeof(protdspSpiFrame_t));
+		ret = (NULL != pipe->frames) ? EXIT_SUCCESS : -ENOMEM;
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		pipe->depth = depth;
+		pipe->build = build;
+		pipe->parse = parse;
+		pipe->scratch_rx = &pipe->frames[2U * depth];
+		pipe->running = 1U;
+
+		tdma_spsc_init(&pipe->free_tx);
+		tdma_spsc_init(&pipe->ready_tx);
+		tdma_spsc_init(&pipe->free_rx);
+		tdma_spsc_init(&pipe->full_rx);
+
+		for (uint32_t i = 0U; i < depth; i++)
+		{
+			tdma_spsc_push(&pipe->free_tx, &pipe->frames[i]);
+			tdma_spsc_push(&pipe->free_rx, &pipe->frames[depth + i]);
+		}
+
+		ret = -pthread_create(&pipe->producer, NULL, tdma_pipe_producer, pipe);
+	}
+
+	if (EXIT_SUCCESS == ret)
+	{
+		ret = -pthread_create(&pipe->consumer, NULL, tdma_pipe_consumer, pipe);
+		if (EXIT_SUCCESS != ret)
+		{
+			__atomic_store_n(&pipe->running, 0U, __ATOMIC_RELEASE);
+			sem_post(&pipe->free_tx.items);
+			pthread_join(pipe->producer, NULL);
+		}
+	}
+
+	/* the first edge must find a frame */
+	if (EXIT_SUCCESS == ret)
+	{
+		pipe->cur_tx = tdma_spsc_wait(pipe, &pipe->ready_tx);
+	}
+
+	if (EXIT_SUCCESS != ret)
+	{
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_ERROR, DLT_STRING("tdma pipe start failed (depth/err)"), DLT_UINT32(depth), DLT_INT32(ret));
+
+		/* the semaphores are set up with the rings, once the frames are there */
+		if (0U != pipe->depth)
+		{
+			tdma_pipe_destroy(pipe);
+		}
+		spi_buf_free(pipe->frames, (2U * depth + 1U) * sizeof(protdspSpiFrame_t));
+		pipe->frames = NULL;
+	}
+
+	return ret;
+}
+
+/* the frame to send on this edge */
+protdspSpiFrame_t *tdma_pipe_tx(tdma_pipe_t *pipe)
+{
+	protdspSpiFrame_t *next = tdma_spsc_try(&pipe->ready_tx);
+
+	if (NULL != next)
+	{
+		tdma_spsc_push(&pipe->free_tx, pipe->cur_tx);
+		pipe->cur_tx = next;
+	}
+	else
+	{
+		pipe->tx_underruns++;
+	}
+
+	return pipe->cur_tx;
+}
+
+/* the buffer to receive into on this edge */
+protdspSpiFrame_t *tdma_pipe_rx(tdma_pipe_t *pipe)
+{
+	protdspSpiFrame_t *rx = pipe->spare_rx;
+
+	if (NULL != rx)
+	{
+		pipe->spare_rx = NULL;
+		return rx;
+	}
+
+	rx = tdma_spsc_try(&pipe->free_rx);
+
+	if (NULL == rx)
+	{
+		pipe->rx_overruns++;
+		rx = pipe->scratch_rx;
+	}
+
+	return rx;
+}
+
+/* after the transfer: a received frame goes to the consumer, a failed one is kept for the next edge,
+ * the scratch one is dropped. free_rx has a single producer, the consumer thread.
+ */
+void tdma_pipe_done(tdma_pipe_t *pipe, protdspSpiFrame_t *rx, int received)
+{
+	if (rx != pipe->scratch_rx)
+	{
+		if (0 != received)
+		{
+			tdma_spsc_push(&pipe->full_rx, rx);
+		}
+		else
+		{
+			pipe->spare_rx = rx;
+		}
+	}
+}
+
+void tdma_pipe_stop(tdma_pipe_t *pipe)
+{
+	if (NULL != pipe->frames)
+	{
+		__atomic_store_n(&pipe->running, 0U, __ATOMIC_RELEASE);
+		sem_post(&pipe->free_tx.items);
+		sem_post(&pipe->full_rx.items);
+		pthread_join(pipe->producer, NULL);
+		pthread_join(pipe->consumer, NULL);
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING("tdma pipe (depth/tx underruns/rx overruns)"),
+				DLT_UINT32(pipe->depth), DLT_UINT64(pipe->tx_underruns), DLT_UINT64(pipe->rx_overruns));
+
+		tdma_pipe_destroy(pipe);
+
+		spi_buf_free(pipe->frames, (2U * pipe->depth + 1U) * sizeof(protdspSpiFrame_t));
+		pipe->frames = NULL;
+	}
+}
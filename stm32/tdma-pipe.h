@@ -0,0 +1,56 @@
+/*
+ ============================================================================
+ Name        : tdma-pipe.h
+ Version     :
+ Copyright   : Closed
+ Description : SPI frame pipeline: TX frames built and RX frames parsed by two
+               helper threads while the RT thread is in the transfer
+ ============================================================================
+ */
+#ifndef TDMA_PIPE
+#define TDMA_PIPE
+#pragma once
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+
+#include "tdma-codec.h"
+
+/* ring capacity, a power of 2, also the max number of buffer pairs */
+#define TDMA_PIPE_SLOTS 8U
+
+typedef void (*tdma_pipe_fn_t)(protdspSpiFrame_t *frame);
+
+/* single producer single consumer ring of frames, sem counts the queued ones */
+typedef struct
+{
+	protdspSpiFrame_t *slots[TDMA_PIPE_SLOTS];
+	uint32_t head;						/* written by the producer only */
+	uint32_t tail;						/* written by the consumer only */
+	sem_t items;
+} tdma_spsc_t;
+
+typedef struct
+{
+	uint32_t depth;
+	uint8_t running;
+	protdspSpiFrame_t *frames;			/* depth TX then depth RX */
+	protdspSpiFrame_t *cur_tx;			/* owned by the RT thread */
+	protdspSpiFrame_t *scratch_rx;		/* received into when the consumer lags */
+	protdspSpiFrame_t *spare_rx;		/* RX buffer of a failed transfer, reused on the next edge */
+	tdma_spsc_t free_tx, ready_tx;		/* RT -> producer -> RT */
+	tdma_spsc_t free_rx, full_rx;		/* consumer -> RT -> consumer */
+	tdma_pipe_fn_t build, parse;
+	pthread_t producer, consumer;
+	uint64_t tx_underruns;				/* no new TX frame at the edge, the last one is sent again */
+	uint64_t rx_overruns;				/* no free RX buffer at the edge, the frame is dropped */
+} tdma_pipe_t;
+
+int tdma_pipe_start(tdma_pipe_t *pipe, uint32_t depth, tdma_pipe_fn_t build, tdma_pipe_fn_t parse);
+protdspSpiFrame_t *tdma_pipe_tx(tdma_pipe_t *pipe);
+protdspSpiFrame_t *tdma_pipe_rx(tdma_pipe_t *pipe);
+void tdma_pipe_done(tdma_pipe_t *pipe, protdspSpiFrame_t *rx, int received);
+void tdma_pipe_stop(tdma_pipe_t *pipe);
+
+#endif // TDMA_PIPE
@@ -0,0 +1,110 @@
+/*
+ ============================================================================
+ Name        : tdma-sched.c
+ Version     :
+ Copyright   : Closed
+ Description : cycle scheduler on absolute CLOCK_MONOTONIC deadlines, for the
+               runners paced without the slave-ready GPIO
+
+ clock_nanosleep(TIMER_ABSTIME) on a fixed grid: a late wake up or a long
+ cycle does not shift the following releases, as a relative sleep would.
+ ============================================================================
+ */
+#include <errno.h>
+#include <time.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-sched.h"
+#include "wi_time.h"
+
+static uint64_t sched_epoch_ns = 0U;
+
+void tdma_sched_init(tdma_sched_t *sched, uint64_t period_ns, uint64_t offset_ns)
+{
+	uint64_t epoch = 0U;
+	uint64_t now = time_getClock_ns();
+
+	/* the first runner sets the grid, the others join it */
+	(void)__atomic_compare_exchange_n(&sched_epoch_ns, &epoch, now, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+	epoch = __atomic_load_n(&sched_epoch_ns, __ATOMIC_ACQUIRE);
+
+	sched->period_ns = (0U < period_ns) ? period_ns : 1U;
+	sched->offset_ns = offset_ns % sched->period_ns;
+	sched->deadline_ns = epoch + sched->offset_ns;
+
+	/* first release still ahead */
+	if (sched->deadline_ns <= now)
+	{
+		sched->deadline_ns += ((now - sched->deadline_ns) / sched->period_ns + 1U) * sched->period_ns;
+	}
+
+	sched->wake_ns = 0U;
+	sched->cycles = 0U;
+	sched->overruns = 0U;
+	sched->skipped = 0U;
+	esg_hist_reset(&sched->release_us);
+	esg_hist_reset(&sched->exec_us);
+}
+
+//==============================================================================
+//! \brief Sleep until the release of the next cycle
+//!
+//! \return 0 at the release, or negative errno error code
+//==============================================================================
+int tdma_sched_wait(tdma_sched_t *sched)
+{
+	struct timespec ts = {.tv_sec = (time_t)(sched->deadline_ns / 1000000000ULL), .tv_nsec = (long)(sched->deadline_ns % 1000000000ULL)};
+	int ret;
+
+	do
+	{
+		ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+	} while (EINTR == ret);
+
+	if (0 == ret)
+	{
+		sched->wake_ns = time_getClock_ns();
+		sched->cycles++;
+		esg_hist_add(&sched->release_us, (int64_t)(sched->wake_ns - sched->deadline_ns) / 1000);
+	}
+
+	return -ret;
+}
+
+/* end of the cycle work: the next release stays on the grid, the ones already gone are skipped */
+void tdma_sched_done(tdma_sched_t *sched)
+{
+	uint64_t now = time_getClock_ns();
+
+	esg_hist_add(&sched->exec_us, (int64_t)(now - sched->wake_ns) / 1000);
+
+	sched->deadline_ns += sched->period_ns;
+
+	if (sched->deadline_ns <= now)
+	{
+		uint64_t missed = (now - sched->deadline_ns) / sched->period_ns + 1U;
+
+		sched->overruns++;
+		sched->skipped += missed;
+		sched->deadline_ns += missed * sched->period_ns;
+	}
+}
+
+void tdma_sched_report(const char *name, const tdma_sched_t *sched)
+{
+	char label[64];
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("cycles (period us/offset us/count/overruns/skipped)"),
+			DLT_UINT64(sched->period_ns / 1000U), DLT_UINT64(sched->offset_ns / 1000U),
+			DLT_UINT64(sched->cycles), DLT_UINT64(sched->overruns), DLT_UINT64(sched->skipped));
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("release jitter us (min/avg/max)"),
+			DLT_INT64(sched->release_us.stats.min), DLT_INT64(esg_stats_avg(&sched->release_us.stats)), DLT_INT64(sched->release_us.stats.max),
+			DLT_STRING("execution us (min/avg/max)"),
+			DLT_INT64(sched->exec_us.stats.min), DLT_INT64(esg_stats_avg(&sched->exec_us.stats)), DLT_INT64(sched->exec_us.stats.max));
+
+	snprintf(label, sizeof(label), "%s release jitter us", name);
+	esg_hist_report(&dlt_ctxt_btst, label, &sched->release_us);
+	snprintf(label, sizeof(label), "%s execution us", name);
+	esg_hist_report(&dlt_ctxt_btst, label, &sched->exec_us);
+}
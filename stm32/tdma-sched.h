@@ -0,0 +1,39 @@
+/*
+ ============================================================================
+ Name        : tdma-sched.h
+ Version     :
+ Copyright   : Closed
+ Description : cycle scheduler on absolute CLOCK_MONOTONIC deadlines, for the
+               runners paced without the slave-ready GPIO
+ ============================================================================
+ */
+#ifndef TDMA_SCHED
+#define TDMA_SCHED
+#pragma once
+
+#include <stdint.h>
+
+#include "esg-stats.h"
+
+/* all the schedulers release on one grid, anchored at the first tdma_sched_init():
+ * a runner releases at epoch + offset + k.period, so that the phase between runners is set
+ */
+typedef struct
+{
+	uint64_t period_ns;
+	uint64_t offset_ns;
+	uint64_t deadline_ns;		/* release of the current cycle, end of the previous one */
+	uint64_t wake_ns;			/* actual wake up */
+	uint64_t cycles;
+	uint64_t overruns;			/* cycles that ended after the next release */
+	uint64_t skipped;			/* releases missed because of them */
+	esg_hist_t release_us;		/* wake up - release */
+	esg_hist_t exec_us;			/* wake up - tdma_sched_done() */
+} tdma_sched_t;
+
+void tdma_sched_init(tdma_sched_t *sched, uint64_t period_ns, uint64_t offset_ns);
+int tdma_sched_wait(tdma_sched_t *sched);
+void tdma_sched_done(tdma_sched_t *sched);
+void tdma_sched_report(const char *name, const tdma_sched_t *sched);
+
+#endif // TDMA_SCHED
@@ -0,0 +1,145 @@
+/*
+ ============================================================================
+ Name        : tdma-seq.c
+ Version     :
+ Copyright   : Closed
+ Description : RX frame sequence from header.index
+
+ The STM32 stamps each frame with its 8 bit SPI counter. Between two decoded
+ frames, the indexes skipped are lost frames: those matching the exchanges
+ this side could not decode were corrupted on the way (crc, malformed, empty),
+ the others never had an exchange here (the STM32 counted a frame the SoC did
+ not clock, e.g. a missed slave-ready edge).
+ ============================================================================
+ */
+#include <string.h>
+
+#include "esg-bsp-test.h"
+#include "tdma-seq.h"
+
+static const char *const seq_event_names[TDMA_SEQ_EVENT_TYPES] = {"gap", "duplicate", "late"};
+
+/* tdma_seq_t.charge */
+#define TDMA_SEQ_CHARGE_NONE 0U
+#define TDMA_SEQ_CHARGE_CORRUPTED 1U
+#define TDMA_SEQ_CHARGE_NOT_EXCHANGED 2U
+
+void tdma_seq_init(tdma_seq_t *seq)
+{
+	memset(seq, 0, sizeof(*seq));
+	esg_hist_reset(&seq->burst);
+}
+
+static void tdma_seq_event(tdma_seq_t *seq, tdma_seq_event_type_t type, uint8_t index, uint64_t t_ns, uint32_t missing, uint32_t unreadable)
+{
+	tdma_seq_event_t *ev = &seq->event[seq->events++ & (TDMA_SEQ_EVENTS - 1U)];
+
+	ev->t_ns = t_ns;
+	ev->type = (uint8_t)type;
+	ev->index = index;
+	ev->missing = (uint16_t)missing;
+	ev->unreadable = (uint16_t)((UINT16_MAX < unreadable) ? UINT16_MAX : unreadable);
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_DEBUG, DLT_STRING("tdma seq"), DLT_STRING(seq_event_names[type]),
+			DLT_STRING("(index/missing/unreadable)"), DLT_UINT8(index), DLT_UINT32(missing), DLT_UINT32(unreadable));
+}
+
+//==============================================================================
+//! \brief Account a decoded RX frame
+//!
+//! \param  index: its header.index
+//! \param  t_ns: CLOCK_MONOTONIC, for the events
+//==============================================================================
+void tdma_seq_rx(tdma_seq_t *seq, uint8_t index, uint64_t t_ns)
+{
+	uint8_t delta = (uint8_t)(index - seq->last);
+
+	seq->frames++;
+
+	if (0U == seq->started)
+	{
+		seq->started = 1U;
+	}
+	else if (0U == delta)
+	{
+		seq->duplicates++;
+		tdma_seq_event(seq, TDMA_SEQ_DUPLICATE, index, t_ns, 0U, 0U);
+		return;
+	}
+	else if ((256U - TDMA_SEQ_LATE_WINDOW) <= delta)
+	{
+		/* behind the last one: taken back from what it was counted as in the gap before it */
+		seq->late++;
+		if (TDMA_SEQ_CHARGE_CORRUPTED == seq->charge[index])
+		{
+			seq->corrupted--;
+			seq->lost--;
+		}
+		else if (TDMA_SEQ_CHARGE_NOT_EXCHANGED == seq->charge[index])
+		{
+			seq->not_exchanged--;
+			seq->lost--;
+		}
+		seq->charge[index] = TDMA_SEQ_CHARGE_NONE;
+		tdma_seq_event(seq, TDMA_SEQ_LATE, index, t_ns, 0U, 0U);
+		return;
+	}
+	else if (1U == delta)
+	{
+		seq->in_order++;
+	}
+	else
+	{
+		uint32_t missing = delta - 1U;
+		uint32_t corrupted = (seq->unreadable < missing) ? seq->unreadable : missing;
+
+		/* which indexes the undecodable exchanges were is unknown: the first ones of the gap */
+		for (uint32_t i = 0U; i < missing; i++)
+		{
+			seq->charge[(uint8_t)(seq->last + 1U + i)] = (i < corrupted) ? TDMA_SEQ_CHARGE_CORRUPTED : TDMA_SEQ_CHARGE_NOT_EXCHANGED;
+		}
+
+		seq->lost += missing;
+		seq->corrupted += corrupted;
+		seq->not_exchanged += missing - corrupted;
+		seq->longest = (missing > seq->longest) ? missing : seq->longest;
+		esg_hist_add(&seq->burst, (int64_t)missing);
+		tdma_seq_event(seq, TDMA_SEQ_GAP, index, t_ns, missing, seq->unreadable);
+	}
+
+	seq->wraps += (index < seq->last) ? 1U : 0U;
+	seq->charge[index] = TDMA_SEQ_CHARGE_NONE;
+	seq->last = index;
+	seq->unreadable = 0U;
+}
+
+/* an exchange without a decodable frame, its index (if any) can't be trusted */
+void tdma_seq_unreadable(tdma_seq_t *seq)
+{
+	seq->unreadable++;
+}
+
+void tdma_seq_report(const char *name, const tdma_seq_t *seq)
+{
+	uint64_t first = (TDMA_SEQ_EVENTS < seq->events) ? (seq->events - TDMA_SEQ_EVENTS) : 0U;
+	char label[64];
+
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("index seq (frames/in order/lost/duplicates/late/wraps)"),
+			DLT_UINT64(seq->frames), DLT_UINT64(seq->in_order), DLT_UINT64(seq->lost), DLT_UINT64(seq->duplicates),
+			DLT_UINT64(seq->late), DLT_UINT64(seq->wraps));
+	DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("index seq lost (corrupted/not exchanged/longest burst)"),
+			DLT_UINT64(seq->corrupted), DLT_UINT64(seq->not_exchanged), DLT_UINT32(seq->longest));
+
+	snprintf(label, sizeof(label), "%s loss burst", name);
+	esg_hist_report(&dlt_ctxt_btst, label, &seq->burst);
+
+	/* the last events, to line up with the DLT timestamps of the other runners */
+	for (uint64_t n = first; n < seq->events; n++)
+	{
+		const tdma_seq_event_t *ev = &seq->event[n & (TDMA_SEQ_EVENTS - 1U)];
+
+		DLT_LOG(dlt_ctxt_btst, DLT_LOG_WARN, DLT_STRING(name), DLT_STRING("index seq event (#/monotonic us/type/index/missing/unreadable)"),
+				DLT_UINT64(n), DLT_UINT64(ev->t_ns / 1000U), DLT_STRING(seq_event_names[ev->type]), DLT_UINT8(ev->index),
+				DLT_UINT16(ev->missing), DLT_UINT16(ev->unreadable));
+	}
+}
@@ -0,0 +1,67 @@
+/*
+ ============================================================================
+ Name        : tdma-seq.h
+ Version     :
+ Copyright   : Closed
+ Description : RX frame sequence from header.index (the STM32 SPI counter):
+               gaps, duplicates, late frames and wrap-arounds, with a loss
+               burst histogram and timestamped events
+ ============================================================================
+ */
+#ifndef TDMA_SEQ
+#define TDMA_SEQ
+#pragma once
+
+#include <stdint.h>
+
+#include "esg-stats.h"
+
+/* a frame up to this many indexes behind the last one came late, further it is a gap */
+#define TDMA_SEQ_LATE_WINDOW 16U
+/* last events kept for the report, a power of 2 */
+#define TDMA_SEQ_EVENTS 64U
+
+typedef enum
+{
+	TDMA_SEQ_GAP = 0,
+	TDMA_SEQ_DUPLICATE = 1,
+	TDMA_SEQ_LATE = 2,
+	//
+	TDMA_SEQ_EVENT_TYPES = 3
+} tdma_seq_event_type_t;
+
+typedef struct
+{
+	uint64_t t_ns;					/* CLOCK_MONOTONIC, as the DLT timestamps of the other runners */
+	uint8_t type;					/* tdma_seq_event_type_t */
+	uint8_t index;					/* of the frame that showed it */
+	uint16_t missing;				/* gap: indexes skipped */
+	uint16_t unreadable;			/* gap: exchanges in between that could not be decoded */
+} tdma_seq_event_t;
+
+typedef struct
+{
+	uint8_t started;
+	uint8_t last;
+	uint32_t unreadable;			/* exchanges since the last decoded frame */
+	uint64_t frames;				/* decoded, with an index */
+	uint64_t in_order;
+	uint64_t lost;					/* indexes never decoded, less those that came late */
+	uint64_t corrupted;				/* of them, exchanged but not decodable (crc, malformed, empty) */
+	uint64_t not_exchanged;			/* of them, with no SPI exchange for them on this side */
+	uint64_t duplicates;
+	uint64_t late;
+	uint64_t wraps;
+	uint32_t longest;
+	uint8_t charge[256];			/* per index lost in the last lap: 0 none, else the counter it went to */
+	esg_hist_t burst;				/* indexes per gap */
+	uint64_t events;
+	tdma_seq_event_t event[TDMA_SEQ_EVENTS];
+} tdma_seq_t;
+
+void tdma_seq_init(tdma_seq_t *seq);
+void tdma_seq_rx(tdma_seq_t *seq, uint8_t index, uint64_t t_ns);
+void tdma_seq_unreadable(tdma_seq_t *seq);
+void tdma_seq_report(const char *name, const tdma_seq_t *seq);
+
+#endif // TDMA_SEQ